@@ -38,6 +38,9 @@
 
 #include <stddef.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/uio.h>
 
 #include "uthash.h"
 
@@ -50,6 +53,23 @@
 #define PV_IP_ADDR_MAX 128
 #define MAX_EVENT_DESC_SIZE 256
 #define MAX_EVENT_ID_SIZE 8
+#define PV_CACHE_LINE_SIZE 64
+#define PV_FLOW_TEXT_MAX 128
+#define PV_FLOW_EMPTY 0xffffffff
+#define PV_FLOW_IPV4 4
+#define PV_FLOW_IPV6 6
+
+#define PV_FLOW_IN_USE 0x01
+#define PV_FLOW_CLOSING 0x02   /* TCP FIN or RST seen */
+#define PV_FLOW_TIMER 0x04     /* linked into a timer wheel slot */
+#define PV_FLOW_DIRTY 0x08     /* counts changed since the last statistics export */
+#define PV_FLOW_ANOMALY 0x10   /* payload anomaly alert raised */
+#define PV_FLOW_TLS_INSPECTED 0x20  /* first payload packet checked for a TLS ClientHello */
+#define PV_FLOW_TLS 0x40       /* ClientHello seen, see pvtls.c */
+#define PV_FLOW_REASM 0x80     /* TCP stream reassembly started, see pvreasm.c */
+#define PV_FLOW_REASM_DONE 0x100  /* stream ended, at the depth, closed or truncated */
+#define PV_FLOW_IOC 0x200      /* IOC matcher state set up, see pvioc.c */
+#define PV_FLOW_CLIENT 0x400   /* first packet a TCP SYN, the flow runs client to server */
 
 #define PV_FILE_OUT       0x01
 #define PV_SERVER_OUT     0x02
@@ -57,6 +77,14 @@
 #define PV_CAPTURE_INPUT  0x08
 #define PV_UNIFIED2_INPUT 0x10
 #define PV_GUI_OUT        0x20
+#define PV_RING_CAPTURE   0x40
+#define PV_REPLAY_INPUT   0x80
+#define PV_QUIET_OUT      0x100 /* do not print packet events on the console */
+#define PV_HEAVY_ONLY     0x200 /* heavy hitters instead of the exact per flow map */
+
+#define PV_PACKET_RECORD 1  /* Fineline event record types, see create_record() */
+#define PV_FLOW_RECORD   2
+#define PV_ALERT_RECORD  3
 
 #define PV_FILE_ACCESS_TIME   0x01
 #define PV_FILE_CREATION_TIME 0x02
@@ -109,17 +137,6 @@ struct pv_project_header
 
 typedef struct pv_project_header pv_project_header_t;
 
-struct pv_url_record
-{
-   char url_record_string[PV_MAX_INPUT_STR];
-   double url_time;
-   long access_count;
-   char url_time_string[32];
-   UT_hash_handle hh;
-};
-
-typedef struct pv_url_record pv_url_record_t;
-
 struct pv_ip_record
 {
    char key_value[512];
@@ -130,6 +147,64 @@ struct pv_ip_record
 
 typedef struct pv_ip_record pv_ip_record_t;
 
+/* Packed binary flow key, ports and addresses are in network byte order. */
+struct pv_flow_key
+{
+   uint8_t  family;             /* PV_FLOW_IPV4 or PV_FLOW_IPV6 */
+   uint8_t  protocol;
+   uint16_t src_port;
+   uint16_t dst_port;
+   uint16_t reserved;           /* must be zero */
+   uint8_t  src_addr[16];       /* IPv4 addresses use the first 4 bytes */
+   uint8_t  dst_addr[16];
+};
+
+typedef struct pv_flow_key pv_flow_key_t;
+
+struct pv_flow_record
+{
+   pv_flow_key_t key;
+   uint32_t hash;
+   uint32_t flags;
+   uint64_t packet_count;
+   uint64_t data_size;
+   /* Second cache line, only touched by flow timeouts and export. */
+   uint64_t first_ts;           /* first and last packet times in microseconds */
+   uint64_t last_ts;
+   uint32_t timer_next;         /* timer wheel slot list, record indexes */
+   uint32_t timer_prev;
+   uint32_t timer_expire;       /* timer expiry time in seconds */
+   uint16_t timer_slot;         /* wheel level * slots per level + slot */
+   uint8_t  tcp_flags;          /* TCP flags seen in the flow */
+   uint64_t exported_packets;   /* counts at the last statistics export */
+   uint64_t exported_bytes;
+   uint32_t payload_bytes;      /* payload bytes kept by payload sampling */
+} __attribute__ ((aligned (PV_CACHE_LINE_SIZE)));
+
+typedef struct pv_flow_record pv_flow_record_t;
+
+struct pv_flow_slot
+{
+   uint32_t hash;
+   uint32_t index;              /* record pool index or PV_FLOW_EMPTY */
+};
+
+typedef struct pv_flow_slot pv_flow_slot_t;
+
+struct pv_flow_table
+{
+   pv_flow_slot_t *slots;       /* open addressing index, linear probing */
+   uint32_t slot_mask;
+   pv_flow_record_t *records;   /* preallocated record pool */
+   uint32_t *free_list;
+   uint32_t free_count;
+   uint32_t capacity;
+   uint32_t count;
+   unsigned long insert_failures;
+};
+
+typedef struct pv_flow_table pv_flow_table_t;
+
 struct pv_sensor_connection
 {
    int sockfd;
@@ -148,10 +223,12 @@ int fatal(char *str);
 void *xcalloc (size_t size);
 void *xmalloc (size_t size);
 void *xrealloc (void *ptr, size_t size);
+void *xmemalign (size_t alignment, size_t size);
 int xfree(char *buf, int len);
 int print_help();
 char* xitoa(int value, char* result, int len, int base);
 int get_time_string(char *tstr, int slen);
+uint64_t get_time_ns();
 int get_ip_address(char *interface, char *ip_addr);
 int validate_ipv4_address(char *ipv4_addr);
 int validate_ipv6_address(char *ipv6_addr);
@@ -164,8 +241,10 @@ char *trim(char *s);
 int init_client_socket(char *server_ip_address);
 int init_server_socket(int port_number, void *(* connector)(void *));
 int send_event(int sockfd, char *event_string);
+int send_iovec(int sockfd, struct iovec *iov, int count, size_t *sent);
 char *get_response(int sockfd, char *in_buffer);
 int close_socket(int sockfd);
+int shutdown_socket(int sockfd, int timeout);
 void *connection_handler(void *socket_desc);
 
 /* pvlog.c */
@@ -180,11 +259,13 @@ int close_log_file();
 
 FILE *open_fineline_event_file(char *evt_file_name);
 int write_fineline_event_record(char *estr);
+int format_event_time(char *time_string, int len, time_t seconds, long usecs);
 int write_fineline_project_header(char *pstr);
 int close_fineline_event_file();
 int dump_statistics();
 int write_event_record(char *event_string);
-int create_event_record(char *event_string, char *data_string);
+int write_event_buffer(char *buffer, size_t length);
+int create_record(char *event_string, int type, char *summary, char *data_string, time_t seconds, long usecs);
 
 /* pveventlog.c */
 
@@ -195,23 +276,29 @@ int close_sensor_log_file(FILE* evt_file);
 
 /* pvipmap.c */
 
-void add_ip(pv_ip_record_t *flip);
-pv_ip_record_t *find_ip(char *lookup_string);
+int init_flow_table(pv_flow_table_t *table, uint32_t capacity);
+void free_flow_table(pv_flow_table_t *table);
+uint32_t hash_flow_key(pv_flow_key_t *key);
+pv_flow_record_t *find_flow(pv_flow_table_t *table, pv_flow_key_t *key, uint32_t hash);
+pv_flow_record_t *find_or_add_flow(pv_flow_table_t *table, pv_flow_key_t *key, uint32_t hash);
+void delete_flow(pv_flow_table_t *table, pv_flow_record_t *record);
+pv_flow_record_t *get_next_flow(pv_flow_table_t *table, pv_flow_record_t *record);
+const char *get_protocol_name(uint8_t protocol);
+int format_flow_key(pv_flow_key_t *key, char *out, int len);
+void init_ip_map(uint32_t capacity);
+void merge_ip_map(pv_flow_table_t *shard);
 void write_ip_map(FILE *outfile);
-void send_ip_map(int sock_desc);
 void print_ip_map();
-void delete_ip(pv_ip_record_t *ip_record);
 void delete_all_ips();
-pv_ip_record_t *get_first_ip_record();
-pv_ip_record_t *get_last_ip_record();
 
 /* pvconnectionmap.c */
 
-void add_connection_ip(pv_ip_record_t *ip_map, pv_ip_record_t *flip);
+void add_connection_ip(pv_ip_record_t **ip_map, pv_ip_record_t *flip);
 pv_ip_record_t *find_connection_ip(pv_ip_record_t *ip_map, char *lookup_string);
+void update_connection_ip(pv_ip_record_t **ip_map, char *key_value, long packets, long data_size);
 pv_ip_record_t *get_last_connection_record(pv_ip_record_t *ip_map);
-void delete_connection(pv_ip_record_t *ip_map, pv_ip_record_t *ip_record);
-void delete_all_connections(pv_ip_record_t *ip_map);
+void delete_connection(pv_ip_record_t **ip_map, pv_ip_record_t *ip_record);
+void delete_all_connections(pv_ip_record_t **ip_map);
 void write_connection_map(pv_ip_record_t *ip_map, FILE *outfile);
 void send_connection_map(pv_ip_record_t *ip_map, int sock_desc);
 void print_connnection_map(pv_ip_record_t *ip_map);
@@ -34,14 +34,14 @@
 #include "pvcommon.h"
 
 
-void add_connection_ip(pv_ip_record_t *ip_map, pv_ip_record_t *flip)
+void add_connection_ip(pv_ip_record_t **ip_map, pv_ip_record_t *flip)
 {
     pv_ip_record_t *s;
 
-    HASH_FIND_STR(ip_map, flip->key_value , s);  /* id already in the hash? */
+    HASH_FIND_STR(*ip_map, flip->key_value , s);  /* id already in the hash? */
     if (s == NULL)
     {
-      HASH_ADD_STR(ip_map, key_value, flip);  /* id: name of key field */
+      HASH_ADD_STR(*ip_map, key_value, flip);  /* id: name of key field */
     }
 
 }
@@ -54,6 +54,29 @@ pv_ip_record_t *find_connection_ip(pv_ip_record_t *ip_map, char *lookup_string)
     return s;
 }
 
+/*
+   Function: update_connection_ip
+   Purpose : Adds packet and data size counts to the record for the key,
+             the record is created if the key is not in the map.
+   Input   : Map head, key string, packet count and data size to add.
+*/
+void update_connection_ip(pv_ip_record_t **ip_map, char *key_value, long packets, long data_size)
+{
+   pv_ip_record_t *s;
+
+   HASH_FIND_STR(*ip_map, key_value, s);
+   if (s == NULL)
+   {
+      s = xcalloc(sizeof(pv_ip_record_t));
+      strncpy(s->key_value, key_value, sizeof(s->key_value) - 1);
+      HASH_ADD_STR(*ip_map, key_value, s);
+   }
+   s->packet_count += packets;
+   s->data_size += data_size;
+
+   return;
+}
+
 pv_ip_record_t *get_first_connection_record(pv_ip_record_t *ip_map)
 {
    return(ip_map);
@@ -68,19 +91,19 @@ pv_ip_record_t *get_last_connection_record(pv_ip_record_t *ip_map)
    return(NULL);
 }
 
-void delete_connection(pv_ip_record_t *ip_map, pv_ip_record_t *ip_record)
+void delete_connection(pv_ip_record_t **ip_map, pv_ip_record_t *ip_record)
 {
-   HASH_DEL(ip_map, ip_record);  /* event: pointer to deletee */
+   HASH_DEL(*ip_map, ip_record);  /* event: pointer to deletee */
    free(ip_record);
 }
 
-void delete_all_connections(pv_ip_record_t *ip_map)
+void delete_all_connections(pv_ip_record_t **ip_map)
 {
    pv_ip_record_t *current_ip, *tmp;
 
-   HASH_ITER(hh, ip_map, current_ip, tmp)
+   HASH_ITER(hh, *ip_map, current_ip, tmp)
    {
-      HASH_DEL(ip_map,current_ip);  /* delete it (ip_map advances to next) */
+      HASH_DEL(*ip_map,current_ip);  /* delete it (ip_map advances to next) */
       free(current_ip);              /* free it */
    }
 }
@@ -35,6 +35,7 @@
 #include <errno.h>
 #include <string.h>
 #include <time.h>
+#include <sys/time.h>
 
 #include "pvcommon.h"
 
@@ -71,30 +72,47 @@ FILE *open_fineline_event_file(char *evt_file_name)
 */
 int write_fineline_event_record(char *estr)
 {
-   time_t curtime;
-   struct tm *loctime;
+   struct timeval curtime;
    char event_string[PV_MAX_INPUT_STR];
-   char *time_str;
 
    /* Get the current time. */
-   curtime = time (NULL);
-   loctime = localtime (&curtime);
-
-   time_str = asctime(loctime);
-   rtrim(time_str);
-
-   /* TODO: add the actual sensor ID number in the id field. */
-   strcpy(event_string, "<event><id>SENSOR0000</id><evidencenumber>NONE</evidencenumber><time>");
-   strcat(event_string, time_str);
-   strcat(event_string, "</time><type>1</type><summary>Pivot Sensor Packet Event</summary><data>");
-   strncat(event_string, estr, strlen(estr));
-   strcat(event_string, "</data><hiddenevent>0</hiddenevent><hiddentext>0</hiddentext><marked>0</marked><pinned>0</pinned><ypos>0</ypos></event>\n");
+   gettimeofday(&curtime, NULL);
 
+   create_record(event_string, PV_PACKET_RECORD, "Pivot Sensor Packet Event", estr, curtime.tv_sec, curtime.tv_usec);
    fputs (event_string, evt_file);
 
    return(0);
 }
 
+/*
+   Function: format_event_time()
+
+   Purpose : Formats an event time in asctime() layout with microseconds,
+           : for example "Sat Oct 17 12:21:30.123456 2026". The date and
+           : time of day are cached per thread and only rebuilt when the
+           : second changes, so each event only formats the microseconds.
+           : Uses localtime_r() so it is safe in the capture worker threads.
+   Input   : Output string and length, time in seconds and microseconds.
+   Output  : Returns the time string length.
+*/
+int format_event_time(char *time_string, int len, time_t seconds, long usecs)
+{
+   static __thread time_t cached_second = -1;
+   static __thread char cached_time[32];  /* "Sat Oct 17 12:21:30" */
+   static __thread int cached_year;
+   struct tm loctime;
+
+   if (seconds != cached_second)
+   {
+      localtime_r(&seconds, &loctime);
+      strftime(cached_time, sizeof(cached_time), "%a %b %e %H:%M:%S", &loctime);
+      cached_year = loctime.tm_year + 1900;
+      cached_second = seconds;
+   }
+
+   return(snprintf(time_string, len, "%s.%06ld %d", cached_time, usecs, cached_year));
+}
+
 /*
    Function: write_fineline_project_header()
 
@@ -148,36 +166,29 @@ int dump_statistics()
 }
 
 /*
-   Function: create_event_record()
-
-   Purpose : Creates a Fineline event string from the input data string.
-           :
-   Input   : Event data string.
-   Output  : Timestamped event record.
+   Function: create_record()
+
+   Purpose : Creates a Fineline event string of the given type from the
+           : input data string, packet events are type 1, flow records
+           : type 2 and alerts type 3.
+           : The event string buffer is PV_MAX_INPUT_STR bytes.
+   Input   : Event string, record type and summary, data string, event
+           : time (capture time of the packet, or last packet of a flow).
+   Output  : Timestamped event record, returns the record length.
 */
-int create_event_record(char *event_string, char *data_string)
+int create_record(char *event_string, int type, char *summary, char *data_string, time_t seconds, long usecs)
 {
-   time_t curtime;
-   struct tm *loctime;
-   char *time_str;
+   char time_str[64];
 
-   /* Get the current time. */
-   curtime = time (NULL);
-   loctime = localtime (&curtime);
-
-   time_str = asctime(loctime);
-   rtrim(time_str);
+   format_event_time(time_str, sizeof(time_str), seconds, usecs);
 
    /* TODO: put an actual sensor id in the id field. */
-   strcpy(event_string, "<event><id>SENSOR0000</id><evidencenumber>NONE</evidencenumber><time>");
-   strcat(event_string, time_str);
-   strcat(event_string, "</time><type>1</type><summary>Pivot Sensor Packet Event</summary><data>");
-   strncat(event_string, data_string, strlen(data_string));
-   strcat(event_string, "</data><hiddenevent>0</hiddenevent><hiddentext>0</hiddentext><marked>0</marked><pinned>0</pinned><ypos>0</ypos></event>\n");
-
-   return(0);
+   return(snprintf(event_string, PV_MAX_INPUT_STR, "<event><id>SENSOR0000</id><evidencenumber>NONE</evidencenumber><time>%s"
+                   "</time><type>%d</type><summary>%s</summary><data>%s"
+                   "</data><hiddenevent>0</hiddenevent><hiddentext>0</hiddentext><marked>0</marked><pinned>0</pinned><ypos>0</ypos></event>\n",
+                   time_str, type, summary, data_string));
 }
-
+
 /*
    Function: write_event_record()
 
@@ -191,3 +202,21 @@ int write_event_record(char *event_string)
    fputs(event_string, evt_file);
    return(0);
 }
+
+/*
+   Function: write_event_buffer()
+
+   Purpose : writes a buffer of Fineline event strings to the event file
+           : with a single call, used by the capture worker threads.
+   Input   : Event buffer and length.
+   Output  : Returns -1 on a short write.
+*/
+int write_event_buffer(char *buffer, size_t length)
+{
+   if (fwrite(buffer, 1, length, evt_file) != length)
+   {
+      print_log_entry("write_event_buffer() <ERROR> Event file write failed.\n");
+      return(-1);
+   }
+   return(0);
+}
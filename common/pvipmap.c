@@ -24,75 +24,375 @@
    Author: Derek Chadwick
    Date  : 06/07/2014
 
-   Purpose: A wrapper for uthash, used to store IP addresses extracted from
-            packet captures.
+   Purpose: An open addressing flow table, used to store the flows extracted
+            from packet captures under a binary flow key. The flow records
+            are preallocated and found through a linear probed slot index
+            that keeps the key hash. Each capture worker updates a private
+            shard of the map, the shards are merged into the global map
+            before the map is written out.
 
 */
 
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
 #include "pvcommon.h"
 
-pv_ip_record_t *ip_map = NULL; /* the hash map head record */
+pv_flow_table_t ip_map; /* the global map, worker shards are merged into it */
 
-void add_ip(pv_ip_record_t *flip)
+/*
+   Function: init_flow_table
+   Purpose : Preallocates the flow record pool and the open addressing
+             slot index. The index has at least twice as many slots as
+             there are records so probe sequences stay short.
+   Input   : Table, maximum number of flow records.
+   Output  : Returns 0.
+*/
+int init_flow_table(pv_flow_table_t *table, uint32_t capacity)
 {
-    pv_ip_record_t *s;
+   uint32_t i, slot_count = 16;
+
+   if (capacity < 1)
+   {
+      capacity = 1;
+   }
+   while (slot_count < (capacity * 2))
+   {
+      slot_count <<= 1;
+   }
+
+   memset(table, 0, sizeof(pv_flow_table_t));
+   table->capacity = capacity;
+   table->slot_mask = slot_count - 1;
+   table->slots = xmemalign(PV_CACHE_LINE_SIZE, slot_count * sizeof(pv_flow_slot_t));
+   table->records = xmemalign(PV_CACHE_LINE_SIZE, capacity * sizeof(pv_flow_record_t));
+   table->free_list = xmalloc(capacity * sizeof(uint32_t));
+
+   for (i = 0; i < slot_count; i++)
+   {
+      table->slots[i].index = PV_FLOW_EMPTY;
+      table->slots[i].hash = 0;
+   }
+   /* Hand out the lowest record indexes first. */
+   for (i = 0; i < capacity; i++)
+   {
+      table->free_list[i] = capacity - 1 - i;
+   }
+   table->free_count = capacity;
 
-    HASH_FIND_STR(ip_map, flip->key_value , s);  /* id already in the hash? */
-    if (s == NULL)
-    {
-      HASH_ADD_STR(ip_map, key_value, flip);  /* id: name of key field */
-    }
+   return(0);
+}
 
+/*
+   Function: free_flow_table
+   Purpose : Frees the record pool and slot index of a flow table.
+   Input   : Table.
+   Output  : None.
+*/
+void free_flow_table(pv_flow_table_t *table)
+{
+   free(table->slots);
+   free(table->records);
+   free(table->free_list);
+   memset(table, 0, sizeof(pv_flow_table_t));
 }
 
-pv_ip_record_t *find_ip(char *lookup_string)
+/*
+   Function: hash_flow_key
+   Purpose : 32 bit hash of the binary flow key, the key is mixed eight
+             bytes at a time with a multiply/xorshift finaliser.
+   Input   : Flow key.
+   Output  : Hash value.
+*/
+uint32_t hash_flow_key(pv_flow_key_t *key)
 {
-    pv_ip_record_t *s;
+   uint64_t words[sizeof(pv_flow_key_t) / 8];
+   uint64_t h = 0x9e3779b97f4a7c15ULL;
+   unsigned int i;
 
-    HASH_FIND_STR(ip_map, lookup_string, s);  /* s: output pointer */
-    return s;
+   memcpy(words, key, sizeof(pv_flow_key_t));
+   for (i = 0; i < sizeof(pv_flow_key_t) / 8; i++)
+   {
+      h ^= words[i];
+      h *= 0xff51afd7ed558ccdULL;
+      h ^= h >> 32;
+   }
+   h *= 0xc4ceb9fe1a85ec53ULL;
+   h ^= h >> 29;
+
+   return((uint32_t)h);
 }
 
-pv_ip_record_t *get_first_ip_record()
+/*
+   Function: find_flow
+   Purpose : Looks up a flow record by key.
+   Input   : Table, key and key hash.
+   Output  : Flow record or NULL if not found.
+*/
+pv_flow_record_t *find_flow(pv_flow_table_t *table, pv_flow_key_t *key, uint32_t hash)
 {
-   return(ip_map);
+   uint32_t i = hash & table->slot_mask;
+   pv_flow_slot_t *slot;
+   pv_flow_record_t *record;
+
+   for (;;)
+   {
+      slot = &table->slots[i];
+      if (slot->index == PV_FLOW_EMPTY)
+      {
+         return(NULL);
+      }
+      if (slot->hash == hash)
+      {
+         record = &table->records[slot->index];
+         if (memcmp(&record->key, key, sizeof(pv_flow_key_t)) == 0)
+         {
+            return(record);
+         }
+      }
+      i = (i + 1) & table->slot_mask;
+   }
+}
+
+/*
+   Function: find_or_add_flow
+   Purpose : Looks up a flow record by key, if it is not found a zeroed
+             record is taken from the pool and added with the key.
+   Input   : Table, key and key hash.
+   Output  : Flow record, or NULL if the record pool is exhausted.
+*/
+pv_flow_record_t *find_or_add_flow(pv_flow_table_t *table, pv_flow_key_t *key, uint32_t hash)
+{
+   uint32_t i = hash & table->slot_mask;
+   pv_flow_slot_t *slot;
+   pv_flow_record_t *record;
+
+   for (;;)
+   {
+      slot = &table->slots[i];
+      if (slot->index == PV_FLOW_EMPTY)
+      {
+         break;
+      }
+      if (slot->hash == hash)
+      {
+         record = &table->records[slot->index];
+         if (memcmp(&record->key, key, sizeof(pv_flow_key_t)) == 0)
+         {
+            return(record);
+         }
+      }
+      i = (i + 1) & table->slot_mask;
+   }
+
+   if (table->free_count == 0)
+   {
+      table->insert_failures++;
+      return(NULL);
+   }
+
+   slot->index = table->free_list[--table->free_count];
+   slot->hash = hash;
+   record = &table->records[slot->index];
+   memset(record, 0, sizeof(pv_flow_record_t));
+   memcpy(&record->key, key, sizeof(pv_flow_key_t));
+   record->hash = hash;
+   record->flags = PV_FLOW_IN_USE;
+   table->count++;
+
+   return(record);
+}
+
+/*
+   Function: delete_flow
+   Purpose : Removes a flow record from the table and returns it to the
+             pool. The following slots in the probe sequence are shifted
+             back so no tombstones are needed.
+   Input   : Table, flow record.
+   Output  : None.
+*/
+void delete_flow(pv_flow_table_t *table, pv_flow_record_t *record)
+{
+   uint32_t index = (uint32_t)(record - table->records);
+   uint32_t i = record->hash & table->slot_mask;
+   uint32_t j, home;
+
+   while (table->slots[i].index != index)
+   {
+      if (table->slots[i].index == PV_FLOW_EMPTY)
+      {
+         return;
+      }
+      i = (i + 1) & table->slot_mask;
+   }
+
+   j = i;
+   for (;;)
+   {
+      j = (j + 1) & table->slot_mask;
+      if (table->slots[j].index == PV_FLOW_EMPTY)
+      {
+         break;
+      }
+      home = table->slots[j].hash & table->slot_mask;
+      /* Move slot j back to i unless its home slot lies cyclically in (i, j]. */
+      if (((j > i) && ((home <= i) || (home > j))) || ((j < i) && ((home <= i) && (home > j))))
+      {
+         table->slots[i] = table->slots[j];
+         i = j;
+      }
+   }
+   table->slots[i].index = PV_FLOW_EMPTY;
+   table->slots[i].hash = 0;
+
+   record->flags = 0;
+   table->free_list[table->free_count++] = index;
+   table->count--;
 }
 
-pv_ip_record_t *get_last_ip_record()
+/*
+   Function: get_next_flow
+   Purpose : Iterates over the records in use, pass NULL to get the first.
+   Input   : Table, previous record.
+   Output  : Next record in use or NULL at the end of the table.
+*/
+pv_flow_record_t *get_next_flow(pv_flow_table_t *table, pv_flow_record_t *record)
 {
-   pv_ip_record_t *s = get_first_ip_record();
-   if (s != NULL)
-      return((pv_ip_record_t *)s->hh.prev);
+   uint32_t i = 0;
+
+   if (record != NULL)
+   {
+      i = (uint32_t)(record - table->records) + 1;
+   }
+   for (; i < table->capacity; i++)
+   {
+      if (table->records[i].flags & PV_FLOW_IN_USE)
+      {
+         return(&table->records[i]);
+      }
+   }
 
    return(NULL);
 }
 
-void delete_ip(pv_ip_record_t *ip_record)
+/*
+   Function: get_protocol_name
+   Purpose : Returns the fixed width protocol name used in flow text.
+   Input   : IP protocol number.
+   Output  : Protocol name string.
+*/
+const char *get_protocol_name(uint8_t protocol)
 {
-   HASH_DEL(ip_map, ip_record);  /* event: pointer to deletee */
-   free(ip_record);
+   switch (protocol)
+   {
+   case IPPROTO_TCP:
+      return("TCP ");
+   case IPPROTO_UDP:
+      return("UDP ");
+   case IPPROTO_ICMP:
+      return("ICMP");
+   case IPPROTO_ICMPV6:
+      return("ICMP6");
+   }
+   return("IP  ");
 }
 
-void delete_all_ips()
+/*
+   Function: format_flow_key
+   Purpose : Renders a binary flow key as text, for example
+             "TCP  1.2.3.4:80 -> 5.6.7.8:1234 ". Only called when
+             flows are exported.
+   Input   : Flow key, output string and length.
+   Output  : Number of characters written.
+*/
+int format_flow_key(pv_flow_key_t *key, char *out, int len)
 {
-   pv_ip_record_t *current_ip, *tmp;
+   char srcip[INET6_ADDRSTRLEN], dstip[INET6_ADDRSTRLEN];
+   int family = (key->family == PV_FLOW_IPV6) ? AF_INET6 : AF_INET;
+
+   inet_ntop(family, key->src_addr, srcip, INET6_ADDRSTRLEN);
+   inet_ntop(family, key->dst_addr, dstip, INET6_ADDRSTRLEN);
 
-   HASH_ITER(hh, ip_map, current_ip, tmp)
+   if ((key->protocol == IPPROTO_TCP) || (key->protocol == IPPROTO_UDP))
    {
-      HASH_DEL(ip_map,current_ip);  /* delete it (ip_map advances to next) */
-      free(current_ip);              /* free it */
+      if (family == AF_INET6)
+      {
+         return(snprintf(out, len, "%s [%s]:%d -> [%s]:%d ", get_protocol_name(key->protocol),
+                         srcip, ntohs(key->src_port), dstip, ntohs(key->dst_port)));
+      }
+      return(snprintf(out, len, "%s %s:%d -> %s:%d ", get_protocol_name(key->protocol),
+                      srcip, ntohs(key->src_port), dstip, ntohs(key->dst_port)));
    }
+   else if ((key->protocol == IPPROTO_ICMP) || (key->protocol == IPPROTO_ICMPV6))
+   {
+      return(snprintf(out, len, "%s %s -> %s ", get_protocol_name(key->protocol), srcip, dstip));
+   }
+
+   return(snprintf(out, len, "%s %s -> %s Proto:%d ", get_protocol_name(key->protocol), srcip, dstip, key->protocol));
 }
 
+/*
+   Function: init_ip_map
+   Purpose : Allocates the global map that the worker shards are merged into.
+   Input   : Maximum number of flow records.
+*/
+void init_ip_map(uint32_t capacity)
+{
+   init_flow_table(&ip_map, capacity);
+}
+
+/*
+   Function: merge_ip_map
+   Purpose : Adds the records of a worker shard to the global map,
+             counts are added to the existing record if the key is
+             already in the global map.
+   Input   : Worker shard.
+*/
+void merge_ip_map(pv_flow_table_t *shard)
+{
+   pv_flow_record_t *current_flow, *s;
+
+   for (current_flow = get_next_flow(shard, NULL); current_flow != NULL; current_flow = get_next_flow(shard, current_flow))
+   {
+      if ((s = find_or_add_flow(&ip_map, &current_flow->key, current_flow->hash)) != NULL)
+      {
+         s->packet_count += current_flow->packet_count;
+         s->data_size += current_flow->data_size;
+      }
+   }
+}
+
+/*
+   Function: delete_all_ips
+   Purpose : Frees the global map.
+   Input   : None.
+   Output  : None.
+*/
+void delete_all_ips()
+{
+   free_flow_table(&ip_map);
+}
+
+/*
+   Function: write_ip_map
+   Purpose : Writes the global map flows and their counts to an event file.
+   Input   : Output file.
+   Output  : None.
+*/
 void write_ip_map(FILE *outfile)
 {
-   pv_ip_record_t *s;
+   pv_flow_record_t *s;
+   char key_value[PV_FLOW_TEXT_MAX];
    char out_str[PV_MAX_INPUT_STR];
 
    fputs("<eventstatistics>\n", outfile);
-   for(s=ip_map; s != NULL; s=(pv_ip_record_t *)(s->hh.next))
+   for (s = get_next_flow(&ip_map, NULL); s != NULL; s = get_next_flow(&ip_map, s))
    {
-      sprintf(out_str, "%s Packet Count %ld Data Size %ld\n", s->key_value, s->packet_count, s->data_size);
+      format_flow_key(&s->key, key_value, PV_FLOW_TEXT_MAX);
+      sprintf(out_str, "%s Packet Count %lu Data Size %lu\n", key_value, (unsigned long)s->packet_count, (unsigned long)s->data_size);
       fputs(out_str, outfile);
    }
    fputs("</eventstatistics>\n", outfile);
@@ -100,30 +400,25 @@ void write_ip_map(FILE *outfile)
    return;
 }
 
-void send_ip_map(int sock_desc)
-{
-   pv_ip_record_t *s;
-
-   for(s=ip_map; s != NULL; s=(pv_ip_record_t *)(s->hh.next))   {
-      send_event(sock_desc, s->key_value);
-        /* TODO: serialize the record as a Fineline event and send to server. */
-   }
-
-   return;
-}
-
+/*
+   Function: print_ip_map
+   Purpose : Prints the global map flows and their counts.
+   Input   : None.
+   Output  : None.
+*/
 void print_ip_map()
 {
-   pv_ip_record_t *s;
+   pv_flow_record_t *s;
+   char key_value[PV_FLOW_TEXT_MAX];
 
-   for(s=ip_map; s != NULL; s=(pv_ip_record_t *)(s->hh.next))
+   for (s = get_next_flow(&ip_map, NULL); s != NULL; s = get_next_flow(&ip_map, s))
    {
-      printf("Packet Data: %s\n", s->key_value);
-      printf("Packets: %ld\n", s->packet_count);
-      printf("Data Size: %ld\n", s->data_size);
+      format_flow_key(&s->key, key_value, PV_FLOW_TEXT_MAX);
+      printf("Packet Data: %s\n", key_value);
+      printf("Packets: %lu\n", (unsigned long)s->packet_count);
+      printf("Data Size: %lu\n", (unsigned long)s->data_size);
       printf("--------------------------------------------------------\n");
    }
 
    return;
 }
-
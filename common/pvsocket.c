@@ -44,6 +44,7 @@
 #include <errno.h>
 #include <arpa/inet.h>
 #include <pthread.h>
+#include <sys/uio.h>
 
 #include "pvcommon.h"
 
@@ -73,12 +74,14 @@ int init_client_socket(char *server_ip_address)
    if(inet_pton(AF_INET, server_ip_address, &serv_addr.sin_addr)<=0)
    {
       print_log_entry("init_socket() <ERROR> inet_pton error occurred.\n");
+      close(sockfd);
       return(-1);
    }
 
    if(connect(sockfd, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0)
    {
       printf("init_socket() <ERROR> Connect Failed.\n");
+      close(sockfd);
       return(-1);
    }
    return(sockfd);
@@ -130,7 +133,7 @@ int init_server_socket(int port_number, void *(* connector)(void *))
       strcpy(message, "Hello Client , I have received your connection. And now I will assign a handler for you.");
       write(new_sock, message, strlen(message));
 
-      new_sock_p = malloc(1);
+      new_sock_p = malloc(sizeof(int));
       *new_sock_p = new_sock;
 
       if(pthread_create(&server_thread, NULL, connector, (void*)new_sock_p) < 0)
@@ -151,16 +154,88 @@ int init_server_socket(int port_number, void *(* connector)(void *))
    return(0);
 }
 
+/*
+   Function: send_event
+   Purpose : Sends an event string, retrying after short writes.
+   Input   : Socket, event string.
+   Return  : Bytes sent or -1 on error.
+*/
 int send_event(int sockfd, char *event_string)
 {
-   int k;
-   k = send(sockfd, event_string, strlen(event_string), 0);
-   if (k == -1)
+   size_t len = strlen(event_string);
+   size_t sent = 0;
+   ssize_t k;
+
+   while (sent < len)
    {
-      print_log_entry("send_event() <ERROR> Cannot write to server!\n");
+      k = send(sockfd, event_string + sent, len - sent, MSG_NOSIGNAL);
+      if (k < 0)
+      {
+         if (errno == EINTR)
+         {
+            continue;
+         }
+         print_log_entry("send_event() <ERROR> Cannot write to server!\n");
+         return(-1);
+      }
+      sent += k;
    }
 
-   return(k);
+   return((int)sent);
+}
+
+/*
+   Function: send_iovec
+   Purpose : Writes a set of buffers with writev(). After a short write the
+             iovecs that were sent are skipped and the next one is trimmed,
+             so the write resumes part way through a buffer. The iovecs are
+             modified.
+   Input   : Socket, iovecs, iovec count, bytes sent (output).
+   Return  : Number of writev() calls or -1 on error.
+*/
+int send_iovec(int sockfd, struct iovec *iov, int count, size_t *sent)
+{
+   size_t remaining = 0;
+   int writes = 0;
+   int first = 0;
+   ssize_t k;
+   int i;
+
+   *sent = 0;
+   for (i = 0; i < count; i++)
+   {
+      remaining += iov[i].iov_len;
+   }
+
+   while (remaining > 0)
+   {
+      k = writev(sockfd, &iov[first], count - first);
+      writes++;
+      if (k < 0)
+      {
+         if (errno == EINTR)
+         {
+            continue;
+         }
+         print_log_entry("send_iovec() <ERROR> Cannot write to server!\n");
+         return(-1);
+      }
+      *sent += k;
+      remaining -= k;
+
+      while ((first < count) && ((size_t)k >= iov[first].iov_len))
+      {
+         k -= iov[first].iov_len;
+         first++;
+      }
+      if ((first < count) && (k > 0))
+      {
+         iov[first].iov_base = (char *)iov[first].iov_base + k;
+         iov[first].iov_len -= k;
+      }
+   }
+
+   return(writes);
 }
 
 /* TODO: protocol not fully specified yet */
@@ -175,6 +250,31 @@ int close_socket(int sockfd)
    return(0);
 }
 
+/*
+   Function: shutdown_socket
+   Purpose : Closes a client connection without losing data. Closing a
+             socket with unread data in the receive queue resets the
+             connection, and the peer can discard data it has not read yet,
+             so the write side is shut down and the socket is read until
+             the peer closes it, or for at most timeout seconds.
+   Input   : Socket, timeout in seconds.
+   Return  : 0.
+*/
+int shutdown_socket(int sockfd, int timeout)
+{
+   char buffer[1024];
+   struct timeval tv;
+
+   tv.tv_sec = timeout;
+   tv.tv_usec = 0;
+   setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+   shutdown(sockfd, SHUT_WR);
+   while (recv(sockfd, buffer, sizeof(buffer), 0) > 0);
+   close(sockfd);
+
+   return(0);
+}
+
 /* DEBUG */
 void *connection_handler(void *socket_desc)
 {
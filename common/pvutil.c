@@ -33,6 +33,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <stdint.h>
 #include <ctype.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
@@ -78,6 +79,17 @@ void *xrealloc (void *ptr, size_t size)
    return value;
 }
 
+/* Aligned allocation with a fatal exit, used for cache line aligned tables. */
+void *xmemalign (size_t alignment, size_t size)
+{
+   void *value = NULL;
+   if (posix_memalign(&value, alignment, size) != 0)
+   {
+      fatal("xmemalign() <FATAL> Virtual Memory Exhausted!!!");
+   }
+   return value;
+}
+
 /* Redefine free with buffer zeroing. */
 int xfree(char *buf, int len)
 {
@@ -181,6 +193,24 @@ int get_time_string(char *tstr, int slen)
 }
 
 
+/*
+   Function: get_time_ns()
+
+   Purpose : Gets the monotonic clock time in nanoseconds, for timing.
+           :
+   Input   : None.
+   Output  : Nanoseconds since an arbitrary start point.
+*/
+uint64_t get_time_ns()
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return(((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec);
+}
+
+
 int validate_ipv4_address(char *ipv4_addr)
 {
 	/* TODO: a regex would be nice = m/\d+\.\d+\.\d+\.\d+/ */
@@ -42,7 +42,8 @@ int main(int argc, char *argv[])
    char server_ip_address[PV_IP_ADDR_MAX];
    char filter_file[PV_PATH_MAX_LENGTH];
    char capture_device[PV_PATH_MAX_LENGTH];
-   char bpf_string[PV_PATH_MAX_LENGTH];
+   char bpf_string[PV_FILTER_MAX_LENGTH];
+   pv_capture_config_t capture_config;
    int mode;
    int res = open_log_file(argv[0]);
 
@@ -53,31 +54,21 @@ int main(int argc, char *argv[])
    }
    print_log_entry("pivot-sensor.c main() <INFO> Starting Pivotal Sensor 1.0\n");
 
-   mode = parse_command_line_args(argc, argv, capture_device, pv_out_file, server_ip_address, filter_file);
+   mode = parse_command_line_args(argc, argv, capture_device, pv_out_file, server_ip_address, filter_file, &capture_config);
    if (mode > 0)
    {
 
       if (mode & PV_CAPTURE_INPUT)
       {
-         if (mode & PV_FILTER_ON)
+         /* The filter file rules or layer 3 only, and not the Pivotal Server connection. */
+         if (init_bpf_filter(filter_file, server_ip_address, mode, &capture_config, bpf_string) < 0)
          {
-            load_bpf_filters(filter_file, bpf_string);
+            print_log_entry("pivot-sensor.c main() <ERROR> Could not load the capture filter.\n");
          }
          else
          {
-            /* Only do layer 3 and above and not destination Pivotal Server */
-            /* as we will be pushing events to the Pivotal server which may */
-            /* may be running on the local machine.                         */
-            if (mode & PV_SERVER_OUT)
-            {
-               sprintf(bpf_string, "ip and not (host %s and port %s)", server_ip_address, SERVER_PORT_STRING);
-            }
-            else
-            {
-               strncpy(bpf_string, "ip", 2); /* Not sending to server, so just filter on layer 3 packets. */
-            }
+            start_capture(capture_device, bpf_string, pv_out_file, server_ip_address, mode, &capture_config);
          }
-         start_capture(capture_device, bpf_string, pv_out_file, server_ip_address, mode);
       }
       else if (mode & PV_UNIFIED2_INPUT)
       {
@@ -104,10 +95,11 @@ int main(int argc, char *argv[])
 /*
    Function: parse_command_line_args
    Purpose : Validates command line arguments.
-   Input   : argc, argv, capture interface, server ip and filter file strings.
+   Input   : argc, argv, capture interface, server ip and filter file strings,
+             capture configuration.
    Return  : returns -1 on error, mode of operation on success.
 */
-int parse_command_line_args(int argc, char *argv[], char *capture_device, char *pv_event_filename, char *server_ip_address, char *filter_file)
+int parse_command_line_args(int argc, char *argv[], char *capture_device, char *pv_event_filename, char *server_ip_address, char *filter_file, pv_capture_config_t *capture_config)
 {
    int retval = 0;
    char timestr[100];
@@ -123,6 +115,43 @@ int parse_command_line_args(int argc, char *argv[], char *capture_device, char *
    strncpy(capture_device, "eth0", 4);
    strncpy(server_ip_address, "127.0.0.1", 9); /* Default server on the local machine */
 
+   capture_config->ring_size = PV_DEFAULT_RING_SIZE;
+   capture_config->block_size = PV_DEFAULT_BLOCK_SIZE;
+   capture_config->block_timeout = PV_DEFAULT_BLOCK_TIMEOUT;
+   capture_config->snaplen = PV_DEFAULT_SNAPLEN;
+   capture_config->payload_packets = 0;
+   capture_config->payload_bytes = 0;
+   capture_config->heavy_topk = 0;
+   capture_config->fanout_threshold = 0;
+   capture_config->fanout_window = PV_DEFAULT_FANOUT_WINDOW;
+   capture_config->fanout_hosts = PV_DEFAULT_FANOUT_HOSTS;
+   capture_config->scan_ports = 0;
+   capture_config->scan_syns = 0;
+   capture_config->ngram_mode = 0;
+   capture_config->ngram_threshold = PV_DEFAULT_NGRAM_SCORE;
+   memset(capture_config->ngram_file, 0, PV_PATH_MAX_LENGTH);
+   capture_config->url_topk = 0;
+   capture_config->dns_topk = 0;
+   capture_config->tls_inspect = 0;
+   capture_config->reasm_memory = 0;
+   capture_config->reasm_depth = PV_DEFAULT_REASM_DEPTH;
+   memset(capture_config->ioc_file, 0, PV_PATH_MAX_LENGTH);
+   memset(capture_config->blocklist_files, 0, sizeof(capture_config->blocklist_files));
+   capture_config->blocklist_count = 0;
+   memset(capture_config->blocklist_table, 0, PV_PATH_MAX_LENGTH);
+   capture_config->worker_count = 1;
+   capture_config->flow_capacity = PV_DEFAULT_FLOW_CAPACITY;
+   capture_config->idle_timeout = PV_DEFAULT_IDLE_TIMEOUT;
+   capture_config->active_timeout = PV_DEFAULT_ACTIVE_TIMEOUT;
+   capture_config->export_interval = PV_DEFAULT_EXPORT_INTERVAL;
+   capture_config->send_latency = PV_DEFAULT_SEND_LATENCY;
+   capture_config->output_slots = -1;
+   strcpy(capture_config->spool_dir, ".");
+   capture_config->stats_interval = PV_DEFAULT_STATS_INTERVAL;
+   strcpy(capture_config->stats_file, PV_DEFAULT_STATS_FILE);
+   capture_config->replay_pacing = 0;
+   memset(capture_config->replay_file, 0, PV_PATH_MAX_LENGTH);
+
    if (tlen > 0) /* Build the default event filename, fineline-events-YYYYMMDD-HHMMSS.fle */
    {
       strncat(pv_event_filename, timestr, tlen);
@@ -163,6 +192,482 @@ int parse_command_line_args(int argc, char *argv[], char *capture_device, char *
          {
             retval = retval | PV_FILE_OUT | PV_SERVER_OUT; /* Create FineLine event file and send events to server */
          }
+         else if (strncmp(argv[i], "-m", 2) == 0)
+         {
+            retval = retval | PV_RING_CAPTURE; /* Capture with the TPACKET_V3 memory mapped ring */
+         }
+         else if (strncmp(argv[i], "-R", 2) == 0)
+         {
+            /* Ring or kernel capture buffer size in megabytes */
+            if (((i+1) < argc) && (atoi(argv[i+1]) > 0))
+            {
+               capture_config->ring_size = atoi(argv[i+1]);
+               printf("parse_command_line_args() <INFO> Ring size: %u MB\n", capture_config->ring_size);
+            }
+            else
+            {
+               print_log_entry("parse_command_line_args() <ERROR> Missing or invalid ring size.\n");
+               return(-1);
+            }
+         }
+         else if (strncmp(argv[i], "-B", 2) == 0)
+         {
+            /* Ring block size in kilobytes */
+            if (((i+1) < argc) && (atoi(argv[i+1]) > 0))
+            {
+               capture_config->block_size = atoi(argv[i+1]);
+               printf("parse_command_line_args() <INFO> Block size: %u KB\n", capture_config->block_size);
+            }
+            else
+            {
+               print_log_entry("parse_command_line_args() <ERROR> Missing or invalid block size.\n");
+               return(-1);
+            }
+         }
+         else if (strncmp(argv[i], "-T", 2) == 0)
+         {
+            /* Ring block timeout in milliseconds */
+            if (((i+1) < argc) && (atoi(argv[i+1]) > 0))
+            {
+               capture_config->block_timeout = atoi(argv[i+1]);
+               printf("parse_command_line_args() <INFO> Block timeout: %u ms\n", capture_config->block_timeout);
+            }
+            else
+            {
+               print_log_entry("parse_command_line_args() <ERROR> Missing or invalid block timeout.\n");
+               return(-1);
+            }
+         }
+         else if (strncmp(argv[i], "-W", 2) == 0)
+         {
+            /* Number of capture worker threads, joined in a PACKET_FANOUT group */
+            if (((i+1) < argc) && (atoi(argv[i+1]) > 0) && (atoi(argv[i+1]) <= PV_MAX_WORKERS))
+            {
+               capture_config->worker_count = atoi(argv[i+1]);
+               printf("parse_command_line_args() <INFO> Capture workers: %d\n", capture_config->worker_count);
+            }
+            else
+            {
+               print_log_entry("parse_command_line_args() <ERROR> Missing or invalid worker count.\n");
+               return(-1);
+            }
+         }
+         else if (strncmp(argv[i], "-N", 2) == 0)
+         {
+            /* Flow table capacity per worker, records are preallocated */
+            if (((i+1) < argc) && (atoi(argv[i+1]) > 0))
+            {
+               capture_config->flow_capacity = atoi(argv[i+1]);
+               printf("parse_command_line_args() <INFO> Flow table capacity: %u\n", capture_config->flow_capacity);
+            }
+            else
+            {
+               print_log_entry("parse_command_line_args() <ERROR> Missing or invalid flow table capacity.\n");
+               return(-1);
+            }
+         }
+         else if (strncmp(argv[i], "-I", 2) == 0)
+         {
+            /* Flows with no packets for this many seconds are exported */
+            if (((i+1) < argc) && (atoi(argv[i+1]) > 0))
+            {
+               capture_config->idle_timeout = atoi(argv[i+1]);
+               printf("parse_command_line_args() <INFO> Flow idle timeout: %u\n", capture_config->idle_timeout);
+            }
+            else
+            {
+               print_log_entry("parse_command_line_args() <ERROR> Missing or invalid flow idle timeout.\n");
+               return(-1);
+            }
+         }
+         else if (strncmp(argv[i], "-A", 2) == 0)
+         {
+            /* Flows open for this many seconds are exported and restarted */
+            if (((i+1) < argc) && (atoi(argv[i+1]) > 0))
+            {
+               capture_config->active_timeout = atoi(argv[i+1]);
+               printf("parse_command_line_args() <INFO> Flow active timeout: %u\n", capture_config->active_timeout);
+            }
+            else
+            {
+               print_log_entry("parse_command_line_args() <ERROR> Missing or invalid flow active timeout.\n");
+               return(-1);
+            }
+         }
+         else if (strncmp(argv[i], "-E", 2) == 0)
+         {
+            /* Send the flow statistics deltas to the server every N seconds */
+            if (((i+1) < argc) && (atoi(argv[i+1]) > 0))
+            {
+               capture_config->export_interval = atoi(argv[i+1]);
+               printf("parse_command_line_args() <INFO> Flow statistics export interval: %u\n", capture_config->export_interval);
+            }
+            else
+            {
+               print_log_entry("parse_command_line_args() <ERROR> Missing or invalid export interval.\n");
+               return(-1);
+            }
+         }
+         else if (strncmp(argv[i], "-L", 2) == 0)
+         {
+            /* Events wait at most N milliseconds in the server send buffer */
+            if (((i+1) < argc) && (atoi(argv[i+1]) >= 0))
+            {
+               capture_config->send_latency = atoi(argv[i+1]);
+               printf("parse_command_line_args() <INFO> Server send latency: %u ms\n", capture_config->send_latency);
+            }
+            else
+            {
+               print_log_entry("parse_command_line_args() <ERROR> Missing or invalid server send latency.\n");
+               return(-1);
+            }
+         }
+         else if (strncmp(argv[i], "-D", 2) == 0)
+         {
+            /* Output ring slots per worker, 0 runs the output stage on the capture thread */
+            if (((i+1) < argc) && (atoi(argv[i+1]) >= 0))
+            {
+               capture_config->output_slots = atoi(argv[i+1]);
+               printf("parse_command_line_args() <INFO> Output ring slots: %d\n", capture_config->output_slots);
+            }
+            else
+            {
+               print_log_entry("parse_command_line_args() <ERROR> Missing or invalid output ring size.\n");
+               return(-1);
+            }
+         }
+         else if (strncmp(argv[i], "-q", 2) == 0)
+         {
+            /* Directory for the server output spill files */
+            if ((i+1) < argc)
+            {
+               strncpy(capture_config->spool_dir, argv[i+1], PV_PATH_MAX_LENGTH - 1);
+               printf("parse_command_line_args() <INFO> Server spool directory: %s\n", capture_config->spool_dir);
+            }
+            else
+            {
+               print_log_entry("parse_command_line_args() <ERROR> Missing spool directory.\n");
+               return(-1);
+            }
+         }
+         else if (strncmp(argv[i], "-S", 2) == 0)
+         {
+            /* Bytes captured per packet */
+            if (((i+1) < argc) && (atoi(argv[i+1]) >= PV_MIN_SNAPLEN) && (atoi(argv[i+1]) <= PV_MAX_SNAPLEN))
+            {
+               capture_config->snaplen = atoi(argv[i+1]);
+               printf("parse_command_line_args() <INFO> Snaplen: %u bytes\n", capture_config->snaplen);
+            }
+            else
+            {
+               print_log_entry("parse_command_line_args() <ERROR> Missing or invalid snaplen.\n");
+               return(-1);
+            }
+         }
+         else if (strncmp(argv[i], "-H", 2) == 0)
+         {
+            /* Header only capture, the snaplen covers the deepest headers the decoder reads */
+            capture_config->snaplen = PV_HEADER_SNAPLEN;
+            printf("parse_command_line_args() <INFO> Header only capture, snaplen: %u bytes\n", capture_config->snaplen);
+         }
+         else if (strncmp(argv[i], "-K", 2) == 0)
+         {
+            /* Keep the payload of the first N packets of each flow */
+            if (((i+1) < argc) && (atoi(argv[i+1]) >= 0))
+            {
+               capture_config->payload_packets = atoi(argv[i+1]);
+               printf("parse_command_line_args() <INFO> Payload sampled for the first %u packets of each flow\n", capture_config->payload_packets);
+            }
+            else
+            {
+               print_log_entry("parse_command_line_args() <ERROR> Missing or invalid payload packet count.\n");
+               return(-1);
+            }
+         }
+         else if (strncmp(argv[i], "-k", 2) == 0)
+         {
+            /* Keep the first N payload bytes of each flow */
+            if (((i+1) < argc) && (atoi(argv[i+1]) >= 0))
+            {
+               capture_config->payload_bytes = atoi(argv[i+1]);
+               printf("parse_command_line_args() <INFO> Payload sampled for the first %u bytes of each flow\n", capture_config->payload_bytes);
+            }
+            else
+            {
+               print_log_entry("parse_command_line_args() <ERROR> Missing or invalid payload byte count.\n");
+               return(-1);
+            }
+         }
+         else if (strncmp(argv[i], "-x", 2) == 0)
+         {
+            /* Track the top N talkers and conversations in fixed memory */
+            if (((i+1) < argc) && (atoi(argv[i+1]) > 0) && (atoi(argv[i+1]) <= PV_MAX_TOPK))
+            {
+               capture_config->heavy_topk = atoi(argv[i+1]);
+               printf("parse_command_line_args() <INFO> Heavy hitters: top %u\n", capture_config->heavy_topk);
+            }
+            else
+            {
+               print_log_entry("parse_command_line_args() <ERROR> Missing or invalid heavy hitter count.\n");
+               return(-1);
+            }
+         }
+         else if (strncmp(argv[i], "-X", 2) == 0)
+         {
+            retval = retval | PV_HEAVY_ONLY; /* Heavy hitters instead of the exact per flow map */
+         }
+         else if (strncmp(argv[i], "-F", 2) == 0)
+         {
+            /* Alert when a host contacts, or is contacted by, N distinct hosts in a window */
+            if (((i+1) < argc) && (atoi(argv[i+1]) > 0))
+            {
+               capture_config->fanout_threshold = atoi(argv[i+1]);
+               printf("parse_command_line_args() <INFO> Fan-out/fan-in threshold: %u\n", capture_config->fanout_threshold);
+            }
+            else
+            {
+               print_log_entry("parse_command_line_args() <ERROR> Missing or invalid fan-out threshold.\n");
+               return(-1);
+            }
+         }
+         else if (strncmp(argv[i], "-G", 2) == 0)
+         {
+            /* Fan-out/fan-in and scan detection window in seconds */
+            if (((i+1) < argc) && (atoi(argv[i+1]) > 0))
+            {
+               capture_config->fanout_window = atoi(argv[i+1]);
+               printf("parse_command_line_args() <INFO> Detection window: %u seconds\n", capture_config->fanout_window);
+            }
+            else
+            {
+               print_log_entry("parse_command_line_args() <ERROR> Missing or invalid fan-out window.\n");
+               return(-1);
+            }
+         }
+         else if (strncmp(argv[i], "-J", 2) == 0)
+         {
+            /* Hosts tracked per direction per worker, and sources tracked for scan detection */
+            if (((i+1) < argc) && (atoi(argv[i+1]) > 0))
+            {
+               capture_config->fanout_hosts = atoi(argv[i+1]);
+               printf("parse_command_line_args() <INFO> Detection hosts tracked: %u\n", capture_config->fanout_hosts);
+            }
+            else
+            {
+               print_log_entry("parse_command_line_args() <ERROR> Missing or invalid fan-out host count.\n");
+               return(-1);
+            }
+         }
+         else if (strncmp(argv[i], "-P", 2) == 0)
+         {
+            /* Alert when a source tries N distinct destination ports in a window */
+            if (((i+1) < argc) && (atoi(argv[i+1]) > 0))
+            {
+               capture_config->scan_ports = atoi(argv[i+1]);
+               printf("parse_command_line_args() <INFO> Port scan threshold: %u ports\n", capture_config->scan_ports);
+            }
+            else
+            {
+               print_log_entry("parse_command_line_args() <ERROR> Missing or invalid port scan threshold.\n");
+               return(-1);
+            }
+         }
+         else if (strncmp(argv[i], "-Y", 2) == 0)
+         {
+            /* Alert when a source sends N connection attempts in a window */
+            if (((i+1) < argc) && (atoi(argv[i+1]) > 0))
+            {
+               capture_config->scan_syns = atoi(argv[i+1]);
+               printf("parse_command_line_args() <INFO> SYN flood threshold: %u SYNs\n", capture_config->scan_syns);
+            }
+            else
+            {
+               print_log_entry("parse_command_line_args() <ERROR> Missing or invalid SYN flood threshold.\n");
+               return(-1);
+            }
+         }
+         else if (strncmp(argv[i], "-U", 2) == 0)
+         {
+            /* Write a statistics report every N seconds, 0 for none */
+            if (((i+1) < argc) && (atoi(argv[i+1]) >= 0))
+            {
+               capture_config->stats_interval = atoi(argv[i+1]);
+               printf("parse_command_line_args() <INFO> Statistics interval: %u seconds\n", capture_config->stats_interval);
+            }
+            else
+            {
+               print_log_entry("parse_command_line_args() <ERROR> Missing or invalid statistics interval.\n");
+               return(-1);
+            }
+         }
+         else if (strncmp(argv[i], "-u", 2) == 0)
+         {
+            /* Statistics report file */
+            if ((i+1) < argc)
+            {
+               strncpy(capture_config->stats_file, argv[i+1], PV_PATH_MAX_LENGTH - 1);
+               printf("parse_command_line_args() <INFO> Statistics file: %s\n", capture_config->stats_file);
+            }
+            else
+            {
+               print_log_entry("parse_command_line_args() <ERROR> Missing statistics file name.\n");
+               return(-1);
+            }
+         }
+         else if ((strncmp(argv[i], "-g", 2) == 0) || (strncmp(argv[i], "-n", 2) == 0))
+         {
+            /* Train n-gram models and save them to a file, or detect anomalies with them */
+            if ((i+1) < argc)
+            {
+               capture_config->ngram_mode = (argv[i][1] == 'g') ? PV_NGRAM_TRAIN : PV_NGRAM_DETECT;
+               printf("parse_command_line_args() <INFO> N-gram model file: %s\n", argv[i+1]);
+               strncpy(capture_config->ngram_file, argv[i+1], PV_PATH_MAX_LENGTH - 1);
+            }
+            else
+            {
+               print_log_entry("parse_command_line_args() <ERROR> Missing n-gram model file name.\n");
+               return(-1);
+            }
+         }
+         else if (strncmp(argv[i], "-j", 2) == 0)
+         {
+            /* Percentage of unseen 5-grams that raises a payload anomaly alert */
+            if (((i+1) < argc) && (atoi(argv[i+1]) > 0) && (atoi(argv[i+1]) <= 100))
+            {
+               capture_config->ngram_threshold = atoi(argv[i+1]);
+               printf("parse_command_line_args() <INFO> N-gram score threshold: %u%%\n", capture_config->ngram_threshold);
+            }
+            else
+            {
+               print_log_entry("parse_command_line_args() <ERROR> Missing or invalid n-gram score threshold, 1 to 100.\n");
+               return(-1);
+            }
+         }
+         else if (strncmp(argv[i], "-y", 2) == 0)
+         {
+            /* Parse HTTP requests and report the top N URLs */
+            if (((i+1) < argc) && (atoi(argv[i+1]) > 0) && (atoi(argv[i+1]) <= PV_MAX_TOPK))
+            {
+               capture_config->url_topk = atoi(argv[i+1]);
+               printf("parse_command_line_args() <INFO> URLs: top %u\n", capture_config->url_topk);
+            }
+            else
+            {
+               print_log_entry("parse_command_line_args() <ERROR> Missing or invalid URL count.\n");
+               return(-1);
+            }
+         }
+         else if (strncmp(argv[i], "-d", 2) == 0)
+         {
+            /* Parse DNS messages, summarise them with the top N domains */
+            if (((i+1) < argc) && (atoi(argv[i+1]) > 0) && (atoi(argv[i+1]) <= PV_MAX_TOPK))
+            {
+               capture_config->dns_topk = atoi(argv[i+1]);
+               printf("parse_command_line_args() <INFO> DNS domains: top %u\n", capture_config->dns_topk);
+            }
+            else
+            {
+               print_log_entry("parse_command_line_args() <ERROR> Missing or invalid domain count.\n");
+               return(-1);
+            }
+         }
+         else if (strncmp(argv[i], "-e", 2) == 0)
+         {
+            capture_config->tls_inspect = 1; /* SNI, ALPN and JA3 from TLS ClientHellos */
+         }
+         else if (strncmp(argv[i], "-M", 2) == 0)
+         {
+            /* Reassemble TCP streams in a fixed amount of memory */
+            if (((i+1) < argc) && (atoi(argv[i+1]) > 0) && (atoi(argv[i+1]) <= 65536))
+            {
+               capture_config->reasm_memory = atoi(argv[i+1]);
+               printf("parse_command_line_args() <INFO> TCP reassembly memory: %u MB\n", capture_config->reasm_memory);
+            }
+            else
+            {
+               print_log_entry("parse_command_line_args() <ERROR> Missing or invalid reassembly memory size.\n");
+               return(-1);
+            }
+         }
+         else if (strncmp(argv[i], "-O", 2) == 0)
+         {
+            /* Bytes reassembled in each direction of a TCP connection */
+            if (((i+1) < argc) && (atoi(argv[i+1]) > 0) && (atoi(argv[i+1]) <= 1048576))
+            {
+               capture_config->reasm_depth = atoi(argv[i+1]);
+               printf("parse_command_line_args() <INFO> TCP reassembly depth: %u KB\n", capture_config->reasm_depth);
+            }
+            else
+            {
+               print_log_entry("parse_command_line_args() <ERROR> Missing or invalid reassembly depth.\n");
+               return(-1);
+            }
+         }
+         else if (strncmp(argv[i], "-l", 2) == 0)
+         {
+            /* Match payloads against the IOC patterns in a file */
+            if ((i+1) < argc)
+            {
+               printf("parse_command_line_args() <INFO> IOC pattern file: %s\n", argv[i+1]);
+               strncpy(capture_config->ioc_file, argv[i+1], PV_PATH_MAX_LENGTH - 1);
+            }
+            else
+            {
+               print_log_entry("parse_command_line_args() <ERROR> Missing IOC pattern file name.\n");
+               return(-1);
+            }
+         }
+         else if (strncmp(argv[i], "-z", 2) == 0)
+         {
+            /* Alert on new flows to or from the CIDR prefixes in a blocklist, may be repeated */
+            if (((i+1) < argc) && (capture_config->blocklist_count < PV_LPM_MAX_LISTS))
+            {
+               printf("parse_command_line_args() <INFO> Blocklist file: %s\n", argv[i+1]);
+               strncpy(capture_config->blocklist_files[capture_config->blocklist_count++], argv[i+1], PV_PATH_MAX_LENGTH - 1);
+            }
+            else
+            {
+               print_log_entry("parse_command_line_args() <ERROR> Missing blocklist file name or too many blocklists.\n");
+               return(-1);
+            }
+         }
+         else if (strncmp(argv[i], "-Z", 2) == 0)
+         {
+            /* Compiled blocklist table, written after the blocklists are compiled or mapped without them */
+            if ((i+1) < argc)
+            {
+               printf("parse_command_line_args() <INFO> Blocklist table file: %s\n", argv[i+1]);
+               strncpy(capture_config->blocklist_table, argv[i+1], PV_PATH_MAX_LENGTH - 1);
+            }
+            else
+            {
+               print_log_entry("parse_command_line_args() <ERROR> Missing blocklist table file name.\n");
+               return(-1);
+            }
+         }
+         else if (strncmp(argv[i], "-r", 2) == 0)
+         {
+            /* Replay packets from a pcap file instead of a network interface */
+            if ((i+1) < argc)
+            {
+               printf("parse_command_line_args() <INFO> Replay file: %s\n", argv[i+1]);
+               strncpy(capture_config->replay_file, argv[i+1], PV_PATH_MAX_LENGTH - 1);
+               retval = retval | PV_CAPTURE_INPUT | PV_REPLAY_INPUT;
+            }
+            else
+            {
+               print_log_entry("parse_command_line_args() <ERROR> Missing replay file name.\n");
+               return(-1);
+            }
+         }
+         else if (strncmp(argv[i], "-Q", 2) == 0)
+         {
+            retval = retval | PV_QUIET_OUT; /* Do not print packet events on the console */
+         }
+         else if (strncmp(argv[i], "-p", 2) == 0)
+         {
+            capture_config->replay_pacing = 1; /* Replay at the original packet timestamp pace */
+         }
          else if (strncmp(argv[i], "-o", 2) == 0)
          {
             /* Optional FineLine event file name to use for output of event records */
@@ -216,7 +721,7 @@ int parse_command_line_args(int argc, char *argv[], char *capture_device, char *
             if ((i+1) < argc)
             {
                printf("parse_command_line_args() <INFO> Filter file: %s\n", argv[i+1]);
-               strncpy(filter_file, argv[i+1], strlen(argv[i+1]));
+               strncpy(filter_file, argv[i+1], PV_PATH_MAX_LENGTH - 1);
 			      retval = retval | PV_FILTER_ON;
             }
             else
@@ -228,6 +733,16 @@ int parse_command_line_args(int argc, char *argv[], char *capture_device, char *
       }
    }
 
+   if ((retval & PV_HEAVY_ONLY) && (capture_config->heavy_topk == 0))
+   {
+      capture_config->heavy_topk = PV_DEFAULT_TOPK;
+   }
+
+   if ((capture_config->snaplen <= PV_HEADER_SNAPLEN) && (capture_config->payload_packets | capture_config->payload_bytes))
+   {
+      print_log_entry("parse_command_line_args() <WARNING> Payload sampling with a header only snaplen, little payload will be captured.\n");
+   }
+
    print_log_entry("parse_command_line_args() <INFO> Finished processing command line arguments.\n");
 
    return(retval);
@@ -245,7 +760,46 @@ int show_sensor_help()
    printf("Specify fineline output filename                  : -o FILENAME\n");
    printf("Specify network interface                         : -i INTERFACE\n");
    printf("Specify a server IP address                       : -a 192.168.1.10\n");
-   printf("Specify filter file                               : -f FILENAME\n");
+   printf("Specify filter file, reloaded on SIGHUP           : -f FILENAME\n");
+   printf("Capture with the TPACKET_V3 mmap ring             : -m\n");
+   printf("Ring/capture buffer size in MB (default 64)       : -R SIZE\n");
+   printf("Ring block size in KB (default 1024)              : -B SIZE\n");
+   printf("Ring block/read timeout in ms (default 64)        : -T MSECS\n");
+   printf("Number of capture worker threads (default 1)      : -W COUNT\n");
+   printf("Flow table capacity per worker (default 262144)   : -N FLOWS\n");
+   printf("Flow idle timeout in seconds (default 60)         : -I SECS\n");
+   printf("Flow active timeout in seconds (default 1800)     : -A SECS\n");
+   printf("Flow statistics export interval (default 60)      : -E SECS\n");
+   printf("Server send queue latency (default 100)           : -L MSECS\n");
+   printf("Server spill file directory (default .)           : -q DIRECTORY\n");
+   printf("Output ring slots per worker (default 65536)      : -D SLOTS\n");
+   printf("Bytes captured per packet (default 65535)         : -S SNAPLEN\n");
+   printf("Header only capture, snaplen 256                  : -H\n");
+   printf("Keep payload for the first packets of each flow   : -K PACKETS\n");
+   printf("Keep payload for the first bytes of each flow     : -k BYTES\n");
+   printf("Track the top talkers and conversations           : -x COUNT\n");
+   printf("Heavy hitters instead of the exact flow map       : -X\n");
+   printf("Fan-out/fan-in alert threshold, distinct hosts    : -F COUNT\n");
+   printf("Port scan alert threshold, distinct ports         : -P PORTS\n");
+   printf("SYN flood alert threshold, SYNs per window        : -Y SYNS\n");
+   printf("Train 5-gram payload models, save them to a file  : -g FILENAME\n");
+   printf("Detect payload anomalies with 5-gram models       : -n FILENAME\n");
+   printf("Payload anomaly score, %% unseen 5-grams (def. 40) : -j PERCENT\n");
+   printf("Count HTTP request URLs, report the top URLs      : -y COUNT\n");
+   printf("Summarise DNS instead of packet events, top names : -d COUNT\n");
+   printf("Add TLS SNI, ALPN and JA3 to TCP flow records     : -e\n");
+   printf("Reassemble TCP streams, memory in MB              : -M SIZE\n");
+   printf("Reassembly depth per direction in KB (def. 1024)  : -O KB\n");
+   printf("Alert on payloads matching IOC patterns in a file : -l FILENAME\n");
+   printf("Alert on flows with blocklisted addresses (CIDR)  : -z FILENAME\n");
+   printf("Save or map the compiled blocklist table          : -Z FILENAME\n");
+   printf("Fan-out and scan window in seconds (default 60)   : -G SECS\n");
+   printf("Fan-out and scan hosts tracked (default 4096)     : -J HOSTS\n");
+   printf("Statistics report interval, 0 = none (default 60) : -U SECS\n");
+   printf("Statistics report file                            : -u FILENAME\n");
+   printf("Replay packets from a pcap file                   : -r FILENAME\n");
+   printf("Pace replay by packet timestamps (default max)    : -p\n");
+   printf("Do not print packet events on the console         : -Q\n");
    printf("\n");
    printf("Input and output files are optional. For sending events to the server\n");
    printf("-a <IPaddress> is mandatory. Minimal command line is:\n\n");
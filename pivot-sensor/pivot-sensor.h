@@ -44,42 +44,1426 @@
 #include <signal.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <net/ethernet.h>
 #include <arpa/inet.h>
 #include <netinet/ip.h>
 #include <netinet/tcp.h>
 #include <netinet/udp.h>
 #include <netinet/ip_icmp.h>
 #include <ifaddrs.h>
+#include <pthread.h>
 #include <pcap.h>
 
+#define PV_DEFAULT_SNAPLEN 65535
+/*
+   Header only capture snaplen (-H), sized for one tunnel: VXLAN with two
+   VLAN tags inside and out, IPv4 options and TCP options,
+   22 + 60 + 8 + 8 + 22 + 60 + 60 = 240 bytes, rounded up. GRE with all of
+   its optional fields is no longer. It is not the deepest the decoder
+   reads, a second tunnel or chained IPv6 extension headers, up to
+   PV_DECODE_MAX_IPV6_EXT of up to 2 KB each, can put the transport header
+   past it. Those packets are decoded as far as they were captured and the
+   flow key has no ports, -S sets a larger snaplen.
+*/
+#define PV_HEADER_SNAPLEN 256
+#define PV_MIN_SNAPLEN 64
+#define PV_MAX_SNAPLEN 262144
+#define PV_DEFAULT_RING_SIZE 64      /* MB */
+#define PV_DEFAULT_BLOCK_SIZE 1024   /* KB */
+#define PV_DEFAULT_BLOCK_TIMEOUT 64  /* milliseconds */
+#define PV_MAX_WORKERS 64
+#define PV_WORKER_OUTBUF_SIZE 65536
+#define PV_WORKER_FLUSH_INTERVAL 1   /* seconds */
+#define PV_DEFAULT_FLOW_CAPACITY 262144  /* flow records per worker */
+#define PV_DEFAULT_IDLE_TIMEOUT 60       /* seconds */
+#define PV_DEFAULT_ACTIVE_TIMEOUT 1800   /* seconds */
+#define PV_FLOW_CLOSE_LINGER 2           /* seconds after a TCP FIN or RST */
+#define PV_DEFAULT_EXPORT_INTERVAL 60    /* seconds between flow statistics exports */
+#define PV_FLOW_STATS_DATA_MAX (PV_MAX_INPUT_STR - 256)  /* flow statistics lines per message */
+#define PV_SEND_THRESHOLD 65536          /* bytes queued before a server flush */
+#define PV_DEFAULT_SEND_LATENCY 100      /* milliseconds an event can wait in the server queue */
+
+/* Server output spool, see pvspool.c. */
+#define PV_SPOOL_QUEUE_SIZE (8 * 1024 * 1024)      /* in memory queue bytes */
+#define PV_SPOOL_SEGMENT_SIZE (64 * 1024 * 1024)   /* bytes per spill segment file */
+#define PV_SPOOL_SPILL_LIMIT (1024ULL * 1024 * 1024)  /* spill file bytes kept before events are dropped */
+#define PV_SPOOL_READ_SIZE 65536         /* spill bytes replayed per write */
+#define PV_SPOOL_MAX_BACKOFF 60          /* seconds between reconnect attempts */
+#define PV_SPOOL_SEND_TIMEOUT 10         /* seconds a stalled write waits before reconnecting */
+#define PV_SPOOL_DRAIN_TIMEOUT 10        /* seconds to send the queue at shutdown */
+#define PV_SPOOL_CONTROL_SIZE (PV_FILTER_MAX_LENGTH + 1024)  /* server control message bytes */
+
+/* Flow timer wheel, four levels of 64 one second slots. */
+#define PV_WHEEL_LEVELS 4
+#define PV_WHEEL_BITS   6
+#define PV_WHEEL_SLOTS  (1 << PV_WHEEL_BITS)
+#define PV_WHEEL_MASK   (PV_WHEEL_SLOTS - 1)
+#define PV_WHEEL_SPAN   (1U << (PV_WHEEL_BITS * PV_WHEEL_LEVELS))
+
+/* Packet processing stages, timed for the latency histograms. */
+#define PV_STAGE_DECODE  0
+#define PV_STAGE_FLOW    1
+#define PV_STAGE_FORMAT  2
+#define PV_STAGE_FILE    3
+#define PV_STAGE_SEND    4
+#define PV_STAGE_CONSOLE 5
+#define PV_STAGE_QUEUE   6
+#define PV_STAGE_COUNT   7
+
+/* Packet decoder, see pvdecode.c. */
+#define PV_DECODE_OK 0
+#define PV_DECODE_SHORT -1               /* too short for an IP header */
+#define PV_DECODE_UNSUPPORTED -2         /* not an IP packet */
+#define PV_DECODE_MAX_VLANS 2            /* VLAN IDs kept, outer first */
+#define PV_DECODE_MAX_TUNNELS 2          /* nested tunnels decapsulated */
+#define PV_DECODE_MAX_IPV6_EXT 8         /* IPv6 extension headers skipped */
+#define PV_DECODE_FRAGMENT 0x01          /* not the first fragment, no transport header */
+#define PV_VXLAN_PORT 4789
+#define PV_DEFAULT_FILTER "ip or ip6 or (vlan and (ip or ip6))"
+#define PV_TUNNEL_NONE  0
+#define PV_TUNNEL_GRE   1
+#define PV_TUNNEL_VXLAN 2
+#define PV_TUNNEL_IPIP  3
+
+/* Sensor telemetry, see pvstats.c. */
+#define PV_HIST_SUB_BITS 3               /* 8 buckets per power of two, within 12.5% */
+#define PV_HIST_SUB_BUCKETS (1 << PV_HIST_SUB_BITS)
+#define PV_HIST_MAX_BITS 40              /* latencies up to 2^40 ns, about 18 minutes */
+#define PV_HIST_BUCKETS ((PV_HIST_MAX_BITS - PV_HIST_SUB_BITS + 1) * PV_HIST_SUB_BUCKETS)
+#define PV_STATS_SAMPLE_MASK 15          /* live capture times one packet in 16 */
+#define PV_DEFAULT_STATS_INTERVAL 60     /* seconds between statistics reports */
+#define PV_DEFAULT_STATS_FILE "pivot-sensor-stats.txt"
+#define PV_STATS_REPORT_MAX PV_FLOW_STATS_DATA_MAX  /* report text sent to the server */
+#define PV_STATS_COUNTERS 5              /* packets, short packets, kernel packets, kernel drops, output drops */
+
+/* Heavy hitter sketches and top K lists, see pvheavy.c. */
+#define PV_HEAVY_TALKERS 0
+#define PV_HEAVY_CONVERSATIONS 1
+#define PV_HEAVY_TYPES 2
+#define PV_DEFAULT_TOPK 10               /* keys reported for each key type */
+#define PV_MAX_TOPK 1000
+#define PV_TOPK_COUNTERS 8               /* Space-Saving counters per reported key */
+#define PV_SKETCH_DEPTH 4                /* Count-Min rows, estimates hold with probability 1 - e^-4 */
+#define PV_SKETCH_WIDTH_BITS 12
+#define PV_SKETCH_WIDTH (1 << PV_SKETCH_WIDTH_BITS)  /* counters per row, estimates within e/4096 of the total */
+#define PV_HEAVY_LINE_MAX 128            /* longest report line, an IPv6 conversation */
+#define PV_SKETCH_COLUMN(hash, r) ((uint32_t)(((uint64_t)(hash) * sketch_seeds[r]) >> (64 - PV_SKETCH_WIDTH_BITS)))
+/* Fan-out and fan-in HyperLogLog sketches, see pvfanout.c. */
+#define PV_FANOUT_OUT 0                  /* distinct destinations per source */
+#define PV_FANOUT_IN  1                  /* distinct sources per destination */
+#define PV_FANOUT_TYPES 2
+#define PV_HLL_BITS 10
+#define PV_HLL_REGISTERS (1 << PV_HLL_BITS)  /* 1 KB per host, standard error 1.04/32 = 3.3% */
+#define PV_DEFAULT_FANOUT_WINDOW 60      /* seconds */
+#define PV_DEFAULT_FANOUT_HOSTS 4096     /* hosts tracked per direction per worker */
+/* Port scan and SYN flood detection with sliding window bitmaps, see pvscan.c. */
+#define PV_SCAN_SLOTS 4                  /* steps the window slides in */
+#define PV_SCAN_BITMAP_BITS 9
+#define PV_SCAN_BITMAP_WORDS ((1 << PV_SCAN_BITMAP_BITS) / 64)  /* one cache line of port bits per step */
+#define PV_SCAN_PORTS 0
+#define PV_SCAN_SYNS  1
+#define PV_SCAN_TYPES 2
+/* 5-gram payload anomaly detection with Bloom filters, see pvngram.c. */
+#define PV_NGRAM_TRAIN  1
+#define PV_NGRAM_DETECT 2
+#define PV_NGRAM_LENGTH 5
+#define PV_NGRAM_FILTER_BITS 22
+#define PV_NGRAM_FILTER_WORDS (1 << (PV_NGRAM_FILTER_BITS - 6))  /* 512 KB per service model */
+#define PV_NGRAM_MAX_MODELS 64           /* service ports modelled */
+#define PV_NGRAM_MIN_PAYLOAD 16          /* shorter payloads are not trained or scored */
+#define PV_NGRAM_MIN_TRAINING 100        /* payloads a model needs before it scores */
+#define PV_NGRAM_SERVICE_PORTS 1024      /* ports modelled when the TCP handshake was not seen */
+#define PV_DEFAULT_NGRAM_SCORE 40        /* percent of unseen 5-grams that raises an alert */
+#define PV_NGRAM_MAGIC "PVNGRAM1"
+#define PV_NGRAM_MASK_BITS 12
+#define PV_NGRAM_MASKS (1 << PV_NGRAM_MASK_BITS)  /* 32 KB table of 3 bit word masks */
+/* The shift drops the bytes before the last PV_NGRAM_LENGTH of the rolled value. */
+#define PV_NGRAM_HASH(gram) (((gram) << (64 - (8 * PV_NGRAM_LENGTH))) * 0x9e3779b97f4a7c15ULL)
+#define PV_NGRAM_WORD(hash) ((uint32_t)((hash) >> (64 - (PV_NGRAM_FILTER_BITS - 6))))
+#define PV_NGRAM_BITS(hash) (ngram_masks[((hash) >> 20) & (PV_NGRAM_MASKS - 1)])
+/* Packet text copied into reports and server messages, other bytes become '?'. */
+#define PV_TEXT_CHAR(c) (((c) > ' ') && ((c) < 0x7F) && ((c) != '<') && ((c) != '>') && ((c) != '&'))
+/* Record n of a string map, see pvstrmap.c. */
+#define PV_STRING_RECORD(map, n) ((pv_string_record_t *)((map)->records + (size_t)(n) * (map)->record_size))
+/* HTTP request URLs, see pvhttp.c and pvurlmap.c. */
+#define PV_HTTP_MIN_REQUEST 6            /* "GET / " */
+#define PV_HTTP_METHOD_MAX 8             /* longest method and the space, "OPTIONS " */
+#define PV_HTTP_CONNECT 7                /* index of CONNECT in http_methods[] */
+#define PV_URL_MAX_LENGTH 512            /* longer URLs are cut */
+#define PV_URL_TABLE_CAPACITY 65536      /* distinct URLs stored */
+#define PV_URL_ARENA_SIZE (4 * 1024 * 1024)  /* URL string bytes stored */
+#define PV_URL_LINE_MAX 96               /* URL characters in a report line */
+/* DNS messages and domains, see pvdns.c. */
+#define PV_DNS_PORT 53
+#define PV_DNS_HEADER_LENGTH 12
+#define PV_DNS_NAME_MAX 256              /* dotted name and the NUL */
+#define PV_DNS_MAX_OPCODE 2              /* QUERY, IQUERY and STATUS, others are not parsed */
+#define PV_DNS_MAX_ANSWERS 64            /* answer records parsed per response */
+#define PV_DNS_RESPONSE 0x8000           /* QR flag */
+#define PV_DNS_NXDOMAIN 3
+#define PV_DNS_TYPE_A 1
+#define PV_DNS_TYPE_AAAA 28
+#define PV_DNS_TABLE_CAPACITY 262144     /* distinct domains stored */
+#define PV_DNS_ARENA_SIZE (8 * 1024 * 1024)  /* domain string bytes stored */
+#define PV_DNS_COUNTERS 4                /* queries, responses, NXDOMAIN, malformed */
+/* TLS ClientHello inspection, see pvtls.c. */
+#define PV_TLS_HANDSHAKE 0x16            /* record content type */
+#define PV_TLS_CLIENT_HELLO 1            /* handshake type */
+#define PV_TLS_MIN_HELLO 43              /* record and handshake headers, version and random */
+#define PV_TLS_EXT_SNI 0
+#define PV_TLS_EXT_GROUPS 10
+#define PV_TLS_EXT_POINT_FORMATS 11
+#define PV_TLS_EXT_ALPN 16
+#define PV_TLS_SNI_MAX 64                /* longer server names are cut */
+#define PV_TLS_ALPN_MAX 16
+/* GREASE values, RFC 8701, 0x0a0a, 0x1a1a ... 0xfafa. */
+#define PV_TLS_GREASE(v) ((((v) & 0x0f0f) == 0x0a0a) && (((v) >> 8) == ((v) & 0xff)))
+/* TCP stream reassembly, see pvreasm.c. */
+#define PV_REASM_BLOCK_SIZE 2048         /* segment bytes per pool block */
+#define PV_REASM_FLOW_BLOCKS 32          /* blocks a stream may hold, 64 KB ahead of a hole */
+#define PV_DEFAULT_REASM_DEPTH 1024      /* KB reassembled per direction */
+#define PV_REASM_MAX_CONSUMERS 4
+#define PV_REASM_NONE 0xffffffff
+#define PV_SEQ_LT(a, b) ((int32_t)((uint32_t)(a) - (uint32_t)(b)) < 0)
+/* Multi-pattern IOC matching, see pvioc.c. */
+#define PV_IOC_MAX_PATTERN 256           /* pattern bytes after the hex escapes */
+#define PV_IOC_DENSE_DEPTH 2             /* states nearer the root than this get a full transition row */
+#define PV_IOC_NONE 0xffffffff
+#define PV_IOC_FLOW_ALERTS 8             /* alerts raised per flow, later matches are only counted */
+#define PV_IOC_TEXT_MAX 64               /* pattern characters shown in alerts and reports */
+#define PV_IOC_REPORT_MAX 20             /* patterns in a hit report */
+/* IP blocklist longest prefix match, see pvblocklist.c. */
+#define PV_LPM_MAGIC "PVLPM001"
+#define PV_LPM_MAX_LISTS 8               /* blocklist files */
+#define PV_LPM_NAME_MAX 64               /* blocklist name kept in the table */
+#define PV_LPM_ROOT4_BITS 24             /* IPv4 prefixes up to /24 are expanded into a 64 MB root table */
+#define PV_LPM_ROOT6_BITS 16             /* IPv6 prefixes up to /16 */
+#define PV_LPM_BUCKET 0x80000000         /* entry pointing at a bucket of ranges of the longer prefixes inside it */
+#define PV_LPM_TABLE  0x40000000         /* entry pointing at a table for the next address byte */
+#define PV_LPM_INDEX  0x3fffffff
+#define PV_LPM_BUCKET_MAX 8              /* ranges in an IPv6 bucket, more are split by the next address byte */
+#define PV_LPM_LINE_SLOTS 12             /* ranges in an IPv4 bucket, one cache line */
+#define PV_LPM_LINE_KEYS  16             /* range starts in an IPv4 bucket, searched in four steps */
+#define PV_LPM_KEY_BEFORE(a, b) (((a).hi < (b).hi) || (((a).hi == (b).hi) && ((a).lo < (b).lo)))
+#define PV_LPM_SRC 1
+#define PV_LPM_DST 2
+
+/* BPF capture filters, see pvfilter.c. */
+#define PV_FILTER_MAX_LENGTH 65536       /* filter expression with the rules OR'ed */
+#define PV_FILTER_UPDATE_TIMEOUT 5       /* seconds the workers have to set a replaced filter */
+
+/* Output stage rings between the capture workers and the output threads, see pvoutput.c. */
+#define PV_DEFAULT_OUTPUT_SLOTS 65536    /* event slots per worker ring */
+#define PV_OUTPUT_BATCH 64               /* slots consumed before the ring tail is published */
+#define PV_OUTPUT_IDLE_SLEEP 100         /* microseconds an idle output thread sleeps */
+#define PV_OUTPUT_PACKET 1
+#define PV_OUTPUT_FLOW   2
+#define PV_OUTPUT_ALERT  3
+
+/* Sensor alerts, rendered by the output stage, see pvevent.c. */
+#define PV_ALERT_FANOUT 1                /* a source contacted too many destinations */
+#define PV_ALERT_FANIN  2                /* a destination was contacted by too many sources */
+#define PV_ALERT_PORTSCAN 3              /* a source tried too many destination ports */
+#define PV_ALERT_SYNFLOOD 4              /* a source sent too many connection attempts */
+#define PV_ALERT_NGRAM    5              /* a payload with too many unseen 5-grams */
+#define PV_ALERT_IOC      6              /* a payload matched an IOC pattern */
+#define PV_ALERT_BLOCKLIST 7             /* a new flow to or from a blocklisted address */
+
+/* Records the time since the last mark in a stage histogram, only when this packet is timed. */
+#define PV_STAGE_MARK(w, s) if ((w)->timing) { uint64_t stage_now = get_time_ns(); record_latency(&(w)->latency[s], stage_now - (w)->stage_mark); (w)->stage_mark = stage_now; }
+
+/*
+   DATA STRUCTURES
+*/
+
+struct pv_capture_config
+{
+   unsigned int ring_size;      /* kernel ring/buffer size in MB */
+   unsigned int block_size;     /* TPACKET_V3 block size in KB */
+   unsigned int block_timeout;  /* block retire/read timeout in milliseconds */
+   unsigned int snaplen;        /* bytes captured per packet */
+   unsigned int payload_packets;  /* payload kept for the first N packets of a flow, 0 = all */
+   unsigned int payload_bytes;  /* payload kept for the first N bytes of a flow, 0 = all */
+   unsigned int heavy_topk;     /* heavy hitter list size, 0 = no heavy hitter tracking */
+   unsigned int fanout_threshold;  /* distinct destinations or sources, 0 = no fan-out tracking */
+   unsigned int fanout_window;  /* seconds, fan-out and scan detection */
+   unsigned int fanout_hosts;   /* hosts tracked per direction per worker, fan-out and scan detection */
+   unsigned int scan_ports;     /* distinct destination ports, 0 = no port scan detection */
+   unsigned int scan_syns;      /* connection attempts per window, 0 = no SYN flood detection */
+   int ngram_mode;              /* PV_NGRAM_TRAIN or PV_NGRAM_DETECT, 0 = no n-gram analysis */
+   unsigned int ngram_threshold;  /* percent of unseen 5-grams that raises an alert */
+   char ngram_file[PV_PATH_MAX_LENGTH];  /* n-gram model file */
+   unsigned int url_topk;       /* URLs reported, 0 = no HTTP request parsing */
+   unsigned int dns_topk;       /* domains reported, 0 = no DNS parsing */
+   int tls_inspect;             /* inspect the first payload packet of TCP flows for a ClientHello */
+   unsigned int reasm_memory;   /* MB of TCP reassembly blocks shared by the workers, 0 = no reassembly */
+   unsigned int reasm_depth;    /* KB reassembled per direction */
+   char ioc_file[PV_PATH_MAX_LENGTH];  /* IOC pattern file, empty = no IOC matching */
+   char blocklist_files[PV_LPM_MAX_LISTS][PV_PATH_MAX_LENGTH];  /* CIDR blocklists */
+   int blocklist_count;
+   char blocklist_table[PV_PATH_MAX_LENGTH];  /* compiled blocklist table file */
+   int worker_count;            /* number of capture worker threads */
+   unsigned int flow_capacity;  /* preallocated flow records per worker */
+   unsigned int idle_timeout;   /* flow idle timeout in seconds */
+   unsigned int active_timeout; /* flow active timeout in seconds */
+   unsigned int export_interval; /* flow statistics export interval in seconds */
+   unsigned int send_latency;   /* max server queue latency in milliseconds */
+   unsigned int stats_interval; /* seconds between statistics reports, 0 = none */
+   char stats_file[PV_PATH_MAX_LENGTH];  /* statistics report file */
+   int output_slots;            /* output ring slots, 0 = output on the capture thread, -1 = default */
+   char spool_dir[PV_PATH_MAX_LENGTH];  /* directory for the server spill files */
+   char replay_file[PV_PATH_MAX_LENGTH];  /* pcap file for offline replay */
+   int replay_pacing;           /* replay at the original timestamp pace */
+};
+
+typedef struct pv_capture_config pv_capture_config_t;
+
+struct pv_ring
+{
+   int sockfd;
+   int link_type;
+   unsigned int snaplen;
+   unsigned char *map;
+   size_t map_size;
+   unsigned char **blocks;
+   unsigned int block_size;
+   unsigned int block_count;
+   unsigned int block_timeout;
+   unsigned int current_block;
+   unsigned int occupancy;
+   unsigned int max_occupancy;
+   unsigned long blocks_processed;
+   unsigned long packets_processed;
+   unsigned long kernel_packets;
+   unsigned long kernel_drops;
+   unsigned long freeze_count;
+};
+
+typedef struct pv_ring pv_ring_t;
+
+/*
+   Fixed size binary packet event filled in by the decoder. Text is only
+   rendered from it in the output stage when an event is emitted.
+   Header fields are in host byte order, the flow key is in network order.
+*/
+/* Where the decoder found each layer, offsets are from the start of the captured packet. */
+struct pv_packet_desc
+{
+   uint16_t l3_offset;          /* innermost IP header */
+   uint16_t l4_offset;          /* transport header, 0 if not decoded */
+   uint16_t payload_offset;     /* transport payload, 0 if none captured */
+   uint16_t vlan_id[PV_DECODE_MAX_VLANS];  /* outer tag first */
+   uint32_t payload_length;     /* captured payload bytes */
+   uint8_t  vlan_count;
+   uint8_t  tunnel;             /* outermost tunnel decapsulated, PV_TUNNEL_NONE if none */
+   uint8_t  ip_version;
+   uint8_t  flags;              /* PV_DECODE_FRAGMENT */
+};
+
+typedef struct pv_packet_desc pv_packet_desc_t;
+
+struct pv_packet_event
+{
+   uint32_t ts_sec;             /* capture timestamp */
+   uint32_t ts_usec;
+   pv_flow_key_t key;
+   pv_packet_desc_t desc;
+   uint32_t tcp_seq;
+   uint32_t tcp_ack;
+   uint16_t ip_id;
+   uint16_t ip_length;          /* datagram length */
+   uint16_t ip_header_length;   /* bytes, including IPv6 extension headers */
+   uint16_t tcp_window;
+   uint16_t icmp_ident;
+   uint16_t icmp_sequence;
+   uint8_t  ip_tos;
+   uint8_t  ip_ttl;
+   uint8_t  tcp_flags;
+   uint8_t  tcp_header_length;  /* bytes */
+   uint8_t  icmp_type;
+   uint8_t  icmp_code;
+};
+
+typedef struct pv_packet_event pv_packet_event_t;
+
+/* Layer 2 decoder for a datalink type, see pvdecode.c. */
+typedef int (*pv_link_decoder_t)(pv_packet_event_t *event, u_char *packet, uint32_t caplen);
+
+/* Timer expiry function, returns 1 if the flow record was deleted. */
+typedef int (*pv_timer_func_t)(void *user, pv_flow_record_t *record, uint32_t now);
+
+struct pv_timer_wheel
+{
+   uint32_t current;            /* wheel time in seconds */
+   int started;
+   uint32_t timer_count;
+   unsigned int idle_timeout;
+   unsigned int active_timeout;
+   uint32_t heads[PV_WHEEL_LEVELS][PV_WHEEL_SLOTS];  /* first record index or PV_FLOW_EMPTY */
+   unsigned long expired_idle;
+   unsigned long expired_active;
+   unsigned long expired_closed;
+};
+
+typedef struct pv_timer_wheel pv_timer_wheel_t;
+
+/* ClientHello details for a flow, kept in a per worker array alongside the flow record pool. */
+struct pv_tls_info
+{
+   char sni[PV_TLS_SNI_MAX];
+   char alpn[PV_TLS_ALPN_MAX];  /* first protocol offered */
+   uint8_t ja3[16];             /* MD5 fingerprint */
+   uint16_t version;            /* ClientHello version */
+   uint8_t complete;            /* the whole ClientHello was captured, ja3 is set */
+};
+
+typedef struct pv_tls_info pv_tls_info_t;
+
+struct pv_md5
+{
+   uint32_t state[4];
+   uint64_t length;             /* bytes hashed */
+   uint8_t block[64];
+};
+
+typedef struct pv_md5 pv_md5_t;
+
+/* A completed flow, copied out of the flow table for the output stage. */
+struct pv_flow_export
+{
+   pv_flow_key_t key;
+   uint64_t packet_count;
+   uint64_t data_size;
+   uint64_t first_ts;           /* microseconds */
+   uint64_t last_ts;
+   const char *reason;          /* static string */
+   uint8_t tcp_flags;
+   uint8_t has_tls;             /* a ClientHello was seen, tls is set */
+   pv_tls_info_t tls;
+};
+
+typedef struct pv_flow_export pv_flow_export_t;
+
+struct pv_alert
+{
+   pv_flow_key_t key;           /* the host address is in src_addr, scan alerts have the flow */
+   uint32_t ts_sec;             /* packet that raised the alert */
+   uint32_t ts_usec;
+   uint32_t value;              /* measured value and the alert threshold */
+   uint32_t threshold;
+   uint32_t window;             /* seconds */
+   uint8_t type;                /* PV_ALERT_* */
+   uint8_t direction;           /* blocklist alerts, PV_LPM_SRC or PV_LPM_DST */
+   char list[PV_LPM_NAME_MAX];  /* blocklist alerts, the list name in the table that matched */
+};
+
+typedef struct pv_alert pv_alert_t;
+
+struct pv_output_slot
+{
+   int type;                    /* PV_OUTPUT_PACKET, PV_OUTPUT_FLOW or PV_OUTPUT_ALERT */
+   union
+   {
+      pv_packet_event_t packet;
+      pv_flow_export_t flow;
+      pv_alert_t alert;
+   } data;
+};
+
+typedef struct pv_output_slot pv_output_slot_t;
+
+struct pv_histogram
+{
+   uint64_t count;
+   uint64_t total_ns;
+   uint64_t max_ns;
+   uint64_t buckets[PV_HIST_BUCKETS];  /* log-linear latency buckets, see pvstats.c */
+};
+
+typedef struct pv_histogram pv_histogram_t;
+
+/*
+   Single producer, single consumer ring of preallocated slots. The head is
+   only written by the capture worker and the tail only by the output
+   thread, each on its own cache line with a cached copy of the other index.
+*/
+struct pv_event_ring
+{
+   pv_output_slot_t *slots;
+   uint32_t size;
+   uint32_t mask;
+   int blocking;                /* wait for a free slot instead of dropping, for replay */
+   uint32_t head __attribute__ ((aligned (PV_CACHE_LINE_SIZE)));
+   uint32_t cached_tail;
+   unsigned long queued;
+   unsigned long dropped;
+   uint32_t tail __attribute__ ((aligned (PV_CACHE_LINE_SIZE)));
+   uint32_t cached_head;
+   uint32_t high_water;         /* deepest the ring has been, sampled by the consumer */
+   unsigned long consumed;
+};
+
+typedef struct pv_event_ring pv_event_ring_t;
+
+struct pv_output
+{
+   pv_event_ring_t ring;        /* no slots when output runs on the capture thread */
+   pthread_t thread;
+   int running;
+   volatile int stopping;
+   char *out_buffer;            /* private event file output buffer */
+   size_t out_length;
+   time_t last_flush;
+   uint32_t sample_mask;        /* time the events where (slot & mask) == 0 */
+   int timing;                  /* time the stages of this event */
+   uint64_t stage_mark;
+   pv_histogram_t latency[PV_STAGE_COUNT];
+};
+
+typedef struct pv_output pv_output_t;
+
+struct pv_sketch_cell
+{
+   uint64_t packets;
+   uint64_t bytes;
+};
+
+typedef struct pv_sketch_cell pv_sketch_cell_t;
+
+/* Count-Min sketch, PV_SKETCH_DEPTH rows of PV_SKETCH_WIDTH counters. */
+struct pv_sketch
+{
+   pv_sketch_cell_t *cells;
+};
+
+typedef struct pv_sketch pv_sketch_t;
+
+/* Space-Saving list, the record packet count is the key count. */
+struct pv_topk
+{
+   pv_flow_table_t table;       /* the monitored keys */
+   uint32_t *heap;              /* record indexes, min heap on the packet count */
+   uint32_t *heap_pos;          /* heap position of each record */
+   uint32_t size;
+   unsigned long evictions;
+};
+
+typedef struct pv_topk pv_topk_t;
+
+struct pv_heavy
+{
+   pv_sketch_t sketch[PV_HEAVY_TYPES];
+   pv_topk_t topk[PV_HEAVY_TYPES];
+};
+
+typedef struct pv_heavy pv_heavy_t;
+
+struct pv_heavy_candidate
+{
+   pv_flow_key_t key;
+   uint64_t packets;            /* merged sketch estimates */
+   uint64_t bytes;
+};
+
+typedef struct pv_heavy_candidate pv_heavy_candidate_t;
+
+/* HyperLogLog state of a tracked host, the registers are kept separately. */
+struct pv_hll_host
+{
+   double inverse_sum;          /* sum of 2^-register, kept up to date for the estimate */
+   uint32_t zeros;              /* registers still zero */
+   uint32_t window_start;       /* seconds */
+   uint32_t lru_prev;           /* LRU list, record indexes, most recent first */
+   uint32_t lru_next;
+   uint16_t last_register;      /* cleared without a memset when it is the only one set */
+   uint8_t alerted;             /* alert raised in this window */
+};
+
+typedef struct pv_hll_host pv_hll_host_t;
+
+/* Bounded table of tracked hosts, the least recently seen host is evicted. */
+struct pv_fanout
+{
+   pv_flow_table_t table;       /* host address in the key src_addr */
+   pv_hll_host_t *hosts;        /* state of each record */
+   uint8_t *registers;          /* PV_HLL_REGISTERS per record */
+   uint32_t lru_head;
+   uint32_t lru_tail;
+   uint32_t threshold;          /* distinct count that raises an alert */
+   uint32_t window;             /* seconds */
+   unsigned long evictions;
+   unsigned long alerts;
+};
+
+typedef struct pv_fanout pv_fanout_t;
+
+/* Sliding window state of a tracked source, the port bitmaps are kept separately. */
+struct pv_scan_host
+{
+   uint32_t syns[PV_SCAN_SLOTS];  /* connection attempts in each step */
+   uint32_t slot;               /* current step number, seconds / step length */
+   uint32_t rearm[PV_SCAN_TYPES];  /* step from which an alert can be raised again */
+   uint32_t lru_prev;           /* LRU list, record indexes, most recent first */
+   uint32_t lru_next;
+   uint16_t port_bits;          /* bits set in the union of the port bitmaps */
+   uint8_t used;                /* steps with port bits set */
+};
+
+typedef struct pv_scan_host pv_scan_host_t;
+
+/* Bounded table of tracked sources, the least recently seen source is evicted. */
+struct pv_scan
+{
+   pv_flow_table_t table;       /* source address in the key src_addr */
+   pv_scan_host_t *hosts;       /* state of each record */
+   uint64_t *bitmaps;           /* PV_SCAN_SLOTS port bitmaps per record */
+   uint32_t lru_head;
+   uint32_t lru_tail;
+   uint32_t port_threshold;     /* distinct ports that raise an alert, 0 = off */
+   uint32_t syn_threshold;      /* connection attempts that raise an alert, 0 = off */
+   uint32_t slot_seconds;       /* step length, the window is PV_SCAN_SLOTS steps */
+   unsigned long evictions;
+   unsigned long alerts[PV_SCAN_TYPES];
+   unsigned long suppressed;    /* packet events dropped while a source is in alert */
+};
+
+typedef struct pv_scan pv_scan_t;
+
+struct pv_ngram_model
+{
+   uint64_t *filter;            /* blocked Bloom filter, PV_NGRAM_FILTER_WORDS */
+   uint64_t payloads;           /* payloads trained */
+   uint16_t port;               /* service port */
+};
+
+typedef struct pv_ngram_model pv_ngram_model_t;
+
+/* Service models shared by the capture workers. */
+struct pv_ngram_models
+{
+   int mode;                    /* PV_NGRAM_TRAIN or PV_NGRAM_DETECT, 0 = off */
+   uint32_t threshold;          /* percent */
+   uint32_t count;
+   int full;                    /* a port was not modelled, the table was full */
+   pthread_mutex_t lock;        /* adding a model while training */
+   char file[PV_PATH_MAX_LENGTH];
+   uint8_t index[65536];        /* service port to model number + 1, 0 = no model */
+   pv_ngram_model_t models[PV_NGRAM_MAX_MODELS];
+};
+
+typedef struct pv_ngram_models pv_ngram_models_t;
+
+/* An HTTP request, pointers into the payload. */
+struct pv_http_request
+{
+   const uint8_t *method;
+   const uint8_t *path;         /* without the query, empty for an absolute URL without a path */
+   const uint8_t *host;         /* Host header or absolute URL host, NULL if neither */
+   uint32_t method_length;
+   uint32_t path_length;
+   uint32_t host_length;
+};
+
+typedef struct pv_http_request pv_http_request_t;
+
+/* String counter, the first member of every string map record, the string is in the map arena. */
+struct pv_string_record
+{
+   uint64_t count;              /* URL requests, domain queries */
+   uint64_t exported;           /* rank at the last report */
+   uint32_t first_seen;
+   uint32_t last_seen;
+   uint32_t offset;             /* of the string in the arena */
+   uint32_t hash;
+   uint16_t length;
+};
+
+typedef struct pv_string_record pv_string_record_t;
+
+typedef uint64_t (*pv_string_rank_t)(pv_string_record_t *record);
+
+/* String table shared by the capture workers, see pvstrmap.c. */
+struct pv_string_map
+{
+   uint32_t *slots;             /* open addressing, record number + 1, 0 = empty */
+   char *records;               /* record_size bytes each, starting with a pv_string_record_t */
+   char *arena;                 /* NUL terminated strings */
+   uint32_t record_size;
+   uint32_t arena_used;
+   uint32_t arena_size;
+   uint32_t count;
+   uint32_t capacity;
+   uint32_t mask;
+   pv_string_rank_t rank;       /* select_top_strings() rank, NULL = count */
+   pthread_mutex_t lock;        /* adding a string */
+   unsigned long not_stored;    /* new strings dropped, the table or arena was full */
+};
+
+typedef struct pv_string_map pv_string_map_t;
+
+struct pv_string_top
+{
+   pv_string_record_t *record;
+   uint64_t count;              /* rank in the interval or since capture started */
+};
+
+typedef struct pv_string_top pv_string_top_t;
+
+/* A DNS message, the query name is written to a separate buffer. */
+struct pv_dns_message
+{
+   uint16_t id;
+   uint16_t flags;
+   uint16_t rcode;
+   uint16_t qtype;
+   uint32_t name_length;
+   uint32_t answers;            /* answer records parsed */
+   uint32_t addresses;          /* A and AAAA answers */
+};
+
+typedef struct pv_dns_message pv_dns_message_t;
+
+/* Domain counters in the domain string map, the string count is the queries. */
+struct pv_dns_record
+{
+   pv_string_record_t string;
+   uint64_t responses;
+   uint64_t nxdomain;
+   uint64_t answers;            /* A and AAAA answers */
+   uint16_t qtype;              /* last query type */
+};
+
+typedef struct pv_dns_record pv_dns_record_t;
+
+/* Stream consumer, passed in order data of a TCP flow direction. */
+struct pv_worker;
+typedef void (*pv_stream_func_t)(struct pv_worker *worker, pv_flow_record_t *flow, pv_packet_event_t *event, uint8_t *data, uint32_t len);
+
+struct pv_stream_consumer
+{
+   pv_stream_func_t func;
+   uint32_t min_length;         /* shorter chunks are not passed on */
+};
+
+typedef struct pv_stream_consumer pv_stream_consumer_t;
+
+struct pv_reasm_block
+{
+   uint32_t next;               /* stream list or free list */
+   uint32_t seq;
+   uint32_t length;
+   uint8_t data[PV_REASM_BLOCK_SIZE];
+};
+
+typedef struct pv_reasm_block pv_reasm_block_t;
+
+/* Stream state of a flow record, indexed like the flow record pool. */
+struct pv_reasm_stream
+{
+   uint32_t next_seq;           /* next sequence number to pass on */
+   uint32_t head;               /* held blocks in sequence order */
+   uint32_t blocks;
+   uint32_t delivered;          /* bytes passed on, up to the depth */
+   uint32_t fifo_prev;          /* streams holding blocks, oldest first */
+   uint32_t fifo_next;
+};
+
+typedef struct pv_reasm_stream pv_reasm_stream_t;
+
+struct pv_reasm
+{
+   pv_reasm_block_t *blocks;    /* preallocated pool */
+   uint32_t block_count;
+   uint32_t free_head;
+   uint32_t free_count;
+   pv_reasm_stream_t *streams;
+   uint32_t fifo_head;          /* truncated first when the pool is empty */
+   uint32_t fifo_tail;
+   uint32_t depth;              /* bytes per direction */
+   int consumer_count;
+   pv_stream_consumer_t consumers[PV_REASM_MAX_CONSUMERS];
+   unsigned long streams_started;
+   unsigned long long bytes_delivered;
+   unsigned long out_of_order;  /* segments held */
+   unsigned long duplicates;    /* segments already passed on */
+   unsigned long gaps;          /* holes given up on */
+   unsigned long truncated;     /* streams that lost held data, pool full or flow expired */
+   unsigned long depth_reached;
+};
+
+typedef struct pv_reasm pv_reasm_t;
+
+struct pv_ioc_pattern
+{
+   uint64_t hits;               /* matches by all the workers */
+   uint64_t exported;           /* hits at the last statistics report */
+   uint32_t offset;             /* pattern bytes in the arena */
+   uint32_t length;
+   uint32_t line;               /* line in the pattern file */
+};
+
+typedef struct pv_ioc_pattern pv_ioc_pattern_t;
+
+/* Aho-Corasick automaton state, the trie node for a prefix of the patterns. */
+struct pv_ioc_state
+{
+   uint32_t fail;               /* longest proper suffix that is also a state */
+   uint32_t output;             /* nearest state on the fail chain, this one included, that ends a pattern */
+   uint32_t pattern;            /* pattern ending here or PV_IOC_NONE */
+   uint32_t row;                /* dense transition row or PV_IOC_NONE */
+   uint32_t edges;              /* first sparse edge, sorted by byte */
+   uint16_t edge_count;
+   uint16_t depth;
+};
+
+typedef struct pv_ioc_state pv_ioc_state_t;
+
+/* Built once at startup and shared read only by the capture workers, except the hit counters. */
+struct pv_ioc_matcher
+{
+   pv_ioc_state_t *states;      /* state 0 is the root */
+   uint32_t state_count;
+   uint32_t *rows;              /* 256 next states per dense state, complete transitions */
+   uint32_t row_count;
+   uint8_t *edge_bytes;         /* trie edges of the sparse states */
+   uint32_t *edge_targets;
+   pv_ioc_pattern_t *patterns;
+   uint32_t pattern_count;
+   uint8_t *arena;              /* pattern bytes */
+   uint32_t arena_used;
+};
+
+typedef struct pv_ioc_matcher pv_ioc_matcher_t;
+
+/* Matcher state of a flow record, so a pattern split across segments is found. */
+struct pv_ioc_flow
+{
+   uint32_t state;
+   uint32_t next_seq;           /* TCP sequence number the state continues at */
+   uint32_t last_pattern;       /* last pattern alerted */
+   uint32_t alerts;
+};
+
+typedef struct pv_ioc_flow pv_ioc_flow_t;
+
+struct pv_ioc_top
+{
+   pv_ioc_pattern_t *pattern;
+   uint64_t hits;               /* in the interval or since capture started */
+};
+
+typedef struct pv_ioc_top pv_ioc_top_t;
+
+struct pv_lpm_rule
+{
+   uint8_t addr[16];            /* prefix with the host bits zero, IPv4 in the first 4 bytes */
+   uint8_t family;              /* PV_FLOW_IPV4 or PV_FLOW_IPV6 */
+   uint8_t length;
+   uint16_t list;               /* blocklist the prefix came from */
+};
+
+typedef struct pv_lpm_rule pv_lpm_rule_t;
+
+/* Address range inside a root table entry, the address bits after the root bits. */
+struct pv_lpm_range
+{
+   uint64_t hi;                 /* IPv4 bits 24-31, or IPv6 bits 16-79 */
+   uint64_t lo;                 /* IPv6 bits 80-127 */
+   uint32_t rule;               /* rule + 1 of the longest prefix over the range, 0 = none */
+   uint32_t count;              /* ranges in the bucket, set in the first one */
+};
+
+typedef struct pv_lpm_range pv_lpm_range_t;
+
+/* Ranges inside an IPv4 /24 in one cache line, the unused slots repeat the last range start. */
+struct pv_lpm_line
+{
+   uint32_t rule[PV_LPM_LINE_SLOTS];  /* rule + 1, 0 = none */
+   uint8_t start[PV_LPM_LINE_KEYS];   /* last address byte */
+};
+
+typedef struct pv_lpm_line pv_lpm_line_t;
+
+/* Start of a compiled blocklist table, the arrays follow at the offsets. */
+struct pv_lpm_header
+{
+   char magic[8];               /* PV_LPM_MAGIC */
+   uint64_t size;               /* bytes in the table */
+   uint64_t root4_offset;
+   uint64_t root6_offset;
+   uint64_t rules_offset;
+   uint64_t ranges_offset;
+   uint64_t lines_offset;
+   uint64_t tables_offset;
+   uint32_t rule_count;
+   uint32_t range_count;
+   uint32_t line_count;
+   uint32_t table_count;
+   uint32_t list_count;
+   char lists[PV_LPM_MAX_LISTS][PV_LPM_NAME_MAX];
+};
+
+typedef struct pv_lpm_header pv_lpm_header_t;
+
+struct pv_lpm_table
+{
+   pv_lpm_header_t *header;     /* table buffer or file mapping */
+   uint32_t *root4;             /* rule + 1 for each IPv4 /24, 0 = none, or PV_LPM_BUCKET or PV_LPM_TABLE and an index */
+   uint32_t *root6;             /* the same for each IPv6 /16 */
+   pv_lpm_rule_t *rules;
+   pv_lpm_range_t *ranges;      /* IPv6 buckets of disjoint ranges sorted by address */
+   pv_lpm_line_t *lines;        /* IPv4 buckets */
+   uint32_t *tables;            /* 256 entries for each table, the same as the root entries */
+   void *memory;                /* allocation the header is aligned in, NULL when mapped */
+   uint64_t size;               /* bytes in the table */
+   int mapped;                  /* unmapped instead of freed */
+   struct pv_lpm_table *retired_next;  /* older replaced table */
+   unsigned int retired_generation;    /* blocklist generation that replaced it */
+};
+
+typedef struct pv_lpm_table pv_lpm_table_t;
+
+/* Buckets and tables while a table is compiled, they are copied into the table after the root tables are filled. */
+struct pv_lpm_build
+{
+   pv_lpm_range_t *scratch;     /* ranges under the root entry being compiled */
+   uint32_t scratch_size;
+   pv_lpm_range_t *ranges;
+   uint32_t range_count;
+   uint32_t range_size;
+   pv_lpm_line_t *lines;
+   uint32_t line_count;
+   uint32_t line_size;
+   uint32_t *tables;
+   uint32_t table_count;
+   uint32_t table_size;
+};
+
+typedef struct pv_lpm_build pv_lpm_build_t;
+
+struct pv_blocklist
+{
+   pv_lpm_table_t *table;       /* swapped by a reload, NULL when there is no blocklist */
+   char files[PV_LPM_MAX_LISTS][PV_PATH_MAX_LENGTH];
+   int file_count;
+   char table_file[PV_PATH_MAX_LENGTH];  /* compiled table, saved after a build or mapped when there are no lists */
+   unsigned int generation;     /* incremented when a reload swaps the table, atomic */
+   pv_lpm_table_t *retired;     /* replaced tables, newest first, freed once every worker has seen the swap */
+   unsigned long reloads;
+};
+
+typedef struct pv_blocklist pv_blocklist_t;
+
+struct pv_bpf_filter
+{
+   char filter_file[PV_PATH_MAX_LENGTH];  /* read again by a reload, empty when there is no filter file */
+   char server_address[PV_IP_ADDR_MAX];   /* excluded from capture, empty when not sending to the server */
+   int link_type;               /* of the capture sockets, replaced filters are compiled for it */
+   unsigned int snaplen;
+   struct bpf_program program;  /* replaced filter, set by each worker on its socket */
+   unsigned int generation;     /* incremented when the program is replaced, atomic */
+   pthread_mutex_t lock;        /* protects the pending expression */
+   char *pending;               /* expression sent by the server, PV_FILTER_MAX_LENGTH */
+   int pending_set;             /* atomic, read without the lock */
+   unsigned long replaces;
+   unsigned long failures;      /* replacements that failed and worker sockets that could not set one, atomic */
+};
+
+typedef struct pv_bpf_filter pv_bpf_filter_t;
+
+struct pv_worker
+{
+   int worker_id;
+   int running;
+   pthread_t thread;
+   int link_type;
+   pv_link_decoder_t link_decoder;  /* picked once for the datalink type */
+   pcap_t *pcap_device;
+   pv_ring_t ring;
+   pv_flow_table_t flow_table;  /* private flow table shard */
+   pv_timer_wheel_t wheel;      /* flow timeouts for the shard */
+   unsigned long flows_exported;
+   uint32_t *dirty_flows;       /* flows changed since the last statistics export */
+   uint32_t dirty_count;
+   char *stats_buffer;          /* flow statistics batch for the server */
+   size_t stats_length;
+   unsigned int stats_entries;
+   unsigned int export_interval;
+   uint32_t next_export;        /* next statistics export time in seconds */
+   unsigned long stats_batches;
+   pv_output_t output;          /* event formatting and output stage */
+   unsigned long packet_count;
+   unsigned long short_packets; /* too short to decode */
+   unsigned long unsupported_packets;  /* not IP */
+   unsigned int payload_packets;  /* per flow payload sampling limits, 0 = no limit */
+   unsigned int payload_bytes;
+   unsigned long long payload_kept;  /* payload bytes passed on and trimmed by sampling */
+   unsigned long long payload_trimmed;
+   pv_heavy_t *heavy;           /* heavy hitter tracking, NULL when it is off */
+   pv_fanout_t *fanout;         /* PV_FANOUT_TYPES tables, NULL when fan-out tracking is off */
+   pv_scan_t *scan;             /* port scan and SYN flood detection, NULL when it is off */
+   unsigned long ngram_payloads;  /* payloads trained or scored by n-gram analysis */
+   unsigned long long ngram_bytes;
+   unsigned long ngram_anomalies;
+   unsigned long http_requests; /* HTTP requests counted in the URL map */
+   unsigned long dns_queries;   /* DNS messages counted instead of output as packet events */
+   unsigned long dns_responses;
+   unsigned long dns_nxdomain;
+   unsigned long dns_malformed; /* port 53 payloads that did not parse */
+   pv_tls_info_t *tls;          /* per flow record, NULL when TLS inspection is off */
+   unsigned long tls_hellos;
+   unsigned long tls_truncated; /* ClientHellos without a fingerprint */
+   pv_reasm_t *reasm;           /* TCP stream reassembly, NULL when it is off */
+   pv_ioc_flow_t *ioc;          /* per flow record, NULL when IOC matching is off */
+   unsigned long long ioc_bytes;  /* payload bytes scanned for IOC patterns */
+   unsigned long ioc_matches;
+   unsigned long ioc_alerts;
+   unsigned long blocklist_lookups;  /* new flow addresses looked up */
+   unsigned int blocklist_generation;  /* blocklist swap seen between reads, see pvblocklist.c */
+   unsigned long blocklist_matches;
+   unsigned long kernel_packets;  /* socket counters, sampled every second */
+   unsigned long kernel_drops;
+   time_t next_kernel_stats;
+   volatile int finished;       /* set when the capture thread exits */
+   unsigned int filter_generation;  /* filter program set on the socket, see pvfilter.c */
+   unsigned int filter_failed;  /* filter program the socket could not set */
+   time_t filter_retry;         /* next attempt to set it */
+   uint32_t sample_mask;        /* time the packets where (count & mask) == 0 */
+   int timing;                  /* time the stages of this packet */
+   uint64_t stage_mark;
+   pv_histogram_t latency[PV_STAGE_COUNT];
+};
+
+typedef struct pv_worker pv_worker_t;
+
+struct pv_spool
+{
+   pthread_t thread;
+   pthread_mutex_t lock;
+   pthread_cond_t ready;        /* signalled when events are queued or on shutdown */
+   int started;
+   int closing;
+   int sockfd;                  /* -1 when not connected */
+   char server_address[PV_IP_ADDR_MAX];
+   unsigned int backoff;        /* seconds until the next reconnect attempt */
+   char *queue;                 /* in memory queue, a byte ring */
+   size_t head;
+   size_t tail;
+   size_t used;
+   uint64_t first_queued;       /* time the oldest queued byte was added, ns */
+   uint64_t max_latency;        /* ns */
+   int spilling;                /* events go to the spill files until they are replayed */
+   char spool_dir[PV_PATH_MAX_LENGTH];
+   FILE *spill_out;
+   FILE *spill_in;
+   unsigned int write_seq;      /* segment being appended */
+   unsigned int read_seq;       /* segment being replayed */
+   uint64_t segment_bytes;      /* bytes in the segment being appended */
+   uint64_t spill_bytes;        /* spilled bytes not yet replayed */
+   char *read_buffer;
+   unsigned long events_queued;
+   unsigned long events_spilled;
+   unsigned long events_dropped;
+   unsigned long flushes;
+   unsigned long size_flushes;
+   unsigned long latency_flushes;
+   unsigned long replay_flushes;
+   unsigned long writes;
+   unsigned long short_writes;
+   unsigned long send_errors;
+   unsigned long connects;
+   unsigned long connect_failures;
+   size_t max_flush_bytes;
+   uint64_t bytes_sent;
+   uint64_t bytes_spilled;
+   uint64_t bytes_replayed;
+   uint64_t bytes_lost;         /* unsent part of a message cut off by a write error, see pvspool.c */
+   pv_histogram_t write_latency;  /* server write times */
+   char *control;               /* partial control message from the server */
+   size_t control_length;
+};
+
+typedef struct pv_spool pv_spool_t;
+
+struct pv_stats
+{
+   FILE *stats_file;
+   unsigned int interval;       /* seconds between reports, 0 = none */
+   time_t last_report;
+   pv_histogram_t previous[PV_STAGE_COUNT + 1];  /* totals at the last report, server writes last */
+   pv_histogram_t current[PV_STAGE_COUNT + 1];
+   unsigned long *worker_counts;  /* per worker totals at the last report, PV_STATS_COUNTERS each */
+   unsigned long spool_events;  /* spool totals at the last report */
+   unsigned long spool_spilled;
+   unsigned long spool_dropped;
+   unsigned long spool_errors;
+   uint64_t spool_bytes;
+   uint64_t spool_lost;
+   unsigned long reports;
+   unsigned int heavy_topk;     /* heavy hitters reported, 0 when heavy hitter tracking is off */
+   pv_sketch_t heavy_current[PV_HEAVY_TYPES];   /* merged worker sketches */
+   pv_sketch_t heavy_previous[PV_HEAVY_TYPES];  /* merged sketches at the last report */
+   unsigned int url_topk;       /* URLs reported, 0 when HTTP request parsing is off */
+   pv_string_top_t *url_top;
+   unsigned int dns_topk;       /* domains reported, 0 when DNS parsing is off */
+   pv_string_top_t *dns_top;
+   unsigned long dns_counts[PV_DNS_COUNTERS];  /* worker DNS totals at the last report */
+   unsigned int ioc_topk;       /* patterns reported, 0 when IOC matching is off */
+   pv_ioc_top_t *ioc_top;
+};
+
+typedef struct pv_stats pv_stats_t;
+
+extern volatile sig_atomic_t capture_running;
+extern uint64_t sketch_seeds[PV_SKETCH_DEPTH];
+extern pv_ngram_models_t ngram_models;
+extern uint64_t ngram_masks[PV_NGRAM_MASKS];
+extern pv_string_map_t url_table;
+extern pv_string_map_t dns_table;
+extern pv_ioc_matcher_t ioc_matcher;
+extern pv_blocklist_t blocklist;
+extern pv_bpf_filter_t bpf_filter;
+extern volatile sig_atomic_t reload_requested;
 
 /* pivot-sensor.c */
 
-int parse_command_line_args(int argc, char *argv[], char *capture_device, char *pv_event_filename, char *server_ip_address, char *filter_file);
+int parse_command_line_args(int argc, char *argv[], char *capture_device, char *pv_event_filename, char *server_ip_address, char *filter_file, pv_capture_config_t *capture_config);
 int show_sensor_help();
 
 /* pvsniffer.c */
 
-pcap_t* open_pcap_socket(char* device, const char* bpfstr);
-void start_capture_loop(int packets, pcap_handler func);
+pcap_t* open_pcap_socket(char* device, const char* bpfstr, pv_capture_config_t *config);
 void process_packet(u_char *user, struct pcap_pkthdr *packethdr, u_char *packetptr);
+void sample_flow_payload(pv_worker_t *worker, pv_flow_record_t *flow, pv_packet_event_t *event);
+void interrupt_capture(int signal_number);
+void request_reload(int signal_number);
+void reload_sensor();
 void terminate_capture(int signal_number);
-int start_capture(char *interface, const char *bpf_string, char *event_file, char *server_address, int mode);
+int send_server_event(char *event_string);
+int start_capture(char *interface, const char *bpf_string, char *event_file, char *server_address, int mode, pv_capture_config_t *config);
+
+/* pvdecode.c */
+
+pv_link_decoder_t get_link_decoder(int link_type);
+const char *get_tunnel_name(uint8_t tunnel);
+int decode_packet(pv_link_decoder_t decoder, pv_packet_event_t *event, struct pcap_pkthdr *packethdr, u_char *packetptr);
+int decode_ethernet(pv_packet_event_t *event, u_char *packet, uint32_t caplen);
+int decode_ethernet_frame(pv_packet_event_t *event, u_char *packet, uint32_t caplen, uint32_t offset, int depth);
+int decode_ethertype(pv_packet_event_t *event, u_char *packet, uint32_t caplen, uint32_t offset, uint16_t ethertype, int depth);
+int decode_ip_version(pv_packet_event_t *event, u_char *packet, uint32_t caplen, uint32_t offset);
+int decode_linux_sll(pv_packet_event_t *event, u_char *packet, uint32_t caplen);
+int decode_linux_sll2(pv_packet_event_t *event, u_char *packet, uint32_t caplen);
+int decode_loopback_family(pv_packet_event_t *event, u_char *packet, uint32_t caplen, uint32_t family);
+int decode_null(pv_packet_event_t *event, u_char *packet, uint32_t caplen);
+int decode_loop(pv_packet_event_t *event, u_char *packet, uint32_t caplen);
+int decode_raw(pv_packet_event_t *event, u_char *packet, uint32_t caplen);
+int decode_ppp(pv_packet_event_t *event, u_char *packet, uint32_t caplen);
+int decode_slip(pv_packet_event_t *event, u_char *packet, uint32_t caplen);
+void reset_network_layer(pv_packet_event_t *event, uint32_t offset, uint8_t version);
+int decode_ipv4(pv_packet_event_t *event, u_char *packet, uint32_t caplen, uint32_t offset, int depth);
+int decode_ipv6(pv_packet_event_t *event, u_char *packet, uint32_t caplen, uint32_t offset, int depth);
+int decode_tunnel(pv_packet_event_t *event, u_char *packet, uint32_t end, uint32_t offset, uint16_t ethertype, uint8_t tunnel, int depth);
+int decode_gre(pv_packet_event_t *event, u_char *packet, uint32_t end, uint32_t offset, int depth);
+int decode_transport(pv_packet_event_t *event, u_char *packet, uint32_t end, uint32_t offset, uint8_t protocol, int depth);
+
+/* pvring.c */
+
+int open_ring_socket(pv_ring_t *ring, char *device, const char *bpfstr, pv_capture_config_t *config);
+int get_ring_link_type(int sockfd, char *device);
+int set_ring_filter(pv_ring_t *ring, const char *bpfstr);
+int attach_ring_filter(pv_ring_t *ring, struct bpf_program *program);
+unsigned int get_ring_occupancy(pv_ring_t *ring);
+int ring_dispatch(pv_ring_t *ring, pcap_handler func, u_char *user);
+int join_fanout_group(int sockfd, int fanout_id);
+int update_ring_stats(pv_ring_t *ring);
+void print_ring_stats(pv_ring_t *ring);
+void close_ring_socket(pv_ring_t *ring);
+
+/* pvworker.c */
+
+int open_worker_socket(pv_worker_t *worker, char *interface, const char *bpf_string, pv_capture_config_t *config, int fanout_id);
+void *capture_worker(void *arg);
+void init_worker_state(pv_worker_t *worker, pv_capture_config_t *config, int count);
+int start_workers(char *interface, const char *bpf_string, pv_capture_config_t *config);
+void wait_for_workers();
+void delete_workers();
+int count_running_workers();
+void close_workers();
+void free_worker_state(pv_worker_t *worker);
+
+/* pvreplay.c */
+
+pcap_t *open_replay_file(char *pcap_file, const char *bpf_string);
+void pace_replay(struct timeval *ts, uint64_t first_ts, uint64_t start_time);
+void print_replay_stats(pv_worker_t *worker, unsigned long packets, unsigned long long bytes, unsigned long long captured, uint64_t elapsed);
+int start_replay(const char *bpf_string, pv_capture_config_t *config);
+
+/* pvevent.c */
+
+int format_packet_event(pv_packet_event_t *event, char *out, int len);
+void output_packet_event(pv_output_t *output, pv_packet_event_t *event);
+void output_flow_export(pv_output_t *output, pv_flow_export_t *flow);
+int format_alert(pv_alert_t *alert, char *out, int len);
+void output_alert(pv_output_t *output, pv_alert_t *alert);
+
+/* pvoutput.c */
+
+int init_output(pv_output_t *output, int slots, uint32_t sample_mask);
+void free_output(pv_output_t *output);
+pv_output_slot_t *reserve_output_slot(pv_event_ring_t *ring);
+void commit_output_slot(pv_event_ring_t *ring);
+void flush_output(pv_output_t *output);
+void buffer_output_event(pv_output_t *output, char *event_string);
+void queue_packet_event(pv_worker_t *worker, pv_packet_event_t *event);
+void queue_flow_export(pv_worker_t *worker, pv_flow_record_t *record, const char *reason);
+void queue_alert(pv_worker_t *worker, pv_alert_t *alert);
+void *output_worker(void *arg);
+int start_output(pv_output_t *output);
+void stop_output(pv_output_t *output);
+void print_output_stats(int worker_id, pv_output_t *output);
+
+/* pvflowtimer.c */
+
+void init_timer_wheel(pv_timer_wheel_t *wheel, unsigned int idle_timeout, unsigned int active_timeout);
+void cancel_flow_timer(pv_timer_wheel_t *wheel, pv_flow_table_t *table, pv_flow_record_t *record);
+void schedule_flow_timer(pv_timer_wheel_t *wheel, pv_flow_table_t *table, pv_flow_record_t *record, uint32_t expire);
+int advance_timer_wheel(pv_timer_wheel_t *wheel, pv_flow_table_t *table, uint32_t now, pv_timer_func_t func, void *user);
+uint32_t get_flow_deadline(pv_timer_wheel_t *wheel, pv_flow_record_t *record);
+void start_flow_timer(pv_worker_t *worker, pv_flow_record_t *record);
+void close_flow(pv_worker_t *worker, pv_flow_record_t *record);
+void close_reverse_flow(pv_worker_t *worker, pv_flow_key_t *key);
+void export_flow_record(pv_worker_t *worker, pv_flow_record_t *record, const char *reason);
+int expire_flow(void *user, pv_flow_record_t *record, uint32_t now);
+int update_flow_timers(pv_worker_t *worker, uint32_t now);
+
+/* pvspool.c */
+
+int init_spool(pv_spool_t *spool, char *server_address, pv_capture_config_t *config);
+int spool_event(pv_spool_t *spool, char *data, size_t len);
+void read_spool_control(pv_spool_t *spool);
+void run_server_control(char *message);
+void *spool_sender(void *arg);
+void close_spool(pv_spool_t *spool);
+void print_spool_stats(pv_spool_t *spool);
+
+/* pvstats.c */
+
+void record_latency(pv_histogram_t *hist, uint64_t ns);
+uint64_t get_bucket_value(int bucket);
+uint64_t get_percentile(pv_histogram_t *hist, unsigned int permille);
+void add_histogram(pv_histogram_t *dst, pv_histogram_t *src);
+int append_report(char *out, int len, int n, char *format, ...);
+int format_latency_line(char *out, int len, int n, char *name, pv_histogram_t *hist);
+void update_capture_stats(pv_worker_t *worker);
+int init_stats(pv_stats_t *stats, pv_capture_config_t *config);
+void write_stats_report(pv_stats_t *stats, time_t now);
+void write_heavy_report(pv_stats_t *stats, time_t now);
+void write_url_report(pv_stats_t *stats, time_t now);
+void write_dns_report(pv_stats_t *stats, time_t now);
+void write_ioc_report(pv_stats_t *stats, time_t now);
+void send_control_report(char *type, char *report, time_t now);
+void monitor_workers(pv_stats_t *stats);
+void close_stats(pv_stats_t *stats);
+
+/* pvheavy.c */
+
+void init_sketch_seeds();
+int init_sketch(pv_sketch_t *sketch);
+void free_sketch(pv_sketch_t *sketch);
+void update_sketch(pv_sketch_t *sketch, uint32_t hash, uint32_t bytes);
+void estimate_sketch(pv_sketch_t *sketch, pv_sketch_t *previous, uint32_t hash, uint64_t *packets, uint64_t *bytes);
+int init_topk(pv_topk_t *topk, unsigned int k);
+void free_topk(pv_topk_t *topk);
+void swap_topk(pv_topk_t *topk, uint32_t a, uint32_t b);
+void sift_topk(pv_topk_t *topk, uint32_t pos);
+void update_topk(pv_topk_t *topk, pv_flow_key_t *key, uint32_t hash, uint32_t bytes);
+int init_heavy_hitters(pv_heavy_t *heavy, unsigned int k);
+void free_heavy_hitters(pv_heavy_t *heavy);
+void update_heavy_hitters(pv_heavy_t *heavy, pv_flow_key_t *flow_key, uint32_t bytes);
+void merge_heavy_sketches(pv_sketch_t *merged, int type);
+int compare_heavy_candidates(const void *a, const void *b);
+int format_heavy_key(pv_flow_key_t *key, int type, char *out, int len);
+int format_heavy_hitters(pv_sketch_t *current, pv_sketch_t *previous, unsigned int k, char *out, int len);
+void print_heavy_hitters(pv_sketch_t *merged, unsigned int k);
+
+/* pvfanout.c */
+
+int init_fanout(pv_fanout_t *fanout, unsigned int hosts, unsigned int threshold, unsigned int window);
+void free_fanout(pv_fanout_t *fanout);
+uint64_t hash_fanout_element(uint8_t *addr, uint16_t port);
+void clear_hll(pv_fanout_t *fanout, uint32_t index, uint32_t now);
+uint32_t estimate_hll(pv_hll_host_t *host);
+void unlink_fanout_host(pv_fanout_t *fanout, uint32_t index);
+void push_fanout_host(pv_fanout_t *fanout, uint32_t index);
+uint32_t count_distinct(pv_fanout_t *fanout, pv_flow_key_t *host, uint32_t hash, uint64_t element, uint32_t now);
+void raise_fanout_alert(pv_worker_t *worker, uint8_t type, pv_flow_key_t *host, uint32_t estimate, pv_fanout_t *fanout, pv_packet_event_t *event);
+void update_fanout(pv_worker_t *worker, pv_packet_event_t *event);
+void print_fanout_stats(int worker_id, pv_fanout_t *fanout);
+
+/* pvscan.c */
+
+int init_scan(pv_scan_t *scan, unsigned int hosts, unsigned int port_threshold, unsigned int syn_threshold, unsigned int window);
+void free_scan(pv_scan_t *scan);
+void unlink_scan_host(pv_scan_t *scan, uint32_t index);
+void push_scan_host(pv_scan_t *scan, uint32_t index);
+void slide_scan_window(pv_scan_t *scan, uint32_t index, uint32_t slot);
+uint32_t find_scan_host(pv_scan_t *scan, pv_flow_key_t *key, uint32_t hash, uint32_t slot);
+uint32_t estimate_scan_ports(uint32_t bits);
+void raise_scan_alert(pv_worker_t *worker, uint8_t type, uint32_t value, uint32_t threshold, pv_packet_event_t *event);
+int update_scan(pv_worker_t *worker, pv_packet_event_t *event);
+void print_scan_stats(int worker_id, pv_scan_t *scan);
+
+/* pvngram.c */
+
+void init_ngram_masks();
+int init_ngram_models(pv_ngram_models_t *models, pv_capture_config_t *config);
+uint8_t add_ngram_model(pv_ngram_models_t *models, uint16_t port);
+void train_ngrams(pv_ngram_model_t *model, uint8_t *payload, uint32_t len);
+uint32_t score_ngrams(pv_ngram_model_t *model, uint8_t *payload, uint32_t len);
+void update_ngrams(pv_worker_t *worker, pv_flow_record_t *flow, pv_packet_event_t *event, uint8_t *payload, uint32_t len);
+int load_ngram_models(pv_ngram_models_t *models, char *file_name);
+int save_ngram_models(pv_ngram_models_t *models, char *file_name);
+void close_ngram_models(pv_ngram_models_t *models);
+void print_ngram_stats(int worker_id, pv_worker_t *worker);
+
+/* pvflowstats.c */
+
+void init_flow_stats(pv_worker_t *worker, pv_capture_config_t *config);
+void free_flow_stats(pv_worker_t *worker);
+void send_flow_stats(pv_worker_t *worker);
+void append_flow_delta(pv_worker_t *worker, pv_flow_record_t *record);
+void export_flow_deltas(pv_worker_t *worker);
+void mark_flow_dirty(pv_worker_t *worker, pv_flow_record_t *record);
+void update_flow_exports(pv_worker_t *worker, uint32_t now);
 
 /* pvfilter.c */
 
-int load_bpf_filters(char *filter_filename, char *filter_string);
+int load_bpf_filters(char *filter_filename, char *filter_string, int max_length);
+void print_filter_error(char *filter_filename, int line_number, char *rule, char *error);
+int init_bpf_filter(char *filter_file, char *server_address, int mode, pv_capture_config_t *config, char *filter_string);
+int get_bpf_filter(char *expression, char *filter_string);
+int compile_bpf_filter(char *filter_string, struct bpf_program *program);
+int replace_bpf_filter(char *expression);
+int wait_for_filter_update();
+void set_worker_filter(pv_worker_t *worker);
+void queue_bpf_filter(char *expression);
+void delete_bpf_filter();
+
+/* pvstrmap.c */
+
+int init_string_map(pv_string_map_t *map, uint32_t capacity, uint32_t arena_size, uint32_t record_size, pv_string_rank_t rank);
+uint32_t hash_string(char *string, uint32_t length);
+pv_string_record_t *probe_string(pv_string_map_t *map, char *string, uint32_t length, uint32_t hash, uint32_t *slot);
+pv_string_record_t *find_string(pv_string_map_t *map, char *string, uint32_t length);
+pv_string_record_t *add_string(pv_string_map_t *map, char *string, uint32_t length, uint32_t now);
+char *get_map_string(pv_string_map_t *map, pv_string_record_t *record);
+int select_top_strings(pv_string_map_t *map, pv_string_top_t *top, unsigned int k, int interval);
+void delete_string_map(pv_string_map_t *map);
 
 /* pvurlmap.c */
 
-void add_url(pv_url_record_t *flurl);
-pv_url_record_t *find_url(char *lookup_string);
-void write_url_map(FILE *outfile);
-void send_url_map(int sock_desc);
-void delete_url(pv_url_record_t *url_record);
+int init_url_map(uint32_t capacity, uint32_t arena_size);
+pv_string_record_t *add_url(char *url, uint32_t length, uint32_t now);
+int format_url_map(pv_string_top_t *top, int count, char *out, int len);
+void write_url_map(FILE *outfile, pv_string_top_t *top, int count);
+void send_url_map(pv_string_top_t *top, int count, time_t now);
+void print_url_map(unsigned int k);
 void delete_all_urls();
-pv_url_record_t *get_first_url_record();
-pv_url_record_t *get_last_url_record();
+
+/* pvhttp.c */
+
+int parse_http_request(const uint8_t *data, uint32_t len, pv_http_request_t *request);
+void update_http(pv_worker_t *worker, pv_flow_record_t *flow, pv_packet_event_t *event, uint8_t *payload, uint32_t len);
+
+/* pvdns.c */
+
+int init_dns_table(uint32_t capacity, uint32_t arena_size);
+uint32_t read_dns_name(const uint8_t *msg, uint32_t len, uint32_t offset, char *name, uint32_t *name_length);
+int parse_dns_message(const uint8_t *data, uint32_t len, int tcp, pv_dns_message_t *message, char *name);
+uint64_t rank_domain(pv_string_record_t *record);
+int update_dns(pv_worker_t *worker, pv_packet_event_t *event, uint8_t *payload);
+char *get_dns_type_name(uint16_t qtype);
+int format_dns_summary(unsigned long *counts, pv_string_top_t *top, int count, char *out, int len);
+void sum_dns_counts(unsigned long *counts);
+void print_dns_summary(unsigned int k);
+void delete_dns_table();
+
+/* pvtls.c */
+
+void md5_transform(uint32_t *state, const uint8_t *block);
+void md5_init(pv_md5_t *md5);
+void md5_update(pv_md5_t *md5, const uint8_t *data, uint32_t len);
+void md5_final(pv_md5_t *md5, uint8_t *digest);
+void hash_ja3_list(pv_md5_t *md5, const uint8_t *list, uint32_t count, int width);
+void copy_tls_string(char *out, uint32_t size, const uint8_t *name, uint32_t len, int host);
+int parse_client_hello(const uint8_t *data, uint32_t len, pv_tls_info_t *tls);
+void inspect_tls(pv_worker_t *worker, pv_flow_record_t *flow, uint8_t *payload, uint32_t len);
+int format_tls_info(pv_tls_info_t *tls, char *out, int len);
+void print_tls_stats(int worker_id, pv_worker_t *worker);
+
+/* pvreasm.c */
+
+int init_reasm(pv_reasm_t *reasm, uint32_t flow_capacity, uint64_t memory, uint32_t depth);
+int add_stream_consumer(pv_reasm_t *reasm, pv_stream_func_t func, uint32_t min_length);
+void init_stream_consumers(pv_reasm_t *reasm);
+void unlink_stream(pv_reasm_t *reasm, uint32_t index);
+void push_stream(pv_reasm_t *reasm, uint32_t index);
+void free_stream_blocks(pv_reasm_t *reasm, uint32_t index);
+uint32_t alloc_reasm_block(pv_worker_t *worker, uint32_t index);
+void deliver_stream(pv_worker_t *worker, pv_flow_record_t *flow, pv_packet_event_t *event, uint8_t *data, uint32_t len);
+void drain_stream(pv_worker_t *worker, pv_flow_record_t *flow, pv_packet_event_t *event, int skip_gaps);
+void hold_segment(pv_worker_t *worker, pv_flow_record_t *flow, pv_packet_event_t *event, uint32_t seq, uint8_t *data, uint32_t len);
+void reassemble_tcp(pv_worker_t *worker, pv_flow_record_t *flow, pv_packet_event_t *event, uint8_t *payload);
+void end_stream(pv_worker_t *worker, pv_flow_record_t *flow);
+void free_reasm(pv_reasm_t *reasm);
+void print_reasm_stats(int worker_id, pv_reasm_t *reasm);
+
+/* pvioc.c */
+
+int parse_ioc_pattern(char *text, uint8_t *pattern);
+uint32_t add_ioc_state(pv_ioc_matcher_t *matcher, uint32_t *child, uint32_t *sibling, uint8_t *byte, uint32_t parent, uint8_t c);
+int insert_ioc_pattern(pv_ioc_matcher_t *matcher, uint32_t *child, uint32_t *sibling, uint8_t *byte, uint32_t id);
+uint32_t next_ioc_state(pv_ioc_matcher_t *matcher, uint32_t s, uint8_t c);
+void build_ioc_matcher(pv_ioc_matcher_t *matcher, uint32_t *child, uint32_t *sibling, uint8_t *byte);
+int load_ioc_patterns(pv_ioc_matcher_t *matcher, char *file_name);
+void report_ioc_matches(pv_worker_t *worker, pv_ioc_flow_t *ioc, pv_packet_event_t *event, uint32_t s);
+uint32_t scan_iocs(pv_worker_t *worker, pv_ioc_flow_t *ioc, pv_packet_event_t *event, uint32_t s, uint8_t *data, uint32_t len);
+void update_iocs(pv_worker_t *worker, pv_flow_record_t *flow, pv_packet_event_t *event, uint8_t *payload, uint32_t len);
+int format_ioc_pattern(uint32_t id, char *out, int len);
+int select_top_iocs(pv_ioc_top_t *top, unsigned int k, int interval);
+int format_ioc_hits(pv_ioc_top_t *top, int count, char *out, int len);
+void print_ioc_hits(unsigned int k);
+void print_ioc_stats(int worker_id, pv_worker_t *worker);
+void free_ioc_matcher(pv_ioc_matcher_t *matcher);
+
+/* pvblocklist.c */
+
+int parse_prefix(char *text, pv_lpm_rule_t *rule);
+int read_blocklist(char *file_name, uint16_t list, pv_lpm_rule_t **rules, uint32_t *count, uint32_t *capacity);
+int compare_prefixes(const void *a, const void *b);
+void mask_prefix(uint8_t *out, const uint8_t *addr, int bytes, int length);
+void get_range_key(uint8_t family, const uint8_t *addr, pv_lpm_range_t *key);
+int next_range_key(uint8_t family, pv_lpm_range_t *key);
+void set_range_byte(uint8_t family, pv_lpm_range_t *key, int byte, uint8_t value);
+void add_lpm_range(pv_lpm_range_t *ranges, uint32_t *count, pv_lpm_range_t *key, uint32_t rule);
+uint32_t build_lpm_ranges(pv_lpm_build_t *build, pv_lpm_rule_t *rules, uint32_t first, uint32_t last, uint32_t rule);
+uint32_t place_lpm_ranges(pv_lpm_build_t *build, uint8_t family, pv_lpm_range_t *ranges, uint32_t count, pv_lpm_range_t *base, int byte);
+int set_lpm_pointers(pv_lpm_table_t *table, uint64_t size);
+int check_lpm_entry(pv_lpm_table_t *table, uint8_t *visited, uint8_t family, uint32_t entry, int byte);
+int check_lpm_table(pv_lpm_table_t *table);
+pv_lpm_table_t *build_lpm_table(char files[][PV_PATH_MAX_LENGTH], int file_count);
+int save_lpm_table(pv_lpm_table_t *table, char *file_name);
+pv_lpm_table_t *map_lpm_table(char *file_name);
+void free_lpm_table(pv_lpm_table_t *table);
+pv_lpm_rule_t *lookup_prefix(pv_lpm_table_t *table, uint8_t family, const uint8_t *addr);
+void check_blocklist(pv_worker_t *worker, pv_packet_event_t *event);
+pv_lpm_table_t *load_blocklist();
+int init_blocklist(pv_capture_config_t *config);
+void reload_blocklist();
+int is_blocklist_unused(unsigned int generation);
+void free_retired_blocklist();
+void print_blocklist_stats(int worker_id, pv_worker_t *worker);
+void delete_blocklist();
 
 /* pvtail.c */
 
@@ -0,0 +1,1134 @@
+/*  Copyright 2014 Derek Chadwick
+
+    This file is part of the Pivotal Network Security Tools.
+
+    Pivotal is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Pivotal is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Pivotal.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+   pvblocklist.c
+
+   Title : Pivotal NST Sensor IP Blocklist
+   Author: Derek Chadwick
+   Date  : 17/10/2026
+
+   Purpose: Looks the source and destination addresses of each new flow
+            up in a table of IPv4 and IPv6 CIDR prefixes and raises an
+            alert for the longest matching prefix.
+
+            Blocklist files (-z option, up to PV_LPM_MAX_LISTS) are plain
+            text with one address or prefix on each line, the rest of the
+            line after a space, # or ; is a comment, so the usual DROP and
+            FireHOL list formats load as they are.
+
+            Example:
+
+            # Known C2 networks
+            203.0.113.0/24 ; SBL123456
+            198.51.100.7
+            2001:db8:bad::/48
+
+            The lists are compiled into a DIR-24-8 style table. Prefixes up
+            to /24 are expanded into a root table with an entry for every
+            IPv4 /24, and IPv6 prefixes up to /16 into a root table for
+            every /16, so most lookups are one memory access. The longer
+            prefixes, which are mostly single addresses, do not always get
+            second level tables, a million host addresses would take a 1 KB
+            table each. Instead the address space under a root entry with
+            longer prefixes inside it is cut into disjoint ranges, each
+            labelled with the longest prefix over it. Up to 12 ranges of an
+            IPv4 /24 are packed into one cache line that is searched without
+            branches, so a lookup is at most two cache misses like DIR-24-8,
+            and a million scattered hosts take 64 MB of lines. IPv6 ranges
+            keep their full 112 bit start, up to 8 in a bucket. More ranges
+            than a bucket holds are split by a 256 entry table for the next
+            address byte, which is a DIR-24-8 second level table for a busy
+            IPv4 /24, and the parts are placed the same way.
+
+            The compiled table is one block of memory with offsets instead
+            of pointers. With -Z it is saved to a file after the lists are
+            compiled, and a sensor started with -Z and no lists maps that
+            file and starts without parsing anything. The file is in the
+            byte order of the machine that compiled it.
+
+            SIGHUP reloads the lists, or maps the table file again, on the
+            main thread. The new table is swapped in with one atomic store
+            while the workers keep capturing, and the blocklist generation
+            is incremented. A lookup reads the table pointer once, and a
+            worker holds no table between reads, where it acknowledges the
+            generation, the same way it sets a replaced capture filter. The
+            main thread loop frees the old tables once every running worker
+            has acknowledged a generation after them, so reloads in quick
+            succession do not wait for each other. In replay the lookups
+            run on the thread doing the reload, so the old table is freed at
+            once. A reload that fails leaves the old table in use.
+
+   Status : EXPERIMENTAL - not for use in production networks.
+
+*/
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "pvcommon.h"
+#include "pivot-sensor.h"
+
+pv_blocklist_t blocklist;
+
+extern pv_worker_t *workers;
+extern int worker_count;
+
+/*
+   Function: parse_prefix
+   Purpose : Converts an address or address/length to a prefix rule, the
+             host bits are cleared.
+   Input   : Text, rule to fill in.
+   Output  : Returns 0, or -1 if the text is not a valid prefix.
+*/
+int parse_prefix(char *text, pv_lpm_rule_t *rule)
+{
+   char *slash = strchr(text, '/');
+   char *end;
+   uint8_t addr[16];
+   long length;
+   int max;
+
+   memset(rule, 0, sizeof(pv_lpm_rule_t));
+   if (slash != NULL)
+   {
+      *slash = 0;
+   }
+   if (inet_pton(AF_INET, text, addr) == 1)
+   {
+      rule->family = PV_FLOW_IPV4;
+      max = 32;
+   }
+   else if (inet_pton(AF_INET6, text, addr) == 1)
+   {
+      rule->family = PV_FLOW_IPV6;
+      max = 128;
+   }
+   else
+   {
+      return(-1);
+   }
+
+   length = max;
+   if (slash != NULL)
+   {
+      length = strtol(slash + 1, &end, 10);
+      if ((end == slash + 1) || (*end != 0) || (length < 0) || (length > max))
+      {
+         return(-1);
+      }
+   }
+   rule->length = (uint8_t)length;
+   mask_prefix(rule->addr, addr, max / 8, rule->length);
+
+   return(0);
+}
+
+/*
+   Function: read_blocklist
+   Purpose : Adds the prefixes in a blocklist file to a growing rule array.
+   Input   : File name, list number, rule array, rule count and capacity.
+   Output  : Number of invalid lines, or -1 if the file could not be read.
+*/
+int read_blocklist(char *file_name, uint16_t list, pv_lpm_rule_t **rules, uint32_t *count, uint32_t *capacity)
+{
+   char instr[PV_MAX_INPUT_STR];
+   char *p;
+   FILE *list_file;
+   int line = 0, invalid = 0;
+
+   if ((list_file = fopen(file_name, "r")) == NULL)
+   {
+      sprint_log_entry("read_blocklist() <ERROR> Could not open blocklist file", file_name);
+      return(-1);
+   }
+
+   while (fgets(instr, PV_MAX_INPUT_STR, list_file) != NULL)
+   {
+      line++;
+      p = instr + strspn(instr, " \t");
+      p[strcspn(p, " \t\r\n#;")] = 0;
+      if (*p == 0)
+      {
+         continue;
+      }
+      if (*count == *capacity)
+      {
+         *capacity = (*capacity == 0) ? 65536 : *capacity * 2;
+         *rules = xrealloc(*rules, *capacity * sizeof(pv_lpm_rule_t));
+      }
+      if (parse_prefix(p, &(*rules)[*count]) < 0)
+      {
+         iprint_log_entry("read_blocklist() <WARNING> Invalid address or prefix on line", line);
+         invalid++;
+         continue;
+      }
+      (*rules)[*count].list = list;
+      (*count)++;
+   }
+   fclose(list_file);
+
+   return(invalid);
+}
+
+/*
+   Function: compare_prefixes
+   Purpose : qsort() order of the rules: family, address, then shortest
+             prefix first, so a prefix comes after every prefix it is inside
+             and the longer prefixes under a root entry are together.
+*/
+int compare_prefixes(const void *a, const void *b)
+{
+   const pv_lpm_rule_t *x = a;
+   const pv_lpm_rule_t *y = b;
+   int res;
+
+   if (x->family != y->family)
+   {
+      return(x->family - y->family);
+   }
+   if ((res = memcmp(x->addr, y->addr, 16)) != 0)
+   {
+      return(res);
+   }
+   if (x->length != y->length)
+   {
+      return(x->length - y->length);
+   }
+
+   return(x->list - y->list);
+}
+
+/*
+   Function: mask_prefix
+   Purpose : Copies the first length bits of an address, the rest of the
+             address bytes are zero.
+   Input   : Output address, address, address bytes, prefix length.
+   Output  : None.
+*/
+void mask_prefix(uint8_t *out, const uint8_t *addr, int bytes, int length)
+{
+   int i;
+
+   for (i = 0; i < bytes; i++, length -= 8)
+   {
+      out[i] = (length >= 8) ? addr[i] : ((length <= 0) ? 0 : (addr[i] & (0xff << (8 - length))));
+   }
+}
+
+/*
+   Function: get_range_key
+   Purpose : Converts the address bits after the root bits to a range key.
+   Input   : Address family, address, key to fill in.
+   Output  : None.
+*/
+void get_range_key(uint8_t family, const uint8_t *addr, pv_lpm_range_t *key)
+{
+   int i;
+
+   key->hi = 0;
+   key->lo = 0;
+   if (family != PV_FLOW_IPV6)
+   {
+      key->hi = addr[3];
+      return;
+   }
+   for (i = 2; i < 10; i++)
+   {
+      key->hi = (key->hi << 8) | addr[i];
+   }
+   for (i = 10; i < 16; i++)
+   {
+      key->lo = (key->lo << 8) | addr[i];
+   }
+}
+
+/*
+   Function: next_range_key
+   Purpose : Steps a range key to the next address.
+   Input   : Address family, key.
+   Output  : Returns 0 if the key was the last address under the root entry, else 1.
+*/
+int next_range_key(uint8_t family, pv_lpm_range_t *key)
+{
+   if (family != PV_FLOW_IPV6)
+   {
+      return((key->hi < 255) ? (int)++key->hi : 0);
+   }
+   if (key->lo < (((uint64_t)1 << 48) - 1))
+   {
+      key->lo++;
+      return(1);
+   }
+   if (key->hi == ~(uint64_t)0)
+   {
+      return(0);
+   }
+   key->lo = 0;
+   key->hi++;
+
+   return(1);
+}
+
+/*
+   Function: set_range_byte
+   Purpose : Sets one address byte of a range key.
+   Input   : Address family, key, address byte number, value.
+   Output  : None.
+*/
+void set_range_byte(uint8_t family, pv_lpm_range_t *key, int byte, uint8_t value)
+{
+   uint64_t *half = &key->hi;
+   int shift;
+
+   if (family != PV_FLOW_IPV6)
+   {
+      key->hi = value;
+      return;
+   }
+   shift = (9 - byte) * 8;
+   if (byte >= 10)
+   {
+      half = &key->lo;
+      shift = (15 - byte) * 8;
+   }
+   *half = (*half & ~((uint64_t)0xff << shift)) | ((uint64_t)value << shift);
+}
+
+/*
+   Function: add_lpm_range
+   Purpose : Starts a new range under the root entry being compiled. A
+             range at the same address replaces the last one, and a range
+             with the same rule as the last one is merged into it.
+   Input   : Ranges, range count, range start, rule + 1.
+   Output  : None.
+*/
+void add_lpm_range(pv_lpm_range_t *ranges, uint32_t *count, pv_lpm_range_t *key, uint32_t rule)
+{
+   pv_lpm_range_t *last = (*count > 0) ? &ranges[*count - 1] : NULL;
+
+   if ((last != NULL) && (last->hi == key->hi) && (last->lo == key->lo))
+   {
+      last->rule = rule;
+      if ((*count > 1) && (last[-1].rule == rule))
+      {
+         (*count)--;
+      }
+      return;
+   }
+   if ((last != NULL) && (last->rule == rule))
+   {
+      return;
+   }
+   last = &ranges[(*count)++];
+   last->hi = key->hi;
+   last->lo = key->lo;
+   last->rule = rule;
+   last->count = 0;
+}
+
+/*
+   Function: build_lpm_ranges
+   Purpose : Cuts the address space under a root entry into the ranges
+             of its longer prefixes. The prefixes are in address order and
+             nested or apart, so a stack of the open prefixes gives the
+             rule for the range after each one ends.
+   Input   : Build state, rules, first and last + 1 rule under the root
+             entry, rule + 1 of the root entry.
+   Output  : Number of ranges in the build scratch array.
+*/
+uint32_t build_lpm_ranges(pv_lpm_build_t *build, pv_lpm_rule_t *rules, uint32_t first, uint32_t last, uint32_t rule)
+{
+   pv_lpm_range_t stack[129];
+   pv_lpm_range_t key;
+   pv_lpm_rule_t *prefix;
+   uint32_t count = 0, i;
+   uint8_t family = rules[first].family;
+   int depth = 0, host;
+   int lo_bits = (family == PV_FLOW_IPV6) ? 48 : 0;
+
+   if (build->scratch_size < (last - first) * 2 + 1)
+   {
+      build->scratch_size = (last - first) * 2 + 1;
+      build->scratch = xrealloc(build->scratch, build->scratch_size * sizeof(pv_lpm_range_t));
+   }
+   memset(&key, 0, sizeof(pv_lpm_range_t));
+   add_lpm_range(build->scratch, &count, &key, rule);
+   for (i = first; i < last; i++)
+   {
+      prefix = &rules[i];
+      get_range_key(family, prefix->addr, &key);
+      /* Close the prefixes that end before this one starts. */
+      while ((depth > 0) && PV_LPM_KEY_BEFORE(stack[depth - 1], key))
+      {
+         depth--;
+         if (next_range_key(family, &stack[depth]))
+         {
+            add_lpm_range(build->scratch, &count, &stack[depth], (depth > 0) ? stack[depth - 1].rule : rule);
+         }
+      }
+      add_lpm_range(build->scratch, &count, &key, i + 1);
+
+      /* Push the end of this prefix. */
+      host = ((family == PV_FLOW_IPV6) ? 128 : 32) - prefix->length;
+      stack[depth] = key;
+      if (host <= lo_bits)
+      {
+         stack[depth].lo |= ((uint64_t)1 << host) - 1;
+      }
+      else
+      {
+         stack[depth].lo |= ((uint64_t)1 << lo_bits) - 1;
+         stack[depth].hi |= ((uint64_t)1 << (host - lo_bits)) - 1;
+      }
+      stack[depth++].rule = i + 1;
+   }
+   while (depth > 0)
+   {
+      depth--;
+      if (next_range_key(family, &stack[depth]))
+      {
+         add_lpm_range(build->scratch, &count, &stack[depth], (depth > 0) ? stack[depth - 1].rule : rule);
+      }
+   }
+
+   return(count);
+}
+
+/*
+   Function: place_lpm_ranges
+   Purpose : Stores the ranges of an address space as an entry: the rule
+             when there is one range, a bucket when there are up to
+             PV_LPM_LINE_SLOTS IPv4 or PV_LPM_BUCKET_MAX IPv6 ranges,
+             otherwise a table for the next address byte with the ranges
+             of each of its 256 parts placed the same way.
+   Input   : Build state, address family, ranges, range count, start of
+             the address space, next address byte.
+   Output  : Root or table entry.
+*/
+uint32_t place_lpm_ranges(pv_lpm_build_t *build, uint8_t family, pv_lpm_range_t *ranges, uint32_t count, pv_lpm_range_t *base, int byte)
+{
+   pv_lpm_range_t sub, next, saved;
+   pv_lpm_line_t *line;
+   uint32_t index, entry, r, e, i;
+   int b;
+
+   if (count == 1)
+   {
+      return(ranges[0].rule);
+   }
+   if ((family != PV_FLOW_IPV6) && (count <= PV_LPM_LINE_SLOTS))
+   {
+      if (build->line_count == build->line_size)
+      {
+         build->line_size = (build->line_size == 0) ? 1024 : build->line_size * 2;
+         build->lines = xrealloc(build->lines, build->line_size * sizeof(pv_lpm_line_t));
+      }
+      line = &build->lines[build->line_count];
+      for (i = 0; i < PV_LPM_LINE_KEYS; i++)
+      {
+         line->start[i] = (uint8_t)ranges[(i < count) ? i : count - 1].hi;
+      }
+      for (i = 0; i < PV_LPM_LINE_SLOTS; i++)
+      {
+         line->rule[i] = ranges[(i < count) ? i : count - 1].rule;
+      }
+      return(PV_LPM_BUCKET | build->line_count++);
+   }
+   if ((family == PV_FLOW_IPV6) && (count <= PV_LPM_BUCKET_MAX))
+   {
+      if (build->range_count + count > build->range_size)
+      {
+         build->range_size = (build->range_size + count) * 2;
+         build->ranges = xrealloc(build->ranges, build->range_size * sizeof(pv_lpm_range_t));
+      }
+      memcpy(&build->ranges[build->range_count], ranges, count * sizeof(pv_lpm_range_t));
+      build->ranges[build->range_count].count = count;
+      build->range_count += count;
+      return(PV_LPM_BUCKET | (build->range_count - count));
+   }
+
+   if (build->table_count == build->table_size)
+   {
+      build->table_size = (build->table_size == 0) ? 64 : build->table_size * 2;
+      build->tables = xrealloc(build->tables, build->table_size * 256 * sizeof(uint32_t));
+   }
+   index = build->table_count++;
+   sub = *base;
+   next = *base;
+   for (b = 0, r = 0; b < 256; b++)
+   {
+      /* ranges[r] is the last range starting at or before this part, ranges[e] the first after it. */
+      set_range_byte(family, &sub, byte, b);
+      while ((r + 1 < count) && !PV_LPM_KEY_BEFORE(sub, ranges[r + 1]))
+      {
+         r++;
+      }
+      if (b < 255)
+      {
+         set_range_byte(family, &next, byte, b + 1);
+      }
+      for (e = r + 1; (e < count) && ((b == 255) || PV_LPM_KEY_BEFORE(ranges[e], next)); e++)
+         ;
+      /* The first range is cut to the start of the part while it is placed. */
+      saved = ranges[r];
+      ranges[r].hi = sub.hi;
+      ranges[r].lo = sub.lo;
+      entry = place_lpm_ranges(build, family, ranges + r, e - r, &sub, byte + 1);
+      ranges[r] = saved;
+      build->tables[(index << 8) | b] = entry;
+   }
+
+   return(PV_LPM_TABLE | index);
+}
+
+/*
+   Function: set_lpm_pointers
+   Purpose : Checks a table header against the table size and points the
+             table at its arrays.
+   Input   : Table with the header set, table size.
+   Output  : Returns 0, or -1 if the header does not fit the table.
+*/
+int set_lpm_pointers(pv_lpm_table_t *table, uint64_t size)
+{
+   pv_lpm_header_t *header = table->header;
+   uint8_t *base = (uint8_t *)header;
+
+   if ((size < sizeof(pv_lpm_header_t)) || (memcmp(header->magic, PV_LPM_MAGIC, 8) != 0) || (header->size != size)
+       || (header->root4_offset + ((uint64_t)sizeof(uint32_t) << PV_LPM_ROOT4_BITS) > size)
+       || (header->root6_offset + ((uint64_t)sizeof(uint32_t) << PV_LPM_ROOT6_BITS) > size)
+       || (header->rules_offset + (uint64_t)header->rule_count * sizeof(pv_lpm_rule_t) > size)
+       || (header->lines_offset + (uint64_t)header->line_count * sizeof(pv_lpm_line_t) > size)
+       || (header->ranges_offset + (uint64_t)header->range_count * sizeof(pv_lpm_range_t) > size)
+       || (header->tables_offset + ((uint64_t)header->table_count << 8) * sizeof(uint32_t) > size)
+       || (header->list_count > PV_LPM_MAX_LISTS))
+   {
+      return(-1);
+   }
+   table->root4 = (uint32_t *)(base + header->root4_offset);
+   table->root6 = (uint32_t *)(base + header->root6_offset);
+   table->rules = (pv_lpm_rule_t *)(base + header->rules_offset);
+   table->lines = (pv_lpm_line_t *)(base + header->lines_offset);
+   table->ranges = (pv_lpm_range_t *)(base + header->ranges_offset);
+   table->tables = (uint32_t *)(base + header->tables_offset);
+   table->size = size;
+
+   return(0);
+}
+
+/*
+   Function: check_lpm_entry
+   Purpose : Checks a root or table entry of a mapped table, and the
+             buckets and tables under it, so a lookup cannot read outside
+             the table. IPv4 buckets are only found in the root and IPv4
+             tables only index the last address byte. A table may only be
+             reached once, which also bounds the walk.
+   Input   : Table, visited table flags, address family, entry, address
+             byte a table under the entry is indexed by.
+   Output  : Returns 0, or -1 if the entry is not valid.
+*/
+int check_lpm_entry(pv_lpm_table_t *table, uint8_t *visited, uint8_t family, uint32_t entry, int byte)
+{
+   pv_lpm_header_t *header = table->header;
+   pv_lpm_range_t *bucket;
+   pv_lpm_line_t *line;
+   uint32_t index = entry & PV_LPM_INDEX;
+   uint32_t i;
+
+   if (entry & PV_LPM_TABLE)
+   {
+      if ((index >= header->table_count) || visited[index] || (byte > ((family == PV_FLOW_IPV6) ? 15 : 3)))
+      {
+         return(-1);
+      }
+      visited[index] = 1;
+      for (i = 0; i < 256; i++)
+      {
+         if (check_lpm_entry(table, visited, family, table->tables[(index << 8) | i], byte + 1) < 0)
+         {
+            return(-1);
+         }
+      }
+      return(0);
+   }
+
+   if ((entry & PV_LPM_BUCKET) && (family == PV_FLOW_IPV6))
+   {
+      bucket = &table->ranges[index];
+      if ((index >= header->range_count) || (bucket->count == 0) || (bucket->count > PV_LPM_BUCKET_MAX)
+          || (bucket->count > header->range_count - index))
+      {
+         return(-1);
+      }
+      for (i = 0; i < bucket->count; i++)
+      {
+         if (bucket[i].rule > header->rule_count)
+         {
+            return(-1);
+         }
+      }
+      return(0);
+   }
+
+   if (entry & PV_LPM_BUCKET)
+   {
+      if ((byte != 3) || (index >= header->line_count))
+      {
+         return(-1);
+      }
+      line = &table->lines[index];
+      for (i = 0; i < PV_LPM_LINE_SLOTS; i++)
+      {
+         if (line->rule[i] > header->rule_count)
+         {
+            return(-1);
+         }
+      }
+      return(0);
+   }
+
+   return((entry <= header->rule_count) ? 0 : -1);
+}
+
+/*
+   Function: check_lpm_table
+   Purpose : Checks every index stored in a mapped table file, the root
+             entries, the tables, the bucket counts and the rule lists.
+   Input   : Table with the pointers set.
+   Output  : Returns 0, or -1 if the table is corrupt.
+*/
+int check_lpm_table(pv_lpm_table_t *table)
+{
+   pv_lpm_header_t *header = table->header;
+   uint8_t *visited = xcalloc(header->table_count + 1);
+   uint32_t i;
+   int retval = 0;
+
+   for (i = 0; (i < (1U << PV_LPM_ROOT4_BITS)) && (retval == 0); i++)
+   {
+      retval = check_lpm_entry(table, visited, PV_FLOW_IPV4, table->root4[i], 3);
+   }
+   for (i = 0; (i < (1U << PV_LPM_ROOT6_BITS)) && (retval == 0); i++)
+   {
+      retval = check_lpm_entry(table, visited, PV_FLOW_IPV6, table->root6[i], 2);
+   }
+   for (i = 0; (i < header->rule_count) && (retval == 0); i++)
+   {
+      if (table->rules[i].list >= header->list_count)
+      {
+         retval = -1;
+      }
+   }
+   free(visited);
+
+   return(retval);
+}
+
+/*
+   Function: build_lpm_table
+   Purpose : Reads the blocklist files and compiles the lookup table.
+   Input   : Blocklist file names, number of files.
+   Output  : Table or NULL if a file could not be read.
+*/
+pv_lpm_table_t *build_lpm_table(char files[][PV_PATH_MAX_LENGTH], int file_count)
+{
+   pv_lpm_table_t *table;
+   pv_lpm_header_t *header;
+   pv_lpm_rule_t *rules = NULL;
+   pv_lpm_rule_t *rule;
+   pv_lpm_build_t build;
+   pv_lpm_range_t base;
+   uint32_t count = 0, capacity = 0, longer = 0, ipv6 = 0, n, i, j, index, span;
+   uint32_t *root;
+   uint64_t size, used, shift;
+   char *name;
+   int invalid = 0, res, f, bits;
+
+   for (i = 0; i < (uint32_t)file_count; i++)
+   {
+      if ((res = read_blocklist(files[i], i, &rules, &count, &capacity)) < 0)
+      {
+         free(rules);
+         return(NULL);
+      }
+      invalid += res;
+   }
+
+   /* Sort and drop the duplicate prefixes, the first list keeps them. */
+   qsort(rules, count, sizeof(pv_lpm_rule_t), compare_prefixes);
+   for (i = 0, n = 0; i < count; i++)
+   {
+      if ((n == 0) || (memcmp(&rules[n - 1], &rules[i], offsetof(pv_lpm_rule_t, list)) != 0))
+      {
+         rules[n++] = rules[i];
+         f = (rules[i].family == PV_FLOW_IPV6);
+         ipv6 += f;
+         longer += (rules[i].length > (f ? PV_LPM_ROOT6_BITS : PV_LPM_ROOT4_BITS));
+      }
+   }
+
+   /* The buckets and tables are appended when their size is known. */
+   table = xcalloc(sizeof(pv_lpm_table_t));
+   size = (sizeof(pv_lpm_header_t) + 63) & ~63ULL;
+   size += ((uint64_t)sizeof(uint32_t) << PV_LPM_ROOT4_BITS) + ((uint64_t)sizeof(uint32_t) << PV_LPM_ROOT6_BITS);
+   size += ((uint64_t)n * sizeof(pv_lpm_rule_t) + 63) & ~63ULL;
+   table->memory = xcalloc(size + 64);
+   header = table->header = (pv_lpm_header_t *)(((uintptr_t)table->memory + 63) & ~(uintptr_t)63);
+   memcpy(header->magic, PV_LPM_MAGIC, 8);
+   header->size = size;
+   header->root4_offset = (sizeof(pv_lpm_header_t) + 63) & ~63ULL;
+   header->root6_offset = header->root4_offset + ((uint64_t)sizeof(uint32_t) << PV_LPM_ROOT4_BITS);
+   header->rules_offset = header->root6_offset + ((uint64_t)sizeof(uint32_t) << PV_LPM_ROOT6_BITS);
+   header->lines_offset = header->rules_offset + (((uint64_t)n * sizeof(pv_lpm_rule_t) + 63) & ~63ULL);
+   header->ranges_offset = header->lines_offset;
+   header->tables_offset = header->lines_offset;
+   header->rule_count = n;
+   header->list_count = file_count;
+   for (i = 0; i < (uint32_t)file_count; i++)
+   {
+      name = ((name = strrchr(files[i], '/')) != NULL) ? name + 1 : files[i];
+      strncpy(header->lists[i], name, PV_LPM_NAME_MAX - 1);
+   }
+   set_lpm_pointers(table, size);
+   if (n > 0)
+   {
+      memcpy(table->rules, rules, n * sizeof(pv_lpm_rule_t));
+   }
+   free(rules);
+
+   memset(&build, 0, sizeof(pv_lpm_build_t));
+   memset(&base, 0, sizeof(pv_lpm_range_t));
+   for (i = 0; i < n; i = j)
+   {
+      rule = &table->rules[i];
+      f = (rule->family == PV_FLOW_IPV6);
+      bits = f ? PV_LPM_ROOT6_BITS : PV_LPM_ROOT4_BITS;
+      root = f ? table->root6 : table->root4;
+      index = f ? ((rule->addr[0] << 8) | rule->addr[1]) : ((rule->addr[0] << 16) | (rule->addr[1] << 8) | rule->addr[2]);
+      j = i + 1;
+      if (rule->length <= bits)
+      {
+         /* Prefixes come after the prefixes they are inside, so this one replaces them. */
+         span = 1U << (bits - rule->length);
+         for (span += index; index < span; index++)
+         {
+            root[index] = i + 1;
+         }
+         continue;
+      }
+      /* The longer prefixes under a root entry are together, after the prefixes over it. */
+      while ((j < n) && (table->rules[j].family == rule->family) && (table->rules[j].length > bits)
+             && (memcmp(table->rules[j].addr, rule->addr, bits / 8) == 0))
+      {
+         j++;
+      }
+      span = build_lpm_ranges(&build, table->rules, i, j, root[index]);
+      root[index] = place_lpm_ranges(&build, rule->family, build.scratch, span, &base, bits / 8);
+   }
+
+   /* Append the buckets and tables, the header stays on a cache line boundary if the allocation moves. */
+   used = size;
+   shift = (uint8_t *)header - (uint8_t *)table->memory;
+   header->line_count = build.line_count;
+   header->range_count = build.range_count;
+   header->table_count = build.table_count;
+   header->ranges_offset = header->lines_offset + (uint64_t)build.line_count * sizeof(pv_lpm_line_t);
+   header->tables_offset = header->ranges_offset + (((uint64_t)build.range_count * sizeof(pv_lpm_range_t) + 63) & ~63ULL);
+   header->size = size = header->tables_offset + ((uint64_t)build.table_count << 8) * sizeof(uint32_t);
+   table->memory = xrealloc(table->memory, size + 64);
+   header = table->header = (pv_lpm_header_t *)(((uintptr_t)table->memory + 63) & ~(uintptr_t)63);
+   if ((uint8_t *)header - (uint8_t *)table->memory != shift)
+   {
+      memmove(header, (uint8_t *)table->memory + shift, used);
+   }
+   memset((uint8_t *)header + used, 0, size - used);
+   set_lpm_pointers(table, size);
+   if (build.line_count > 0)
+   {
+      memcpy(table->lines, build.lines, build.line_count * sizeof(pv_lpm_line_t));
+   }
+   if (build.range_count > 0)
+   {
+      memcpy(table->ranges, build.ranges, build.range_count * sizeof(pv_lpm_range_t));
+   }
+   if (build.table_count > 0)
+   {
+      memcpy(table->tables, build.tables, (build.table_count << 8) * sizeof(uint32_t));
+   }
+   free(build.scratch);
+   free(build.lines);
+   free(build.ranges);
+   free(build.tables);
+
+   printf("build_lpm_table() <INFO> Loaded %u prefixes, %u IPv4 and %u IPv6, %u longer than the root tables, from %d blocklists, %d invalid lines: %lu MB\n",
+          n, n - ipv6, ipv6, longer, file_count, invalid, (unsigned long)(size >> 20));
+
+   return(table);
+}
+
+/*
+   Function: save_lpm_table
+   Purpose : Writes a compiled table to a file, through a temporary file
+             that is renamed so a sensor mapping the old file is not
+             affected.
+   Input   : Table, file name.
+   Output  : Returns 0, or -1 if the file could not be written.
+*/
+int save_lpm_table(pv_lpm_table_t *table, char *file_name)
+{
+   char temp_name[PV_PATH_MAX_LENGTH + 8];
+   FILE *table_file;
+   int res = 0;
+
+   snprintf(temp_name, sizeof(temp_name), "%s.tmp", file_name);
+   if ((table_file = fopen(temp_name, "wb")) == NULL)
+   {
+      sprint_log_entry("save_lpm_table() <ERROR> Could not open blocklist table file", temp_name);
+      return(-1);
+   }
+   if (fwrite(table->header, table->size, 1, table_file) != 1)
+   {
+      res = -1;
+   }
+   if ((fclose(table_file) != 0) || (res < 0) || (rename(temp_name, file_name) < 0))
+   {
+      sprint_log_entry("save_lpm_table() <ERROR> Could not write blocklist table file", file_name);
+      unlink(temp_name);
+      return(-1);
+   }
+
+   return(0);
+}
+
+/*
+   Function: map_lpm_table
+   Purpose : Maps a compiled table file read only. Every index in the
+             file is checked before it is used, so a corrupt file is
+             rejected instead of sending the workers outside the mapping.
+   Input   : File name.
+   Output  : Table or NULL if the file is not a compiled table.
+*/
+pv_lpm_table_t *map_lpm_table(char *file_name)
+{
+   pv_lpm_table_t *table;
+   struct stat st;
+   void *map;
+   int fd;
+
+   if ((fd = open(file_name, O_RDONLY)) < 0)
+   {
+      sprint_log_entry("map_lpm_table() <ERROR> Could not open blocklist table file", file_name);
+      return(NULL);
+   }
+   if ((fstat(fd, &st) < 0) || (st.st_size < (off_t)sizeof(pv_lpm_header_t))
+       || ((map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED))
+   {
+      sprint_log_entry("map_lpm_table() <ERROR> Could not map blocklist table file", file_name);
+      close(fd);
+      return(NULL);
+   }
+   close(fd);
+
+   table = xcalloc(sizeof(pv_lpm_table_t));
+   table->header = map;
+   table->size = st.st_size;
+   table->mapped = 1;
+   if (set_lpm_pointers(table, st.st_size) < 0)
+   {
+      sprint_log_entry("map_lpm_table() <ERROR> Not a compatible blocklist table file", file_name);
+      free_lpm_table(table);
+      return(NULL);
+   }
+   if (check_lpm_table(table) < 0)
+   {
+      sprint_log_entry("map_lpm_table() <ERROR> Corrupt blocklist table file", file_name);
+      free_lpm_table(table);
+      return(NULL);
+   }
+   printf("map_lpm_table() <INFO> Mapped %u prefixes from %u blocklists in %s\n", table->header->rule_count,
+          table->header->list_count, file_name);
+
+   return(table);
+}
+
+/*
+   Function: free_lpm_table
+   Purpose : Unmaps a mapped table file or frees a built table.
+   Input   : Table.
+   Output  : None.
+*/
+void free_lpm_table(pv_lpm_table_t *table)
+{
+   if (table->mapped)
+   {
+      munmap(table->header, table->size);
+   }
+   else
+   {
+      free(table->memory);
+   }
+   free(table);
+}
+
+/*
+   Function: lookup_prefix
+   Purpose : Finds the longest prefix that contains an address.
+   Input   : Table, address family, address.
+   Output  : Matching rule or NULL.
+*/
+pv_lpm_rule_t *lookup_prefix(pv_lpm_table_t *table, uint8_t family, const uint8_t *addr)
+{
+   pv_lpm_range_t *bucket;
+   pv_lpm_range_t key;
+   pv_lpm_line_t *line;
+   uint32_t entry, i;
+   int byte = 2;
+
+   if (family != PV_FLOW_IPV6)
+   {
+      entry = table->root4[(addr[0] << 16) | (addr[1] << 8) | addr[2]];
+      if (entry & PV_LPM_TABLE)
+      {
+         entry = table->tables[((entry & PV_LPM_INDEX) << 8) | addr[3]];
+      }
+      else if (entry & PV_LPM_BUCKET)
+      {
+         /* Last range starting at or before the address, a binary search of the 16 starts without branches. */
+         line = &table->lines[entry & PV_LPM_INDEX];
+         i = (line->start[8] <= addr[3]) << 3;
+         i += (line->start[i + 4] <= addr[3]) << 2;
+         i += (line->start[i + 2] <= addr[3]) << 1;
+         i += (line->start[i + 1] <= addr[3]);
+         entry = line->rule[(i < PV_LPM_LINE_SLOTS) ? i : PV_LPM_LINE_SLOTS - 1];
+      }
+      return((entry != 0) ? &table->rules[entry - 1] : NULL);
+   }
+
+   entry = table->root6[(addr[0] << 8) | addr[1]];
+   while (entry & PV_LPM_TABLE)
+   {
+      entry = table->tables[((entry & PV_LPM_INDEX) << 8) | addr[byte++]];
+   }
+   if (entry & PV_LPM_BUCKET)
+   {
+      /* Last range starting at or before the address, the first range starts at the start of the bucket. */
+      bucket = &table->ranges[entry & PV_LPM_INDEX];
+      get_range_key(family, addr, &key);
+      for (i = 1; (i < bucket->count) && !PV_LPM_KEY_BEFORE(key, bucket[i]); i++)
+         ;
+      entry = bucket[i - 1].rule;
+   }
+
+   return((entry != 0) ? &table->rules[entry - 1] : NULL);
+}
+
+/*
+   Function: check_blocklist
+   Purpose : Looks up the addresses of a new flow and raises an alert for
+             each one that is in a blocklist.
+   Input   : Worker, packet event of the first packet.
+   Output  : None.
+*/
+void check_blocklist(pv_worker_t *worker, pv_packet_event_t *event)
+{
+   pv_lpm_table_t *table = __atomic_load_n(&blocklist.table, __ATOMIC_ACQUIRE);
+   pv_lpm_rule_t *rule;
+   pv_alert_t alert;
+   int direction;
+
+   for (direction = PV_LPM_SRC; direction <= PV_LPM_DST; direction++)
+   {
+      worker->blocklist_lookups++;
+      if ((rule = lookup_prefix(table, event->key.family, (direction == PV_LPM_SRC) ? event->key.src_addr : event->key.dst_addr)) == NULL)
+      {
+         continue;
+      }
+      worker->blocklist_matches++;
+
+      memset(&alert, 0, sizeof(pv_alert_t));
+      memcpy(&alert.key, &event->key, sizeof(pv_flow_key_t));
+      alert.type = PV_ALERT_BLOCKLIST;
+      alert.ts_sec = event->ts_sec;
+      alert.ts_usec = event->ts_usec;
+      alert.value = rule->list;
+      alert.threshold = rule->length;
+      alert.direction = direction;
+      /* A reload may replace the table before the alert is output. */
+      strncpy(alert.list, table->header->lists[rule->list], PV_LPM_NAME_MAX - 1);
+      queue_alert(worker, &alert);
+   }
+}
+
+/*
+   Function: load_blocklist
+   Purpose : Compiles the blocklist files and saves the table file, or
+             maps the table file when there are no blocklist files.
+   Input   : None.
+   Output  : Table or NULL.
+*/
+pv_lpm_table_t *load_blocklist()
+{
+   pv_lpm_table_t *table;
+
+   if (blocklist.file_count == 0)
+   {
+      return(map_lpm_table(blocklist.table_file));
+   }
+   /* A table that could not be saved is still used. */
+   if (((table = build_lpm_table(blocklist.files, blocklist.file_count)) != NULL) && (blocklist.table_file[0] != 0))
+   {
+      save_lpm_table(table, blocklist.table_file);
+   }
+
+   return(table);
+}
+
+/*
+   Function: init_blocklist
+   Purpose : Keeps the blocklist files and table file for reloads and loads
+             the first table.
+   Input   : Capture configuration.
+   Output  : Returns -1 on error, 0 on success.
+*/
+int init_blocklist(pv_capture_config_t *config)
+{
+   memset(&blocklist, 0, sizeof(pv_blocklist_t));
+   memcpy(blocklist.files, config->blocklist_files, sizeof(blocklist.files));
+   blocklist.file_count = config->blocklist_count;
+   memcpy(blocklist.table_file, config->blocklist_table, PV_PATH_MAX_LENGTH);
+
+   if ((blocklist.table = load_blocklist()) == NULL)
+   {
+      return(-1);
+   }
+
+   return(0);
+}
+
+/*
+   Function: reload_blocklist
+   Purpose : Loads the blocklist again and swaps the new table in, called
+             on the main thread after a SIGHUP, see reload_sensor(). The
+             old table is retired until the workers have seen the swap, or
+             freed at once when no capture worker thread can be using it.
+   Input   : None.
+   Output  : None.
+*/
+void reload_blocklist()
+{
+   pv_lpm_table_t *table, *old;
+   unsigned int generation;
+
+   print_log_entry("reload_blocklist() <INFO> Reloading the blocklist.\n");
+   if ((table = load_blocklist()) == NULL)
+   {
+      print_log_entry("reload_blocklist() <ERROR> Could not reload the blocklist, the old table is still in use.\n");
+      return;
+   }
+   old = __atomic_exchange_n(&blocklist.table, table, __ATOMIC_ACQ_REL);
+   generation = __atomic_add_fetch(&blocklist.generation, 1, __ATOMIC_RELEASE);
+   blocklist.reloads++;
+
+   if (count_running_workers() == 0)
+   {
+      free_lpm_table(old);
+      return;
+   }
+   old->retired_generation = generation;
+   old->retired_next = blocklist.retired;
+   blocklist.retired = old;
+}
+
+/*
+   Function: is_blocklist_unused
+   Purpose : Checks that every running capture worker has acknowledged a
+             blocklist generation, so no lookup can still be using the
+             tables it replaced.
+   Input   : Blocklist generation.
+   Output  : Returns 1 if the replaced tables are unused, otherwise 0.
+*/
+int is_blocklist_unused(unsigned int generation)
+{
+   int i;
+
+   for (i = 0; i < worker_count; i++)
+   {
+      if (workers[i].running && !workers[i].finished &&
+          ((int)(__atomic_load_n(&workers[i].blocklist_generation, __ATOMIC_ACQUIRE) - generation) < 0))
+      {
+         return(0);
+      }
+   }
+
+   return(1);
+}
+
+/*
+   Function: free_retired_blocklist
+   Purpose : Frees the tables replaced by a reload that no worker can still
+             be using, called from the main thread loop. The workers see the
+             swaps in order, so once a table is unused the older ones are too.
+   Input   : None.
+   Output  : None.
+*/
+void free_retired_blocklist()
+{
+   pv_lpm_table_t **link = &blocklist.retired;
+   pv_lpm_table_t *table;
+
+   while ((*link != NULL) && !is_blocklist_unused((*link)->retired_generation))
+   {
+      link = &(*link)->retired_next;
+   }
+   while ((table = *link) != NULL)
+   {
+      *link = table->retired_next;
+      free_lpm_table(table);
+   }
+}
+
+/*
+   Function: print_blocklist_stats
+   Purpose : Prints the blocklist counters of a worker.
+   Input   : Worker ID, worker.
+   Output  : None.
+*/
+void print_blocklist_stats(int worker_id, pv_worker_t *worker)
+{
+   printf("Worker %d blocklist: %lu lookups, %lu matches\n", worker_id, worker->blocklist_lookups, worker->blocklist_matches);
+}
+
+/*
+   Function: delete_blocklist
+   Purpose : Frees the blocklist table and the retired tables.
+   Input   : None.
+   Output  : None.
+*/
+void delete_blocklist()
+{
+   pv_lpm_table_t *table;
+
+   while ((table = blocklist.retired) != NULL)
+   {
+      blocklist.retired = table->retired_next;
+      free_lpm_table(table);
+   }
+   free_lpm_table(blocklist.table);
+   blocklist.table = NULL;
+}
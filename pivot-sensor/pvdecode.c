@@ -0,0 +1,715 @@
+/*  Copyright 2014 Derek Chadwick
+
+    This file is part of the Pivotal Network Security Tools.
+
+    Pivotal is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Pivotal is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Pivotal.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+   pvdecode.c
+
+   Title : Pivotal NST Sensor Packet Decoder
+   Author: Derek Chadwick
+   Date  : 17/10/2026
+
+   Purpose: Decodes each packet once, layer 2 to layer 4, into the binary
+            packet event. The event holds the flow key, the header fields
+            that are printed and a descriptor of the layer offsets, VLAN
+            tags and tunnel, so the later stages never parse the headers
+            again.
+
+            The layer 2 decoder is picked once per capture socket from the
+            datalink type, so there is no link type switch per packet:
+
+            DLT_EN10MB      Ethernet, 802.1Q and QinQ VLAN tags
+            DLT_LINUX_SLL   Linux cooked capture (the "any" interface)
+            DLT_LINUX_SLL2  Linux cooked capture v2, if libpcap has it
+            DLT_NULL/LOOP   BSD loopback
+            DLT_RAW/IPV4/IPV6  raw IP
+            DLT_PPP/SLIP
+
+            IPv4 and IPv6 are decoded, IPv6 extension headers are skipped
+            to the transport header. GRE, VXLAN (UDP port 4789) and IP in IP
+            tunnels are decapsulated, up to two deep, and the event describes
+            the inner packet with the outer tunnel type recorded. If the
+            inner packet can not be decoded the outer packet is kept.
+
+            Non first fragments have no transport header, only the IP
+            fields are decoded.
+
+   Status : EXPERIMENTAL - not for use in production networks.
+
+*/
+
+#include "pvcommon.h"
+#include "pivot-sensor.h"
+
+/* Network byte order reads, the headers are not aligned after VLAN tags or tunnels. */
+#define PV_GET16(p) ((uint16_t)(((p)[0] << 8) | (p)[1]))
+#define PV_GET32(p) ((uint32_t)(((uint32_t)(p)[0] << 24) | ((uint32_t)(p)[1] << 16) | ((uint32_t)(p)[2] << 8) | (p)[3]))
+
+struct pv_link_decoder_entry
+{
+   int link_type;
+   pv_link_decoder_t decoder;
+   const char *name;
+};
+
+static struct pv_link_decoder_entry link_decoders[] =
+{
+   { DLT_EN10MB, decode_ethernet, "Ethernet" },
+   { DLT_LINUX_SLL, decode_linux_sll, "Linux cooked" },
+#ifdef DLT_LINUX_SLL2
+   { DLT_LINUX_SLL2, decode_linux_sll2, "Linux cooked v2" },
+#endif
+   { DLT_NULL, decode_null, "BSD loopback" },
+   { DLT_LOOP, decode_loop, "OpenBSD loopback" },
+   { DLT_RAW, decode_raw, "raw IP" },
+   { DLT_IPV4, decode_raw, "raw IPv4" },
+   { DLT_IPV6, decode_raw, "raw IPv6" },
+   { DLT_PPP, decode_ppp, "PPP" },
+   { DLT_SLIP, decode_slip, "SLIP" }
+};
+
+static char *tunnel_names[] = { "", "GRE", "VXLAN", "IPIP" };
+
+/*
+   Function: get_link_decoder
+   Purpose : Finds the layer 2 decoder for a datalink type.
+   Input   : libpcap datalink type.
+   Output  : Decoder or NULL if the datalink type is not supported.
+*/
+pv_link_decoder_t get_link_decoder(int link_type)
+{
+   int i;
+
+   for (i = 0; i < (int)(sizeof(link_decoders) / sizeof(link_decoders[0])); i++)
+   {
+      if (link_decoders[i].link_type == link_type)
+      {
+         printf("get_link_decoder() <INFO> Datalink: %s\n", link_decoders[i].name);
+         return(link_decoders[i].decoder);
+      }
+   }
+   iprint_log_entry("get_link_decoder() <ERROR> Unsupported datalink", link_type);
+
+   return(NULL);
+}
+
+/*
+   Function: get_tunnel_name
+   Purpose : Gets the text name of a tunnel type for the event text.
+   Input   : Tunnel type.
+   Output  : Name, an empty string for no tunnel.
+*/
+const char *get_tunnel_name(uint8_t tunnel)
+{
+   if (tunnel >= sizeof(tunnel_names) / sizeof(tunnel_names[0]))
+   {
+      return("");
+   }
+
+   return(tunnel_names[tunnel]);
+}
+
+/*
+   Function: decode_packet
+   Purpose : Decodes a captured packet into a binary packet event with the
+             capture socket layer 2 decoder. No text is formatted here.
+   Input   : Layer 2 decoder, packet event, libpcap packet header and packet data.
+   Output  : PV_DECODE_OK, PV_DECODE_SHORT if the packet is too short for
+             an IP header or PV_DECODE_UNSUPPORTED if it is not IP.
+*/
+int decode_packet(pv_link_decoder_t decoder, pv_packet_event_t *event, struct pcap_pkthdr *packethdr, u_char *packetptr)
+{
+   memset(event, 0, sizeof(pv_packet_event_t));
+   event->ts_sec = packethdr->ts.tv_sec;
+   event->ts_usec = packethdr->ts.tv_usec;
+
+   return(decoder(event, packetptr, packethdr->caplen));
+}
+
+/*
+   Function: decode_ethernet
+   Purpose : Layer 2 decoder for Ethernet frames.
+   Input   : Packet event, packet data, captured length.
+   Output  : PV_DECODE_OK or a decode error.
+*/
+int decode_ethernet(pv_packet_event_t *event, u_char *packet, uint32_t caplen)
+{
+   return(decode_ethernet_frame(event, packet, caplen, 0, 0));
+}
+
+/*
+   Function: decode_ethernet_frame
+   Purpose : Decodes an Ethernet header at an offset in the packet, the
+             outer frame or a frame carried in a tunnel, then the VLAN
+             tags and the network layer.
+   Input   : Packet event, packet data, captured length, frame offset, tunnel depth.
+   Output  : PV_DECODE_OK or a decode error.
+*/
+int decode_ethernet_frame(pv_packet_event_t *event, u_char *packet, uint32_t caplen, uint32_t offset, int depth)
+{
+   if (caplen < offset + 14)
+   {
+      return(PV_DECODE_SHORT);
+   }
+
+   return(decode_ethertype(event, packet, caplen, offset + 14, PV_GET16(packet + offset + 12), depth));
+}
+
+/*
+   Function: decode_ethertype
+   Purpose : Skips any 802.1Q, 802.1ad or QinQ VLAN tags then decodes the
+             network layer. The first two VLAN IDs are kept, outer first.
+   Input   : Packet event, packet data, captured length, network layer
+             offset, ethertype, tunnel depth.
+   Output  : PV_DECODE_OK or a decode error.
+*/
+int decode_ethertype(pv_packet_event_t *event, u_char *packet, uint32_t caplen, uint32_t offset, uint16_t ethertype, int depth)
+{
+   while ((ethertype == ETHERTYPE_VLAN) || (ethertype == 0x88a8) || (ethertype == 0x9100))
+   {
+      if (caplen < offset + 4)
+      {
+         return(PV_DECODE_SHORT);
+      }
+      if (event->desc.vlan_count < PV_DECODE_MAX_VLANS)
+      {
+         event->desc.vlan_id[event->desc.vlan_count++] = PV_GET16(packet + offset) & 0x0fff;
+      }
+      ethertype = PV_GET16(packet + offset + 2);
+      offset += 4;
+   }
+
+   switch (ethertype)
+   {
+   case ETHERTYPE_IP:
+      return(decode_ipv4(event, packet, caplen, offset, depth));
+
+   case ETHERTYPE_IPV6:
+      return(decode_ipv6(event, packet, caplen, offset, depth));
+   }
+
+   return(PV_DECODE_UNSUPPORTED);
+}
+
+/*
+   Function: decode_ip_version
+   Purpose : Decodes an IP packet with no layer 2 header, the IP version
+             is taken from the first nibble.
+   Input   : Packet event, packet data, captured length, IP header offset.
+   Output  : PV_DECODE_OK or a decode error.
+*/
+int decode_ip_version(pv_packet_event_t *event, u_char *packet, uint32_t caplen, uint32_t offset)
+{
+   if (caplen < offset + 1)
+   {
+      return(PV_DECODE_SHORT);
+   }
+
+   switch (packet[offset] >> 4)
+   {
+   case 4:
+      return(decode_ipv4(event, packet, caplen, offset, 0));
+
+   case 6:
+      return(decode_ipv6(event, packet, caplen, offset, 0));
+   }
+
+   return(PV_DECODE_UNSUPPORTED);
+}
+
+/*
+   Function: decode_linux_sll
+   Purpose : Layer 2 decoder for the 16 byte Linux cooked capture header,
+             the protocol is the last two bytes.
+   Input   : Packet event, packet data, captured length.
+   Output  : PV_DECODE_OK or a decode error.
+*/
+int decode_linux_sll(pv_packet_event_t *event, u_char *packet, uint32_t caplen)
+{
+   if (caplen < 16)
+   {
+      return(PV_DECODE_SHORT);
+   }
+
+   return(decode_ethertype(event, packet, caplen, 16, PV_GET16(packet + 14), 0));
+}
+
+/*
+   Function: decode_linux_sll2
+   Purpose : Layer 2 decoder for the 20 byte Linux cooked capture v2
+             header, the protocol is the first two bytes.
+   Input   : Packet event, packet data, captured length.
+   Output  : PV_DECODE_OK or a decode error.
+*/
+int decode_linux_sll2(pv_packet_event_t *event, u_char *packet, uint32_t caplen)
+{
+   if (caplen < 20)
+   {
+      return(PV_DECODE_SHORT);
+   }
+
+   return(decode_ethertype(event, packet, caplen, 20, PV_GET16(packet), 0));
+}
+
+/*
+   Function: decode_loopback_family
+   Purpose : Decodes the network layer for a BSD loopback address family.
+             AF_INET6 differs between the BSDs, Linux and OS X so all of
+             the values are accepted.
+   Input   : Packet event, packet data, captured length, address family.
+   Output  : PV_DECODE_OK or a decode error.
+*/
+int decode_loopback_family(pv_packet_event_t *event, u_char *packet, uint32_t caplen, uint32_t family)
+{
+   switch (family)
+   {
+   case 2:
+      return(decode_ipv4(event, packet, caplen, 4, 0));
+
+   case 10:
+   case 24:
+   case 28:
+   case 30:
+      return(decode_ipv6(event, packet, caplen, 4, 0));
+   }
+
+   return(PV_DECODE_UNSUPPORTED);
+}
+
+/*
+   Function: decode_null
+   Purpose : Layer 2 decoder for DLT_NULL, a 4 byte address family in the
+             byte order of the capturing host. Files from a host with the
+             other byte order have the family in the top byte.
+   Input   : Packet event, packet data, captured length.
+   Output  : PV_DECODE_OK or a decode error.
+*/
+int decode_null(pv_packet_event_t *event, u_char *packet, uint32_t caplen)
+{
+   uint32_t family;
+
+   if (caplen < 4)
+   {
+      return(PV_DECODE_SHORT);
+   }
+   memcpy(&family, packet, 4);
+   if ((family & 0xffff0000) != 0)
+   {
+      family = ((family >> 24) & 0xff) | ((family >> 8) & 0xff00);
+   }
+
+   return(decode_loopback_family(event, packet, caplen, family));
+}
+
+/*
+   Function: decode_loop
+   Purpose : Layer 2 decoder for DLT_LOOP, a 4 byte address family in
+             network byte order.
+   Input   : Packet event, packet data, captured length.
+   Output  : PV_DECODE_OK or a decode error.
+*/
+int decode_loop(pv_packet_event_t *event, u_char *packet, uint32_t caplen)
+{
+   if (caplen < 4)
+   {
+      return(PV_DECODE_SHORT);
+   }
+
+   return(decode_loopback_family(event, packet, caplen, PV_GET32(packet)));
+}
+
+/*
+   Function: decode_raw
+   Purpose : Layer 2 decoder for raw IP captures.
+   Input   : Packet event, packet data, captured length.
+   Output  : PV_DECODE_OK or a decode error.
+*/
+int decode_raw(pv_packet_event_t *event, u_char *packet, uint32_t caplen)
+{
+   return(decode_ip_version(event, packet, caplen, 0));
+}
+
+/*
+   Function: decode_ppp
+   Purpose : Layer 2 decoder for PPP, the address and control bytes are
+             optional, then a two byte protocol.
+   Input   : Packet event, packet data, captured length.
+   Output  : PV_DECODE_OK or a decode error.
+*/
+int decode_ppp(pv_packet_event_t *event, u_char *packet, uint32_t caplen)
+{
+   uint32_t offset = 0;
+
+   if (caplen < 4)
+   {
+      return(PV_DECODE_SHORT);
+   }
+   if ((packet[0] == 0xff) && (packet[1] == 0x03))
+   {
+      offset = 2;
+   }
+
+   switch (PV_GET16(packet + offset))
+   {
+   case 0x0021:
+      return(decode_ipv4(event, packet, caplen, offset + 2, 0));
+
+   case 0x0057:
+      return(decode_ipv6(event, packet, caplen, offset + 2, 0));
+   }
+
+   return(PV_DECODE_UNSUPPORTED);
+}
+
+/*
+   Function: decode_slip
+   Purpose : Layer 2 decoder for SLIP, a 16 byte pseudo header then IP.
+   Input   : Packet event, packet data, captured length.
+   Output  : PV_DECODE_OK or a decode error.
+*/
+int decode_slip(pv_packet_event_t *event, u_char *packet, uint32_t caplen)
+{
+   return(decode_ip_version(event, packet, caplen, 16));
+}
+
+/*
+   Function: reset_network_layer
+   Purpose : Clears the network and transport fields of the event before
+             an IP header is decoded, an inner packet replaces the fields
+             of the tunnel packet.
+   Input   : Packet event, IP header offset, IP version.
+   Output  : None.
+*/
+void reset_network_layer(pv_packet_event_t *event, uint32_t offset, uint8_t version)
+{
+   memset(&event->key, 0, sizeof(pv_flow_key_t));
+   event->tcp_seq = 0;
+   event->tcp_ack = 0;
+   event->tcp_window = 0;
+   event->tcp_flags = 0;
+   event->tcp_header_length = 0;
+   event->icmp_type = 0;
+   event->icmp_code = 0;
+   event->icmp_ident = 0;
+   event->icmp_sequence = 0;
+   event->desc.l3_offset = offset;
+   event->desc.l4_offset = 0;
+   event->desc.payload_offset = 0;
+   event->desc.payload_length = 0;
+   event->desc.flags = 0;
+   event->desc.ip_version = version;
+
+   return;
+}
+
+/*
+   Function: decode_ipv4
+   Purpose : Decodes an IPv4 header then the transport layer. Non first
+             fragments and truncated options stop after the IP fields.
+   Input   : Packet event, packet data, captured length, IP header offset, tunnel depth.
+   Output  : PV_DECODE_OK or PV_DECODE_SHORT if there is no whole IP header.
+*/
+int decode_ipv4(pv_packet_event_t *event, u_char *packet, uint32_t caplen, uint32_t offset, int depth)
+{
+   u_char *iphdr = packet + offset;
+   uint32_t header_length, end;
+
+   if ((caplen < offset + 20) || ((iphdr[0] >> 4) != 4) || ((iphdr[0] & 0x0f) < 5))
+   {
+      return(PV_DECODE_SHORT);
+   }
+
+   reset_network_layer(event, offset, 4);
+   header_length = 4 * (iphdr[0] & 0x0f);
+   event->ip_tos = iphdr[1];
+   event->ip_length = PV_GET16(iphdr + 2);
+   event->ip_id = PV_GET16(iphdr + 4);
+   event->ip_ttl = iphdr[8];
+   event->ip_header_length = header_length;
+   event->key.family = PV_FLOW_IPV4;
+   event->key.protocol = iphdr[9];
+   memcpy(event->key.src_addr, iphdr + 12, 4);
+   memcpy(event->key.dst_addr, iphdr + 16, 4);
+
+   if (PV_GET16(iphdr + 6) & 0x1fff)
+   {
+      event->desc.flags |= PV_DECODE_FRAGMENT;
+      return(PV_DECODE_OK);
+   }
+   if (caplen < offset + header_length)
+   {
+      return(PV_DECODE_OK);
+   }
+
+   /* Segmentation offload can leave the total length zero, use the captured length. */
+   end = offset + event->ip_length;
+   if ((event->ip_length < header_length) || (end > caplen))
+   {
+      end = caplen;
+   }
+
+   return(decode_transport(event, packet, end, offset + header_length, iphdr[9], depth));
+}
+
+/*
+   Function: decode_ipv6
+   Purpose : Decodes an IPv6 header and skips the extension headers to the
+             transport layer. Non first fragments, ESP and unknown headers
+             stop after the IP fields.
+   Input   : Packet event, packet data, captured length, IP header offset, tunnel depth.
+   Output  : PV_DECODE_OK or PV_DECODE_SHORT if there is no whole IP header.
+*/
+int decode_ipv6(pv_packet_event_t *event, u_char *packet, uint32_t caplen, uint32_t offset, int depth)
+{
+   u_char *iphdr = packet + offset;
+   u_char *exthdr;
+   uint32_t header_offset, end;
+   uint8_t next_header;
+   int i;
+
+   if ((caplen < offset + 40) || ((iphdr[0] >> 4) != 6))
+   {
+      return(PV_DECODE_SHORT);
+   }
+
+   reset_network_layer(event, offset, 6);
+   event->ip_tos = (uint8_t)(PV_GET16(iphdr) >> 4);
+   event->ip_length = PV_GET16(iphdr + 4) + 40;
+   event->ip_ttl = iphdr[7];
+   event->key.family = PV_FLOW_IPV6;
+   memcpy(event->key.src_addr, iphdr + 8, 16);
+   memcpy(event->key.dst_addr, iphdr + 24, 16);
+
+   end = offset + event->ip_length;
+   if ((event->ip_length == 40) || (end > caplen))
+   {
+      end = caplen;
+   }
+
+   next_header = iphdr[6];
+   header_offset = offset + 40;
+   for (i = 0; i < PV_DECODE_MAX_IPV6_EXT; i++)
+   {
+      if ((next_header != IPPROTO_HOPOPTS) && (next_header != IPPROTO_ROUTING) && (next_header != IPPROTO_DSTOPTS)
+          && (next_header != IPPROTO_FRAGMENT) && (next_header != IPPROTO_AH))
+      {
+         break;
+      }
+      if (end < header_offset + 8)
+      {
+         event->key.protocol = next_header;
+         event->ip_header_length = header_offset - offset;
+         return(PV_DECODE_OK);
+      }
+      exthdr = packet + header_offset;
+      if (next_header == IPPROTO_FRAGMENT)
+      {
+         event->ip_id = (uint16_t)PV_GET32(exthdr + 4);
+         if (PV_GET16(exthdr + 2) & 0xfff8)
+         {
+            event->desc.flags |= PV_DECODE_FRAGMENT;
+            event->key.protocol = exthdr[0];
+            event->ip_header_length = header_offset + 8 - offset;
+            return(PV_DECODE_OK);
+         }
+         header_offset += 8;
+      }
+      else if (next_header == IPPROTO_AH)
+      {
+         header_offset += (exthdr[1] + 2) * 4;
+      }
+      else
+      {
+         header_offset += (exthdr[1] + 1) * 8;
+      }
+      next_header = exthdr[0];
+   }
+
+   event->key.protocol = next_header;
+   event->ip_header_length = header_offset - offset;
+   if (end < header_offset)
+   {
+      return(PV_DECODE_OK);
+   }
+
+   return(decode_transport(event, packet, end, header_offset, next_header, depth));
+}
+
+/*
+   Function: decode_tunnel
+   Purpose : Decodes the packet carried by a tunnel. The outer event is
+             restored if the inner packet can not be decoded, or the tunnel
+             nesting is too deep.
+   Input   : Packet event, packet data, end of the tunnel payload, inner
+             packet offset, ethertype of the inner packet or 0 for an
+             Ethernet frame, tunnel type, tunnel depth.
+   Output  : PV_DECODE_OK.
+*/
+int decode_tunnel(pv_packet_event_t *event, u_char *packet, uint32_t end, uint32_t offset, uint16_t ethertype, uint8_t tunnel, int depth)
+{
+   pv_packet_event_t outer;
+   int res;
+
+   if (depth >= PV_DECODE_MAX_TUNNELS)
+   {
+      return(PV_DECODE_OK);
+   }
+
+   memcpy(&outer, event, sizeof(pv_packet_event_t));
+   if (ethertype == 0)
+   {
+      res = decode_ethernet_frame(event, packet, end, offset, depth + 1);
+   }
+   else
+   {
+      res = decode_ethertype(event, packet, end, offset, ethertype, depth + 1);
+   }
+
+   if (res != PV_DECODE_OK)
+   {
+      memcpy(event, &outer, sizeof(pv_packet_event_t));
+      return(PV_DECODE_OK);
+   }
+   if (outer.desc.tunnel == PV_TUNNEL_NONE)
+   {
+      event->desc.tunnel = tunnel;
+   }
+
+   return(PV_DECODE_OK);
+}
+
+/*
+   Function: decode_gre
+   Purpose : Decodes a version 0 GRE header, skips the optional checksum,
+             key and sequence fields then decapsulates the payload. GRE
+             protocol 0x6558 carries Ethernet frames.
+   Input   : Packet event, packet data, end of the IP payload, GRE header offset, tunnel depth.
+   Output  : PV_DECODE_OK.
+*/
+int decode_gre(pv_packet_event_t *event, u_char *packet, uint32_t end, uint32_t offset, int depth)
+{
+   uint16_t flags, protocol;
+   uint32_t length = 4;
+
+   if (end < offset + 4)
+   {
+      return(PV_DECODE_OK);
+   }
+   flags = PV_GET16(packet + offset);
+   protocol = PV_GET16(packet + offset + 2);
+   if ((flags & 0x0007) != 0)  /* version 1 is PPTP */
+   {
+      return(PV_DECODE_OK);
+   }
+   if (flags & 0x8000)  /* checksum */
+   {
+      length += 4;
+   }
+   if (flags & 0x2000)  /* key */
+   {
+      length += 4;
+   }
+   if (flags & 0x1000)  /* sequence number */
+   {
+      length += 4;
+   }
+
+   return(decode_tunnel(event, packet, end, offset + length, (protocol == 0x6558) ? 0 : protocol, PV_TUNNEL_GRE, depth));
+}
+
+/*
+   Function: decode_transport
+   Purpose : Decodes the TCP, UDP, ICMP or ICMPv6 header and sets the
+             payload offset and length, or decapsulates a tunnel.
+   Input   : Packet event, packet data, end of the IP payload, transport
+             header offset, IP protocol, tunnel depth.
+   Output  : PV_DECODE_OK.
+*/
+int decode_transport(pv_packet_event_t *event, u_char *packet, uint32_t end, uint32_t offset, uint8_t protocol, int depth)
+{
+   u_char *l4hdr = packet + offset;
+   uint32_t payload;
+
+   switch (protocol)
+   {
+   case IPPROTO_TCP:
+      if (end < offset + 20)
+      {
+         return(PV_DECODE_OK);
+      }
+      memcpy(&event->key.src_port, l4hdr, 2);
+      memcpy(&event->key.dst_port, l4hdr + 2, 2);
+      event->tcp_seq = PV_GET32(l4hdr + 4);
+      event->tcp_ack = PV_GET32(l4hdr + 8);
+      event->tcp_header_length = 4 * (l4hdr[12] >> 4);
+      event->tcp_flags = l4hdr[13];
+      event->tcp_window = PV_GET16(l4hdr + 14);
+      payload = offset + ((event->tcp_header_length > 20) ? event->tcp_header_length : 20);
+      break;
+
+   case IPPROTO_UDP:
+      if (end < offset + 8)
+      {
+         return(PV_DECODE_OK);
+      }
+      memcpy(&event->key.src_port, l4hdr, 2);
+      memcpy(&event->key.dst_port, l4hdr + 2, 2);
+      payload = offset + 8;
+      if ((PV_GET16(l4hdr + 2) == PV_VXLAN_PORT) && (end >= payload + 8) && (packet[payload] & 0x08))
+      {
+         event->desc.l4_offset = offset;
+         event->desc.payload_offset = payload;
+         event->desc.payload_length = end - payload;
+         return(decode_tunnel(event, packet, end, payload + 8, 0, PV_TUNNEL_VXLAN, depth));
+      }
+      break;
+
+   case IPPROTO_ICMP:
+   case IPPROTO_ICMPV6:
+      if (end < offset + 8)
+      {
+         return(PV_DECODE_OK);
+      }
+      event->icmp_type = l4hdr[0];
+      event->icmp_code = l4hdr[1];
+      event->icmp_ident = PV_GET16(l4hdr + 4);
+      event->icmp_sequence = PV_GET16(l4hdr + 6);
+      payload = offset + 8;
+      break;
+
+   case IPPROTO_GRE:
+      return(decode_gre(event, packet, end, offset, depth));
+
+   case IPPROTO_IPIP:
+      return(decode_tunnel(event, packet, end, offset, ETHERTYPE_IP, PV_TUNNEL_IPIP, depth));
+
+   case IPPROTO_IPV6:
+      return(decode_tunnel(event, packet, end, offset, ETHERTYPE_IPV6, PV_TUNNEL_IPIP, depth));
+
+   default:
+      return(PV_DECODE_OK);
+   }
+
+   event->desc.l4_offset = offset;
+   if (payload < end)
+   {
+      event->desc.payload_offset = payload;
+      event->desc.payload_length = end - payload;
+   }
+
+   return(PV_DECODE_OK);
+}
@@ -0,0 +1,422 @@
+/*  Copyright 2014 Derek Chadwick
+
+    This file is part of the Pivotal Network Security Tools.
+
+    Pivotal is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Pivotal is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Pivotal.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+   pvdns.c
+
+   Title : Pivotal NST Sensor DNS Dissector
+   Author: Derek Chadwick
+   Date  : 17/10/2026
+
+   Purpose: Parses DNS queries and responses on port 53 (-d option) and
+            counts them per domain.
+
+            The parser reads the header, the first question and the
+            answer records in place, the only thing written is the query
+            name, lower cased into a buffer on the stack. Compression
+            pointers are followed backwards only, so a message cannot make
+            the parser loop. Answers cut off by the snaplen are not counted.
+
+            The domains are interned in a string map shared by the
+            workers, see pvstrmap.c, the same as the URLs of pvurlmap.c.
+            The string count of a domain is its queries, and the record
+            adds response, NXDOMAIN and answer counters.
+
+            DNS messages that parse are counted instead of being output as
+            packet events, every statistics report (-U option) a summary
+            with the most queried domains of the interval is written to the
+            statistics file and sent to the server as a <control>dns
+            message, for example:
+
+            DNS: 52210 queries 51873 responses 1702 NXDOMAIN 3 malformed
+            Domains: 4711 stored 96520 bytes 0 not stored
+                 queries        total nxdomain type   domain
+                    1450        20671        0 A      www.example.com
+
+   Status : EXPERIMENTAL - not for use in production networks.
+
+*/
+
+#include "pvcommon.h"
+#include "pivot-sensor.h"
+
+extern pv_worker_t *workers;
+extern int worker_count;
+
+pv_string_map_t dns_table;
+
+/*
+   Function: init_dns_table
+   Purpose : Allocates the domain string map.
+   Input   : Number of domains, arena size in bytes.
+   Output  : Returns 0.
+*/
+int init_dns_table(uint32_t capacity, uint32_t arena_size)
+{
+   return(init_string_map(&dns_table, capacity, arena_size, sizeof(pv_dns_record_t), rank_domain));
+}
+
+/*
+   Function: read_dns_name
+   Purpose : Reads a domain name at an offset in a DNS message, following
+             compression pointers. The name is lower cased and written in
+             dotted form. The names go into the <control>dns messages, so
+             markup characters, '/' and bytes that are not printable become
+             '?'. The root name is written as ".".
+   Input   : Message, message length, offset of the name, name buffer of
+             PV_DNS_NAME_MAX bytes or NULL to only skip the name, returns
+             the name length.
+   Output  : Offset after the name in the message, or 0 if the name is
+             malformed or cut off.
+*/
+uint32_t read_dns_name(const uint8_t *msg, uint32_t len, uint32_t offset, char *name, uint32_t *name_length)
+{
+   uint32_t next = 0;           /* after the name where it started, before any pointer */
+   uint32_t n = 0, i, label;
+   uint8_t c;
+
+   while (offset < len)
+   {
+      label = msg[offset];
+      if (label == 0)
+      {
+         if (next == 0)
+         {
+            next = offset + 1;
+         }
+         break;
+      }
+      if ((label & 0xC0) == 0xC0)
+      {
+         if (offset + 1 >= len)
+         {
+            return(0);
+         }
+         if (next == 0)
+         {
+            next = offset + 2;
+         }
+         if (name == NULL)
+         {
+            return(next);
+         }
+         label = ((label & 0x3F) << 8) | msg[offset + 1];
+         if (label >= offset)
+         {
+            return(0);    /* pointers only go backwards, no loops */
+         }
+         offset = label;
+         continue;
+      }
+      if (((label & 0xC0) != 0) || (offset + 1 + label > len))
+      {
+         return(0);
+      }
+      if (name != NULL)
+      {
+         if (n + label + 1 >= PV_DNS_NAME_MAX)
+         {
+            return(0);
+         }
+         if (n > 0)
+         {
+            name[n++] = '.';
+         }
+         for (i = 1; i <= label; i++)
+         {
+            c = msg[offset + i];
+            if ((c >= 'A') && (c <= 'Z'))
+            {
+               c |= 0x20;
+            }
+            else if (!PV_TEXT_CHAR(c) || (c == '.') || (c == '/'))
+            {
+               c = '?';
+            }
+            name[n++] = c;
+         }
+      }
+      offset += 1 + label;
+   }
+   if (next == 0)
+   {
+      return(0);
+   }
+
+   if (name != NULL)
+   {
+      if (n == 0)
+      {
+         name[n++] = '.';
+      }
+      name[n] = 0;
+      *name_length = n;
+   }
+
+   return(next);
+}
+
+/*
+   Function: parse_dns_message
+   Purpose : Parses the header, the first question and the answer records
+             of a DNS message. TCP messages start with a two byte length.
+   Input   : Payload, payload length, TCP flag, message to fill in, name
+             buffer of PV_DNS_NAME_MAX bytes.
+   Output  : Returns 1 if the payload is a DNS message with a question,
+             otherwise 0.
+*/
+int parse_dns_message(const uint8_t *data, uint32_t len, int tcp, pv_dns_message_t *message, char *name)
+{
+   uint32_t offset, answers, i, rdlength;
+   uint16_t type;
+
+   if (tcp)
+   {
+      if (len < 2 + PV_DNS_HEADER_LENGTH)
+      {
+         return(0);
+      }
+      data += 2;
+      len -= 2;
+   }
+   if (len < PV_DNS_HEADER_LENGTH)
+   {
+      return(0);
+   }
+
+   memset(message, 0, sizeof(pv_dns_message_t));
+   message->id = (data[0] << 8) | data[1];
+   message->flags = (data[2] << 8) | data[3];
+   message->rcode = message->flags & 0x000F;
+   answers = (data[6] << 8) | data[7];
+   if ((((data[4] << 8) | data[5]) == 0) || (((message->flags >> 11) & 0x0F) > PV_DNS_MAX_OPCODE))
+   {
+      return(0);
+   }
+
+   offset = read_dns_name(data, len, PV_DNS_HEADER_LENGTH, name, &message->name_length);
+   if ((offset == 0) || (offset + 4 > len))
+   {
+      return(0);
+   }
+   message->qtype = (data[offset] << 8) | data[offset + 1];
+   offset += 4;
+
+   if (!(message->flags & PV_DNS_RESPONSE))
+   {
+      return(1);
+   }
+
+   for (i = 0; (i < answers) && (i < PV_DNS_MAX_ANSWERS); i++)
+   {
+      if (((offset = read_dns_name(data, len, offset, NULL, NULL)) == 0) || (offset + 10 > len))
+      {
+         break;
+      }
+      type = (data[offset] << 8) | data[offset + 1];
+      rdlength = (data[offset + 8] << 8) | data[offset + 9];
+      offset += 10 + rdlength;
+      if (offset > len)
+      {
+         break;
+      }
+      message->answers++;
+      if ((type == PV_DNS_TYPE_A) || (type == PV_DNS_TYPE_AAAA))
+      {
+         message->addresses++;
+      }
+   }
+
+   return(1);
+}
+
+/*
+   Function: rank_domain
+   Purpose : Ranks a domain by its queries, domains only seen in responses
+             are ranked by their responses.
+   Input   : Domain record.
+   Output  : Rank for select_top_strings().
+*/
+uint64_t rank_domain(pv_string_record_t *record)
+{
+   return((record->count > 0) ? record->count : ((pv_dns_record_t *)record)->responses);
+}
+
+/*
+   Function: update_dns
+   Purpose : Counts a DNS message in the worker counters and against its
+             query name in the domain table.
+   Input   : Worker, packet event, payload.
+   Output  : Returns 1 if the payload was a DNS message and the packet
+             event is not needed, otherwise 0.
+*/
+int update_dns(pv_worker_t *worker, pv_packet_event_t *event, uint8_t *payload)
+{
+   pv_dns_message_t message;
+   pv_dns_record_t *record;
+   char name[PV_DNS_NAME_MAX];
+
+   if (!parse_dns_message(payload, event->desc.payload_length, (event->key.protocol == IPPROTO_TCP), &message, name))
+   {
+      if (event->desc.payload_length > 0)
+      {
+         worker->dns_malformed++;
+      }
+      return(0);
+   }
+
+   record = (pv_dns_record_t *)add_string(&dns_table, name, message.name_length, event->ts_sec);
+   if (message.flags & PV_DNS_RESPONSE)
+   {
+      worker->dns_responses++;
+      if (message.rcode == PV_DNS_NXDOMAIN)
+      {
+         worker->dns_nxdomain++;
+      }
+      if (record != NULL)
+      {
+         __atomic_fetch_add(&record->responses, 1, __ATOMIC_RELAXED);
+         __atomic_fetch_add(&record->answers, message.addresses, __ATOMIC_RELAXED);
+         if (message.rcode == PV_DNS_NXDOMAIN)
+         {
+            __atomic_fetch_add(&record->nxdomain, 1, __ATOMIC_RELAXED);
+         }
+      }
+   }
+   else
+   {
+      worker->dns_queries++;
+      if (record != NULL)
+      {
+         __atomic_fetch_add(&record->string.count, 1, __ATOMIC_RELAXED);
+         record->qtype = message.qtype;
+      }
+   }
+
+   return(1);
+}
+
+/*
+   Function: get_dns_type_name
+   Purpose : Names the common DNS query types.
+   Input   : Query type.
+   Output  : Returns the type name, NULL for other types.
+*/
+char *get_dns_type_name(uint16_t qtype)
+{
+   switch (qtype)
+   {
+   case 1:   return("A");
+   case 2:   return("NS");
+   case 5:   return("CNAME");
+   case 6:   return("SOA");
+   case 12:  return("PTR");
+   case 15:  return("MX");
+   case 16:  return("TXT");
+   case 28:  return("AAAA");
+   case 33:  return("SRV");
+   case 65:  return("HTTPS");
+   case 255: return("ANY");
+   }
+
+   return(NULL);
+}
+
+/*
+   Function: format_dns_summary
+   Purpose : Renders the DNS counters and a top domain list.
+   Input   : Counters (queries, responses, NXDOMAIN, malformed), top list,
+             entries, output string and length.
+   Output  : Number of characters written.
+*/
+int format_dns_summary(unsigned long *counts, pv_string_top_t *top, int count, char *out, int len)
+{
+   pv_dns_record_t *record;
+   char *type;
+   int n, i;
+
+   n = snprintf(out, len, "DNS: %lu queries %lu responses %lu NXDOMAIN %lu malformed\n", counts[0], counts[1], counts[2], counts[3]);
+   n += snprintf(out + n, len - n, "Domains: %u stored %u bytes %lu not stored\n%12s %12s %8s %-6s %s\n",
+                 dns_table.count, dns_table.arena_used, dns_table.not_stored, "queries", "total", "nxdomain", "type", "domain");
+   for (i = 0; (i < count) && (len - n > PV_DNS_NAME_MAX + 48); i++)
+   {
+      record = (pv_dns_record_t *)top[i].record;
+      if ((type = get_dns_type_name(record->qtype)) != NULL)
+      {
+         n += snprintf(out + n, len - n, "%12lu %12lu %8lu %-6s %s\n", (unsigned long)top[i].count, (unsigned long)record->string.count,
+                       (unsigned long)record->nxdomain, type, get_map_string(&dns_table, top[i].record));
+      }
+      else
+      {
+         n += snprintf(out + n, len - n, "%12lu %12lu %8lu %-6u %s\n", (unsigned long)top[i].count, (unsigned long)record->string.count,
+                       (unsigned long)record->nxdomain, record->qtype, get_map_string(&dns_table, top[i].record));
+      }
+   }
+
+   return(n);
+}
+
+/*
+   Function: sum_dns_counts
+   Purpose : Adds up the worker DNS counters.
+   Input   : Counters to fill in, PV_DNS_COUNTERS.
+   Output  : None.
+*/
+void sum_dns_counts(unsigned long *counts)
+{
+   int i;
+
+   memset(counts, 0, PV_DNS_COUNTERS * sizeof(unsigned long));
+   for (i = 0; (workers != NULL) && (i < worker_count); i++)
+   {
+      counts[0] += workers[i].dns_queries;
+      counts[1] += workers[i].dns_responses;
+      counts[2] += workers[i].dns_nxdomain;
+      counts[3] += workers[i].dns_malformed;
+   }
+}
+
+/*
+   Function: print_dns_summary
+   Purpose : Prints the DNS counters and the most queried domains since
+             capture started.
+   Input   : Number of domains to print.
+   Output  : None.
+*/
+void print_dns_summary(unsigned int k)
+{
+   char report[PV_STATS_REPORT_MAX];
+   unsigned long counts[PV_DNS_COUNTERS];
+   pv_string_top_t *top = xmalloc(k * sizeof(pv_string_top_t));
+
+   sum_dns_counts(counts);
+   format_dns_summary(counts, top, select_top_strings(&dns_table, top, k, 0), report, PV_STATS_REPORT_MAX);
+   fputs(report, stdout);
+   free(top);
+}
+
+/*
+   Function: delete_dns_table
+   Purpose : Frees the DNS domain string map.
+   Input   : None.
+   Output  : None.
+*/
+void delete_dns_table()
+{
+   delete_string_map(&dns_table);
+}
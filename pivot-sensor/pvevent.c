@@ -0,0 +1,305 @@
+/*  Copyright 2014 Derek Chadwick
+
+    This file is part of the Pivotal Network Security Tools.
+
+    Pivotal is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Pivotal is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Pivotal.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+   pvevent.c
+
+   Title : Pivotal NST Sensor Packet Event Output
+   Author: Derek Chadwick
+   Date  : 17/10/2026
+
+   Purpose: Output stage for packet events and completed flows. The
+            decoder fills in a fixed size binary event, the event text and
+            the Fineline event record are only rendered here, once, and only
+            for the outputs that are enabled: event file, Pivotal Server and
+            the console (unless the -Q option is given). Sensor alerts are
+            rendered here as well. Called by the output threads, see
+            pvoutput.c.
+
+   Status : EXPERIMENTAL - not for use in production networks.
+
+*/
+
+#include "pvcommon.h"
+#include "pivot-sensor.h"
+
+extern int options;
+extern struct in_addr server_ipv4_addr;
+extern unsigned int server_ipv4_port;
+
+/*
+   Function: format_packet_event
+   Purpose : Renders the event data text for a packet event, for example
+             "TCP  1.2.3.4:80 -> 5.6.7.8:1234 ID:1 TOS:0x0 TTL:64 ...".
+             VLAN IDs and the tunnel type are added when the packet had them.
+   Input   : Packet event, output string and length.
+   Output  : Number of characters written.
+*/
+int format_packet_event(pv_packet_event_t *event, char *out, int len)
+{
+   char srcip[INET6_ADDRSTRLEN], dstip[INET6_ADDRSTRLEN];
+   int family = (event->key.family == PV_FLOW_IPV6) ? AF_INET6 : AF_INET;
+   int n, i;
+
+   /* Fragments after the first have no transport header. */
+   switch ((event->desc.flags & PV_DECODE_FRAGMENT) ? IPPROTO_RAW : event->key.protocol)
+   {
+   case IPPROTO_TCP:
+      n = format_flow_key(&event->key, out, len);
+      n += snprintf(out + n, len - n, "ID:%d TOS:0x%x TTL:%d IpLen:%d DgLen:%d %c%c%c%c%c%c Seq: 0x%x Ack: 0x%x Win: 0x%x TcpLen: %d ",
+                    event->ip_id, event->ip_tos, event->ip_ttl, event->ip_header_length, event->ip_length,
+                    ((event->tcp_flags & TH_URG) ? 'U' : '*'),
+                    ((event->tcp_flags & TH_ACK) ? 'A' : '*'),
+                    ((event->tcp_flags & TH_PUSH) ? 'P' : '*'),
+                    ((event->tcp_flags & TH_RST) ? 'R' : '*'),
+                    ((event->tcp_flags & TH_SYN) ? 'S' : '*'),
+                    ((event->tcp_flags & TH_FIN) ? 'F' : '*'),
+                    event->tcp_seq, event->tcp_ack, event->tcp_window, event->tcp_header_length);
+      break;
+
+   case IPPROTO_UDP:
+      n = format_flow_key(&event->key, out, len);
+      n += snprintf(out + n, len - n, "ID:%d TOS:0x%x TTL:%d IpLen:%d DgLen:%d ",
+                    event->ip_id, event->ip_tos, event->ip_ttl, event->ip_header_length, event->ip_length);
+      break;
+
+   case IPPROTO_ICMP:
+   case IPPROTO_ICMPV6:
+      n = format_flow_key(&event->key, out, len);
+      n += snprintf(out + n, len - n, "ID:%d TOS:0x%x TTL:%d IpLen:%d DgLen:%d Type:%d Code:%d ID:%d Seq:%d ",
+                    event->ip_id, event->ip_tos, event->ip_ttl, event->ip_header_length, event->ip_length,
+                    event->icmp_type, event->icmp_code, event->icmp_ident, event->icmp_sequence);
+      break;
+
+   default:
+      inet_ntop(family, event->key.src_addr, srcip, INET6_ADDRSTRLEN);
+      inet_ntop(family, event->key.dst_addr, dstip, INET6_ADDRSTRLEN);
+      n = snprintf(out, len, "Src: %s Dst: %s Hdr: ID:%d TOS:0x%x TTL:%d IpLen:%d DgLen:%d Proto:%d ", srcip, dstip,
+                   event->ip_id, event->ip_tos, event->ip_ttl, event->ip_header_length, event->ip_length, event->key.protocol);
+   }
+
+   for (i = 0; (i < event->desc.vlan_count) && (n < len); i++)
+   {
+      n += snprintf(out + n, len - n, "VLAN:%d ", event->desc.vlan_id[i]);
+   }
+   if ((event->desc.tunnel != PV_TUNNEL_NONE) && (n < len))
+   {
+      n += snprintf(out + n, len - n, "Tunnel:%s ", get_tunnel_name(event->desc.tunnel));
+   }
+
+   return(n);
+}
+
+/*
+   Function: output_packet_event
+   Purpose : Renders the packet event and writes it to the enabled outputs.
+             Nothing is formatted if there is no output for the event.
+   Input   : Output stage, packet event.
+   Output  : None.
+*/
+void output_packet_event(pv_output_t *output, pv_packet_event_t *event)
+{
+   char event_data[512];
+   char fl_event_string[PV_MAX_INPUT_STR];
+   int to_server = 0;
+
+   /*
+      Only send the event record to the server if the packet captured was not
+      from us to the server, this is to prevent recursive introspection.
+      Server filtering should already be included in the BPF filters,
+      this is a double check to prevent a packet storm in case the BPF
+      filters are not working or have been omitted.
+   */
+   if (options & PV_SERVER_OUT)
+   {
+      to_server = !((event->key.family == PV_FLOW_IPV4) && (event->key.protocol == IPPROTO_TCP)
+                    && (memcmp(event->key.dst_addr, &server_ipv4_addr, 4) == 0) && (event->key.dst_port == server_ipv4_port));
+   }
+
+   if (!(options & PV_FILE_OUT) && !to_server && (options & PV_QUIET_OUT))
+   {
+      return;
+   }
+
+   format_packet_event(event, event_data, sizeof(event_data));
+   if ((options & PV_FILE_OUT) || to_server)
+   {
+      /* Create a Fineline event record string */
+      create_record(fl_event_string, PV_PACKET_RECORD, "Pivot Sensor Packet Event", event_data, event->ts_sec, event->ts_usec);
+   }
+   PV_STAGE_MARK(output, PV_STAGE_FORMAT);
+
+   /* Now write a Fineline event record. */
+   if (options & PV_FILE_OUT)
+   {
+      buffer_output_event(output, fl_event_string);
+      PV_STAGE_MARK(output, PV_STAGE_FILE);
+   }
+
+   if (to_server)
+   {
+      send_server_event(fl_event_string);
+      PV_STAGE_MARK(output, PV_STAGE_SEND);
+   }
+
+   if (!(options & PV_QUIET_OUT))
+   {
+      printf("%s\n", event_data);
+      printf("------------------------------------------------------------\n\n");
+      PV_STAGE_MARK(output, PV_STAGE_CONSOLE);
+   }
+
+   return;
+}
+
+/*
+   Function: output_flow_export
+   Purpose : Creates a Fineline flow record for a completed flow and
+             writes it to the event file and/or sends it to the server.
+   Input   : Output stage, completed flow.
+   Output  : None.
+*/
+void output_flow_export(pv_output_t *output, pv_flow_export_t *flow)
+{
+   char key_value[PV_FLOW_TEXT_MAX];
+   char flow_data[PV_MAX_INPUT_STR];
+   char fl_event_string[PV_MAX_INPUT_STR];
+   uint64_t duration = flow->last_ts - flow->first_ts;
+   int n;
+
+   if (!(options & (PV_FILE_OUT | PV_SERVER_OUT)))
+   {
+      return;
+   }
+
+   format_flow_key(&flow->key, key_value, PV_FLOW_TEXT_MAX);
+   n = snprintf(flow_data, PV_MAX_INPUT_STR, "%sPackets:%lu Bytes:%lu Start:%lu.%06lu End:%lu.%06lu Duration:%lu.%06lu TcpFlags:0x%02x Reason:%s",
+            key_value, (unsigned long)flow->packet_count, (unsigned long)flow->data_size,
+            (unsigned long)(flow->first_ts / 1000000), (unsigned long)(flow->first_ts % 1000000),
+            (unsigned long)(flow->last_ts / 1000000), (unsigned long)(flow->last_ts % 1000000),
+            (unsigned long)(duration / 1000000), (unsigned long)(duration % 1000000),
+            flow->tcp_flags, flow->reason);
+   if (flow->has_tls)
+   {
+      format_tls_info(&flow->tls, flow_data + n, PV_MAX_INPUT_STR - n);
+   }
+
+   create_record(fl_event_string, PV_FLOW_RECORD, "Pivot Sensor Flow Record", flow_data, (time_t)(flow->last_ts / 1000000),
+                 (long)(flow->last_ts % 1000000));
+
+   if (options & PV_FILE_OUT)
+   {
+      buffer_output_event(output, fl_event_string);
+   }
+   if (options & PV_SERVER_OUT)
+   {
+      send_server_event(fl_event_string);
+   }
+
+   return;
+}
+
+/*
+   Function: format_alert
+   Purpose : Renders the event data text for an alert. Scan alerts also
+             name the destination of the last connection attempt.
+   Input   : Alert, output string and length.
+   Output  : Number of characters written.
+*/
+int format_alert(pv_alert_t *alert, char *out, int len)
+{
+   char host[INET6_ADDRSTRLEN], dstip[INET6_ADDRSTRLEN];
+   char key_value[PV_FLOW_TEXT_MAX];
+   char pattern[PV_IOC_TEXT_MAX];
+   uint8_t prefix[16];
+   int family = (alert->key.family == PV_FLOW_IPV6) ? AF_INET6 : AF_INET;
+
+   inet_ntop(family, alert->key.src_addr, host, INET6_ADDRSTRLEN);
+   inet_ntop(family, alert->key.dst_addr, dstip, INET6_ADDRSTRLEN);
+
+   switch (alert->type)
+   {
+   case PV_ALERT_FANOUT:
+      return(snprintf(out, len, "Alert: Fan-out Src: %s Destinations: %u Window: %us Threshold: %u",
+                      host, alert->value, alert->window, alert->threshold));
+
+   case PV_ALERT_FANIN:
+      return(snprintf(out, len, "Alert: Fan-in Dst: %s Sources: %u Window: %us Threshold: %u",
+                      host, alert->value, alert->window, alert->threshold));
+
+   case PV_ALERT_PORTSCAN:
+      return(snprintf(out, len, "Alert: Port scan Src: %s Dst: %s Ports: %u Window: %us Threshold: %u",
+                      host, dstip, alert->value, alert->window, alert->threshold));
+
+   case PV_ALERT_SYNFLOOD:
+      return(snprintf(out, len, "Alert: SYN flood Src: %s Dst: %s:%u SYNs: %u Rate: %u/s Window: %us Threshold: %u",
+                      host, dstip, ntohs(alert->key.dst_port), alert->value, alert->value / alert->window, alert->window, alert->threshold));
+
+   case PV_ALERT_NGRAM:
+      format_flow_key(&alert->key, key_value, PV_FLOW_TEXT_MAX);
+      return(snprintf(out, len, "Alert: Payload anomaly %sScore: %u%% Threshold: %u%%", key_value, alert->value, alert->threshold));
+
+   case PV_ALERT_IOC:
+      format_flow_key(&alert->key, key_value, PV_FLOW_TEXT_MAX);
+      format_ioc_pattern(alert->value, pattern, PV_IOC_TEXT_MAX);
+      return(snprintf(out, len, "Alert: IOC match %sPattern: %s Line: %u", key_value, pattern, ioc_matcher.patterns[alert->value].line));
+
+   case PV_ALERT_BLOCKLIST:
+      format_flow_key(&alert->key, key_value, PV_FLOW_TEXT_MAX);
+      memset(prefix, 0, 16);
+      mask_prefix(prefix, (alert->direction == PV_LPM_SRC) ? alert->key.src_addr : alert->key.dst_addr, (family == AF_INET6) ? 16 : 4, alert->threshold);
+      inet_ntop(family, prefix, host, INET6_ADDRSTRLEN);
+      return(snprintf(out, len, "Alert: Blocklist %sMatched: %s %s/%u List: %s", key_value, (alert->direction == PV_LPM_SRC) ? "src" : "dst",
+                      host, alert->threshold, alert->list));
+   }
+
+   return(snprintf(out, len, "Alert: Type: %d Host: %s Value: %u", alert->type, host, alert->value));
+}
+
+/*
+   Function: output_alert
+   Purpose : Creates a Fineline alert record and writes it to the enabled
+             outputs. Alerts are always printed on the console.
+   Input   : Output stage, alert.
+   Output  : None.
+*/
+void output_alert(pv_output_t *output, pv_alert_t *alert)
+{
+   char alert_data[512];
+   char fl_event_string[PV_MAX_INPUT_STR];
+
+   format_alert(alert, alert_data, sizeof(alert_data));
+   printf("%s\n", alert_data);
+
+   if (!(options & (PV_FILE_OUT | PV_SERVER_OUT)))
+   {
+      return;
+   }
+
+   create_record(fl_event_string, PV_ALERT_RECORD, "Pivot Sensor Alert", alert_data, alert->ts_sec, alert->ts_usec);
+   if (options & PV_FILE_OUT)
+   {
+      buffer_output_event(output, fl_event_string);
+   }
+   if (options & PV_SERVER_OUT)
+   {
+      send_server_event(fl_event_string);
+   }
+
+   return;
+}
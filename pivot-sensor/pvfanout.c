@@ -0,0 +1,380 @@
+/*  Copyright 2014 Derek Chadwick
+
+    This file is part of the Pivotal Network Security Tools.
+
+    Pivotal is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Pivotal is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Pivotal.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+   pvfanout.c
+
+   Title : Pivotal NST Sensor Fan-out and Fan-in Detection
+   Author: Derek Chadwick
+   Date  : 17/10/2026
+
+   Purpose: Counts the distinct destinations (address and port) each
+            source contacts and the distinct sources that contact each
+            destination, to find scans and distributed floods (-F option).
+
+            Each capture worker has a bounded table of hosts for each
+            direction (-J option, default 4096 hosts), the least recently
+            seen host is evicted when the table is full. Each host has a
+            HyperLogLog sketch of 1024 one byte registers, 3.3% standard
+            error. The sum used by the estimate is kept up to date as the
+            registers change, so the estimate costs the same however many
+            registers there are, and it is only worked out when a register
+            grows.
+
+            The sketches are cleared at the start of each window (-G option,
+            default 60 seconds) and an alert is raised the first time in a
+            window that a host reaches the threshold. Only connection
+            attempts are counted for TCP, SYN without ACK, so a busy server
+            answering its clients does not look like a scan.
+
+            The fanout hash spreads the flows of a host evenly over the
+            capture workers, so each worker alerts at its share of the
+            threshold and the alert reports the estimate scaled up to all
+            the workers.
+
+   Status : EXPERIMENTAL - not for use in production networks.
+
+*/
+
+#include <math.h>
+
+#include "pvcommon.h"
+#include "pivot-sensor.h"
+
+extern int worker_count;
+
+/*
+   Function: init_fanout
+   Purpose : Allocates a host table and the host sketches.
+   Input   : Table, number of hosts, distinct count threshold, window in seconds.
+   Output  : Returns 0.
+*/
+int init_fanout(pv_fanout_t *fanout, unsigned int hosts, unsigned int threshold, unsigned int window)
+{
+   unsigned int i;
+
+   init_flow_table(&fanout->table, hosts);
+   fanout->hosts = xmalloc(hosts * sizeof(pv_hll_host_t));
+   fanout->registers = xcalloc(hosts * PV_HLL_REGISTERS);
+   for (i = 0; i < hosts; i++)
+   {
+      fanout->hosts[i].zeros = PV_HLL_REGISTERS;
+      fanout->hosts[i].inverse_sum = PV_HLL_REGISTERS;
+   }
+   fanout->lru_head = PV_FLOW_EMPTY;
+   fanout->lru_tail = PV_FLOW_EMPTY;
+   fanout->threshold = threshold;
+   fanout->window = window;
+   fanout->evictions = 0;
+   fanout->alerts = 0;
+
+   return(0);
+}
+
+/*
+   Function: free_fanout
+   Purpose : Frees the fan-out host table and registers of a worker.
+   Input   : Fan-out state.
+   Output  : None.
+*/
+void free_fanout(pv_fanout_t *fanout)
+{
+   free_flow_table(&fanout->table);
+   free(fanout->hosts);
+   free(fanout->registers);
+   fanout->hosts = NULL;
+   fanout->registers = NULL;
+}
+
+/*
+   Function: hash_fanout_element
+   Purpose : 64 bit hash of an address and port, the top bits pick the
+             register and the leading zeros of the rest give the rank.
+   Input   : 16 byte address, port.
+   Output  : Hash value.
+*/
+uint64_t hash_fanout_element(uint8_t *addr, uint16_t port)
+{
+   uint64_t words[2];
+   uint64_t h = port;
+   int i;
+
+   memcpy(words, addr, sizeof(words));
+   for (i = 0; i < 2; i++)
+   {
+      h = (h ^ words[i]) * 0x9e3779b97f4a7c15ULL;
+      h ^= h >> 32;
+   }
+   h ^= h >> 33;
+   h *= 0xff51afd7ed558ccdULL;
+   h ^= h >> 33;
+   h *= 0xc4ceb9fe1a85ec53ULL;
+   h ^= h >> 33;
+
+   return(h);
+}
+
+/*
+   Function: clear_hll
+   Purpose : Starts a new window for a host. A host seen with one element,
+             which is most of them in a spoofed flood, only has one register
+             to clear.
+   Input   : Table, record index, window start time.
+   Output  : None.
+*/
+void clear_hll(pv_fanout_t *fanout, uint32_t index, uint32_t now)
+{
+   pv_hll_host_t *host = &fanout->hosts[index];
+
+   if (host->zeros == PV_HLL_REGISTERS - 1)
+   {
+      fanout->registers[(index << PV_HLL_BITS) + host->last_register] = 0;
+   }
+   else if (host->zeros < PV_HLL_REGISTERS)
+   {
+      memset(&fanout->registers[index << PV_HLL_BITS], 0, PV_HLL_REGISTERS);
+   }
+   host->zeros = PV_HLL_REGISTERS;
+   host->inverse_sum = PV_HLL_REGISTERS;
+   host->window_start = now;
+   host->alerted = 0;
+
+   return;
+}
+
+/*
+   Function: estimate_hll
+   Purpose : HyperLogLog estimate, with linear counting while the estimate
+             is small and some registers are still zero.
+   Input   : Host state.
+   Output  : Estimated distinct count.
+*/
+uint32_t estimate_hll(pv_hll_host_t *host)
+{
+   double m = PV_HLL_REGISTERS;
+   double estimate = (0.7213 / (1.0 + (1.079 / m))) * m * m / host->inverse_sum;
+
+   if ((estimate <= 2.5 * m) && (host->zeros > 0))
+   {
+      estimate = m * log(m / host->zeros);
+   }
+
+   return((uint32_t)(estimate + 0.5));
+}
+
+/*
+   Function: unlink_fanout_host
+   Purpose : Takes a host out of the least recently used list.
+   Input   : Fan-out state, host index.
+   Output  : None.
+*/
+void unlink_fanout_host(pv_fanout_t *fanout, uint32_t index)
+{
+   pv_hll_host_t *host = &fanout->hosts[index];
+
+   if (host->lru_prev != PV_FLOW_EMPTY)
+   {
+      fanout->hosts[host->lru_prev].lru_next = host->lru_next;
+   }
+   else
+   {
+      fanout->lru_head = host->lru_next;
+   }
+   if (host->lru_next != PV_FLOW_EMPTY)
+   {
+      fanout->hosts[host->lru_next].lru_prev = host->lru_prev;
+   }
+   else
+   {
+      fanout->lru_tail = host->lru_prev;
+   }
+}
+
+/*
+   Function: push_fanout_host
+   Purpose : Adds a host to the front of the least recently used list.
+   Input   : Fan-out state, host index.
+   Output  : None.
+*/
+void push_fanout_host(pv_fanout_t *fanout, uint32_t index)
+{
+   pv_hll_host_t *host = &fanout->hosts[index];
+
+   host->lru_prev = PV_FLOW_EMPTY;
+   host->lru_next = fanout->lru_head;
+   if (fanout->lru_head != PV_FLOW_EMPTY)
+   {
+      fanout->hosts[fanout->lru_head].lru_prev = index;
+   }
+   else
+   {
+      fanout->lru_tail = index;
+   }
+   fanout->lru_head = index;
+}
+
+/*
+   Function: count_distinct
+   Purpose : Adds an element to the sketch of a host, the host is added to
+             the table, evicting the least recently seen host if the table
+             is full, and moved to the front of the LRU list.
+   Input   : Table, host key and hash, element hash, packet time in seconds.
+   Output  : The estimate when it first reaches the threshold in the
+             window, otherwise 0.
+*/
+uint32_t count_distinct(pv_fanout_t *fanout, pv_flow_key_t *host, uint32_t hash, uint64_t element, uint32_t now)
+{
+   pv_flow_table_t *table = &fanout->table;
+   pv_flow_record_t *record;
+   pv_hll_host_t *state;
+   uint32_t index, reg, estimate;
+   uint8_t rank;
+
+   if ((record = find_flow(table, host, hash)) != NULL)
+   {
+      index = (uint32_t)(record - table->records);
+      if (fanout->lru_head != index)
+      {
+         unlink_fanout_host(fanout, index);
+         push_fanout_host(fanout, index);
+      }
+   }
+   else
+   {
+      if (table->count == table->capacity)
+      {
+         index = fanout->lru_tail;
+         unlink_fanout_host(fanout, index);
+         delete_flow(table, &table->records[index]);
+         fanout->evictions++;
+      }
+      record = find_or_add_flow(table, host, hash);
+      index = (uint32_t)(record - table->records);
+      push_fanout_host(fanout, index);
+      clear_hll(fanout, index, now);
+   }
+
+   state = &fanout->hosts[index];
+   if ((now >= state->window_start + fanout->window) || (now < state->window_start))
+   {
+      clear_hll(fanout, index, now);
+   }
+
+   /* The bit or'ed in below the rank bits caps the rank at 64 - PV_HLL_BITS + 1. */
+   reg = (index << PV_HLL_BITS) + (uint32_t)(element >> (64 - PV_HLL_BITS));
+   rank = (uint8_t)__builtin_clzll((element << PV_HLL_BITS) | (1ULL << (PV_HLL_BITS - 1))) + 1;
+   if (rank <= fanout->registers[reg])
+   {
+      return(0);
+   }
+
+   if (fanout->registers[reg] == 0)
+   {
+      state->zeros--;
+   }
+   state->inverse_sum += (1.0 / (double)(1ULL << rank)) - (1.0 / (double)(1ULL << fanout->registers[reg]));
+   fanout->registers[reg] = rank;
+   state->last_register = (uint16_t)(element >> (64 - PV_HLL_BITS));
+
+   if (state->alerted || ((estimate = estimate_hll(state)) < fanout->threshold))
+   {
+      return(0);
+   }
+   state->alerted = 1;
+   fanout->alerts++;
+
+   return(estimate);
+}
+
+/*
+   Function: raise_fanout_alert
+   Purpose : Passes a fan-out or fan-in alert to the output stage.
+   Input   : Worker, alert type, host key, estimate, table, packet event.
+   Output  : None.
+*/
+void raise_fanout_alert(pv_worker_t *worker, uint8_t type, pv_flow_key_t *host, uint32_t estimate, pv_fanout_t *fanout, pv_packet_event_t *event)
+{
+   pv_alert_t alert;
+
+   memset(&alert, 0, sizeof(pv_alert_t));
+   memcpy(&alert.key, host, sizeof(pv_flow_key_t));
+   alert.type = type;
+   alert.ts_sec = event->ts_sec;
+   alert.ts_usec = event->ts_usec;
+   alert.value = estimate * worker_count;
+   alert.threshold = fanout->threshold * worker_count;
+   alert.window = fanout->window;
+   queue_alert(worker, &alert);
+
+   return;
+}
+
+/*
+   Function: update_fanout
+   Purpose : Counts the destination of a packet for its source and the
+             source for its destination. The address hashes index the host
+             tables, and the source address hash is the fan-in element.
+   Input   : Worker, packet event.
+   Output  : None.
+*/
+void update_fanout(pv_worker_t *worker, pv_packet_event_t *event)
+{
+   pv_flow_key_t host;
+   uint64_t src_hash, dst_hash;
+   uint32_t estimate;
+
+   if ((event->key.protocol == IPPROTO_TCP) && ((event->tcp_flags & (TH_SYN | TH_ACK)) != TH_SYN))
+   {
+      return;
+   }
+
+   src_hash = hash_fanout_element(event->key.src_addr, 0);
+   dst_hash = hash_fanout_element(event->key.dst_addr, 0);
+
+   memset(&host, 0, sizeof(pv_flow_key_t));
+   host.family = event->key.family;
+   memcpy(host.src_addr, event->key.src_addr, sizeof(host.src_addr));
+   estimate = count_distinct(&worker->fanout[PV_FANOUT_OUT], &host, (uint32_t)src_hash,
+                             hash_fanout_element(event->key.dst_addr, event->key.dst_port), event->ts_sec);
+   if (estimate > 0)
+   {
+      raise_fanout_alert(worker, PV_ALERT_FANOUT, &host, estimate, &worker->fanout[PV_FANOUT_OUT], event);
+   }
+
+   memcpy(host.src_addr, event->key.dst_addr, sizeof(host.src_addr));
+   estimate = count_distinct(&worker->fanout[PV_FANOUT_IN], &host, (uint32_t)dst_hash, src_hash, event->ts_sec);
+   if (estimate > 0)
+   {
+      raise_fanout_alert(worker, PV_ALERT_FANIN, &host, estimate, &worker->fanout[PV_FANOUT_IN], event);
+   }
+
+   return;
+}
+
+/*
+   Function: print_fanout_stats
+   Purpose : Prints the host table counters for a worker.
+   Input   : Worker number, fan-out and fan-in tables.
+   Output  : None.
+*/
+void print_fanout_stats(int worker_id, pv_fanout_t *fanout)
+{
+   printf("Worker %d fan-out: %u sources tracked, %lu evicted, %lu alerts; fan-in: %u destinations tracked, %lu evicted, %lu alerts\n",
+          worker_id, fanout[PV_FANOUT_OUT].table.count, fanout[PV_FANOUT_OUT].evictions, fanout[PV_FANOUT_OUT].alerts,
+          fanout[PV_FANOUT_IN].table.count, fanout[PV_FANOUT_IN].evictions, fanout[PV_FANOUT_IN].alerts);
+}
@@ -44,59 +44,416 @@
              This means capture http, ssh, icmp and all packets from the Google DNS server(8.8.8.8).
              All other traffic will be ignored.
 
+             Blank lines and lines starting with # are skipped. Each rule is
+             compiled on its own first, so a bad rule is reported with its
+             line number instead of one error for the whole expression.
+             When events are sent to the server the server connection is
+             always excluded from capture, with or without a filter file.
+
              For more information see the Wireshark User Guide, TCPDUMP man pages or
              http://wiki.wireshark.org/CaptureFilters
 
+             The filter can be replaced while the sensor runs, without
+             losing the flow state. SIGHUP reads the filter file again,
+             and the server can send a new filter expression:
+
+             <control>filter<data>not net 10.1.0.0/16</data></control>
+
+             An empty expression goes back to the filter file or the
+             default filter, <control>reload</control> does the same as
+             SIGHUP. The main thread compiles the new filter and each
+             capture worker sets it on its own socket between reads, with
+             pcap_setfilter() or by attaching it to the ring socket, so an
+             exclusion filter sheds load in the kernel. A filter that does
+             not compile leaves the old filter in use. An expression is
+             compiled on its own before the server exclusion is added, so
+             it cannot close the parentheses around it. A worker that cannot
+             set the filter on its socket logs it once and tries again every
+             second.
+
 */
 
+#include <ctype.h>
+
 #include "pvcommon.h"
 #include "pivot-sensor.h"
 
 
+pv_bpf_filter_t bpf_filter;
+
+extern pv_worker_t *workers;
+extern int worker_count;
+extern int options;
+
 /*
    Function: load_bpf_filters
    Purpose : loads in the filter list file and constructs a single
-             filter string by OR'ing the text lines.
+             filter string by OR'ing the text lines. Every rule is
+             checked, so all of the bad rules are reported at once.
+   Input   : Filter file name, output string and its size.
+   Output  : Returns -1 on error, the number of rules on success.
 */
-int load_bpf_filters(char *filter_filename, char *filter_string)
+int load_bpf_filters(char *filter_filename, char *filter_string, int max_length)
 {
-	char instr[PV_MAX_INPUT_STR];
-	char tmpstr[PV_MAX_INPUT_STR];
-	FILE *filter_file;
-	int filter_counter = 0;
+   char instr[PV_MAX_INPUT_STR];
+   char *rule;
+   FILE *filter_file;
+   pcap_t *pdead;
+   struct bpf_program bpfp;
+   int filter_counter = 0;
+   int line_number = 0;
+   int errors = 0;
+   int len = 0;
 
+   filter_string[0] = 0;
    filter_file = fopen(filter_filename, "r");
    if (filter_file == NULL)
    {
-      printf("load_bpf_filters() <ERROR>: could not open event file: %s\n", filter_filename);
+      sprint_log_entry("load_bpf_filters() <ERROR> Could not open filter file", filter_filename);
+      return(-1);
+   }
+   if ((pdead = pcap_open_dead(bpf_filter.link_type, bpf_filter.snaplen)) == NULL)
+   {
+      print_log_entry("load_bpf_filters() <ERROR> Could not open pcap compiler handle.\n");
+      fclose(filter_file);
       return(-1);
    }
 
-   /* !!!CLEAR THE BUFFERS!!! */
    memset(instr, 0, PV_MAX_INPUT_STR);
-   memset(tmpstr, 0, PV_MAX_INPUT_STR);
 
-	while (fgets(instr, PV_MAX_INPUT_STR, filter_file) != NULL)
-	{
+   while (fgets(instr, PV_MAX_INPUT_STR, filter_file) != NULL)
+   {
+      line_number++;
       rtrim(instr); /* Remove any newlines/whitespace from end of line then surround with brackets. */
-      sprintf(tmpstr, "(%s)", instr);
-      if (filter_counter > 0)
+      rule = instr;
+      while (isspace((unsigned char)*rule))
+      {
+         rule++;
+      }
+      if ((*rule == 0) || (*rule == '#'))
       {
-         strncat(filter_string, " or ", 4);
+         continue;
       }
-      strncat(filter_string, tmpstr, strlen(instr));
 
-		filter_counter++;
+      if (pcap_compile(pdead, &bpfp, rule, 1, PCAP_NETMASK_UNKNOWN) < 0)
+      {
+         print_filter_error(filter_filename, line_number, rule, pcap_geterr(pdead));
+         errors++;
+         continue;
+      }
+      pcap_freecode(&bpfp);
+
+      if (len + (int)strlen(rule) + 6 >= max_length)
+      {
+         iprint_log_entry("load_bpf_filters() <ERROR> Filter is too long at line", line_number);
+         errors++;
+         break;
+      }
+      len += sprintf(filter_string + len, "%s(%s)", (filter_counter > 0) ? " or " : "", rule);
+      filter_counter++;
+   }
 
-      /* !!!CLEAR THE BUFFERS!!! */
-      memset(instr, 0, PV_MAX_INPUT_STR);
-      memset(tmpstr, 0, PV_MAX_INPUT_STR);
-	}
+   pcap_close(pdead);
+   fclose(filter_file);
+
+   if (errors > 0)
+   {
+      iprint_log_entry("load_bpf_filters() <ERROR> Invalid BPF filters", errors);
+      return(-1);
+   }
+   if (filter_counter == 0)
+   {
+      sprint_log_entry("load_bpf_filters() <ERROR> No BPF filters in file", filter_filename);
+      return(-1);
+   }
 
    printf("load_bpf_filters() <INFO> Loaded %d BPF filters.\n", filter_counter);
 
-   fclose(filter_file);
+   return(filter_counter);
+}
 
-	return(0);
+/*
+   Function: print_filter_error
+   Purpose : Logs a rule that did not compile with its file and line.
+   Input   : Filter file name, line number, rule and pcap error.
+   Output  : None.
+*/
+void print_filter_error(char *filter_filename, int line_number, char *rule, char *error)
+{
+   char *message = xmalloc(strlen(filter_filename) + strlen(rule) + 64);
+
+   sprintf(message, "load_bpf_filters() <ERROR> %s line %d: %s", filter_filename, line_number, rule);
+   sprint_log_entry(message, error);
+   free(message);
 }
 
+/*
+   Function: init_bpf_filter
+   Purpose : Keeps the filter file and server address for reloads and
+             builds the initial capture filter. Until the capture sockets
+             are open rules are checked for Ethernet.
+   Input   : Filter file name, server IP address, mode, capture
+             configuration and output string of PV_FILTER_MAX_LENGTH.
+   Output  : Returns -1 on error, 0 on success.
+*/
+int init_bpf_filter(char *filter_file, char *server_address, int mode, pv_capture_config_t *config, char *filter_string)
+{
+   memset(&bpf_filter, 0, sizeof(pv_bpf_filter_t));
+   pthread_mutex_init(&bpf_filter.lock, NULL);
+   bpf_filter.link_type = DLT_EN10MB;
+   bpf_filter.snaplen = config->snaplen;
+   bpf_filter.pending = xmalloc(PV_FILTER_MAX_LENGTH);
+
+   if (mode & PV_FILTER_ON)
+   {
+      snprintf(bpf_filter.filter_file, PV_PATH_MAX_LENGTH, "%s", filter_file);
+   }
+   if (mode & PV_SERVER_OUT)
+   {
+      snprintf(bpf_filter.server_address, PV_IP_ADDR_MAX, "%s", server_address);
+   }
+
+   return(get_bpf_filter(NULL, filter_string));
+}
+
+/*
+   Function: get_bpf_filter
+   Purpose : Builds the capture filter from the expression given, or the
+             filter file rules, or the default filter. The expression must
+             compile on its own, as the filter file rules do. The default is
+             layer 3 only, IPv4 and IPv6, VLAN tagged or not. The vlan
+             keyword changes the offsets for the rest of the expression so
+             it must come last. Events sent to the server, which may be
+             running on the local machine, must not be captured again.
+   Input   : Expression, NULL or empty for the configured filter, output
+             string of PV_FILTER_MAX_LENGTH.
+   Output  : Returns -1 on error, 0 on success.
+*/
+int get_bpf_filter(char *expression, char *filter_string)
+{
+   char *rules = xmalloc(PV_FILTER_MAX_LENGTH);
+   struct bpf_program program;
+   int len;
+
+   if ((expression != NULL) && (expression[0] != 0))
+   {
+      snprintf(rules, PV_FILTER_MAX_LENGTH, "%s", expression);
+      if (compile_bpf_filter(rules, &program) < 0)
+      {
+         sprint_log_entry("get_bpf_filter() <ERROR> Invalid filter expression", rules);
+         free(rules);
+         return(-1);
+      }
+      pcap_freecode(&program);
+   }
+   else if (bpf_filter.filter_file[0] != 0)
+   {
+      /* Room for the server exclusion. */
+      if (load_bpf_filters(bpf_filter.filter_file, rules, PV_FILTER_MAX_LENGTH - PV_IP_ADDR_MAX - 64) < 0)
+      {
+         free(rules);
+         return(-1);
+      }
+   }
+   else
+   {
+      strcpy(rules, PV_DEFAULT_FILTER);
+   }
+
+   if (bpf_filter.server_address[0] != 0)
+   {
+      len = snprintf(filter_string, PV_FILTER_MAX_LENGTH, "not (host %s and port %s) and (%s)",
+                     bpf_filter.server_address, SERVER_PORT_STRING, rules);
+   }
+   else
+   {
+      len = snprintf(filter_string, PV_FILTER_MAX_LENGTH, "%s", rules);
+   }
+   free(rules);
+
+   if (len >= PV_FILTER_MAX_LENGTH)
+   {
+      print_log_entry("get_bpf_filter() <ERROR> Filter expression is too long.\n");
+      return(-1);
+   }
+
+   return(0);
+}
+
+/*
+   Function: compile_bpf_filter
+   Purpose : Compiles a filter with optimisation for the link type and
+             snap length of the capture sockets.
+   Input   : Filter string, program (output).
+   Output  : Returns -1 on error, 0 on success.
+*/
+int compile_bpf_filter(char *filter_string, struct bpf_program *program)
+{
+   pcap_t *pdead;
+   int retval = 0;
+
+   if ((pdead = pcap_open_dead(bpf_filter.link_type, bpf_filter.snaplen)) == NULL)
+   {
+      print_log_entry("compile_bpf_filter() <ERROR> Could not open pcap compiler handle.\n");
+      return(-1);
+   }
+   if (pcap_compile(pdead, program, filter_string, 1, PCAP_NETMASK_UNKNOWN) < 0)
+   {
+      sprint_log_entry("compile_bpf_filter() <ERROR>", pcap_geterr(pdead));
+      retval = -1;
+   }
+   pcap_close(pdead);
+
+   return(retval);
+}
+
+/*
+   Function: replace_bpf_filter
+   Purpose : Compiles a new capture filter and hands it to the capture
+             workers, called on the main thread. The workers copy the
+             program when they set it, so the last program is only freed
+             once every worker has set it.
+   Input   : Expression, NULL or empty for the configured filter.
+   Output  : Returns -1 on error, 0 on success.
+*/
+int replace_bpf_filter(char *expression)
+{
+   char *filter_string = xmalloc(PV_FILTER_MAX_LENGTH);
+   struct bpf_program program;
+
+   if ((get_bpf_filter(expression, filter_string) < 0) || (compile_bpf_filter(filter_string, &program) < 0))
+   {
+      print_log_entry("replace_bpf_filter() <ERROR> Could not replace the capture filter, the old filter is still in use.\n");
+      __atomic_fetch_add(&bpf_filter.failures, 1, __ATOMIC_RELAXED);
+      free(filter_string);
+      return(-1);
+   }
+   if (wait_for_filter_update() < 0)
+   {
+      print_log_entry("replace_bpf_filter() <ERROR> Workers have not set the last filter, the old filter is still in use.\n");
+      __atomic_fetch_add(&bpf_filter.failures, 1, __ATOMIC_RELAXED);
+      pcap_freecode(&program);
+      free(filter_string);
+      return(-1);
+   }
+
+   pcap_freecode(&bpf_filter.program);
+   bpf_filter.program = program;
+   __atomic_add_fetch(&bpf_filter.generation, 1, __ATOMIC_RELEASE);
+   bpf_filter.replaces++;
+   sprint_log_entry("replace_bpf_filter() <INFO> Capture filter replaced", filter_string);
+   free(filter_string);
+
+   return(0);
+}
+
+/*
+   Function: wait_for_filter_update
+   Purpose : Waits for the running capture workers to set the current
+             filter program, or fail to, at most PV_FILTER_UPDATE_TIMEOUT
+             seconds. A worker reads its socket for at most the block
+             timeout. A worker that could not set the program no longer
+             needs it, the next program replaces it.
+   Input   : None.
+   Output  : Returns -1 on timeout, 0 on success.
+*/
+int wait_for_filter_update()
+{
+   unsigned int generation = __atomic_load_n(&bpf_filter.generation, __ATOMIC_ACQUIRE);
+   time_t deadline = time(NULL) + PV_FILTER_UPDATE_TIMEOUT;
+   int waiting = 1;
+   int i;
+
+   while (waiting)
+   {
+      waiting = 0;
+      for (i = 0; i < worker_count; i++)
+      {
+         if (workers[i].running && !workers[i].finished &&
+             (__atomic_load_n(&workers[i].filter_generation, __ATOMIC_ACQUIRE) != generation) &&
+             (__atomic_load_n(&workers[i].filter_failed, __ATOMIC_ACQUIRE) != generation))
+         {
+            waiting = 1;
+         }
+      }
+      if (waiting)
+      {
+         if (time(NULL) > deadline)
+         {
+            return(-1);
+         }
+         usleep(10000);
+      }
+   }
+
+   return(0);
+}
+
+/*
+   Function: set_worker_filter
+   Purpose : Sets the replaced filter program on the worker socket, called
+             by the worker between reads. If it fails the socket keeps the
+             old filter, the failure is logged and counted once and the
+             worker tries again a second later.
+   Input   : Worker.
+   Output  : None.
+*/
+void set_worker_filter(pv_worker_t *worker)
+{
+   unsigned int generation = __atomic_load_n(&bpf_filter.generation, __ATOMIC_ACQUIRE);
+   int res;
+
+   if ((worker->filter_failed == generation) && (time(NULL) < worker->filter_retry))
+   {
+      return;
+   }
+   if (options & PV_RING_CAPTURE)
+   {
+      res = attach_ring_filter(&worker->ring, &bpf_filter.program);
+   }
+   else if ((res = pcap_setfilter(worker->pcap_device, &bpf_filter.program)) < 0)
+   {
+      sprint_log_entry("set_worker_filter() <ERROR>", pcap_geterr(worker->pcap_device));
+   }
+   if (res < 0)
+   {
+      if (worker->filter_failed != generation)
+      {
+         iprint_log_entry("set_worker_filter() <ERROR> Could not set the capture filter on worker", worker->worker_id);
+         __atomic_fetch_add(&bpf_filter.failures, 1, __ATOMIC_RELAXED);
+         __atomic_store_n(&worker->filter_failed, generation, __ATOMIC_RELEASE);
+      }
+      worker->filter_retry = time(NULL) + 1;
+      return;
+   }
+
+   __atomic_store_n(&worker->filter_generation, generation, __ATOMIC_RELEASE);
+}
+
+/*
+   Function: queue_bpf_filter
+   Purpose : Passes a filter expression from a server control message to
+             the main thread, which replaces the filter.
+   Input   : Expression, empty for the configured filter.
+   Output  : None.
+*/
+void queue_bpf_filter(char *expression)
+{
+   pthread_mutex_lock(&bpf_filter.lock);
+   snprintf(bpf_filter.pending, PV_FILTER_MAX_LENGTH, "%s", expression);
+   __atomic_store_n(&bpf_filter.pending_set, 1, __ATOMIC_RELEASE);
+   pthread_mutex_unlock(&bpf_filter.lock);
+}
+
+/*
+   Function: delete_bpf_filter
+   Purpose : Frees the replaced filter program.
+   Input   : None.
+   Output  : None.
+*/
+void delete_bpf_filter()
+{
+   pcap_freecode(&bpf_filter.program);
+   free(bpf_filter.pending);
+   bpf_filter.pending = NULL;
+}
@@ -0,0 +1,230 @@
+/*  Copyright 2014 Derek Chadwick
+
+    This file is part of the Pivotal Network Security Tools.
+
+    Pivotal is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Pivotal is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Pivotal.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+   pvflowstats.c
+
+   Title : Pivotal NST Sensor Flow Statistics Export
+   Author: Derek Chadwick
+   Date  : 17/10/2026
+
+   Purpose: Sends the flow packet and byte counts to the Pivotal Server
+            every export interval (-E option). Only the flows that changed
+            since the last export are sent, as deltas, so the server can
+            keep traffic totals without an event for every packet.
+
+            Each worker keeps a list of the flows it has updated since the
+            last export. At each interval the deltas are packed into
+            <flowstats> messages, one line per flow:
+
+            <flowstats><id>SENSOR0000</id><time>SECS</time><flows>N</flows><data>
+            PROTO SRCIP SRCPORT DSTIP DSTPORT PACKETS BYTES
+            ...
+            </data></flowstats>
+
+            Each message fits in one server receive buffer. Deltas for flows
+            that expire between exports are added to the next batch.
+
+   Status : EXPERIMENTAL - not for use in production networks.
+
+*/
+
+#include "pvcommon.h"
+#include "pivot-sensor.h"
+
+extern int options;
+
+/*
+   Function: init_flow_stats
+   Purpose : Allocates the worker changed flow list and statistics batch.
+   Input   : Worker, capture configuration.
+   Output  : None.
+*/
+void init_flow_stats(pv_worker_t *worker, pv_capture_config_t *config)
+{
+   worker->dirty_flows = xmalloc(config->flow_capacity * sizeof(uint32_t));
+   worker->dirty_count = 0;
+   worker->stats_buffer = xmalloc(PV_FLOW_STATS_DATA_MAX);
+   worker->stats_length = 0;
+   worker->stats_entries = 0;
+   worker->export_interval = config->export_interval;
+   worker->next_export = 0;
+
+   return;
+}
+
+/*
+   Function: free_flow_stats
+   Purpose : Frees the dirty flow list and statistics buffer of a worker.
+   Input   : Worker.
+   Output  : None.
+*/
+void free_flow_stats(pv_worker_t *worker)
+{
+   free(worker->dirty_flows);
+   free(worker->stats_buffer);
+   worker->dirty_flows = NULL;
+   worker->stats_buffer = NULL;
+}
+
+/*
+   Function: send_flow_stats
+   Purpose : Sends the statistics batch to the server as one message.
+   Input   : Worker.
+   Output  : None.
+*/
+void send_flow_stats(pv_worker_t *worker)
+{
+   char message[PV_MAX_INPUT_STR];
+
+   if (worker->stats_entries == 0)
+   {
+      return;
+   }
+
+   /* TODO: put an actual sensor id in the id field. */
+   snprintf(message, PV_MAX_INPUT_STR, "<flowstats><id>SENSOR0000</id><time>%lu</time><flows>%u</flows><data>\n%.*s</data></flowstats>\n",
+            (unsigned long)worker->wheel.current, worker->stats_entries, (int)worker->stats_length, worker->stats_buffer);
+
+   send_server_event(message);
+
+   worker->stats_batches++;
+   worker->stats_length = 0;
+   worker->stats_entries = 0;
+
+   return;
+}
+
+/*
+   Function: append_flow_delta
+   Purpose : Adds the flow counts since the last export to the statistics
+             batch, the batch is sent first if the line does not fit.
+   Input   : Worker, flow record.
+   Output  : None.
+*/
+void append_flow_delta(pv_worker_t *worker, pv_flow_record_t *record)
+{
+   char srcip[INET6_ADDRSTRLEN], dstip[INET6_ADDRSTRLEN];
+   char line[PV_FLOW_TEXT_MAX * 2];
+   int family = (record->key.family == PV_FLOW_IPV6) ? AF_INET6 : AF_INET;
+   uint64_t packets = record->packet_count - record->exported_packets;
+   uint64_t bytes = record->data_size - record->exported_bytes;
+   int len;
+
+   record->flags &= ~PV_FLOW_DIRTY;
+   if (packets == 0)
+   {
+      return;
+   }
+   record->exported_packets = record->packet_count;
+   record->exported_bytes = record->data_size;
+
+   inet_ntop(family, record->key.src_addr, srcip, INET6_ADDRSTRLEN);
+   inet_ntop(family, record->key.dst_addr, dstip, INET6_ADDRSTRLEN);
+   len = snprintf(line, sizeof(line), "%d %s %d %s %d %lu %lu\n", record->key.protocol,
+                  srcip, ntohs(record->key.src_port), dstip, ntohs(record->key.dst_port),
+                  (unsigned long)packets, (unsigned long)bytes);
+
+   if (worker->stats_length + len > PV_FLOW_STATS_DATA_MAX)
+   {
+      send_flow_stats(worker);
+   }
+   memcpy(worker->stats_buffer + worker->stats_length, line, len);
+   worker->stats_length += len;
+   worker->stats_entries++;
+
+   return;
+}
+
+/*
+   Function: export_flow_deltas
+   Purpose : Sends the deltas for every flow changed since the last export
+             and empties the changed flow list.
+   Input   : Worker.
+   Output  : None.
+*/
+void export_flow_deltas(pv_worker_t *worker)
+{
+   pv_flow_record_t *record;
+   uint32_t i;
+
+   for (i = 0; i < worker->dirty_count; i++)
+   {
+      record = &worker->flow_table.records[worker->dirty_flows[i]];
+      /* Flows deleted since they were listed have no flags set. */
+      if (record->flags & PV_FLOW_DIRTY)
+      {
+         append_flow_delta(worker, record);
+      }
+   }
+   worker->dirty_count = 0;
+   send_flow_stats(worker);
+
+   return;
+}
+
+/*
+   Function: mark_flow_dirty
+   Purpose : Adds a flow to the changed flow list the first time it is
+             updated after an export. Deleted flows can leave stale entries
+             in the list, if it fills up the deltas are exported early.
+   Input   : Worker, flow record.
+   Output  : None.
+*/
+void mark_flow_dirty(pv_worker_t *worker, pv_flow_record_t *record)
+{
+   if (record->flags & PV_FLOW_DIRTY)
+   {
+      return;
+   }
+   if (worker->dirty_count == worker->flow_table.capacity)
+   {
+      export_flow_deltas(worker);
+   }
+   record->flags |= PV_FLOW_DIRTY;
+   worker->dirty_flows[worker->dirty_count++] = (uint32_t)(record - worker->flow_table.records);
+
+   return;
+}
+
+/*
+   Function: update_flow_exports
+   Purpose : Exports the flow deltas when the export interval has passed.
+             Called with the packet time and with the wall clock time when
+             the link is quiet.
+   Input   : Worker, time in seconds.
+   Output  : None.
+*/
+void update_flow_exports(pv_worker_t *worker, uint32_t now)
+{
+   if (!(options & PV_SERVER_OUT))
+   {
+      return;
+   }
+   if (worker->next_export == 0)
+   {
+      worker->next_export = now + worker->export_interval;
+   }
+   else if (now >= worker->next_export)
+   {
+      export_flow_deltas(worker);
+      worker->next_export = now + worker->export_interval;
+   }
+
+   return;
+}
@@ -0,0 +1,430 @@
+/*  Copyright 2014 Derek Chadwick
+
+    This file is part of the Pivotal Network Security Tools.
+
+    Pivotal is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Pivotal is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Pivotal.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+   pvflowtimer.c
+
+   Title : Pivotal NST Sensor Flow Timeouts
+   Author: Derek Chadwick
+   Date  : 17/10/2026
+
+   Purpose: Expires flows from the worker flow table shards. A flow is
+            completed when it has been idle for the idle timeout (-I option),
+            when it has been open for the active timeout (-A option), or
+            shortly after a TCP FIN or RST is seen. Completed flows are sent
+            to the event file and the Pivotal Server as flow records and
+            their table entries are freed.
+
+            Each worker has a hierarchical timer wheel, four levels of 64
+            one second slots, so expiry never scans the flow table. Timers
+            are not moved on every packet: a timer is set when the flow is
+            created and when it fires the flow deadlines are checked against
+            the last packet time, the timer is set again if the flow is
+            still live.
+
+   Status : EXPERIMENTAL - not for use in production networks.
+
+*/
+
+#include "pvcommon.h"
+#include "pivot-sensor.h"
+
+extern int options;
+
+/*
+   Function: init_timer_wheel
+   Purpose : Empties the timer wheel, the wheel time is set by the
+             first call to advance_timer_wheel().
+   Input   : Timer wheel, idle and active flow timeouts in seconds.
+   Output  : None.
+*/
+void init_timer_wheel(pv_timer_wheel_t *wheel, unsigned int idle_timeout, unsigned int active_timeout)
+{
+   int level, slot;
+
+   memset(wheel, 0, sizeof(pv_timer_wheel_t));
+   for (level = 0; level < PV_WHEEL_LEVELS; level++)
+   {
+      for (slot = 0; slot < PV_WHEEL_SLOTS; slot++)
+      {
+         wheel->heads[level][slot] = PV_FLOW_EMPTY;
+      }
+   }
+   wheel->idle_timeout = idle_timeout;
+   wheel->active_timeout = active_timeout;
+
+   return;
+}
+
+/*
+   Function: link_timer
+   Purpose : Adds a flow record to the wheel slot for its expiry time.
+             The level is chosen by the distance to the expiry time,
+             timers beyond the wheel span are clamped and rechecked
+             when they fire.
+   Input   : Timer wheel, flow table, flow record.
+   Output  : None.
+*/
+static void link_timer(pv_timer_wheel_t *wheel, pv_flow_table_t *table, pv_flow_record_t *record)
+{
+   uint32_t index = (uint32_t)(record - table->records);
+   uint32_t delta, slot, *head;
+   int level = 0;
+
+   if (record->timer_expire < wheel->current)
+   {
+      record->timer_expire = wheel->current;
+   }
+   delta = record->timer_expire - wheel->current;
+   if (delta >= PV_WHEEL_SPAN)
+   {
+      record->timer_expire = wheel->current + PV_WHEEL_SPAN - 1;
+      delta = PV_WHEEL_SPAN - 1;
+   }
+   while (delta >= (1U << (PV_WHEEL_BITS * (level + 1))))
+   {
+      level++;
+   }
+
+   slot = (record->timer_expire >> (PV_WHEEL_BITS * level)) & PV_WHEEL_MASK;
+   head = &wheel->heads[level][slot];
+   record->timer_slot = (uint16_t)(level * PV_WHEEL_SLOTS + slot);
+   record->timer_prev = PV_FLOW_EMPTY;
+   record->timer_next = *head;
+   if (*head != PV_FLOW_EMPTY)
+   {
+      table->records[*head].timer_prev = index;
+   }
+   *head = index;
+   record->flags |= PV_FLOW_TIMER;
+   wheel->timer_count++;
+
+   return;
+}
+
+/*
+   Function: cancel_flow_timer
+   Purpose : Removes a flow record from its timer wheel slot.
+   Input   : Timer wheel, flow table, flow record.
+   Output  : None.
+*/
+void cancel_flow_timer(pv_timer_wheel_t *wheel, pv_flow_table_t *table, pv_flow_record_t *record)
+{
+   uint32_t *head;
+
+   if (!(record->flags & PV_FLOW_TIMER))
+   {
+      return;
+   }
+
+   head = &wheel->heads[record->timer_slot / PV_WHEEL_SLOTS][record->timer_slot % PV_WHEEL_SLOTS];
+   if (record->timer_prev == PV_FLOW_EMPTY)
+   {
+      *head = record->timer_next;
+   }
+   else
+   {
+      table->records[record->timer_prev].timer_next = record->timer_next;
+   }
+   if (record->timer_next != PV_FLOW_EMPTY)
+   {
+      table->records[record->timer_next].timer_prev = record->timer_prev;
+   }
+   record->flags &= ~PV_FLOW_TIMER;
+   wheel->timer_count--;
+
+   return;
+}
+
+/*
+   Function: schedule_flow_timer
+   Purpose : Sets the flow record timer, replacing any timer already set.
+   Input   : Timer wheel, flow table, flow record, expiry time in seconds.
+   Output  : None.
+*/
+void schedule_flow_timer(pv_timer_wheel_t *wheel, pv_flow_table_t *table, pv_flow_record_t *record, uint32_t expire)
+{
+   cancel_flow_timer(wheel, table, record);
+   if (expire <= wheel->current)
+   {
+      expire = wheel->current + 1;
+   }
+   record->timer_expire = expire;
+   link_timer(wheel, table, record);
+
+   return;
+}
+
+/*
+   Function: cascade_timers
+   Purpose : Moves the timers in the current slot of an upper level down
+             to the lower levels, called when the lower levels wrap.
+   Input   : Timer wheel, flow table, wheel level.
+   Output  : None.
+*/
+static void cascade_timers(pv_timer_wheel_t *wheel, pv_flow_table_t *table, int level)
+{
+   uint32_t slot = (wheel->current >> (PV_WHEEL_BITS * level)) & PV_WHEEL_MASK;
+   uint32_t index = wheel->heads[level][slot];
+   uint32_t next;
+   pv_flow_record_t *record;
+
+   wheel->heads[level][slot] = PV_FLOW_EMPTY;
+   while (index != PV_FLOW_EMPTY)
+   {
+      record = &table->records[index];
+      next = record->timer_next;
+      record->flags &= ~PV_FLOW_TIMER;
+      wheel->timer_count--;
+      link_timer(wheel, table, record);
+      index = next;
+   }
+
+   return;
+}
+
+/*
+   Function: advance_timer_wheel
+   Purpose : Moves the wheel forward to the given time one tick at a time,
+             calling the expiry function for each timer that fires. The
+             timer is removed before the expiry function is called so it
+             can delete the record or set a new timer. When the wheel is
+             empty it jumps straight to the new time.
+   Input   : Timer wheel, flow table, time in seconds, expiry function and
+             its user data.
+   Output  : Returns the number of timers that fired.
+*/
+int advance_timer_wheel(pv_timer_wheel_t *wheel, pv_flow_table_t *table, uint32_t now, pv_timer_func_t func, void *user)
+{
+   uint32_t index, next;
+   pv_flow_record_t *record;
+   int level, fired = 0;
+
+   if (!wheel->started)
+   {
+      wheel->current = now;
+      wheel->started = 1;
+      return(0);
+   }
+
+   while (wheel->current < now)
+   {
+      if (wheel->timer_count == 0)
+      {
+         wheel->current = now;
+         break;
+      }
+      wheel->current++;
+
+      for (level = PV_WHEEL_LEVELS - 1; level > 0; level--)
+      {
+         if ((wheel->current & ((1U << (PV_WHEEL_BITS * level)) - 1)) == 0)
+         {
+            cascade_timers(wheel, table, level);
+         }
+      }
+
+      index = wheel->heads[0][wheel->current & PV_WHEEL_MASK];
+      wheel->heads[0][wheel->current & PV_WHEEL_MASK] = PV_FLOW_EMPTY;
+      while (index != PV_FLOW_EMPTY)
+      {
+         record = &table->records[index];
+         next = record->timer_next;
+         record->flags &= ~PV_FLOW_TIMER;
+         wheel->timer_count--;
+         func(user, record, wheel->current);
+         fired++;
+         index = next;
+      }
+   }
+
+   return(fired);
+}
+
+/*
+   Function: get_flow_deadline
+   Purpose : Works out when a flow is due to expire from its first and
+             last packet times.
+   Input   : Timer wheel, flow record.
+   Output  : Expiry time in seconds.
+*/
+uint32_t get_flow_deadline(pv_timer_wheel_t *wheel, pv_flow_record_t *record)
+{
+   uint32_t idle_deadline, active_deadline;
+
+   if (record->flags & PV_FLOW_CLOSING)
+   {
+      idle_deadline = (uint32_t)(record->last_ts / 1000000) + PV_FLOW_CLOSE_LINGER;
+   }
+   else
+   {
+      idle_deadline = (uint32_t)(record->last_ts / 1000000) + wheel->idle_timeout;
+   }
+   active_deadline = (uint32_t)(record->first_ts / 1000000) + wheel->active_timeout;
+
+   return(idle_deadline < active_deadline ? idle_deadline : active_deadline);
+}
+
+/*
+   Function: start_flow_timer
+   Purpose : Sets the timer for a new flow or a flow that is closing.
+   Input   : Worker, flow record.
+   Output  : None.
+*/
+void start_flow_timer(pv_worker_t *worker, pv_flow_record_t *record)
+{
+   schedule_flow_timer(&worker->wheel, &worker->flow_table, record, get_flow_deadline(&worker->wheel, record));
+
+   return;
+}
+
+/*
+   Function: close_flow
+   Purpose : Marks a flow as closing after a TCP FIN or RST, the flow is
+             expired once no more packets have been seen for the close
+             linger time so the final ACKs are counted in the same record.
+   Input   : Worker, flow record.
+   Output  : None.
+*/
+void close_flow(pv_worker_t *worker, pv_flow_record_t *record)
+{
+   if (!(record->flags & PV_FLOW_CLOSING))
+   {
+      record->flags |= PV_FLOW_CLOSING;
+      start_flow_timer(worker, record);
+   }
+
+   return;
+}
+
+/*
+   Function: close_reverse_flow
+   Purpose : A TCP RST ends both directions of the connection, so the
+             flow going the other way is closed as well. Fanout hashing
+             puts both directions on the same worker.
+   Input   : Worker, flow key of the RST packet.
+   Output  : None.
+*/
+void close_reverse_flow(pv_worker_t *worker, pv_flow_key_t *key)
+{
+   pv_flow_key_t reverse_key;
+   pv_flow_record_t *record;
+
+   memcpy(&reverse_key, key, sizeof(pv_flow_key_t));
+   reverse_key.src_port = key->dst_port;
+   reverse_key.dst_port = key->src_port;
+   memcpy(reverse_key.src_addr, key->dst_addr, 16);
+   memcpy(reverse_key.dst_addr, key->src_addr, 16);
+
+   if ((record = find_flow(&worker->flow_table, &reverse_key, hash_flow_key(&reverse_key))) != NULL)
+   {
+      close_flow(worker, record);
+   }
+
+   return;
+}
+
+/*
+   Function: export_flow_record
+   Purpose : Passes a completed flow to the output stage, which creates a
+             Fineline flow record and writes it to the event file and/or
+             sends it to the server.
+   Input   : Worker, flow record, expiry reason.
+   Output  : None.
+*/
+void export_flow_record(pv_worker_t *worker, pv_flow_record_t *record, const char *reason)
+{
+   queue_flow_export(worker, record, reason);
+   worker->flows_exported++;
+
+   return;
+}
+
+/*
+   Function: expire_flow
+   Purpose : Timer wheel expiry function. Exports and deletes the flow if
+             it has reached a deadline, otherwise sets a new timer for the
+             next deadline.
+   Input   : Worker, flow record, current time in seconds.
+   Output  : Returns 1 if the flow was deleted, 0 if it is still live.
+*/
+int expire_flow(void *user, pv_flow_record_t *record, uint32_t now)
+{
+   pv_worker_t *worker = (pv_worker_t *)user;
+   pv_timer_wheel_t *wheel = &worker->wheel;
+   uint32_t last_seen = (uint32_t)(record->last_ts / 1000000);
+   const char *reason;
+
+   if (record->flags & PV_FLOW_CLOSING)
+   {
+      if (now < last_seen + PV_FLOW_CLOSE_LINGER)
+      {
+         start_flow_timer(worker, record);
+         return(0);
+      }
+      reason = "closed";
+      wheel->expired_closed++;
+   }
+   else if (now >= last_seen + wheel->idle_timeout)
+   {
+      reason = "idle";
+      wheel->expired_idle++;
+   }
+   else if (now >= (uint32_t)(record->first_ts / 1000000) + wheel->active_timeout)
+   {
+      reason = "active";
+      wheel->expired_active++;
+   }
+   else
+   {
+      start_flow_timer(worker, record);
+      return(0);
+   }
+
+   export_flow_record(worker, record, reason);
+   if (record->flags & PV_FLOW_DIRTY)
+   {
+      append_flow_delta(worker, record);
+   }
+   if (record->flags & PV_FLOW_REASM)
+   {
+      end_stream(worker, record);
+   }
+   delete_flow(&worker->flow_table, record);
+
+   return(1);
+}
+
+/*
+   Function: update_flow_timers
+   Purpose : Advances the worker timer wheel and expires the flows that
+             are due. Called for each packet with the packet time and by
+             the capture loop with the wall clock time when the link is
+             quiet, the wheel never moves backwards.
+   Input   : Worker, time in seconds.
+   Output  : Returns the number of timers that fired.
+*/
+int update_flow_timers(pv_worker_t *worker, uint32_t now)
+{
+   if (worker->wheel.started && (now <= worker->wheel.current))
+   {
+      return(0);
+   }
+
+   return(advance_timer_wheel(&worker->wheel, &worker->flow_table, now, expire_flow, worker));
+}
@@ -0,0 +1,566 @@
+/*  Copyright 2014 Derek Chadwick
+
+    This file is part of the Pivotal Network Security Tools.
+
+    Pivotal is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Pivotal is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Pivotal.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+   pvheavy.c
+
+   Title : Pivotal NST Sensor Heavy Hitters
+   Author: Derek Chadwick
+   Date  : 17/10/2026
+
+   Purpose: Fixed memory heavy hitter tracking (-x and -X options) for the
+            top talkers (source addresses) and top conversations (address
+            pairs, both directions counted together).
+
+            Each capture worker keeps a Count-Min sketch of packets and bytes
+            for each key type, PV_SKETCH_DEPTH rows of PV_SKETCH_WIDTH
+            counter pairs, and a Space-Saving list of the 8K keys with the
+            most packets, for the top K keys that are reported. A key that
+            is not in a full list replaces the key with the smallest count
+            and inherits that count, so any key with more than 1/8K of the
+            packets is always in the list. The list is a flow table with a
+            min heap on the packet count.
+
+            Memory does not depend on the traffic, a flood of spoofed
+            sources only churns the bottom of the Space-Saving lists. With
+            the default width a sketch estimate is at most 0.07% of the
+            packets (or bytes) seen above the true count, with 98%
+            confidence.
+
+            The sketches use the same row hashes in every worker, so the
+            statistics thread merges them by adding the counters. Every
+            statistics report ranks the keys in the worker lists by their
+            merged sketch estimates for the interval, the sketch at the
+            last report is subtracted, and the top K are written to the
+            statistics file and sent to the server as a <control>topk
+            message. The lists and sketches are read without locking, like
+            the other statistics, a list entry read while it is replaced
+            gets an estimate below the sketch error bound and is not
+            reported.
+
+            With -X the heavy hitters replace the exact per flow map that
+            is built, printed and written to the event file when capture
+            stops.
+
+   Status : EXPERIMENTAL - not for use in production networks.
+
+*/
+
+#include <time.h>
+
+#include "pvcommon.h"
+#include "pivot-sensor.h"
+
+extern pv_worker_t *workers;
+extern int worker_count;
+
+uint64_t sketch_seeds[PV_SKETCH_DEPTH];  /* row hash multipliers, shared by all the workers */
+char *heavy_names[PV_HEAVY_TYPES] = { "talkers", "conversations" };
+
+/*
+   Function: init_sketch_seeds
+   Purpose : Picks random odd multipliers for the sketch row hashes, so
+             the rows a key maps to can not be worked out in advance.
+   Input   : None.
+   Output  : None.
+*/
+void init_sketch_seeds()
+{
+   uint64_t x = get_time_ns() ^ ((uint64_t)getpid() << 32);
+   uint64_t z;
+   int r;
+
+   for (r = 0; r < PV_SKETCH_DEPTH; r++)
+   {
+      x += 0x9e3779b97f4a7c15ULL;
+      z = x;
+      z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+      z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+      sketch_seeds[r] = (z ^ (z >> 31)) | 1;
+   }
+
+   return;
+}
+
+/*
+   Function: init_sketch
+   Purpose : Allocates a zeroed sketch, aligned to the cache line.
+   Input   : Sketch.
+   Output  : Returns 0.
+*/
+int init_sketch(pv_sketch_t *sketch)
+{
+   sketch->cells = xmemalign(PV_CACHE_LINE_SIZE, PV_SKETCH_DEPTH * PV_SKETCH_WIDTH * sizeof(pv_sketch_cell_t));
+   memset(sketch->cells, 0, PV_SKETCH_DEPTH * PV_SKETCH_WIDTH * sizeof(pv_sketch_cell_t));
+
+   return(0);
+}
+
+/*
+   Function: free_sketch
+   Purpose : Frees the cells of a sketch.
+   Input   : Sketch.
+   Output  : None.
+*/
+void free_sketch(pv_sketch_t *sketch)
+{
+   free(sketch->cells);
+   sketch->cells = NULL;
+}
+
+/*
+   Function: update_sketch
+   Purpose : Adds a packet to the counters of a key in each sketch row.
+             The row column is the top bits of the key hash times the row
+             multiplier.
+   Input   : Sketch, key hash, packet bytes.
+   Output  : None.
+*/
+void update_sketch(pv_sketch_t *sketch, uint32_t hash, uint32_t bytes)
+{
+   pv_sketch_cell_t *cell;
+   int r;
+
+   for (r = 0; r < PV_SKETCH_DEPTH; r++)
+   {
+      cell = &sketch->cells[(r * PV_SKETCH_WIDTH) + PV_SKETCH_COLUMN(hash, r)];
+      cell->packets++;
+      cell->bytes += bytes;
+   }
+
+   return;
+}
+
+/*
+   Function: estimate_sketch
+   Purpose : Count-Min estimate for a key, the smallest counter in the key
+             columns. If a previous copy of the sketch is given the estimate
+             is for the counts added since the copy was taken.
+   Input   : Sketch, previous sketch or NULL, key hash, estimates.
+   Output  : None.
+*/
+void estimate_sketch(pv_sketch_t *sketch, pv_sketch_t *previous, uint32_t hash, uint64_t *packets, uint64_t *bytes)
+{
+   uint64_t p, b;
+   uint32_t i;
+   int r;
+
+   for (r = 0; r < PV_SKETCH_DEPTH; r++)
+   {
+      i = (r * PV_SKETCH_WIDTH) + PV_SKETCH_COLUMN(hash, r);
+      p = sketch->cells[i].packets;
+      b = sketch->cells[i].bytes;
+      if (previous != NULL)
+      {
+         p -= previous->cells[i].packets;
+         b -= previous->cells[i].bytes;
+      }
+      if ((r == 0) || (p < *packets))
+      {
+         *packets = p;
+      }
+      if ((r == 0) || (b < *bytes))
+      {
+         *bytes = b;
+      }
+   }
+
+   return;
+}
+
+/*
+   Function: init_topk
+   Purpose : Allocates a Space-Saving list of K keys.
+   Input   : List, number of keys.
+   Output  : Returns 0.
+*/
+int init_topk(pv_topk_t *topk, unsigned int k)
+{
+   init_flow_table(&topk->table, k);
+   topk->heap = xmalloc(k * sizeof(uint32_t));
+   topk->heap_pos = xmalloc(k * sizeof(uint32_t));
+   topk->size = 0;
+   topk->evictions = 0;
+
+   return(0);
+}
+
+/*
+   Function: free_topk
+   Purpose : Frees a top-k table and its heap.
+   Input   : Top-k state.
+   Output  : None.
+*/
+void free_topk(pv_topk_t *topk)
+{
+   free_flow_table(&topk->table);
+   free(topk->heap);
+   free(topk->heap_pos);
+   topk->heap = NULL;
+   topk->heap_pos = NULL;
+}
+
+/*
+   Function: swap_topk
+   Purpose : Swaps two heap positions and updates the record positions.
+   Input   : List, heap positions.
+   Output  : None.
+*/
+void swap_topk(pv_topk_t *topk, uint32_t a, uint32_t b)
+{
+   uint32_t index = topk->heap[a];
+
+   topk->heap[a] = topk->heap[b];
+   topk->heap[b] = index;
+   topk->heap_pos[topk->heap[a]] = a;
+   topk->heap_pos[topk->heap[b]] = b;
+}
+
+/*
+   Function: sift_topk
+   Purpose : Restores the min heap after the count at a heap position has
+             changed, new keys move up and counted keys move down.
+   Input   : List, heap position.
+   Output  : None.
+*/
+void sift_topk(pv_topk_t *topk, uint32_t pos)
+{
+   pv_flow_record_t *records = topk->table.records;
+   uint32_t child, parent;
+
+   while ((pos > 0) && (records[topk->heap[pos]].packet_count < records[topk->heap[(pos - 1) / 2]].packet_count))
+   {
+      parent = (pos - 1) / 2;
+      swap_topk(topk, pos, parent);
+      pos = parent;
+   }
+
+   for (;;)
+   {
+      child = (pos * 2) + 1;
+      if (child >= topk->size)
+      {
+         break;
+      }
+      if ((child + 1 < topk->size) && (records[topk->heap[child + 1]].packet_count < records[topk->heap[child]].packet_count))
+      {
+         child++;
+      }
+      if (records[topk->heap[pos]].packet_count <= records[topk->heap[child]].packet_count)
+      {
+         break;
+      }
+      swap_topk(topk, pos, child);
+      pos = child;
+   }
+
+   return;
+}
+
+/*
+   Function: update_topk
+   Purpose : Counts a packet for a key in a Space-Saving list. When the
+             list is full a new key takes over the record with the smallest
+             count and starts from that count.
+   Input   : List, key, key hash, packet bytes.
+   Output  : None.
+*/
+void update_topk(pv_topk_t *topk, pv_flow_key_t *key, uint32_t hash, uint32_t bytes)
+{
+   pv_flow_table_t *table = &topk->table;
+   pv_flow_record_t *record;
+   uint64_t floor = 0;
+   uint32_t index, pos;
+
+   if ((record = find_flow(table, key, hash)) == NULL)
+   {
+      if (topk->size < table->capacity)
+      {
+         pos = topk->size++;
+      }
+      else
+      {
+         pos = 0;
+         record = &table->records[topk->heap[0]];
+         floor = record->packet_count;
+         delete_flow(table, record);
+         topk->evictions++;
+      }
+      record = find_or_add_flow(table, key, hash);
+      index = (uint32_t)(record - table->records);
+      record->packet_count = floor;
+      topk->heap[pos] = index;
+      topk->heap_pos[index] = pos;
+   }
+
+   record->packet_count++;
+   record->data_size += bytes;
+   sift_topk(topk, topk->heap_pos[record - table->records]);
+
+   return;
+}
+
+/*
+   Function: init_heavy_hitters
+   Purpose : Allocates the sketches and Space-Saving lists for a worker.
+   Input   : Heavy hitters, number of keys reported.
+   Output  : Returns 0.
+*/
+int init_heavy_hitters(pv_heavy_t *heavy, unsigned int k)
+{
+   int t;
+
+   if (sketch_seeds[0] == 0)
+   {
+      init_sketch_seeds();
+   }
+   for (t = 0; t < PV_HEAVY_TYPES; t++)
+   {
+      init_sketch(&heavy->sketch[t]);
+      init_topk(&heavy->topk[t], k * PV_TOPK_COUNTERS);
+   }
+
+   return(0);
+}
+
+/*
+   Function: free_heavy_hitters
+   Purpose : Frees the sketches and top-k tables of a worker.
+   Input   : Heavy hitter state.
+   Output  : None.
+*/
+void free_heavy_hitters(pv_heavy_t *heavy)
+{
+   int t;
+
+   for (t = 0; t < PV_HEAVY_TYPES; t++)
+   {
+      free_sketch(&heavy->sketch[t]);
+      free_topk(&heavy->topk[t]);
+   }
+}
+
+/*
+   Function: update_heavy_hitters
+   Purpose : Counts a packet for its source address and its conversation.
+             The conversation key has the lower address first so both
+             directions are counted together.
+   Input   : Heavy hitters, packet flow key, IP length.
+   Output  : None.
+*/
+void update_heavy_hitters(pv_heavy_t *heavy, pv_flow_key_t *flow_key, uint32_t bytes)
+{
+   pv_flow_key_t key;
+   uint32_t hash;
+
+   memset(&key, 0, sizeof(pv_flow_key_t));
+   key.family = flow_key->family;
+   memcpy(key.src_addr, flow_key->src_addr, sizeof(key.src_addr));
+   hash = hash_flow_key(&key);
+   update_sketch(&heavy->sketch[PV_HEAVY_TALKERS], hash, bytes);
+   update_topk(&heavy->topk[PV_HEAVY_TALKERS], &key, hash, bytes);
+
+   if (memcmp(flow_key->src_addr, flow_key->dst_addr, sizeof(key.src_addr)) <= 0)
+   {
+      memcpy(key.dst_addr, flow_key->dst_addr, sizeof(key.dst_addr));
+   }
+   else
+   {
+      memcpy(key.src_addr, flow_key->dst_addr, sizeof(key.src_addr));
+      memcpy(key.dst_addr, flow_key->src_addr, sizeof(key.dst_addr));
+   }
+   hash = hash_flow_key(&key);
+   update_sketch(&heavy->sketch[PV_HEAVY_CONVERSATIONS], hash, bytes);
+   update_topk(&heavy->topk[PV_HEAVY_CONVERSATIONS], &key, hash, bytes);
+
+   return;
+}
+
+/*
+   Function: merge_heavy_sketches
+   Purpose : Adds up the worker sketches of a key type.
+   Input   : Merged sketch, key type.
+   Output  : None.
+*/
+void merge_heavy_sketches(pv_sketch_t *merged, int type)
+{
+   pv_sketch_cell_t *src;
+   int i, j;
+
+   memset(merged->cells, 0, PV_SKETCH_DEPTH * PV_SKETCH_WIDTH * sizeof(pv_sketch_cell_t));
+   for (i = 0; i < worker_count; i++)
+   {
+      if (workers[i].heavy == NULL)
+      {
+         continue;
+      }
+      src = workers[i].heavy->sketch[type].cells;
+      for (j = 0; j < PV_SKETCH_DEPTH * PV_SKETCH_WIDTH; j++)
+      {
+         merged->cells[j].packets += src[j].packets;
+         merged->cells[j].bytes += src[j].bytes;
+      }
+   }
+
+   return;
+}
+
+/*
+   Function: compare_heavy_candidates
+   Purpose : qsort() order for the report, most packets first, copies of
+             the same key from different workers end up next to each other.
+*/
+int compare_heavy_candidates(const void *a, const void *b)
+{
+   const pv_heavy_candidate_t *x = (const pv_heavy_candidate_t *)a;
+   const pv_heavy_candidate_t *y = (const pv_heavy_candidate_t *)b;
+
+   if (x->packets != y->packets)
+   {
+      return((x->packets > y->packets) ? -1 : 1);
+   }
+
+   return(memcmp(&x->key, &y->key, sizeof(pv_flow_key_t)));
+}
+
+/*
+   Function: format_heavy_key
+   Purpose : Renders a talker address or a conversation address pair.
+   Input   : Key, key type, output string and length.
+   Output  : Number of characters written.
+*/
+int format_heavy_key(pv_flow_key_t *key, int type, char *out, int len)
+{
+   char srcip[INET6_ADDRSTRLEN], dstip[INET6_ADDRSTRLEN];
+   int family = (key->family == PV_FLOW_IPV6) ? AF_INET6 : AF_INET;
+
+   inet_ntop(family, key->src_addr, srcip, INET6_ADDRSTRLEN);
+   if (type == PV_HEAVY_TALKERS)
+   {
+      return(snprintf(out, len, "%s", srcip));
+   }
+   inet_ntop(family, key->dst_addr, dstip, INET6_ADDRSTRLEN);
+
+   return(snprintf(out, len, "%s <-> %s", srcip, dstip));
+}
+
+/*
+   Function: format_heavy_hitters
+   Purpose : Collects the keys in the worker Space-Saving lists, ranks them
+             by their merged sketch estimates and renders the top K of each
+             key type. Keys with an estimate within the sketch error bound,
+             e/width of the packets counted, could be noise and are left
+             out, as are lines that do not fit in the output.
+   Input   : Merged sketches, sketches at the last report or NULL for the
+             counts since capture started, number of keys, output string
+             and length.
+   Output  : Number of characters written.
+*/
+int format_heavy_hitters(pv_sketch_t *current, pv_sketch_t *previous, unsigned int k, char *out, int len)
+{
+   pv_heavy_candidate_t *candidates;
+   pv_flow_record_t *record;
+   char key_text[PV_FLOW_TEXT_MAX];
+   unsigned int limit = worker_count * k * PV_TOPK_COUNTERS;
+   unsigned int count, shown, j;
+   uint64_t total, noise;
+   int n = 0, i, t;
+
+   candidates = xmalloc(limit * sizeof(pv_heavy_candidate_t));
+
+   for (t = 0; t < PV_HEAVY_TYPES; t++)
+   {
+      /* Every packet is counted once in each row. */
+      for (j = 0, total = 0; j < PV_SKETCH_WIDTH; j++)
+      {
+         total += current[t].cells[j].packets - ((previous != NULL) ? previous[t].cells[j].packets : 0);
+      }
+      noise = (total * 2718) / (1000 * PV_SKETCH_WIDTH);
+
+      count = 0;
+      for (i = 0; i < worker_count; i++)
+      {
+         if (workers[i].heavy == NULL)
+         {
+            continue;
+         }
+         for (record = get_next_flow(&workers[i].heavy->topk[t].table, NULL); (record != NULL) && (count < limit);
+              record = get_next_flow(&workers[i].heavy->topk[t].table, record))
+         {
+            memcpy(&candidates[count].key, &record->key, sizeof(pv_flow_key_t));
+            estimate_sketch(&current[t], (previous != NULL) ? &previous[t] : NULL, hash_flow_key(&candidates[count].key),
+                            &candidates[count].packets, &candidates[count].bytes);
+            if (candidates[count].packets > noise)
+            {
+               count++;
+            }
+         }
+      }
+      qsort(candidates, count, sizeof(pv_heavy_candidate_t), compare_heavy_candidates);
+
+      n = append_report(out, len, n, "Top %-26s %12s %16s\n", heavy_names[t], "packets", "bytes");
+      for (j = 0, shown = 0; (j < count) && (shown < k) && (len - n > PV_HEAVY_LINE_MAX); j++)
+      {
+         if ((j > 0) && (memcmp(&candidates[j].key, &candidates[j - 1].key, sizeof(pv_flow_key_t)) == 0))
+         {
+            continue;
+         }
+         format_heavy_key(&candidates[j].key, t, key_text, PV_FLOW_TEXT_MAX);
+         n = append_report(out, len, n, "%-30s %12lu %16lu\n", key_text,
+                           (unsigned long)candidates[j].packets, (unsigned long)candidates[j].bytes);
+         shown++;
+      }
+   }
+
+   free(candidates);
+
+   return(n);
+}
+
+/*
+   Function: print_heavy_hitters
+   Purpose : Prints the top K keys since capture started and the number
+             of Space-Saving evictions, called when capture stops.
+   Input   : Merged sketches, number of keys.
+   Output  : None.
+*/
+void print_heavy_hitters(pv_sketch_t *merged, unsigned int k)
+{
+   char report[PV_STATS_REPORT_MAX];
+   unsigned long evictions[PV_HEAVY_TYPES];
+   int i, t;
+
+   for (t = 0; t < PV_HEAVY_TYPES; t++)
+   {
+      merge_heavy_sketches(&merged[t], t);
+      evictions[t] = 0;
+      for (i = 0; i < worker_count; i++)
+      {
+         if (workers[i].heavy != NULL)
+         {
+            evictions[t] += workers[i].heavy->topk[t].evictions;
+         }
+      }
+   }
+   format_heavy_hitters(merged, NULL, k, report, PV_STATS_REPORT_MAX);
+
+   printf("\nHeavy hitters since capture started (%lu talker and %lu conversation list evictions):\n%s\n",
+          evictions[PV_HEAVY_TALKERS], evictions[PV_HEAVY_CONVERSATIONS], report);
+
+   return;
+}
@@ -0,0 +1,231 @@
+/*  Copyright 2014 Derek Chadwick
+
+    This file is part of the Pivotal Network Security Tools.
+
+    Pivotal is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Pivotal is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Pivotal.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+   pvhttp.c
+
+   Title : Pivotal NST Sensor HTTP Request Parser
+   Author: Derek Chadwick
+   Date  : 17/10/2026
+
+   Purpose: Finds HTTP/1.x requests in TCP payloads and counts their URLs
+            in the URL map (-y option), see pvurlmap.c.
+
+            The parser makes one pass over the payload and does not
+            allocate or copy, the request is returned as pointers into the
+            payload. Payloads that do not start with a known method and a
+            space are rejected on the first bytes. The line ends are found
+            with memchr(), and only the first header line starting with an
+            H is compared against "Host:". A request line cut off by the
+            snaplen still gives the start of the URL.
+
+            The URL is the Host header, or the destination address when
+            there is none, followed by the path without the query string,
+            so the table holds pages and not every query. The URLs go into
+            the <control>urls messages, so the copy stops at a line end or
+            NUL and markup characters and other bytes that are not
+            printable become '?'.
+
+   Status : EXPERIMENTAL - not for use in production networks.
+
+*/
+
+#include "pvcommon.h"
+#include "pivot-sensor.h"
+
+char *http_methods[] = { "GET", "POST", "HEAD", "PUT", "DELETE", "OPTIONS", "PATCH", "CONNECT", "TRACE", NULL };
+
+/*
+   Function: parse_http_request
+   Purpose : Parses the request line and the Host header of an HTTP/1.x
+             request at the start of a payload.
+   Input   : Payload, payload length, request to fill in.
+   Output  : Returns 1 if the payload starts with a request, otherwise 0.
+*/
+int parse_http_request(const uint8_t *data, uint32_t len, pv_http_request_t *request)
+{
+   const uint8_t *end = data + len;
+   const uint8_t *target, *space, *line_end, *p, *q;
+   uint32_t i;
+   int m;
+
+   if (len < PV_HTTP_MIN_REQUEST)
+   {
+      return(0);
+   }
+   switch (data[0])
+   {
+   case 'G': case 'P': case 'H': case 'D': case 'O': case 'C': case 'T':
+      break;
+   default:
+      return(0);
+   }
+
+   for (i = 1; (i < len) && (i < PV_HTTP_METHOD_MAX) && (data[i] != ' '); i++)
+      ;
+   if ((i == len) || (data[i] != ' '))
+   {
+      return(0);
+   }
+   for (m = 0; http_methods[m] != NULL; m++)
+   {
+      if ((strlen(http_methods[m]) == i) && (memcmp(data, http_methods[m], i) == 0))
+      {
+         break;
+      }
+   }
+   if (http_methods[m] == NULL)
+   {
+      return(0);
+   }
+
+   memset(request, 0, sizeof(pv_http_request_t));
+   request->method = data;
+   request->method_length = i;
+
+   /* Request target, up to the space before the version or the end of a cut off payload. */
+   target = data + i + 1;
+   line_end = memchr(target, '\n', end - target);
+   space = memchr(target, ' ', ((line_end != NULL) ? line_end : end) - target);
+   if (space == NULL)
+   {
+      if (line_end != NULL)
+      {
+         return(0);
+      }
+      space = end;
+   }
+   else if ((end - (space + 1) >= 7) ? (memcmp(space + 1, "HTTP/1.", 7) != 0) : (memcmp(space + 1, "HTTP/1.", end - (space + 1)) != 0))
+   {
+      return(0);
+   }
+   if (space == target)
+   {
+      return(0);
+   }
+
+   if (*target == '/')
+   {
+      request->path = target;
+      request->path_length = space - target;
+   }
+   else if ((space - target > 7) && (strncasecmp((char *)target, "http://", 7) == 0))
+   {
+      /* Absolute form, sent to proxies. */
+      request->host = target + 7;
+      if ((p = memchr(request->host, '/', space - request->host)) == NULL)
+      {
+         p = space;
+      }
+      request->host_length = p - request->host;
+      request->path = p;
+      request->path_length = space - p;
+   }
+   else if (m == PV_HTTP_CONNECT)
+   {
+      request->host = target;
+      request->host_length = space - target;
+      return(1);
+   }
+   else
+   {
+      return(0);
+   }
+   if ((q = memchr(request->path, '?', request->path_length)) != NULL)
+   {
+      request->path_length = q - request->path;
+   }
+
+   /* Headers, until the blank line or the end of the payload. */
+   for (p = (line_end != NULL) ? line_end + 1 : end; (p < end) && (request->host == NULL); p = line_end + 1)
+   {
+      if ((line_end = memchr(p, '\n', end - p)) == NULL)
+      {
+         line_end = end;
+      }
+      if ((*p == '\r') || (*p == '\n'))
+      {
+         break;
+      }
+      if (((*p | 0x20) == 'h') && (line_end - p > 5) && (strncasecmp((char *)p, "host:", 5) == 0))
+      {
+         for (q = p + 5; (q < line_end) && ((*q == ' ') || (*q == '\t')); q++)
+            ;
+         request->host = q;
+         for (q = line_end; (q > request->host) && ((q[-1] == '\r') || (q[-1] == ' ') || (q[-1] == '\t')); q--)
+            ;
+         request->host_length = q - request->host;
+      }
+   }
+
+   return(1);
+}
+
+/*
+   Function: update_http
+   Purpose : Counts the URL of an HTTP request payload, or reassembled
+             stream chunk, in the URL map. The host name is lower cased as
+             it is copied into the URL, and the host and path end at a CR,
+             LF or NUL.
+   Input   : Worker, flow record, packet event, payload, payload length.
+   Output  : None.
+*/
+void update_http(pv_worker_t *worker, pv_flow_record_t *flow, pv_packet_event_t *event, uint8_t *payload, uint32_t len)
+{
+   pv_http_request_t request;
+   char url[PV_URL_MAX_LENGTH];
+   uint32_t n, i;
+   uint8_t c;
+
+   if (!parse_http_request(payload, len, &request))
+   {
+      return;
+   }
+   worker->http_requests++;
+
+   for (n = 0; (n < request.host_length) && (n < PV_URL_MAX_LENGTH / 2); n++)
+   {
+      if (((c = request.host[n]) == 0) || (c == '\r') || (c == '\n'))
+      {
+         break;
+      }
+      url[n] = ((c >= 'A') && (c <= 'Z')) ? (c | 0x20) : (PV_TEXT_CHAR(c) ? c : '?');
+   }
+   if (n == 0)
+   {
+      inet_ntop((event->key.family == PV_FLOW_IPV6) ? AF_INET6 : AF_INET, event->key.dst_addr, url, INET6_ADDRSTRLEN);
+      n = strlen(url);
+   }
+   for (i = 0; (i < request.path_length) && (n < PV_URL_MAX_LENGTH - 1); i++)
+   {
+      if (((c = request.path[i]) == 0) || (c == '\r') || (c == '\n'))
+      {
+         break;
+      }
+      url[n++] = PV_TEXT_CHAR(c) ? c : '?';
+   }
+   if (i == 0)
+   {
+      url[n++] = '/';
+   }
+   url[n] = 0;
+
+   add_url(url, n, event->ts_sec);
+
+   return;
+}
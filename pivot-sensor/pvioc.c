@@ -0,0 +1,709 @@
+/*  Copyright 2014 Derek Chadwick
+
+    This file is part of the Pivotal Network Security Tools.
+
+    Pivotal is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Pivotal is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Pivotal.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+   pvioc.c
+
+   Title : Pivotal NST Sensor IOC Pattern Matcher
+   Author: Derek Chadwick
+   Date  : 17/10/2026
+
+   Purpose: Matches payloads against a list of indicator of compromise
+            strings, such as C2 URIs, user agents and exploit markers,
+            loaded at startup from a pattern file (-l option).
+
+            Pattern files are plain text with one pattern on each line,
+            matched case sensitively anywhere in a payload. Binary bytes
+            are written in hex between bars, as in Snort content rules.
+            Empty lines and lines starting with # are skipped, the rest
+            of the line is the pattern, spaces included.
+
+            Example:
+
+            # C2 check-in URI and user agent
+            /gate.php?bot_id=
+            Mozilla/4.0 (compatible; MSIE 6.0; Win32)
+            |4d 5a 90 00|This program
+
+            All the patterns are compiled into one Aho-Corasick automaton,
+            so a payload is scanned once whatever the number of patterns.
+            The root and the states one byte deep have a full 256 entry
+            transition row, a byte that does not start a pattern costs one
+            lookup in the root row, which stays in the cache. The deeper
+            states keep only their trie edges, sorted by byte and searched
+            with memchr(), and follow their fail links on a miss, so the
+            automaton grows with the total pattern length and not with 256
+            times the number of states.
+
+            Each match counts a hit for the pattern, shared by all the
+            workers and reported every statistics interval (-U option),
+            and raises an alert event, up to PV_IOC_FLOW_ALERTS per flow.
+            The matcher state is kept per flow record, so with TCP stream
+            reassembly on (-M option) a pattern split across segments is
+            found, and without it across segments that arrive in order.
+
+   Status : EXPERIMENTAL - not for use in production networks.
+
+*/
+
+#include <ctype.h>
+
+#include "pvcommon.h"
+#include "pivot-sensor.h"
+
+pv_ioc_matcher_t ioc_matcher;
+
+/*
+   Function: parse_ioc_pattern
+   Purpose : Converts a pattern file line to the pattern bytes, with the
+             hex bytes between bars decoded.
+   Input   : Line without the line end, pattern buffer of
+             PV_IOC_MAX_PATTERN bytes.
+   Output  : Pattern length or -1 if the line is not a valid pattern.
+*/
+int parse_ioc_pattern(char *text, uint8_t *pattern)
+{
+   char *p;
+   int length = 0, hex = 0, digits = 0, value = 0;
+
+   for (p = text; *p != 0; p++)
+   {
+      if (*p == '|')
+      {
+         if (hex && (digits > 0))
+         {
+            return(-1);
+         }
+         hex = !hex;
+         continue;
+      }
+      if (hex && (*p == ' '))
+      {
+         continue;
+      }
+      if (length == PV_IOC_MAX_PATTERN)
+      {
+         return(-1);
+      }
+      if (!hex)
+      {
+         pattern[length++] = (uint8_t)*p;
+         continue;
+      }
+      if (!isxdigit((unsigned char)*p))
+      {
+         return(-1);
+      }
+      value = (value << 4) | (isdigit((unsigned char)*p) ? (*p - '0') : ((*p | 0x20) - 'a' + 10));
+      if (++digits == 2)
+      {
+         pattern[length++] = (uint8_t)value;
+         digits = 0;
+         value = 0;
+      }
+   }
+   if (hex || (length == 0))
+   {
+      return(-1);
+   }
+
+   return(length);
+}
+
+/*
+   Function: add_ioc_state
+   Purpose : Adds a trie state for a byte after a parent state. The states
+             near the root get a transition row, the others are linked
+             into the parent's child list until the edges are laid out.
+   Input   : Matcher, build child, sibling and byte arrays, parent state,
+             byte.
+   Output  : New state.
+*/
+uint32_t add_ioc_state(pv_ioc_matcher_t *matcher, uint32_t *child, uint32_t *sibling, uint8_t *byte, uint32_t parent, uint8_t c)
+{
+   uint32_t t = matcher->state_count++;
+   pv_ioc_state_t *state = &matcher->states[t];
+
+   memset(state, 0, sizeof(pv_ioc_state_t));
+   state->output = PV_IOC_NONE;
+   state->pattern = PV_IOC_NONE;
+   state->row = PV_IOC_NONE;
+   state->depth = matcher->states[parent].depth + 1;
+   if (state->depth < PV_IOC_DENSE_DEPTH)
+   {
+      state->row = matcher->row_count++;
+      matcher->rows = xrealloc(matcher->rows, matcher->row_count * 256 * sizeof(uint32_t));
+      memset(matcher->rows + (state->row << 8), 0, 256 * sizeof(uint32_t));
+   }
+   child[t] = 0;
+   byte[t] = c;
+
+   /* State 0 is the root, so 0 in a row or a child list is no child. */
+   if (matcher->states[parent].row != PV_IOC_NONE)
+   {
+      matcher->rows[(matcher->states[parent].row << 8) + c] = t;
+   }
+   else
+   {
+      sibling[t] = child[parent];
+      child[parent] = t;
+   }
+
+   return(t);
+}
+
+/*
+   Function: insert_ioc_pattern
+   Purpose : Adds the trie path for a pattern.
+   Input   : Matcher, build child, sibling and byte arrays, pattern index.
+   Output  : Returns 0, or -1 if the pattern is a duplicate.
+*/
+int insert_ioc_pattern(pv_ioc_matcher_t *matcher, uint32_t *child, uint32_t *sibling, uint8_t *byte, uint32_t id)
+{
+   pv_ioc_pattern_t *pattern = &matcher->patterns[id];
+   uint8_t *p = matcher->arena + pattern->offset;
+   uint32_t s = 0, t, i;
+
+   for (i = 0; i < pattern->length; i++)
+   {
+      if (matcher->states[s].row != PV_IOC_NONE)
+      {
+         t = matcher->rows[(matcher->states[s].row << 8) + p[i]];
+      }
+      else
+      {
+         for (t = child[s]; (t != 0) && (byte[t] != p[i]); t = sibling[t])
+            ;
+      }
+      if (t == 0)
+      {
+         t = add_ioc_state(matcher, child, sibling, byte, s, p[i]);
+      }
+      s = t;
+   }
+   if (matcher->states[s].pattern != PV_IOC_NONE)
+   {
+      return(-1);
+   }
+   matcher->states[s].pattern = id;
+
+   return(0);
+}
+
+/*
+   Function: next_ioc_state
+   Purpose : Automaton transition, follows the fail links from a sparse
+             state until a state has an edge for the byte or a row.
+   Input   : Matcher, state, byte.
+   Output  : Next state.
+*/
+uint32_t next_ioc_state(pv_ioc_matcher_t *matcher, uint32_t s, uint8_t c)
+{
+   pv_ioc_state_t *state;
+   uint8_t *edge;
+
+   for (;;)
+   {
+      state = &matcher->states[s];
+      if (state->row != PV_IOC_NONE)
+      {
+         return(matcher->rows[(state->row << 8) + c]);
+      }
+      if ((state->edge_count > 0) && ((edge = memchr(matcher->edge_bytes + state->edges, c, state->edge_count)) != NULL))
+      {
+         return(matcher->edge_targets[edge - matcher->edge_bytes]);
+      }
+      s = state->fail;
+   }
+}
+
+/*
+   Function: build_ioc_matcher
+   Purpose : Turns the pattern trie into the automaton. The sparse edges
+             are laid out breadth first, then the fail and output links
+             are set and the rows completed in the same order, so the
+             shallower states a transition falls back to are finished.
+   Input   : Matcher with all the patterns inserted, build child, sibling
+             and byte arrays.
+   Output  : None.
+*/
+void build_ioc_matcher(pv_ioc_matcher_t *matcher, uint32_t *child, uint32_t *sibling, uint8_t *byte)
+{
+   pv_ioc_state_t *state, *next;
+   uint32_t *queue = xmalloc(matcher->state_count * sizeof(uint32_t));
+   uint32_t head = 0, tail = 1, edge_count = 0, u, v, e, c;
+   uint32_t *row;
+
+   matcher->edge_bytes = xmalloc(matcher->state_count);
+   matcher->edge_targets = xmalloc(matcher->state_count * sizeof(uint32_t));
+
+   queue[0] = 0;
+   while (head < tail)
+   {
+      u = queue[head++];
+      state = &matcher->states[u];
+      if (state->row != PV_IOC_NONE)
+      {
+         row = matcher->rows + (state->row << 8);
+         for (c = 0; c < 256; c++)
+         {
+            if (row[c] != 0)
+            {
+               queue[tail++] = row[c];
+            }
+         }
+         continue;
+      }
+      state->edges = edge_count;
+      for (v = child[u]; v != 0; v = sibling[v])
+      {
+         /* Insertion sort, most states have one or two edges. */
+         for (e = edge_count; (e > state->edges) && (matcher->edge_bytes[e - 1] > byte[v]); e--)
+         {
+            matcher->edge_bytes[e] = matcher->edge_bytes[e - 1];
+            matcher->edge_targets[e] = matcher->edge_targets[e - 1];
+         }
+         matcher->edge_bytes[e] = byte[v];
+         matcher->edge_targets[e] = v;
+         edge_count++;
+      }
+      state->edge_count = edge_count - state->edges;
+      for (e = state->edges; e < edge_count; e++)
+      {
+         queue[tail++] = matcher->edge_targets[e];
+      }
+   }
+
+   for (head = 0; head < tail; head++)
+   {
+      u = queue[head];
+      state = &matcher->states[u];
+      for (c = 0; c < 256; c++)
+      {
+         if (state->row != PV_IOC_NONE)
+         {
+            row = matcher->rows + (state->row << 8);
+            if ((v = row[c]) == 0)
+            {
+               /* Complete the row, a missing edge goes where the fail state goes. */
+               row[c] = (u == 0) ? 0 : next_ioc_state(matcher, state->fail, (uint8_t)c);
+               continue;
+            }
+         }
+         else if (c < state->edge_count)
+         {
+            v = matcher->edge_targets[state->edges + c];
+         }
+         else
+         {
+            break;
+         }
+         next = &matcher->states[v];
+         next->fail = (u == 0) ? 0 : next_ioc_state(matcher, state->fail, byte[v]);
+         next->output = (next->pattern != PV_IOC_NONE) ? v : matcher->states[next->fail].output;
+      }
+   }
+
+   free(queue);
+   matcher->states = xrealloc(matcher->states, matcher->state_count * sizeof(pv_ioc_state_t));
+}
+
+/*
+   Function: load_ioc_patterns
+   Purpose : Reads the pattern file and builds the matcher.
+   Input   : Matcher, pattern file name.
+   Output  : Returns 0, or -1 if the file could not be read or has no
+             valid patterns.
+*/
+int load_ioc_patterns(pv_ioc_matcher_t *matcher, char *file_name)
+{
+   char instr[PV_MAX_INPUT_STR];
+   uint8_t pattern[PV_IOC_MAX_PATTERN];
+   uint32_t *child, *sibling;
+   uint8_t *byte;
+   uint32_t capacity = 0, arena_size = 0, line = 0, count, i;
+   int length, rejected = 0, duplicates = 0;
+   FILE *pattern_file;
+
+   memset(matcher, 0, sizeof(pv_ioc_matcher_t));
+   if ((pattern_file = fopen(file_name, "r")) == NULL)
+   {
+      sprint_log_entry("load_ioc_patterns() <ERROR> Could not open IOC pattern file", file_name);
+      return(-1);
+   }
+
+   while (fgets(instr, PV_MAX_INPUT_STR, pattern_file) != NULL)
+   {
+      line++;
+      /* Only the line end is removed, spaces can be part of a pattern. */
+      instr[strcspn(instr, "\r\n")] = 0;
+      if ((instr[0] == 0) || (instr[0] == '#'))
+      {
+         continue;
+      }
+      if ((length = parse_ioc_pattern(instr, pattern)) < 0)
+      {
+         iprint_log_entry("load_ioc_patterns() <WARNING> Invalid or too long IOC pattern on line", line);
+         rejected++;
+         continue;
+      }
+      if (matcher->pattern_count == capacity)
+      {
+         capacity = (capacity == 0) ? 1024 : capacity * 2;
+         matcher->patterns = xrealloc(matcher->patterns, capacity * sizeof(pv_ioc_pattern_t));
+      }
+      if (matcher->arena_used + length > arena_size)
+      {
+         arena_size = (arena_size == 0) ? 65536 : arena_size * 2;
+         matcher->arena = xrealloc(matcher->arena, arena_size);
+      }
+      memcpy(matcher->arena + matcher->arena_used, pattern, length);
+      memset(&matcher->patterns[matcher->pattern_count], 0, sizeof(pv_ioc_pattern_t));
+      matcher->patterns[matcher->pattern_count].offset = matcher->arena_used;
+      matcher->patterns[matcher->pattern_count].length = length;
+      matcher->patterns[matcher->pattern_count].line = line;
+      matcher->pattern_count++;
+      matcher->arena_used += length;
+   }
+   fclose(pattern_file);
+
+   if (matcher->pattern_count == 0)
+   {
+      sprint_log_entry("load_ioc_patterns() <ERROR> No valid patterns in IOC pattern file", file_name);
+      free_ioc_matcher(matcher);
+      return(-1);
+   }
+
+   /* A state for each pattern byte at most, and the root. */
+   matcher->states = xmalloc((matcher->arena_used + 1) * sizeof(pv_ioc_state_t));
+   child = xmalloc((matcher->arena_used + 1) * sizeof(uint32_t));
+   sibling = xmalloc((matcher->arena_used + 1) * sizeof(uint32_t));
+   byte = xmalloc(matcher->arena_used + 1);
+   memset(matcher->states, 0, sizeof(pv_ioc_state_t));
+   matcher->states[0].output = PV_IOC_NONE;
+   matcher->states[0].pattern = PV_IOC_NONE;
+   matcher->states[0].row = 0;
+   matcher->rows = xcalloc(256 * sizeof(uint32_t));
+   matcher->row_count = 1;
+   matcher->state_count = 1;
+   child[0] = 0;
+
+   /* Duplicates are dropped and the pattern list closed up behind them. */
+   count = matcher->pattern_count;
+   matcher->pattern_count = 0;
+   for (i = 0; i < count; i++)
+   {
+      matcher->patterns[matcher->pattern_count] = matcher->patterns[i];
+      if (insert_ioc_pattern(matcher, child, sibling, byte, matcher->pattern_count) < 0)
+      {
+         iprint_log_entry("load_ioc_patterns() <WARNING> Duplicate IOC pattern on line", matcher->patterns[i].line);
+         duplicates++;
+         continue;
+      }
+      matcher->pattern_count++;
+   }
+   build_ioc_matcher(matcher, child, sibling, byte);
+   free(child);
+   free(sibling);
+   free(byte);
+
+   printf("load_ioc_patterns() <INFO> Loaded %u IOC patterns, %d invalid, %d duplicates: %u states, %u rows, %lu KB\n",
+          matcher->pattern_count, rejected, duplicates, matcher->state_count, matcher->row_count,
+          (unsigned long)((matcher->state_count * (sizeof(pv_ioc_state_t) + 5) + matcher->row_count * 256 * sizeof(uint32_t)) >> 10));
+
+   return(0);
+}
+
+/*
+   Function: report_ioc_matches
+   Purpose : Counts the patterns ending at a state and raises the alerts,
+             at most PV_IOC_FLOW_ALERTS for a flow and not the same
+             pattern twice in a row.
+   Input   : Worker, flow matcher state or NULL, packet event, state.
+   Output  : None.
+*/
+void report_ioc_matches(pv_worker_t *worker, pv_ioc_flow_t *ioc, pv_packet_event_t *event, uint32_t s)
+{
+   pv_alert_t alert;
+   uint32_t o, id;
+
+   for (o = ioc_matcher.states[s].output; o != PV_IOC_NONE; o = ioc_matcher.states[ioc_matcher.states[o].fail].output)
+   {
+      id = ioc_matcher.states[o].pattern;
+      __atomic_fetch_add(&ioc_matcher.patterns[id].hits, 1, __ATOMIC_RELAXED);
+      worker->ioc_matches++;
+      if ((ioc == NULL) || (ioc->alerts >= PV_IOC_FLOW_ALERTS) || (ioc->last_pattern == id))
+      {
+         continue;
+      }
+      ioc->alerts++;
+      ioc->last_pattern = id;
+      worker->ioc_alerts++;
+
+      memset(&alert, 0, sizeof(pv_alert_t));
+      memcpy(&alert.key, &event->key, sizeof(pv_flow_key_t));
+      alert.type = PV_ALERT_IOC;
+      alert.ts_sec = event->ts_sec;
+      alert.ts_usec = event->ts_usec;
+      alert.value = id;
+      queue_alert(worker, &alert);
+   }
+}
+
+/*
+   Function: scan_iocs
+   Purpose : Runs the automaton over a payload. While the automaton is at
+             the root the loop only looks bytes up in the root row.
+   Input   : Worker, flow matcher state or NULL, packet event, state to
+             start from, payload, payload length.
+   Output  : State after the last byte.
+*/
+uint32_t scan_iocs(pv_worker_t *worker, pv_ioc_flow_t *ioc, pv_packet_event_t *event, uint32_t s, uint8_t *data, uint32_t len)
+{
+   uint32_t *root = ioc_matcher.rows;
+   uint8_t *p = data;
+   uint8_t *end = data + len;
+
+   while (p < end)
+   {
+      if (s == 0)
+      {
+         while ((p < end) && ((s = root[*p]) == 0))
+         {
+            p++;
+         }
+         if (p == end)
+         {
+            break;
+         }
+      }
+      else
+      {
+         s = next_ioc_state(&ioc_matcher, s, *p);
+      }
+      p++;
+      if (ioc_matcher.states[s].output != PV_IOC_NONE)
+      {
+         report_ioc_matches(worker, ioc, event, s);
+      }
+   }
+
+   return(s);
+}
+
+/*
+   Function: update_iocs
+   Purpose : Matches a payload, or reassembled stream chunk, against the
+             IOC patterns. A TCP payload carries on from the flow's
+             matcher state when it starts at the sequence number the last
+             one ended at, otherwise matching starts again at the root.
+   Input   : Worker, flow record, packet event, payload, payload length.
+   Output  : None.
+*/
+void update_iocs(pv_worker_t *worker, pv_flow_record_t *flow, pv_packet_event_t *event, uint8_t *payload, uint32_t len)
+{
+   pv_ioc_flow_t *ioc = NULL;
+   uint32_t index, seq;
+   uint32_t s = 0;
+
+   worker->ioc_bytes += len;
+   if (flow != NULL)
+   {
+      index = flow - worker->flow_table.records;
+      ioc = &worker->ioc[index];
+      if (!(flow->flags & PV_FLOW_IOC))
+      {
+         memset(ioc, 0, sizeof(pv_ioc_flow_t));
+         ioc->last_pattern = PV_IOC_NONE;
+         flow->flags |= PV_FLOW_IOC;
+      }
+      if ((event->key.protocol == IPPROTO_TCP) && !(event->desc.flags & PV_DECODE_FRAGMENT))
+      {
+         /* A reassembled chunk starts at the stream's next sequence number. */
+         if (worker->reasm != NULL)
+         {
+            seq = worker->reasm->streams[index].next_seq;
+         }
+         else
+         {
+            seq = event->tcp_seq + ((event->tcp_flags & TH_SYN) ? 1 : 0);
+         }
+         if (seq == ioc->next_seq)
+         {
+            s = ioc->state;
+         }
+         ioc->next_seq = seq + len;
+      }
+   }
+
+   s = scan_iocs(worker, ioc, event, s, payload, len);
+   if (ioc != NULL)
+   {
+      ioc->state = s;
+   }
+
+   return;
+}
+
+/*
+   Function: format_ioc_pattern
+   Purpose : Renders a pattern as it would be written in the pattern
+             file, long patterns are cut.
+   Input   : Pattern index, output string and length.
+   Output  : Number of characters written.
+*/
+int format_ioc_pattern(uint32_t id, char *out, int len)
+{
+   pv_ioc_pattern_t *pattern = &ioc_matcher.patterns[id];
+   uint8_t *p = ioc_matcher.arena + pattern->offset;
+   uint32_t i;
+   int n = 0, hex = 0;
+
+   /* Room for a hex byte, the closing bar and the NUL. */
+   for (i = 0; (i < pattern->length) && (n < len - 6); i++)
+   {
+      if ((p[i] >= 0x20) && (p[i] < 0x7f) && (p[i] != '|'))
+      {
+         if (hex)
+         {
+            out[n++] = '|';
+            hex = 0;
+         }
+         out[n++] = p[i];
+      }
+      else
+      {
+         n += sprintf(out + n, hex ? " %02x" : "|%02x", p[i]);
+         hex = 1;
+      }
+   }
+   if (hex)
+   {
+      out[n++] = '|';
+   }
+   out[n] = 0;
+
+   return(n);
+}
+
+/*
+   Function: select_top_iocs
+   Purpose : Finds the patterns with the most hits, since capture started
+             or in the interval since the last report. For an interval the
+             hit counts at this report are kept for the next one.
+   Input   : Top list of k entries, k, interval flag.
+   Output  : Number of entries in the list, most hits first.
+*/
+int select_top_iocs(pv_ioc_top_t *top, unsigned int k, int interval)
+{
+   pv_ioc_pattern_t *pattern;
+   uint64_t hits, total;
+   uint32_t i;
+   int n = 0, j;
+
+   for (i = 0; i < ioc_matcher.pattern_count; i++)
+   {
+      pattern = &ioc_matcher.patterns[i];
+      total = pattern->hits;
+      hits = total;
+      if (interval)
+      {
+         hits = total - pattern->exported;
+         pattern->exported = total;
+      }
+      if ((hits == 0) || ((n == (int)k) && (hits <= top[n - 1].hits)))
+      {
+         continue;
+      }
+      for (j = (n < (int)k) ? n++ : n - 1; (j > 0) && (top[j - 1].hits < hits); j--)
+      {
+         top[j] = top[j - 1];
+      }
+      top[j].pattern = pattern;
+      top[j].hits = hits;
+   }
+
+   return(n);
+}
+
+/*
+   Function: format_ioc_hits
+   Purpose : Renders a top pattern list.
+   Input   : Top list, entries, output string and length.
+   Output  : Number of characters written.
+*/
+int format_ioc_hits(pv_ioc_top_t *top, int count, char *out, int len)
+{
+   char text[PV_IOC_TEXT_MAX];
+   int n, i;
+
+   n = snprintf(out, len, "IOC pattern hits: %u patterns\n%12s %12s %6s  %s\n", ioc_matcher.pattern_count, "hits", "total", "line", "pattern");
+   for (i = 0; (i < count) && (len - n > PV_IOC_TEXT_MAX + 40); i++)
+   {
+      format_ioc_pattern(top[i].pattern - ioc_matcher.patterns, text, PV_IOC_TEXT_MAX);
+      n += snprintf(out + n, len - n, "%12lu %12lu %6u  %s\n", (unsigned long)top[i].hits, (unsigned long)top[i].pattern->hits,
+                    top[i].pattern->line, text);
+   }
+
+   return(n);
+}
+
+/*
+   Function: print_ioc_hits
+   Purpose : Prints the patterns with the most hits since capture started.
+   Input   : Number of patterns to print.
+   Output  : None.
+*/
+void print_ioc_hits(unsigned int k)
+{
+   char report[PV_STATS_REPORT_MAX];
+   pv_ioc_top_t *top = xmalloc(k * sizeof(pv_ioc_top_t));
+
+   format_ioc_hits(top, select_top_iocs(top, k, 0), report, PV_STATS_REPORT_MAX);
+   fputs(report, stdout);
+   free(top);
+}
+
+/*
+   Function: print_ioc_stats
+   Purpose : Prints the IOC pattern counters of a worker.
+   Input   : Worker ID, worker.
+   Output  : None.
+*/
+void print_ioc_stats(int worker_id, pv_worker_t *worker)
+{
+   printf("Worker %d IOC patterns: %llu bytes scanned, %lu matches, %lu alerts\n", worker_id, worker->ioc_bytes,
+          worker->ioc_matches, worker->ioc_alerts);
+}
+
+/*
+   Function: free_ioc_matcher
+   Purpose : Frees the pattern automaton.
+   Input   : Matcher.
+   Output  : None.
+*/
+void free_ioc_matcher(pv_ioc_matcher_t *matcher)
+{
+   free(matcher->states);
+   free(matcher->rows);
+   free(matcher->edge_bytes);
+   free(matcher->edge_targets);
+   free(matcher->patterns);
+   free(matcher->arena);
+   memset(matcher, 0, sizeof(pv_ioc_matcher_t));
+}
@@ -0,0 +1,422 @@
+/*  Copyright 2014 Derek Chadwick
+
+    This file is part of the Pivotal Network Security Tools.
+
+    Pivotal is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Pivotal is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Pivotal.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+   pvoutput.c
+
+   Title : Pivotal NST Sensor Output Stage
+   Author: Derek Chadwick
+   Date  : 17/10/2026
+
+   Purpose: Moves event formatting and output off the capture threads.
+            Each capture worker has an output thread, connected by a lock
+            free single producer, single consumer ring of preallocated
+            event slots (-D option, default 65536 slots per worker).
+
+            The capture worker decodes the packet and updates the flow
+            table, then copies the binary packet event, or a completed
+            flow, into the next free slot. The output thread renders the
+            event text and writes the event file, server queue and console
+            output. If the ring is full the event is dropped and counted,
+            so a slow disk or console never stalls capture. The ring depth
+            high water mark and drops are printed when capture stops.
+
+            With -D 0 the output stage runs inline on the capture thread,
+            offline replay does this by default so the per-stage timings
+            are comparable between builds. Replay through the ring waits
+            for a free slot instead of dropping events.
+
+   Status : EXPERIMENTAL - not for use in production networks.
+
+*/
+
+#include <time.h>
+#include <sched.h>
+
+#include "pvcommon.h"
+#include "pivot-sensor.h"
+
+/*
+   Function: init_output
+   Purpose : Allocates the output stage event file buffer, and the slot
+             ring if the output stage has its own thread. The number of
+             slots is rounded up to a power of two.
+   Input   : Output stage, ring slots (0 for inline output), timed event mask.
+   Output  : Returns 0.
+*/
+int init_output(pv_output_t *output, int slots, uint32_t sample_mask)
+{
+   uint32_t size = 1;
+
+   memset(output, 0, sizeof(pv_output_t));
+   output->out_buffer = xmalloc(PV_WORKER_OUTBUF_SIZE);
+   output->last_flush = time(NULL);
+   output->sample_mask = sample_mask;
+
+   if (slots > 0)
+   {
+      while (size < (uint32_t)slots)
+      {
+         size <<= 1;
+      }
+      output->ring.slots = xmemalign(PV_CACHE_LINE_SIZE, size * sizeof(pv_output_slot_t));
+      output->ring.size = size;
+      output->ring.mask = size - 1;
+   }
+
+   return(0);
+}
+
+/*
+   Function: free_output
+   Purpose : Frees the output ring and buffer of a worker.
+   Input   : Output state.
+   Output  : None.
+*/
+void free_output(pv_output_t *output)
+{
+   free(output->out_buffer);
+   free(output->ring.slots);
+   output->out_buffer = NULL;
+   output->ring.slots = NULL;
+}
+
+/*
+   Function: reserve_output_slot
+   Purpose : Producer side, returns the next free slot. The output thread
+             tail is only read when the cached copy shows the ring as full.
+   Input   : Ring.
+   Output  : Slot or NULL if the ring is full.
+*/
+pv_output_slot_t *reserve_output_slot(pv_event_ring_t *ring)
+{
+   if (ring->head - ring->cached_tail >= ring->size)
+   {
+      ring->cached_tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+      while (ring->blocking && (ring->head - ring->cached_tail >= ring->size))
+      {
+         sched_yield();
+         ring->cached_tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+      }
+      if (ring->head - ring->cached_tail >= ring->size)
+      {
+         ring->dropped++;
+         return(NULL);
+      }
+   }
+
+   return(&ring->slots[ring->head & ring->mask]);
+}
+
+/*
+   Function: commit_output_slot
+   Purpose : Producer side, publishes the reserved slot to the consumer.
+   Input   : Ring.
+   Output  : None.
+*/
+void commit_output_slot(pv_event_ring_t *ring)
+{
+   ring->queued++;
+   __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+}
+
+/*
+   Function: flush_output
+   Purpose : Writes the output stage event buffer to the event file.
+   Input   : Output stage.
+   Output  : None.
+*/
+void flush_output(pv_output_t *output)
+{
+   if (output->out_length > 0)
+   {
+      write_event_buffer(output->out_buffer, output->out_length);
+      output->out_length = 0;
+   }
+   output->last_flush = time(NULL);
+
+   return;
+}
+
+/*
+   Function: buffer_output_event
+   Purpose : Appends an event record to the output stage buffer, the
+             buffer is flushed to the event file when it is full.
+   Input   : Output stage, event record string.
+   Output  : None.
+*/
+void buffer_output_event(pv_output_t *output, char *event_string)
+{
+   size_t len = strlen(event_string);
+
+   if (output->out_length + len > PV_WORKER_OUTBUF_SIZE)
+   {
+      flush_output(output);
+   }
+   if (len > PV_WORKER_OUTBUF_SIZE)
+   {
+      write_event_buffer(event_string, len);
+      return;
+   }
+   memcpy(output->out_buffer + output->out_length, event_string, len);
+   output->out_length += len;
+
+   return;
+}
+
+/*
+   Function: queue_packet_event
+   Purpose : Passes a packet event to the output stage, through the ring
+             or by calling the output stage directly.
+   Input   : Worker, packet event.
+   Output  : None.
+*/
+void queue_packet_event(pv_worker_t *worker, pv_packet_event_t *event)
+{
+   pv_output_slot_t *slot;
+
+   if (worker->output.ring.slots == NULL)
+   {
+      /* The format and output stages are timed from the end of the flow stage. */
+      worker->output.timing = worker->timing;
+      worker->output.stage_mark = worker->stage_mark;
+      output_packet_event(&worker->output, event);
+      return;
+   }
+
+   if ((slot = reserve_output_slot(&worker->output.ring)) != NULL)
+   {
+      slot->type = PV_OUTPUT_PACKET;
+      memcpy(&slot->data.packet, event, sizeof(pv_packet_event_t));
+      commit_output_slot(&worker->output.ring);
+   }
+   PV_STAGE_MARK(worker, PV_STAGE_QUEUE);
+
+   return;
+}
+
+/*
+   Function: queue_flow_export
+   Purpose : Copies a completed flow out of the flow table and passes it
+             to the output stage.
+   Input   : Worker, flow record, expiry reason.
+   Output  : None.
+*/
+void queue_flow_export(pv_worker_t *worker, pv_flow_record_t *record, const char *reason)
+{
+   pv_output_slot_t local;
+   pv_output_slot_t *slot = &local;
+   pv_flow_export_t *flow;
+
+   if ((worker->output.ring.slots != NULL) && ((slot = reserve_output_slot(&worker->output.ring)) == NULL))
+   {
+      return;
+   }
+
+   slot->type = PV_OUTPUT_FLOW;
+   flow = &slot->data.flow;
+   memcpy(&flow->key, &record->key, sizeof(pv_flow_key_t));
+   flow->packet_count = record->packet_count;
+   flow->data_size = record->data_size;
+   flow->first_ts = record->first_ts;
+   flow->last_ts = record->last_ts;
+   flow->tcp_flags = record->tcp_flags;
+   flow->reason = reason;
+   flow->has_tls = ((record->flags & PV_FLOW_TLS) != 0);
+   if (flow->has_tls)
+   {
+      memcpy(&flow->tls, &worker->tls[record - worker->flow_table.records], sizeof(pv_tls_info_t));
+   }
+
+   if (slot == &local)
+   {
+      output_flow_export(&worker->output, flow);
+   }
+   else
+   {
+      commit_output_slot(&worker->output.ring);
+   }
+
+   return;
+}
+
+/*
+   Function: queue_alert
+   Purpose : Passes an alert to the output stage.
+   Input   : Worker, alert.
+   Output  : None.
+*/
+void queue_alert(pv_worker_t *worker, pv_alert_t *alert)
+{
+   pv_output_slot_t *slot;
+
+   if (worker->output.ring.slots == NULL)
+   {
+      output_alert(&worker->output, alert);
+      return;
+   }
+
+   if ((slot = reserve_output_slot(&worker->output.ring)) != NULL)
+   {
+      slot->type = PV_OUTPUT_ALERT;
+      memcpy(&slot->data.alert, alert, sizeof(pv_alert_t));
+      commit_output_slot(&worker->output.ring);
+   }
+
+   return;
+}
+
+/*
+   Function: output_worker
+   Purpose : Output thread main loop, renders and writes the events in the
+             ring. The tail is published after each batch of slots so the
+             producer sees the free space without a store per event. When
+             the ring is empty the event buffer is flushed after each second
+             of quiet time and the thread sleeps briefly. The thread exits
+             when it is stopped and the ring is empty.
+   Input   : Output stage.
+   Output  : Returns NULL.
+*/
+void *output_worker(void *arg)
+{
+   pv_output_t *output = (pv_output_t *)arg;
+   pv_event_ring_t *ring = &output->ring;
+   pv_output_slot_t *slot;
+   struct timespec idle;
+   uint32_t tail = ring->tail;
+   uint32_t depth;
+   int n;
+
+   idle.tv_sec = 0;
+   idle.tv_nsec = PV_OUTPUT_IDLE_SLEEP * 1000;
+
+   while (1)
+   {
+      ring->cached_head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+      depth = ring->cached_head - tail;
+      if (depth > ring->high_water)
+      {
+         ring->high_water = depth;
+      }
+
+      if (depth == 0)
+      {
+         if (output->stopping)
+         {
+            break;
+         }
+         if ((output->out_length > 0) && (time(NULL) - output->last_flush >= PV_WORKER_FLUSH_INTERVAL))
+         {
+            flush_output(output);
+         }
+         nanosleep(&idle, NULL);
+         continue;
+      }
+
+      for (n = 0; (n < PV_OUTPUT_BATCH) && (tail != ring->cached_head); n++, tail++)
+      {
+         slot = &ring->slots[tail & ring->mask];
+         output->timing = ((tail & output->sample_mask) == 0);
+         if (output->timing)
+         {
+            output->stage_mark = get_time_ns();
+         }
+         if (slot->type == PV_OUTPUT_PACKET)
+         {
+            output_packet_event(output, &slot->data.packet);
+         }
+         else if (slot->type == PV_OUTPUT_FLOW)
+         {
+            output_flow_export(output, &slot->data.flow);
+         }
+         else
+         {
+            output_alert(output, &slot->data.alert);
+         }
+      }
+      ring->consumed += n;
+      __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+   }
+
+   flush_output(output);
+
+   return(NULL);
+}
+
+/*
+   Function: start_output
+   Purpose : Starts the output thread if the output stage has a ring.
+   Input   : Output stage.
+   Output  : Returns -1 on error, 0 on success.
+*/
+int start_output(pv_output_t *output)
+{
+   if (output->ring.slots == NULL)
+   {
+      return(0);
+   }
+   if (pthread_create(&output->thread, NULL, output_worker, output) != 0)
+   {
+      print_log_entry("start_output() <ERROR> Could not create output thread.\n");
+      return(-1);
+   }
+   output->running = 1;
+
+   return(0);
+}
+
+/*
+   Function: stop_output
+   Purpose : Waits for the output thread to write the events left in the
+             ring and exit, or flushes the inline output buffer.
+   Input   : Output stage.
+   Output  : None.
+*/
+void stop_output(pv_output_t *output)
+{
+   if (output->running)
+   {
+      output->stopping = 1;
+      pthread_join(output->thread, NULL);
+      output->running = 0;
+   }
+   else
+   {
+      flush_output(output);
+   }
+
+   return;
+}
+
+/*
+   Function: print_output_stats
+   Purpose : Prints the output ring counters for a worker.
+   Input   : Worker number, output stage.
+   Output  : None.
+*/
+void print_output_stats(int worker_id, pv_output_t *output)
+{
+   pv_event_ring_t *ring = &output->ring;
+
+   if (ring->slots == NULL)
+   {
+      return;
+   }
+   printf("Worker %d output: %lu events queued, %lu written, %lu dropped, ring high water %u of %u slots\n",
+          worker_id, ring->queued, ring->consumed, ring->dropped, ring->high_water, ring->size);
+}
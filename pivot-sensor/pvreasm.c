@@ -0,0 +1,550 @@
+/*  Copyright 2014 Derek Chadwick
+
+    This file is part of the Pivotal Network Security Tools.
+
+    Pivotal is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Pivotal is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Pivotal.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+   pvreasm.c
+
+   Title : Pivotal NST Sensor TCP Stream Reassembly
+   Author: Derek Chadwick
+   Date  : 17/10/2026
+
+   Purpose: Puts the payload of each direction of a TCP connection back in
+            sequence order (-M option) and passes it to the stream
+            consumers, the HTTP parser and n-gram analysis, as contiguous
+            chunks.
+
+            Each flow record is one direction, the stream state is kept in
+            a per worker array indexed like the flow record pool. Segments
+            that arrive in order are passed on straight from the packet
+            without a copy. Segments ahead of the next expected sequence
+            number are copied into blocks from a preallocated per worker
+            pool, sized by the -M memory limit, and held in a sequence
+            ordered list until the hole before them is filled.
+
+            Memory use is fixed, overload is handled the same way every
+            time:
+
+            - A stream holding PV_REASM_FLOW_BLOCKS blocks gives up on the
+              hole, the held data is passed on and the gap is counted.
+            - When the pool is empty the stream that has held blocks the
+              longest is truncated, its blocks are freed and it is not
+              reassembled any further.
+            - A stream stops once the -O depth has been passed on.
+            - Payload sampling bounds the streams too, a stream stops at
+              the -k byte limit or after the -K packet limit, with its
+              held data passed on.
+
+            Held data is passed on at a FIN or RST, and freed when the flow
+            expires.
+
+   Status : EXPERIMENTAL - not for use in production networks.
+
+*/
+
+#include "pvcommon.h"
+#include "pivot-sensor.h"
+
+/*
+   Function: init_reasm
+   Purpose : Allocates the block pool and the stream states.
+   Input   : Reassembly state, flow table capacity, memory limit in bytes,
+             depth per direction in bytes.
+   Output  : Returns 0.
+*/
+int init_reasm(pv_reasm_t *reasm, uint32_t flow_capacity, uint64_t memory, uint32_t depth)
+{
+   uint32_t i;
+
+   memset(reasm, 0, sizeof(pv_reasm_t));
+   reasm->block_count = memory / sizeof(pv_reasm_block_t);
+   if (reasm->block_count < PV_REASM_FLOW_BLOCKS)
+   {
+      reasm->block_count = PV_REASM_FLOW_BLOCKS;
+   }
+   reasm->blocks = xmalloc(reasm->block_count * sizeof(pv_reasm_block_t));
+   for (i = 0; i < reasm->block_count; i++)
+   {
+      reasm->blocks[i].next = i + 1;
+   }
+   reasm->blocks[reasm->block_count - 1].next = PV_REASM_NONE;
+   reasm->free_head = 0;
+   reasm->free_count = reasm->block_count;
+
+   reasm->streams = xmalloc(flow_capacity * sizeof(pv_reasm_stream_t));
+   for (i = 0; i < flow_capacity; i++)
+   {
+      reasm->streams[i].head = PV_REASM_NONE;
+      reasm->streams[i].blocks = 0;
+   }
+   reasm->fifo_head = PV_REASM_NONE;
+   reasm->fifo_tail = PV_REASM_NONE;
+   reasm->depth = depth;
+
+   return(0);
+}
+
+/*
+   Function: add_stream_consumer
+   Purpose : Registers a function that is passed the reassembled data.
+   Input   : Reassembly state, consumer function, shortest chunk it takes.
+   Output  : Returns -1 if there are too many consumers, 0 on success.
+*/
+int add_stream_consumer(pv_reasm_t *reasm, pv_stream_func_t func, uint32_t min_length)
+{
+   if (reasm->consumer_count == PV_REASM_MAX_CONSUMERS)
+   {
+      print_log_entry("add_stream_consumer() <ERROR> Too many stream consumers.\n");
+      return(-1);
+   }
+   reasm->consumers[reasm->consumer_count].func = func;
+   reasm->consumers[reasm->consumer_count].min_length = min_length;
+   reasm->consumer_count++;
+
+   return(0);
+}
+
+/*
+   Function: init_stream_consumers
+   Purpose : Registers the payload analyses that are on as consumers.
+   Input   : Reassembly state.
+   Output  : None.
+*/
+void init_stream_consumers(pv_reasm_t *reasm)
+{
+   if (url_table.records != NULL)
+   {
+      add_stream_consumer(reasm, update_http, PV_HTTP_MIN_REQUEST);
+   }
+   if (ngram_models.mode)
+   {
+      add_stream_consumer(reasm, update_ngrams, PV_NGRAM_MIN_PAYLOAD);
+   }
+   if (ioc_matcher.states != NULL)
+   {
+      add_stream_consumer(reasm, update_iocs, 1);
+   }
+}
+
+/*
+   Function: unlink_stream
+   Purpose : Takes a stream out of the oldest first stream list.
+   Input   : Reassembly state, stream index.
+   Output  : None.
+*/
+void unlink_stream(pv_reasm_t *reasm, uint32_t index)
+{
+   pv_reasm_stream_t *stream = &reasm->streams[index];
+
+   if (stream->fifo_prev != PV_REASM_NONE)
+   {
+      reasm->streams[stream->fifo_prev].fifo_next = stream->fifo_next;
+   }
+   else
+   {
+      reasm->fifo_head = stream->fifo_next;
+   }
+   if (stream->fifo_next != PV_REASM_NONE)
+   {
+      reasm->streams[stream->fifo_next].fifo_prev = stream->fifo_prev;
+   }
+   else
+   {
+      reasm->fifo_tail = stream->fifo_prev;
+   }
+}
+
+/*
+   Function: push_stream
+   Purpose : Adds a stream to the end of the oldest first stream list.
+   Input   : Reassembly state, stream index.
+   Output  : None.
+*/
+void push_stream(pv_reasm_t *reasm, uint32_t index)
+{
+   pv_reasm_stream_t *stream = &reasm->streams[index];
+
+   stream->fifo_next = PV_REASM_NONE;
+   stream->fifo_prev = reasm->fifo_tail;
+   if (reasm->fifo_tail != PV_REASM_NONE)
+   {
+      reasm->streams[reasm->fifo_tail].fifo_next = index;
+   }
+   else
+   {
+      reasm->fifo_head = index;
+   }
+   reasm->fifo_tail = index;
+}
+
+/*
+   Function: free_stream_blocks
+   Purpose : Returns the blocks held by a stream to the pool.
+   Input   : Reassembly state, stream index.
+   Output  : None.
+*/
+void free_stream_blocks(pv_reasm_t *reasm, uint32_t index)
+{
+   pv_reasm_stream_t *stream = &reasm->streams[index];
+   uint32_t b, next;
+
+   if (stream->blocks == 0)
+   {
+      return;
+   }
+   for (b = stream->head; b != PV_REASM_NONE; b = next)
+   {
+      next = reasm->blocks[b].next;
+      reasm->blocks[b].next = reasm->free_head;
+      reasm->free_head = b;
+      reasm->free_count++;
+   }
+   stream->head = PV_REASM_NONE;
+   stream->blocks = 0;
+   unlink_stream(reasm, index);
+}
+
+/*
+   Function: alloc_reasm_block
+   Purpose : Takes a block from the pool. When the pool is empty the
+             stream that has held blocks the longest, other than the one
+             asking, is truncated.
+   Input   : Worker, index of the stream asking.
+   Output  : Block index or PV_REASM_NONE.
+*/
+uint32_t alloc_reasm_block(pv_worker_t *worker, uint32_t index)
+{
+   pv_reasm_t *reasm = worker->reasm;
+   uint32_t b, victim;
+
+   if (reasm->free_count == 0)
+   {
+      if ((victim = reasm->fifo_head) == index)
+      {
+         victim = reasm->streams[victim].fifo_next;
+      }
+      if (victim == PV_REASM_NONE)
+      {
+         return(PV_REASM_NONE);
+      }
+      free_stream_blocks(reasm, victim);
+      worker->flow_table.records[victim].flags |= PV_FLOW_REASM_DONE;
+      reasm->truncated++;
+   }
+
+   b = reasm->free_head;
+   reasm->free_head = reasm->blocks[b].next;
+   reasm->free_count--;
+
+   return(b);
+}
+
+/*
+   Function: deliver_stream
+   Purpose : Passes in order stream data to the consumers, up to the depth
+             limit or the -k payload sampling limit if it is lower. The
+             stream ends when the limit is reached.
+   Input   : Worker, flow record, packet event, data, length.
+   Output  : None.
+*/
+void deliver_stream(pv_worker_t *worker, pv_flow_record_t *flow, pv_packet_event_t *event, uint8_t *data, uint32_t len)
+{
+   pv_reasm_t *reasm = worker->reasm;
+   pv_reasm_stream_t *stream = &reasm->streams[flow - worker->flow_table.records];
+   uint32_t depth = reasm->depth;
+   int i;
+
+   if (worker->payload_bytes && (worker->payload_bytes < depth))
+   {
+      depth = worker->payload_bytes;
+   }
+   if (len >= depth - stream->delivered)
+   {
+      len = depth - stream->delivered;
+      flow->flags |= PV_FLOW_REASM_DONE;
+      reasm->depth_reached++;
+   }
+   stream->delivered += len;
+   reasm->bytes_delivered += len;
+
+   for (i = 0; i < reasm->consumer_count; i++)
+   {
+      if (len >= reasm->consumers[i].min_length)
+      {
+         reasm->consumers[i].func(worker, flow, event, data, len);
+      }
+   }
+}
+
+/*
+   Function: drain_stream
+   Purpose : Passes on the held blocks that are now in order. With
+             skip_gaps set the holes are given up on and all the held data
+             is passed on.
+   Input   : Worker, flow record, packet event, skip gaps flag.
+   Output  : None.
+*/
+void drain_stream(pv_worker_t *worker, pv_flow_record_t *flow, pv_packet_event_t *event, int skip_gaps)
+{
+   pv_reasm_t *reasm = worker->reasm;
+   uint32_t index = flow - worker->flow_table.records;
+   pv_reasm_stream_t *stream = &reasm->streams[index];
+   pv_reasm_block_t *block;
+   uint32_t b, end;
+
+   while (((b = stream->head) != PV_REASM_NONE) && !(flow->flags & PV_FLOW_REASM_DONE))
+   {
+      block = &reasm->blocks[b];
+      if (PV_SEQ_LT(stream->next_seq, block->seq))
+      {
+         if (!skip_gaps)
+         {
+            break;
+         }
+         stream->next_seq = block->seq;
+         reasm->gaps++;
+      }
+      end = block->seq + block->length;
+      if (PV_SEQ_LT(stream->next_seq, end))
+      {
+         deliver_stream(worker, flow, event, block->data + (stream->next_seq - block->seq), end - stream->next_seq);
+         stream->next_seq = end;
+      }
+      stream->head = block->next;
+      block->next = reasm->free_head;
+      reasm->free_head = b;
+      reasm->free_count++;
+      if (--stream->blocks == 0)
+      {
+         unlink_stream(reasm, index);
+      }
+   }
+   if (flow->flags & PV_FLOW_REASM_DONE)
+   {
+      free_stream_blocks(reasm, index);
+   }
+}
+
+/*
+   Function: hold_segment
+   Purpose : Copies a segment that is ahead of the stream into pool blocks,
+             in sequence order. Data already held is not copied again.
+   Input   : Worker, flow record, packet event, sequence number, data,
+             length.
+   Output  : None.
+*/
+void hold_segment(pv_worker_t *worker, pv_flow_record_t *flow, pv_packet_event_t *event, uint32_t seq, uint8_t *data, uint32_t len)
+{
+   pv_reasm_t *reasm = worker->reasm;
+   uint32_t index = flow - worker->flow_table.records;
+   pv_reasm_stream_t *stream = &reasm->streams[index];
+   pv_reasm_block_t *block;
+   uint32_t *link, b, n;
+
+   reasm->out_of_order++;
+   while ((len > 0) && !(flow->flags & PV_FLOW_REASM_DONE))
+   {
+      if (stream->blocks == PV_REASM_FLOW_BLOCKS)
+      {
+         /* Too far ahead, give up on the hole and pass on what is held. */
+         drain_stream(worker, flow, event, 1);
+         if (PV_SEQ_LT(stream->next_seq, seq))
+         {
+            stream->next_seq = seq;
+            reasm->gaps++;
+         }
+         if (PV_SEQ_LT(seq, stream->next_seq))
+         {
+            n = stream->next_seq - seq;
+            if (n >= len)
+            {
+               return;
+            }
+            data += n;
+            len -= n;
+            seq = stream->next_seq;
+         }
+         if (!(flow->flags & PV_FLOW_REASM_DONE))
+         {
+            deliver_stream(worker, flow, event, data, len);
+            stream->next_seq = seq + len;
+         }
+         return;
+      }
+
+      /* Find the place in the list, skipping what is already held. */
+      for (link = &stream->head; *link != PV_REASM_NONE; link = &reasm->blocks[*link].next)
+      {
+         block = &reasm->blocks[*link];
+         if (PV_SEQ_LT(seq, block->seq))
+         {
+            break;
+         }
+         if (PV_SEQ_LT(seq, block->seq + block->length))
+         {
+            n = block->seq + block->length - seq;
+            if (n >= len)
+            {
+               return;
+            }
+            data += n;
+            len -= n;
+            seq += n;
+         }
+      }
+      n = len;
+      if (n > PV_REASM_BLOCK_SIZE)
+      {
+         n = PV_REASM_BLOCK_SIZE;
+      }
+      if ((*link != PV_REASM_NONE) && PV_SEQ_LT(reasm->blocks[*link].seq, seq + n))
+      {
+         n = reasm->blocks[*link].seq - seq;
+      }
+
+      if ((b = alloc_reasm_block(worker, index)) == PV_REASM_NONE)
+      {
+         return;
+      }
+      block = &reasm->blocks[b];
+      memcpy(block->data, data, n);
+      block->seq = seq;
+      block->length = n;
+      block->next = *link;
+      *link = b;
+      if (stream->blocks++ == 0)
+      {
+         push_stream(reasm, index);
+      }
+      data += n;
+      len -= n;
+      seq += n;
+   }
+}
+
+/*
+   Function: reassemble_tcp
+   Purpose : Adds a TCP segment to the stream of its flow. A stream starts
+             at the SYN, or at the first payload for connections that were
+             already open. It ends after the -K payload sampling limit.
+   Input   : Worker, flow record, packet event, payload.
+   Output  : None.
+*/
+void reassemble_tcp(pv_worker_t *worker, pv_flow_record_t *flow, pv_packet_event_t *event, uint8_t *payload)
+{
+   pv_reasm_t *reasm = worker->reasm;
+   uint32_t index = flow - worker->flow_table.records;
+   pv_reasm_stream_t *stream = &reasm->streams[index];
+   uint32_t seq = event->tcp_seq;
+   uint32_t len = event->desc.payload_length;
+   uint32_t n;
+
+   if (worker->payload_packets && (flow->packet_count > worker->payload_packets))
+   {
+      if (flow->flags & PV_FLOW_REASM)
+      {
+         drain_stream(worker, flow, event, 1);
+      }
+      flow->flags |= PV_FLOW_REASM_DONE;
+      return;
+   }
+   if (!(flow->flags & PV_FLOW_REASM))
+   {
+      if (!(event->tcp_flags & TH_SYN) && (len == 0))
+      {
+         return;
+      }
+      free_stream_blocks(reasm, index);
+      stream->next_seq = (event->tcp_flags & TH_SYN) ? seq + 1 : seq;
+      stream->delivered = 0;
+      flow->flags |= PV_FLOW_REASM;
+      reasm->streams_started++;
+   }
+   if (event->tcp_flags & TH_SYN)
+   {
+      seq++;
+   }
+
+   if (len > 0)
+   {
+      if (PV_SEQ_LT(stream->next_seq, seq))
+      {
+         hold_segment(worker, flow, event, seq, payload, len);
+      }
+      else if (PV_SEQ_LT(stream->next_seq, seq + len))
+      {
+         n = stream->next_seq - seq;
+         deliver_stream(worker, flow, event, payload + n, len - n);
+         stream->next_seq = seq + len;
+         drain_stream(worker, flow, event, 0);
+      }
+      else
+      {
+         reasm->duplicates++;
+      }
+   }
+
+   if ((event->tcp_flags & (TH_FIN | TH_RST)) && !(flow->flags & PV_FLOW_REASM_DONE))
+   {
+      drain_stream(worker, flow, event, 1);
+      flow->flags |= PV_FLOW_REASM_DONE;
+   }
+}
+
+/*
+   Function: end_stream
+   Purpose : Frees the blocks of an expired flow, held data is dropped.
+   Input   : Worker, flow record.
+   Output  : None.
+*/
+void end_stream(pv_worker_t *worker, pv_flow_record_t *flow)
+{
+   pv_reasm_t *reasm = worker->reasm;
+   uint32_t index = flow - worker->flow_table.records;
+
+   if (reasm->streams[index].blocks > 0)
+   {
+      free_stream_blocks(reasm, index);
+      reasm->truncated++;
+   }
+}
+
+/*
+   Function: free_reasm
+   Purpose : Frees the stream and block pools of a worker.
+   Input   : Reassembly state.
+   Output  : None.
+*/
+void free_reasm(pv_reasm_t *reasm)
+{
+   free(reasm->blocks);
+   free(reasm->streams);
+   memset(reasm, 0, sizeof(pv_reasm_t));
+}
+
+/*
+   Function: print_reasm_stats
+   Purpose : Prints the reassembly counters for a worker.
+   Input   : Worker number, reassembly state.
+   Output  : None.
+*/
+void print_reasm_stats(int worker_id, pv_reasm_t *reasm)
+{
+   printf("Worker %d reassembly: %lu streams, %llu bytes, %lu out of order, %lu duplicates, %lu gaps, %lu truncated, %lu at depth, %u of %u blocks free\n",
+          worker_id, reasm->streams_started, reasm->bytes_delivered, reasm->out_of_order, reasm->duplicates, reasm->gaps,
+          reasm->truncated, reasm->depth_reached, reasm->free_count, reasm->block_count);
+}
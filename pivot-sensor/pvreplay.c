@@ -0,0 +1,257 @@
+/*  Copyright 2014 Derek Chadwick
+
+    This file is part of the Pivotal Network Security Tools.
+
+    Pivotal is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Pivotal is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Pivotal.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+   pvreplay.c
+
+   Title : Pivotal NST Sensor Offline Replay
+   Author: Derek Chadwick
+   Date  : 17/10/2026
+
+   Purpose: Reads packets from a pcap file (-r option) and feeds them through
+            the same process_packet() pipeline as live capture, on a single
+            worker so the results are reproducible. Packets are either
+            replayed as fast as possible or paced by their original capture
+            timestamps (-p option). Packets are truncated to the capture
+            snaplen (-S and -H options) as the kernel would truncate them,
+            so header only capture can be measured offline.
+
+            When the file has been read the throughput (packets/s, bytes/s)
+            and the average time per packet spent in each stage of
+            process_packet() are printed, so the hot path can be measured
+            and compared between builds.
+
+   Status : EXPERIMENTAL - not for use in production networks.
+
+*/
+
+#include <time.h>
+#include <errno.h>
+
+#include "pvcommon.h"
+#include "pivot-sensor.h"
+
+extern pv_worker_t *workers;
+extern int worker_count;
+extern char *stage_names[];
+
+/*
+   Function: open_replay_file
+   Purpose : Opens the pcap file and applies the BPF filter to it.
+   Input   : Pcap file name, filter string.
+   Output  : Returns the pcap handle or NULL on error.
+*/
+pcap_t *open_replay_file(char *pcap_file, const char *bpf_string)
+{
+   char error_buffer[PCAP_ERRBUF_SIZE];
+   struct bpf_program bpfp;
+   pcap_t *pdev;
+
+   if ((pdev = pcap_open_offline(pcap_file, error_buffer)) == NULL)
+   {
+      sprint_log_entry("open_replay_file()", error_buffer);
+      return(NULL);
+   }
+
+   if (pcap_compile(pdev, &bpfp, (char *)bpf_string, 1, PCAP_NETMASK_UNKNOWN) < 0)
+   {
+      sprint_log_entry("open_replay_file()", pcap_geterr(pdev));
+      pcap_close(pdev);
+      return(NULL);
+   }
+
+   if (pcap_setfilter(pdev, &bpfp) < 0)
+   {
+      sprint_log_entry("open_replay_file()", pcap_geterr(pdev));
+      pcap_freecode(&bpfp);
+      pcap_close(pdev);
+      return(NULL);
+   }
+   pcap_freecode(&bpfp);
+
+   return(pdev);
+}
+
+/*
+   Function: pace_replay
+   Purpose : Sleeps until the packet is due, relative to the first packet
+             in the file and the replay start time.
+   Input   : Packet timestamp, first packet timestamp (ns), replay start time (ns).
+   Output  : None.
+*/
+void pace_replay(struct timeval *ts, uint64_t first_ts, uint64_t start_time)
+{
+   struct timespec delay;
+   uint64_t packet_ts = ((uint64_t)ts->tv_sec * 1000000000ULL) + ((uint64_t)ts->tv_usec * 1000ULL);
+   uint64_t due, now;
+
+   if (packet_ts <= first_ts)
+   {
+      return;
+   }
+   due = start_time + (packet_ts - first_ts);
+   now = get_time_ns();
+   if (due > now)
+   {
+      delay.tv_sec = (due - now) / 1000000000ULL;
+      delay.tv_nsec = (due - now) % 1000000000ULL;
+      while ((nanosleep(&delay, &delay) < 0) && (errno == EINTR) && capture_running);
+   }
+
+   return;
+}
+
+/*
+   Function: print_replay_stats
+   Purpose : Prints the replay throughput, the average per-stage packet
+             cost and the stage latency percentiles. The format and output
+             stages are timed by the output stage, on the output thread when
+             there is an output ring.
+   Input   : Worker, packet and byte counts, captured bytes, elapsed time in ns.
+   Output  : None.
+*/
+void print_replay_stats(pv_worker_t *worker, unsigned long packets, unsigned long long bytes, unsigned long long captured, uint64_t elapsed)
+{
+   double seconds = (double)elapsed / 1e9;
+   pv_histogram_t stage;
+   uint64_t total_ns = 0;
+   int i;
+
+   if ((packets == 0) || (seconds <= 0.0))
+   {
+      printf("print_replay_stats() <INFO> No packets replayed.\n");
+      return;
+   }
+
+   printf("\nReplay: %lu packets, %llu bytes in %.3f seconds\n", packets, bytes, seconds);
+   printf("Replay: %.0f packets/s, %.0f bytes/s (%.1f Mbit/s)\n",
+          packets / seconds, bytes / seconds, (bytes * 8.0) / (seconds * 1e6));
+   printf("Replay: %llu bytes captured (%.1f%% of wire bytes)\n", captured, bytes ? (captured * 100.0) / bytes : 0.0);
+   for (i = 0; i < PV_STAGE_COUNT; i++)
+   {
+      memset(&stage, 0, sizeof(stage));
+      add_histogram(&stage, &worker->latency[i]);
+      add_histogram(&stage, &worker->output.latency[i]);
+      printf("Stage %-12s : %8.1f ns/packet (p50 %lu p99 %lu p99.9 %lu ns)\n", stage_names[i], (double)stage.total_ns / packets,
+             (unsigned long)get_percentile(&stage, 500), (unsigned long)get_percentile(&stage, 990),
+             (unsigned long)get_percentile(&stage, 999));
+      total_ns += stage.total_ns;
+   }
+   printf("Stage %-12s : %8.1f ns/packet\n", "total", (double)total_ns / packets);
+   printf("Replay wall clock   : %8.1f ns/packet\n\n", (double)elapsed / packets);
+
+   return;
+}
+
+/*
+   Function: start_replay
+   Purpose : Replays a pcap file through process_packet() on a single worker,
+             then prints the throughput and per-stage timing.
+   Input   : Filter string, capture configuration.
+   Output  : Returns -1 on error, 0 on success.
+*/
+int start_replay(const char *bpf_string, pv_capture_config_t *config)
+{
+   struct pcap_pkthdr *pkthdr;
+   struct pcap_pkthdr snapped;
+   const u_char *packet;
+   pv_worker_t *worker;
+   unsigned long packets = 0;
+   unsigned long long bytes = 0;
+   unsigned long long captured = 0;
+   uint64_t start_time, first_ts = 0;
+   int res = 0;
+
+   worker_count = 1;
+   workers = xmemalign(PV_CACHE_LINE_SIZE, sizeof(pv_worker_t));
+   memset(workers, 0, sizeof(pv_worker_t));
+   worker = &workers[0];
+   worker->sample_mask = 0;  /* time every packet */
+   /* Output is inline unless -D is given, replay through the ring waits for free slots. */
+   init_output(&worker->output, (config->output_slots < 0) ? 0 : config->output_slots, 0);
+   worker->output.ring.blocking = 1;
+   init_worker_state(worker, config, 1);
+
+   if ((worker->pcap_device = open_replay_file(config->replay_file, bpf_string)) == NULL)
+   {
+      return(-1);
+   }
+   worker->link_type = pcap_datalink(worker->pcap_device);
+   bpf_filter.link_type = worker->link_type;
+   if ((worker->link_decoder = get_link_decoder(worker->link_type)) == NULL)
+   {
+      return(-1);
+   }
+
+   printf("start_replay() <INFO> Replaying %s %s\n", config->replay_file,
+          config->replay_pacing ? "at original timestamp pace" : "as fast as possible");
+
+   if (start_output(&worker->output) < 0)
+   {
+      return(-1);
+   }
+   start_time = get_time_ns();
+
+   while (capture_running && ((res = pcap_next_ex(worker->pcap_device, &pkthdr, &packet)) >= 0))
+   {
+      if (res == 0)
+      {
+         continue;
+      }
+      if (config->replay_pacing)
+      {
+         if (packets == 0)
+         {
+            first_ts = ((uint64_t)pkthdr->ts.tv_sec * 1000000000ULL) + ((uint64_t)pkthdr->ts.tv_usec * 1000ULL);
+            start_time = get_time_ns();
+         }
+         pace_replay(&pkthdr->ts, first_ts, start_time);
+      }
+      /* Truncate to the capture snaplen, as the kernel would. */
+      if (pkthdr->caplen > config->snaplen)
+      {
+         snapped = *pkthdr;
+         snapped.caplen = config->snaplen;
+         pkthdr = &snapped;
+      }
+
+      process_packet((u_char *)worker, pkthdr, (u_char *)packet);
+      if (reload_requested || __atomic_load_n(&bpf_filter.pending_set, __ATOMIC_ACQUIRE))
+      {
+         reload_sensor();
+      }
+      if (worker->filter_generation != __atomic_load_n(&bpf_filter.generation, __ATOMIC_ACQUIRE))
+      {
+         set_worker_filter(worker);
+      }
+
+      packets++;
+      bytes += pkthdr->len;
+      captured += pkthdr->caplen;
+   }
+
+   if (res == -1)
+   {
+      sprint_log_entry("start_replay() <ERROR>", pcap_geterr(worker->pcap_device));
+   }
+
+   stop_output(&worker->output);
+   print_replay_stats(worker, packets, bytes, captured, get_time_ns() - start_time);
+
+   return(0);
+}
@@ -0,0 +1,458 @@
+/*  Copyright 2014 Derek Chadwick
+
+    This file is part of the Pivotal Network Security Tools.
+
+    Pivotal is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Pivotal is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Pivotal.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+   pvring.c
+
+   Title : Pivotal NST Sensor Ring Capture
+   Author: Derek Chadwick
+   Date  : 17/10/2026
+
+   Purpose: Linux AF_PACKET TPACKET_V3 memory mapped ring capture backend.
+            The kernel writes packets into a ring of fixed size blocks that
+            is shared with the sensor, a block is handed to user space when
+            it fills up or when the block timeout expires. Packets are passed
+            to the packet handler straight out of the ring block, there is no
+            per-packet copy or system call.
+
+            The ring size, block size and block timeout are set on the
+            command line (-R, -B and -T). The BPF filter string is compiled
+            with libpcap and attached to the socket so filtering is still
+            done in the kernel. Worker sockets can be joined to a
+            PACKET_FANOUT group to share the capture load.
+
+   Status : EXPERIMENTAL - not for use in production networks.
+
+*/
+
+#include <errno.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <net/if.h>
+#include <net/if_arp.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <linux/filter.h>
+
+#include "pvcommon.h"
+#include "pivot-sensor.h"
+
+/*
+   Function: get_ring_link_type
+   Purpose : Maps the interface hardware type to a libpcap datalink type.
+   Input   : Socket and interface name.
+   Output  : Returns the DLT value or -1 if the interface type is not supported.
+*/
+int get_ring_link_type(int sockfd, char *device)
+{
+   struct ifreq ifr;
+
+   memset(&ifr, 0, sizeof(ifr));
+   strncpy(ifr.ifr_name, device, IFNAMSIZ - 1);
+   if (ioctl(sockfd, SIOCGIFHWADDR, &ifr) < 0)
+   {
+      print_log_entry("get_ring_link_type() <ERROR> Could not get interface hardware type.\n");
+      return(-1);
+   }
+
+   switch (ifr.ifr_hwaddr.sa_family)
+   {
+   case ARPHRD_ETHER:
+   case ARPHRD_LOOPBACK:
+      return(DLT_EN10MB);
+
+   default:
+      iprint_log_entry("get_ring_link_type() <ERROR> Unsupported hardware type", ifr.ifr_hwaddr.sa_family);
+   }
+
+   return(-1);
+}
+
+/*
+   Function: set_ring_filter
+   Purpose : Compiles the BPF filter string and attaches it to the ring socket.
+             The filter is compiled against a dead pcap handle with the ring
+             snap length, so accepted packets are truncated to the snap length
+             by the kernel.
+   Input   : Ring, filter string.
+   Output  : Returns -1 on error, 0 on success.
+*/
+int set_ring_filter(pv_ring_t *ring, const char *bpfstr)
+{
+   pcap_t *pdead;
+   struct bpf_program bpfp;
+   int retval;
+
+   if ((pdead = pcap_open_dead(ring->link_type, ring->snaplen)) == NULL)
+   {
+      print_log_entry("set_ring_filter() <ERROR> Could not open pcap compiler handle.\n");
+      return(-1);
+   }
+
+   if (pcap_compile(pdead, &bpfp, (char *)bpfstr, 1, PCAP_NETMASK_UNKNOWN) < 0)
+   {
+      sprint_log_entry("set_ring_filter()", pcap_geterr(pdead));
+      pcap_close(pdead);
+      return(-1);
+   }
+
+   retval = attach_ring_filter(ring, &bpfp);
+
+   pcap_freecode(&bpfp);
+   pcap_close(pdead);
+
+   return(retval);
+}
+
+/*
+   Function: attach_ring_filter
+   Purpose : Attaches a compiled filter to the ring socket, replacing the
+             filter already attached. The kernel keeps a copy.
+   Input   : Ring, filter program.
+   Output  : Returns -1 on error, 0 on success.
+*/
+int attach_ring_filter(pv_ring_t *ring, struct bpf_program *program)
+{
+   struct sock_fprog fprog;
+
+   /* The libpcap and kernel BPF instruction layouts are identical. */
+   fprog.len = program->bf_len;
+   fprog.filter = (struct sock_filter *)program->bf_insns;
+   if (setsockopt(ring->sockfd, SOL_SOCKET, SO_ATTACH_FILTER, &fprog, sizeof(fprog)) < 0)
+   {
+      print_log_entry("attach_ring_filter() <ERROR> Could not attach filter to ring socket.\n");
+      return(-1);
+   }
+
+   return(0);
+}
+
+/*
+   Function: open_ring_socket
+   Purpose : Creates an AF_PACKET socket, sets up and maps a TPACKET_V3
+             receive ring, attaches the BPF filter, binds to the interface
+             and enables promiscuous mode.
+   Input   : Ring, interface, filter string and capture configuration.
+   Output  : Returns -1 on error, 0 on success.
+*/
+int open_ring_socket(pv_ring_t *ring, char *device, const char *bpfstr, pv_capture_config_t *config)
+{
+   struct tpacket_req3 req;
+   struct sockaddr_ll sll;
+   struct packet_mreq mreq;
+   int version = TPACKET_V3;
+   int page_size = getpagesize();
+   unsigned int i;
+
+   memset(ring, 0, sizeof(pv_ring_t));
+   ring->sockfd = -1;
+
+   /* Block size must be a multiple of the page size. */
+   ring->block_size = config->block_size * 1024;
+   if ((ring->block_size < (unsigned int)page_size) || (ring->block_size % page_size))
+   {
+      ring->block_size = ((ring->block_size / page_size) + 1) * page_size;
+      iprint_log_entry("open_ring_socket() <WARNING> Block size rounded up to page size multiple", ring->block_size);
+   }
+   ring->block_count = (config->ring_size * 1024 * 1024) / ring->block_size;
+   if (ring->block_count < 2)
+   {
+      ring->block_count = 2;
+   }
+   ring->block_timeout = config->block_timeout;
+   ring->snaplen = config->snaplen;
+
+   if ((ring->sockfd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL))) < 0)
+   {
+      print_log_entry("open_ring_socket() <ERROR> Could not create packet socket.\n");
+      return(-1);
+   }
+
+   if ((ring->link_type = get_ring_link_type(ring->sockfd, device)) < 0)
+   {
+      close_ring_socket(ring);
+      return(-1);
+   }
+
+   if (setsockopt(ring->sockfd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0)
+   {
+      print_log_entry("open_ring_socket() <ERROR> Kernel does not support TPACKET_V3.\n");
+      close_ring_socket(ring);
+      return(-1);
+   }
+
+   memset(&req, 0, sizeof(req));
+   req.tp_block_size = ring->block_size;
+   req.tp_block_nr = ring->block_count;
+   req.tp_frame_size = TPACKET_ALIGNMENT << 7;
+   req.tp_frame_nr = (req.tp_block_size * req.tp_block_nr) / req.tp_frame_size;
+   req.tp_retire_blk_tov = ring->block_timeout;
+   req.tp_feature_req_word = TP_FT_REQ_FILL_RXHASH;
+
+   if (setsockopt(ring->sockfd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0)
+   {
+      print_log_entry("open_ring_socket() <ERROR> Could not create receive ring, check ring and block sizes.\n");
+      close_ring_socket(ring);
+      return(-1);
+   }
+
+   ring->map_size = (size_t)ring->block_size * ring->block_count;
+   ring->map = mmap(NULL, ring->map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED | MAP_POPULATE, ring->sockfd, 0);
+   if (ring->map == MAP_FAILED)
+   {
+      /* MAP_LOCKED fails without CAP_IPC_LOCK or a large enough memlock limit. */
+      ring->map = mmap(NULL, ring->map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->sockfd, 0);
+   }
+   if (ring->map == MAP_FAILED)
+   {
+      ring->map = NULL;
+      print_log_entry("open_ring_socket() <ERROR> Could not map receive ring.\n");
+      close_ring_socket(ring);
+      return(-1);
+   }
+
+   ring->blocks = xcalloc(ring->block_count * sizeof(unsigned char *));
+   for (i = 0; i < ring->block_count; i++)
+   {
+      ring->blocks[i] = ring->map + ((size_t)i * ring->block_size);
+   }
+
+   /* Attach the filter before binding so unfiltered packets never enter the ring. */
+   if (set_ring_filter(ring, bpfstr) < 0)
+   {
+      close_ring_socket(ring);
+      return(-1);
+   }
+
+   memset(&sll, 0, sizeof(sll));
+   sll.sll_family = AF_PACKET;
+   sll.sll_protocol = htons(ETH_P_ALL);
+   sll.sll_ifindex = if_nametoindex(device);
+   if ((sll.sll_ifindex == 0) || (bind(ring->sockfd, (struct sockaddr *)&sll, sizeof(sll)) < 0))
+   {
+      sprint_log_entry("open_ring_socket() <ERROR> Could not bind to interface", device);
+      close_ring_socket(ring);
+      return(-1);
+   }
+
+   memset(&mreq, 0, sizeof(mreq));
+   mreq.mr_ifindex = sll.sll_ifindex;
+   mreq.mr_type = PACKET_MR_PROMISC;
+   if (setsockopt(ring->sockfd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0)
+   {
+      print_log_entry("open_ring_socket() <WARNING> Could not enable promiscuous mode.\n");
+   }
+
+   printf("open_ring_socket() <INFO> TPACKET_V3 ring: %u blocks x %u bytes, timeout %u ms\n",
+          ring->block_count, ring->block_size, ring->block_timeout);
+
+   return(0);
+}
+
+/*
+   Function: get_ring_occupancy
+   Purpose : Counts the blocks ahead of the current block that the kernel
+             has already handed to user space.
+   Input   : Ring.
+   Output  : Number of ready blocks.
+*/
+unsigned int get_ring_occupancy(pv_ring_t *ring)
+{
+   struct tpacket_block_desc *pbd;
+   unsigned int count = 0;
+   unsigned int i = ring->current_block;
+
+   while (count < ring->block_count)
+   {
+      pbd = (struct tpacket_block_desc *)ring->blocks[i];
+      if ((pbd->hdr.bh1.block_status & TP_STATUS_USER) == 0)
+      {
+         break;
+      }
+      count++;
+      i = (i + 1) % ring->block_count;
+   }
+
+   return(count);
+}
+
+/*
+   Function: ring_dispatch
+   Purpose : Waits up to the block timeout for the kernel to release the
+             next ring block, then walks the packets in the block and calls
+             the packet handler with a pointer directly into the ring. The
+             block is returned to the kernel when all of its packets have
+             been processed. Like pcap_dispatch() at most one block is
+             processed per call so the caller can do periodic work.
+   Input   : Ring, packet handler and handler user data.
+   Output  : Returns -1 on error, otherwise the number of packets processed.
+*/
+int ring_dispatch(pv_ring_t *ring, pcap_handler func, u_char *user)
+{
+   struct tpacket_block_desc *pbd;
+   struct tpacket3_hdr *ppd;
+   struct pcap_pkthdr pkthdr;
+   struct pollfd pfd;
+   unsigned int i, num_pkts, occupancy;
+
+   pbd = (struct tpacket_block_desc *)ring->blocks[ring->current_block];
+
+   if ((pbd->hdr.bh1.block_status & TP_STATUS_USER) == 0)
+   {
+      memset(&pfd, 0, sizeof(pfd));
+      pfd.fd = ring->sockfd;
+      pfd.events = POLLIN | POLLERR;
+      if ((poll(&pfd, 1, ring->block_timeout) < 0) && (errno != EINTR))
+      {
+         print_log_entry("ring_dispatch() <ERROR> Poll failed on ring socket.\n");
+         return(-1);
+      }
+      if ((pbd->hdr.bh1.block_status & TP_STATUS_USER) == 0)
+      {
+         return(0);
+      }
+   }
+
+   occupancy = get_ring_occupancy(ring);
+   if (occupancy > ring->max_occupancy)
+   {
+      ring->max_occupancy = occupancy;
+   }
+   ring->occupancy = occupancy;
+
+   num_pkts = pbd->hdr.bh1.num_pkts;
+   ppd = (struct tpacket3_hdr *)((u_char *)pbd + pbd->hdr.bh1.offset_to_first_pkt);
+
+   for (i = 0; i < num_pkts; i++)
+   {
+      pkthdr.ts.tv_sec = ppd->tp_sec;
+      pkthdr.ts.tv_usec = ppd->tp_nsec / 1000;
+      pkthdr.caplen = ppd->tp_snaplen;
+      pkthdr.len = ppd->tp_len;
+
+      func(user, &pkthdr, (u_char *)ppd + ppd->tp_mac);
+
+      ppd = (struct tpacket3_hdr *)((u_char *)ppd + ppd->tp_next_offset);
+   }
+
+   ring->packets_processed += num_pkts;
+   ring->blocks_processed++;
+
+   /* Hand the block back to the kernel. */
+   __sync_synchronize();
+   pbd->hdr.bh1.block_status = TP_STATUS_KERNEL;
+   ring->current_block = (ring->current_block + 1) % ring->block_count;
+
+   return((int)num_pkts);
+}
+
+/*
+   Function: join_fanout_group
+   Purpose : Adds a packet socket to a PACKET_FANOUT group. Hash fanout is
+             used, the kernel flow hash is symmetric so both directions of a
+             flow are delivered to the same socket. Fragments are defragmented
+             before hashing so they follow the rest of their flow.
+   Input   : Packet socket, fanout group id.
+   Output  : Returns -1 on error, 0 on success.
+*/
+int join_fanout_group(int sockfd, int fanout_id)
+{
+   int fanout_arg = (fanout_id & 0xffff) | ((PACKET_FANOUT_HASH | PACKET_FANOUT_FLAG_DEFRAG) << 16);
+
+   if (setsockopt(sockfd, SOL_PACKET, PACKET_FANOUT, &fanout_arg, sizeof(fanout_arg)) < 0)
+   {
+      print_log_entry("join_fanout_group() <ERROR> Could not join packet fanout group.\n");
+      return(-1);
+   }
+
+   return(0);
+}
+
+/*
+   Function: update_ring_stats
+   Purpose : Reads the kernel packet and drop counters for the ring socket.
+             The kernel resets the counters on each read so they are
+             accumulated in the ring structure.
+   Input   : Ring.
+   Output  : Returns -1 on error, 0 on success.
+*/
+int update_ring_stats(pv_ring_t *ring)
+{
+   struct tpacket_stats_v3 kstats;
+   socklen_t len = sizeof(kstats);
+
+   memset(&kstats, 0, sizeof(kstats));
+   if (getsockopt(ring->sockfd, SOL_PACKET, PACKET_STATISTICS, &kstats, &len) < 0)
+   {
+      print_log_entry("update_ring_stats() <ERROR> Could not read ring statistics.\n");
+      return(-1);
+   }
+
+   ring->kernel_packets += kstats.tp_packets;
+   ring->kernel_drops += kstats.tp_drops;
+   ring->freeze_count += kstats.tp_freeze_q_cnt;
+
+   return(0);
+}
+
+/*
+   Function: print_ring_stats
+   Purpose : Prints the ring occupancy and kernel drop counters.
+   Input   : Ring.
+   Output  : None.
+*/
+void print_ring_stats(pv_ring_t *ring)
+{
+   update_ring_stats(ring);
+
+   printf("%lu packets received\n", ring->kernel_packets);
+   printf("%lu packets dropped\n", ring->kernel_drops);
+   printf("%lu ring queue freezes\n", ring->freeze_count);
+   printf("%lu packets processed in %lu blocks\n", ring->packets_processed, ring->blocks_processed);
+   printf("Ring occupancy %u/%u blocks (maximum %u)\n\n", ring->occupancy, ring->block_count, ring->max_occupancy);
+
+   return;
+}
+
+/*
+   Function: close_ring_socket
+   Purpose : Unmaps the receive ring and closes the packet socket.
+   Input   : Ring.
+   Output  : None.
+*/
+void close_ring_socket(pv_ring_t *ring)
+{
+   if (ring->blocks != NULL)
+   {
+      free(ring->blocks);
+      ring->blocks = NULL;
+   }
+   if (ring->map != NULL)
+   {
+      munmap(ring->map, ring->map_size);
+      ring->map = NULL;
+   }
+   if (ring->sockfd >= 0)
+   {
+      close(ring->sockfd);
+      ring->sockfd = -1;
+   }
+
+   return;
+}
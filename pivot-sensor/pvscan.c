@@ -0,0 +1,392 @@
+/*  Copyright 2014 Derek Chadwick
+
+    This file is part of the Pivotal Network Security Tools.
+
+    Pivotal is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Pivotal is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Pivotal.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+   pvscan.c
+
+   Title : Pivotal NST Sensor Port Scan and SYN Flood Detection
+   Author: Derek Chadwick
+   Date  : 17/10/2026
+
+   Purpose: Counts the TCP connection attempts, SYN without ACK, of each
+            source and the distinct destination ports they go to, and
+            raises one alert for a port scan (-P option) or a SYN flood
+            (-Y option) instead of passing on every packet.
+
+            Each capture worker has a bounded table of sources, sharing the
+            size (-J option) and window (-G option) of the fan-out tables,
+            the least recently seen source is evicted when the table is
+            full. The window slides in PV_SCAN_SLOTS steps: each source has
+            a SYN counter and a 512 bit port bitmap per step, and the
+            oldest step is cleared as the window moves on. The distinct
+            port count is a linear counting estimate from the bits set in
+            the union of the bitmaps, which is only worked out when the
+            union gains a bit.
+
+            After an alert the source is not alerted again for that type
+            until a whole window has passed, and the packet events of its
+            connection attempts are dropped from the output until then, so
+            a flood does not swamp the event file, the server or the
+            output rings. The flows are still tracked and exported.
+
+            Like the fan-out tables, each worker alerts at its share of the
+            thresholds and the alert reports the counts scaled up to all
+            the workers.
+
+   Status : EXPERIMENTAL - not for use in production networks.
+
+*/
+
+#include <math.h>
+
+#include "pvcommon.h"
+#include "pivot-sensor.h"
+
+extern int worker_count;
+
+/*
+   Function: init_scan
+   Purpose : Allocates a source table, the per step counters and bitmaps.
+   Input   : Table, number of sources, distinct port threshold, SYN
+             threshold (0 turns a check off), window in seconds.
+   Output  : Returns 0.
+*/
+int init_scan(pv_scan_t *scan, unsigned int hosts, unsigned int port_threshold, unsigned int syn_threshold, unsigned int window)
+{
+   init_flow_table(&scan->table, hosts);
+   scan->hosts = xcalloc(hosts * sizeof(pv_scan_host_t));
+   scan->bitmaps = xcalloc(hosts * PV_SCAN_SLOTS * PV_SCAN_BITMAP_WORDS * sizeof(uint64_t));
+   scan->lru_head = PV_FLOW_EMPTY;
+   scan->lru_tail = PV_FLOW_EMPTY;
+   scan->port_threshold = port_threshold;
+   scan->syn_threshold = syn_threshold;
+   scan->slot_seconds = (window >= PV_SCAN_SLOTS) ? (window / PV_SCAN_SLOTS) : 1;
+   scan->evictions = 0;
+   scan->alerts[PV_SCAN_PORTS] = 0;
+   scan->alerts[PV_SCAN_SYNS] = 0;
+   scan->suppressed = 0;
+
+   return(0);
+}
+
+/*
+   Function: free_scan
+   Purpose : Frees the scan host table and port bitmaps of a worker.
+   Input   : Scan state.
+   Output  : None.
+*/
+void free_scan(pv_scan_t *scan)
+{
+   free_flow_table(&scan->table);
+   free(scan->hosts);
+   free(scan->bitmaps);
+   scan->hosts = NULL;
+   scan->bitmaps = NULL;
+}
+
+/*
+   Function: unlink_scan_host
+   Purpose : Takes a host out of the least recently used list.
+   Input   : Scan state, host index.
+   Output  : None.
+*/
+void unlink_scan_host(pv_scan_t *scan, uint32_t index)
+{
+   pv_scan_host_t *host = &scan->hosts[index];
+
+   if (host->lru_prev != PV_FLOW_EMPTY)
+   {
+      scan->hosts[host->lru_prev].lru_next = host->lru_next;
+   }
+   else
+   {
+      scan->lru_head = host->lru_next;
+   }
+   if (host->lru_next != PV_FLOW_EMPTY)
+   {
+      scan->hosts[host->lru_next].lru_prev = host->lru_prev;
+   }
+   else
+   {
+      scan->lru_tail = host->lru_prev;
+   }
+}
+
+/*
+   Function: push_scan_host
+   Purpose : Adds a host to the front of the least recently used list.
+   Input   : Scan state, host index.
+   Output  : None.
+*/
+void push_scan_host(pv_scan_t *scan, uint32_t index)
+{
+   pv_scan_host_t *host = &scan->hosts[index];
+
+   host->lru_prev = PV_FLOW_EMPTY;
+   host->lru_next = scan->lru_head;
+   if (scan->lru_head != PV_FLOW_EMPTY)
+   {
+      scan->hosts[scan->lru_head].lru_prev = index;
+   }
+   else
+   {
+      scan->lru_tail = index;
+   }
+   scan->lru_head = index;
+}
+
+/*
+   Function: slide_scan_window
+   Purpose : Moves the window of a source on to the current step, clearing
+             the counters and bitmaps of the steps that have fallen out of
+             it. Only the steps that had bits set are cleared, and the union
+             bit count is worked out again if any were.
+   Input   : Table, record index, current step number.
+   Output  : None.
+*/
+void slide_scan_window(pv_scan_t *scan, uint32_t index, uint32_t slot)
+{
+   pv_scan_host_t *host = &scan->hosts[index];
+   uint64_t *bitmap = &scan->bitmaps[index * PV_SCAN_SLOTS * PV_SCAN_BITMAP_WORDS];
+   uint64_t word;
+   uint32_t s, steps = slot - host->slot;
+   int i, j, cleared = 0;
+
+   if (steps > PV_SCAN_SLOTS)
+   {
+      steps = PV_SCAN_SLOTS;
+   }
+   for (s = 1; s <= steps; s++)
+   {
+      i = (host->slot + s) % PV_SCAN_SLOTS;
+      host->syns[i] = 0;
+      if (host->used & (1 << i))
+      {
+         memset(&bitmap[i * PV_SCAN_BITMAP_WORDS], 0, PV_SCAN_BITMAP_WORDS * sizeof(uint64_t));
+         host->used &= ~(1 << i);
+         cleared = 1;
+      }
+   }
+   host->slot = slot;
+
+   if (cleared)
+   {
+      host->port_bits = 0;
+      for (j = 0; (j < PV_SCAN_BITMAP_WORDS) && host->used; j++)
+      {
+         word = 0;
+         for (i = 0; i < PV_SCAN_SLOTS; i++)
+         {
+            word |= bitmap[(i * PV_SCAN_BITMAP_WORDS) + j];
+         }
+         host->port_bits += __builtin_popcountll(word);
+      }
+   }
+
+   return;
+}
+
+/*
+   Function: find_scan_host
+   Purpose : Finds a source in the table, adding it and evicting the least
+             recently seen source if the table is full, moves it to the
+             front of the LRU list and slides its window to the current step.
+   Input   : Table, source key and hash, current step number.
+   Output  : Record index.
+*/
+uint32_t find_scan_host(pv_scan_t *scan, pv_flow_key_t *key, uint32_t hash, uint32_t slot)
+{
+   pv_flow_table_t *table = &scan->table;
+   pv_flow_record_t *record;
+   pv_scan_host_t *host;
+   uint32_t index;
+
+   if ((record = find_flow(table, key, hash)) != NULL)
+   {
+      index = (uint32_t)(record - table->records);
+      if (scan->lru_head != index)
+      {
+         unlink_scan_host(scan, index);
+         push_scan_host(scan, index);
+      }
+      if (slot > scan->hosts[index].slot)
+      {
+         slide_scan_window(scan, index, slot);
+      }
+      return(index);
+   }
+
+   if (table->count == table->capacity)
+   {
+      index = scan->lru_tail;
+      unlink_scan_host(scan, index);
+      delete_flow(table, &table->records[index]);
+      scan->evictions++;
+   }
+   record = find_or_add_flow(table, key, hash);
+   index = (uint32_t)(record - table->records);
+   push_scan_host(scan, index);
+
+   /* Clear whatever the previous source in this record left behind. */
+   host = &scan->hosts[index];
+   slide_scan_window(scan, index, host->slot + PV_SCAN_SLOTS);
+   host->slot = slot;
+   host->rearm[PV_SCAN_PORTS] = 0;
+   host->rearm[PV_SCAN_SYNS] = 0;
+
+   return(index);
+}
+
+/*
+   Function: estimate_scan_ports
+   Purpose : Linear counting estimate of the distinct ports from the number
+             of bits set in the port bitmap union.
+   Input   : Bits set.
+   Output  : Estimated distinct port count.
+*/
+uint32_t estimate_scan_ports(uint32_t bits)
+{
+   double m = PV_SCAN_BITMAP_WORDS * 64;
+
+   if (bits >= m)
+   {
+      bits = (uint32_t)m - 1;
+   }
+
+   return((uint32_t)((m * log(m / (m - bits))) + 0.5));
+}
+
+/*
+   Function: raise_scan_alert
+   Purpose : Passes a port scan or SYN flood alert to the output stage,
+             the destination is the one the last connection attempt went to.
+   Input   : Worker, alert type, count, threshold, packet event.
+   Output  : None.
+*/
+void raise_scan_alert(pv_worker_t *worker, uint8_t type, uint32_t value, uint32_t threshold, pv_packet_event_t *event)
+{
+   pv_alert_t alert;
+
+   memset(&alert, 0, sizeof(pv_alert_t));
+   memcpy(&alert.key, &event->key, sizeof(pv_flow_key_t));
+   alert.type = type;
+   alert.ts_sec = event->ts_sec;
+   alert.ts_usec = event->ts_usec;
+   alert.value = value * worker_count;
+   alert.threshold = threshold * worker_count;
+   alert.window = worker->scan->slot_seconds * PV_SCAN_SLOTS;
+   queue_alert(worker, &alert);
+
+   return;
+}
+
+/*
+   Function: update_scan
+   Purpose : Counts a TCP connection attempt, SYN without ACK, and its
+             destination port for the source, and raises the port scan and
+             SYN flood alerts.
+   Input   : Worker, packet event.
+   Output  : Returns 1 if the source is in alert and the packet event
+             should not be output, otherwise 0.
+*/
+int update_scan(pv_worker_t *worker, pv_packet_event_t *event)
+{
+   pv_scan_t *scan = worker->scan;
+   pv_scan_host_t *host;
+   pv_flow_key_t key;
+   uint64_t *bitmap;
+   uint64_t bit;
+   uint32_t slot = event->ts_sec / scan->slot_seconds;
+   uint32_t index, word, syns, ports;
+   int i, alerted;
+
+   memset(&key, 0, sizeof(pv_flow_key_t));
+   key.family = event->key.family;
+   memcpy(key.src_addr, event->key.src_addr, sizeof(key.src_addr));
+   index = find_scan_host(scan, &key, (uint32_t)hash_fanout_element(key.src_addr, 0), slot);
+   host = &scan->hosts[index];
+   /* A packet from before the current step counts in the current step. */
+   i = host->slot % PV_SCAN_SLOTS;
+   alerted = (host->slot < host->rearm[PV_SCAN_PORTS]) || (host->slot < host->rearm[PV_SCAN_SYNS]);
+
+   if (scan->port_threshold > 0)
+   {
+      word = ((uint32_t)event->key.dst_port * 0x9e3779b1U) >> (32 - PV_SCAN_BITMAP_BITS);
+      bit = 1ULL << (word & 63);
+      bitmap = &scan->bitmaps[((index * PV_SCAN_SLOTS) + i) * PV_SCAN_BITMAP_WORDS];
+      if (!(bitmap[word >> 6] & bit))
+      {
+         bitmap[word >> 6] |= bit;
+         host->used |= (1 << i);
+
+         /* The union only gains the bit if no other step has it. */
+         bitmap = &scan->bitmaps[index * PV_SCAN_SLOTS * PV_SCAN_BITMAP_WORDS];
+         for (i = 0; i < PV_SCAN_SLOTS; i++)
+         {
+            if ((i != (int)(host->slot % PV_SCAN_SLOTS)) && (bitmap[(i * PV_SCAN_BITMAP_WORDS) + (word >> 6)] & bit))
+            {
+               break;
+            }
+         }
+         if (i == PV_SCAN_SLOTS)
+         {
+            host->port_bits++;
+            if ((host->slot >= host->rearm[PV_SCAN_PORTS]) && ((ports = estimate_scan_ports(host->port_bits)) >= scan->port_threshold))
+            {
+               host->rearm[PV_SCAN_PORTS] = host->slot + PV_SCAN_SLOTS;
+               scan->alerts[PV_SCAN_PORTS]++;
+               raise_scan_alert(worker, PV_ALERT_PORTSCAN, ports, scan->port_threshold, event);
+            }
+         }
+      }
+   }
+
+   host->syns[host->slot % PV_SCAN_SLOTS]++;
+   if ((scan->syn_threshold > 0) && (host->slot >= host->rearm[PV_SCAN_SYNS]))
+   {
+      for (i = 0, syns = 0; i < PV_SCAN_SLOTS; i++)
+      {
+         syns += host->syns[i];
+      }
+      if (syns >= scan->syn_threshold)
+      {
+         host->rearm[PV_SCAN_SYNS] = host->slot + PV_SCAN_SLOTS;
+         scan->alerts[PV_SCAN_SYNS]++;
+         raise_scan_alert(worker, PV_ALERT_SYNFLOOD, syns, scan->syn_threshold, event);
+      }
+   }
+
+   if (alerted)
+   {
+      scan->suppressed++;
+   }
+
+   return(alerted);
+}
+
+/*
+   Function: print_scan_stats
+   Purpose : Prints the source table counters for a worker.
+   Input   : Worker number, source table.
+   Output  : None.
+*/
+void print_scan_stats(int worker_id, pv_scan_t *scan)
+{
+   printf("Worker %d scan: %u sources tracked, %lu evicted, %lu port scan alerts, %lu SYN flood alerts, %lu events suppressed\n",
+          worker_id, scan->table.count, scan->evictions, scan->alerts[PV_SCAN_PORTS], scan->alerts[PV_SCAN_SYNS], scan->suppressed);
+}
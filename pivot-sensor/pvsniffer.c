@@ -33,8 +33,8 @@
 
             For each packet processed, the source and destination ip is stored
             in a hashmap and the packet count and data size is accumulated for
-            traffic between the src and dst. These records are then sent to the
-            Pivotal Server every 60 seconds.
+            traffic between the src and dst. The changes to these records are
+            sent to the Pivotal Server every 60 seconds (-E option).
 
    Note   : The default filter is (ip and not src localhost). The negative condition
             is required since we will be sending event packets to the Pivot Server,
@@ -49,20 +49,21 @@
 #include "pvcommon.h"
 #include "pivot-sensor.h"
 
-pcap_t* pcap_device;
-int link_header_length;
-int socket_desc;
+volatile sig_atomic_t capture_running = 1;
+volatile sig_atomic_t reload_requested = 0;
 int options;
+pv_spool_t server_spool;
+pv_stats_t sensor_stats;
 struct in_addr server_ipv4_addr;
 unsigned int server_ipv4_port;
-/* TODO: add ipv6 support. */
 
-pcap_t* open_pcap_socket(char* device, const char* bpfstr)
+pcap_t* open_pcap_socket(char* device, const char* bpfstr, pv_capture_config_t *config)
 {
    char error_buffer[PCAP_ERRBUF_SIZE];
    pcap_t* pdev;
    uint32_t  src_ip, netmask;
    struct bpf_program  bpfp;
+   int res;
 
 /* DEPRECATED: default to eth0 if interface not specified by user.
    if ((strncmp(device, "NONE", 4) == 0) || (strlen(device) == 0))
@@ -75,241 +76,393 @@ pcap_t* open_pcap_socket(char* device, const char* bpfstr)
    }
 */
 
-   if ((pdev = pcap_open_live(device, BUFSIZ, 1, 0, error_buffer)) == NULL)
+   /*
+      Use the create/activate API rather than pcap_open_live() so the
+      kernel buffer size, snap length and read timeout can be set.
+   */
+   if ((pdev = pcap_create(device, error_buffer)) == NULL)
    {
       sprint_log_entry("open_pcap_socket()", error_buffer);
       return NULL;
    }
+   pcap_set_snaplen(pdev, config->snaplen);
+   pcap_set_promisc(pdev, 1);
+   pcap_set_timeout(pdev, config->block_timeout);
+   pcap_set_buffer_size(pdev, config->ring_size * 1024 * 1024);
 
-   /* Get network device source IP address and netmask. */
-   if (pcap_lookupnet(device, &src_ip, &netmask, error_buffer) < 0)
+   if ((res = pcap_activate(pdev)) < 0)
    {
-      sprint_log_entry("open_pcap_socket()", error_buffer);
+      sprint_log_entry("open_pcap_socket()", (char *)pcap_statustostr(res));
+      pcap_close(pdev);
       return NULL;
    }
+   else if (res > 0)
+   {
+      sprint_log_entry("open_pcap_socket() <WARNING>", pcap_geterr(pdev));
+   }
+
+   /* Get network device source IP address and netmask, only used by broadcast filters. */
+   if (pcap_lookupnet(device, &src_ip, &netmask, error_buffer) < 0)
+   {
+      sprint_log_entry("open_pcap_socket() <WARNING>", error_buffer);
+      netmask = PCAP_NETMASK_UNKNOWN;
+   }
 
-   /* Convert the packet filter epxression into a packet filter binary. */
-   if (pcap_compile(pdev, &bpfp, (char*)bpfstr, 0, netmask))
+   /* Convert the packet filter epxression into an optimised packet filter binary. */
+   if (pcap_compile(pdev, &bpfp, (char*)bpfstr, 1, netmask))
    {
-      sprint_log_entry("open_pcap_socket()", pcap_geterr(pcap_device));
+      sprint_log_entry("open_pcap_socket()", pcap_geterr(pdev));
+      pcap_close(pdev);
       return NULL;
    }
 
-   /* Assign the packet filter to the given libpcap socket. */
-   if (pcap_setfilter(pdev, &bpfp) < 0)
+   /* Assign the packet filter to the given libpcap socket, which keeps a copy. */
+   res = pcap_setfilter(pdev, &bpfp);
+   pcap_freecode(&bpfp);
+   if (res < 0)
    {
       sprint_log_entry("open_pcap_socket()", pcap_geterr(pdev));
+      pcap_close(pdev);
       return NULL;
    }
 
    return pdev;
 }
 
-void start_capture_loop(int packets, pcap_handler func)
+/*
+   Function: process_packet
+   Purpose : Called by libpcap to process each packet.
+             Decodes the packet into a binary event, updates the
+             flow table, then the output stage creates a fineline
+             event record and sends the record to the Pivotal Server
+             or writes it to an event file.
+   Input   : user data pointer is the capture worker.
+*/
+void process_packet(u_char *user, struct pcap_pkthdr *packethdr, u_char *packetptr)
 {
-   int link_type;
-
-    /* Determine the datalink layer type. */
-   if ((link_type = pcap_datalink(pcap_device)) < 0)
+   pv_packet_event_t event;
+   pv_flow_record_t *flow;
+   uint64_t packet_ts;
+   pv_worker_t *worker = (pv_worker_t *)user;
+   int suppress = 0;
+   int streamed = 0;
+
+   worker->packet_count++;
+   worker->timing = ((worker->packet_count & worker->sample_mask) == 0);
+   if (worker->timing)
    {
-      sprint_log_entry("capture_loop()", pcap_geterr(pcap_device));
-      return;
+      worker->stage_mark = get_time_ns();
    }
 
-    /* Set the datalink layer header size. */
-   switch (link_type)
+   switch (decode_packet(worker->link_decoder, &event, packethdr, packetptr))
    {
-   case DLT_NULL:
-      link_header_length = 4;
-      break;
+   case PV_DECODE_SHORT:
+      worker->short_packets++;
+      return;
 
-   case DLT_EN10MB:
-      link_header_length = 14;
-      break;
+   case PV_DECODE_UNSUPPORTED:
+      worker->unsupported_packets++;
+      return;
+   }
+   PV_STAGE_MARK(worker, PV_STAGE_DECODE);
 
-   case DLT_SLIP:
-   case DLT_PPP:
-      link_header_length = 24;
-      break;
+   /* Expire the flows that are due, then update the worker flow table shard stats */
+   update_flow_timers(worker, event.ts_sec);
+   update_flow_exports(worker, event.ts_sec);
+   if ((flow = find_or_add_flow(&worker->flow_table, &event.key, hash_flow_key(&event.key))) != NULL)
+   {
+      packet_ts = ((uint64_t)event.ts_sec * 1000000) + event.ts_usec;
+      if (flow->packet_count == 0)
+      {
+         flow->first_ts = packet_ts;
+         flow->last_ts = packet_ts;
+         start_flow_timer(worker, flow);
+         if ((event.key.protocol == IPPROTO_TCP) && ((event.tcp_flags & (TH_SYN | TH_ACK)) == TH_SYN))
+         {
+            flow->flags |= PV_FLOW_CLIENT;
+         }
+         if (blocklist.table != NULL)
+         {
+            check_blocklist(worker, &event);
+         }
+      }
+      else if (packet_ts > flow->last_ts)
+      {
+         flow->last_ts = packet_ts;
+      }
+      flow->packet_count++;
+      flow->data_size += event.ip_length;
+      if (options & PV_SERVER_OUT)
+      {
+         mark_flow_dirty(worker, flow);
+      }
 
-   default:
-      iprint_log_entry("capture_loop() <ERROR> Unsupported datalink", link_type);
-      return;
+      /* TCP FIN or RST closes the flow early. */
+      flow->tcp_flags |= event.tcp_flags;
+      if (event.tcp_flags & (TH_FIN | TH_RST))
+      {
+         close_flow(worker, flow);
+         if (event.tcp_flags & TH_RST)
+         {
+            close_reverse_flow(worker, &event.key);
+         }
+      }
+   }
+   if (worker->heavy != NULL)
+   {
+      update_heavy_hitters(worker->heavy, &event.key, event.ip_length);
+   }
+   if (worker->fanout != NULL)
+   {
+      update_fanout(worker, &event);
    }
+   if ((worker->scan != NULL) && (event.key.protocol == IPPROTO_TCP) && ((event.tcp_flags & (TH_SYN | TH_ACK)) == TH_SYN))
+   {
+      suppress = update_scan(worker, &event);
+   }
+   if ((worker->reasm != NULL) && (flow != NULL) && (event.key.protocol == IPPROTO_TCP) && !(event.desc.flags & PV_DECODE_FRAGMENT))
+   {
+      /* The stream consumers are passed the reassembled data instead of the packet. */
+      streamed = 1;
+      if (!(flow->flags & PV_FLOW_REASM_DONE))
+      {
+         reassemble_tcp(worker, flow, &event, packetptr + event.desc.payload_offset);
+      }
+   }
+   if ((worker->payload_packets | worker->payload_bytes) && (event.desc.payload_length > 0))
+   {
+      sample_flow_payload(worker, flow, &event);
+   }
+   if ((worker->tls != NULL) && (flow != NULL) && (event.key.protocol == IPPROTO_TCP) && (event.desc.payload_length > 0)
+       && !(flow->flags & PV_FLOW_TLS_INSPECTED))
+   {
+      inspect_tls(worker, flow, packetptr + event.desc.payload_offset, event.desc.payload_length);
+   }
+   if (!streamed && (url_table.records != NULL) && (event.key.protocol == IPPROTO_TCP) && (event.desc.payload_length >= PV_HTTP_MIN_REQUEST))
+   {
+      update_http(worker, flow, &event, packetptr + event.desc.payload_offset, event.desc.payload_length);
+   }
+   if ((dns_table.records != NULL) && ((event.key.protocol == IPPROTO_UDP) || (event.key.protocol == IPPROTO_TCP))
+       && ((event.key.src_port == htons(PV_DNS_PORT)) || (event.key.dst_port == htons(PV_DNS_PORT))) && !(event.desc.flags & PV_DECODE_FRAGMENT))
+   {
+      suppress |= update_dns(worker, &event, packetptr + event.desc.payload_offset);
+   }
+   if (!streamed && ngram_models.mode && (event.desc.payload_length >= PV_NGRAM_MIN_PAYLOAD))
+   {
+      update_ngrams(worker, flow, &event, packetptr + event.desc.payload_offset, event.desc.payload_length);
+   }
+   if (!streamed && (ioc_matcher.states != NULL) && (event.desc.payload_length > 0))
+   {
+      update_iocs(worker, flow, &event, packetptr + event.desc.payload_offset, event.desc.payload_length);
+   }
+   PV_STAGE_MARK(worker, PV_STAGE_FLOW);
 
-    /* Start capturing packets. */
-   if (pcap_loop(pcap_device, packets, func, 0) < 0)
+   /* Hand the event to the output stage, the format and output stages are timed there. */
+   if (!suppress)
    {
-      sprint_log_entry("pcap_loop() <ERROR>", pcap_geterr(pcap_device));
+      queue_packet_event(worker, &event);
    }
+
+   return;
 }
 
 
 /*
-   Function: process_packet
-   Purpose : Called by libpcap to process each packet.
-             Parses the ip packet header, tcp/udp headers and
-             creates a fineline event record, then sends the
-             record to the Pivotal Server or writes it to an
-             event file.
-   Input   : user data pointer is either a socket or file pointer.
+   Function: sample_flow_payload
+   Purpose : Per flow payload sampling (-K and -k options). Keeps the payload
+             of the first packets and bytes of each flow and trims the rest
+             from the packet descriptor, so the payload inspection stages only
+             read the start of each flow. The capture snaplen is global, so
+             the full packet is still captured, but the payload is not touched
+             again after this point. Packets without a flow record keep no
+             payload. Reassembled TCP streams are bounded by the same limits,
+             see pvreasm.c.
+   Input   : Worker, flow record or NULL, packet event.
+   Output  : None.
 */
-void process_packet(u_char *user, struct pcap_pkthdr *packethdr, u_char *packetptr)
+void sample_flow_payload(pv_worker_t *worker, pv_flow_record_t *flow, pv_packet_event_t *event)
 {
-   struct ip* iphdr;
-   struct icmphdr* icmphdr;
-   struct tcphdr* tcphdr;
-   struct udphdr* udphdr;
-   char ip_header_info[256], srcip[256], dstip[256], event_data[512], temp_data[256], key_value[512];
-   unsigned short id, seq;
-   pv_ip_record_t *ip_record;
-   char fl_event_string[PV_MAX_INPUT_STR];
-
-   /* CLEAR THE BUFFERS */
-   memset(event_data, 0, 512);
-   memset(key_value, 0, 512);
-   memset(temp_data, 0, 256);
-   memset(fl_event_string, 0, PV_MAX_INPUT_STR);
-
-   /* Skip the datalink layer header and get the IP header fields. */
-   packetptr += link_header_length;
-   iphdr = (struct ip*)packetptr;
-   strcpy(srcip, inet_ntoa(iphdr->ip_src));
-   strcpy(dstip, inet_ntoa(iphdr->ip_dst));
-   sprintf(ip_header_info, "ID:%d TOS:0x%x TTL:%d IpLen:%d DgLen:%d ",ntohs(iphdr->ip_id), iphdr->ip_tos, iphdr->ip_ttl, 4*iphdr->ip_hl, ntohs(iphdr->ip_len));
-
-   /* Advance to the transport layer header then parse and display the fields based on the type of hearder: tcp, udp or icmp. */
-   packetptr += 4*iphdr->ip_hl;
-   switch (iphdr->ip_p)
-   {
-   case IPPROTO_TCP:
-      tcphdr = (struct tcphdr*)packetptr;
-      sprintf(event_data, "TCP  %s:%d -> %s:%d ", srcip, ntohs(tcphdr->source), dstip, ntohs(tcphdr->dest));
-      strncpy(key_value, event_data, strlen(event_data));
-      sprintf(temp_data, "%c%c%c%c%c%c Seq: 0x%x Ack: 0x%x Win: 0x%x TcpLen: %d ",
-               (tcphdr->urg ? 'U' : '*'),
-               (tcphdr->ack ? 'A' : '*'),
-               (tcphdr->psh ? 'P' : '*'),
-               (tcphdr->rst ? 'R' : '*'),
-               (tcphdr->syn ? 'S' : '*'),
-               (tcphdr->fin ? 'F' : '*'),
-               ntohl(tcphdr->seq), ntohl(tcphdr->ack_seq),
-               ntohs(tcphdr->window), 4*tcphdr->doff);
-      strncat(event_data, ip_header_info, strlen(ip_header_info));
-      strncat(event_data, temp_data, strlen(temp_data));
-      break;
-
-   case IPPROTO_UDP:
-      udphdr = (struct udphdr*)packetptr;
-      sprintf(event_data, "UDP  %s:%d -> %s:%d ", srcip, ntohs(udphdr->source), dstip, ntohs(udphdr->dest));
-      strncpy(key_value, event_data, strlen(event_data));
-      strncat(event_data, ip_header_info, strlen(ip_header_info));
-      break;
-
-   case IPPROTO_ICMP:
-      icmphdr = (struct icmphdr*)packetptr;
-      sprintf(event_data, "ICMP %s -> %s ", srcip, dstip);
-      strncpy(key_value, event_data, strlen(event_data));
-      memcpy(&id, (u_char*)icmphdr+4, 2);
-      memcpy(&seq, (u_char*)icmphdr+6, 2);
-      sprintf(temp_data, "Type:%d Code:%d ID:%d Seq:%d ", icmphdr->type, icmphdr->code, ntohs(id), ntohs(seq));
-      strncat(event_data, ip_header_info, strlen(ip_header_info));
-      strncat(event_data, temp_data, strlen(temp_data));
-      break;
-
-      default:
-         sprintf(event_data, "Src: %s Dst: %s Hdr: %s", srcip, dstip, ip_header_info);
-         strncpy(key_value, event_data, strlen(event_data));
-
-   }
-
-   /* Update the hashmap stats */
-   if ((ip_record = find_ip(key_value)) != NULL)
-   {
-      ip_record->packet_count++;
-      ip_record->data_size += ntohs(iphdr->ip_len);
-   }
-   else
-   {
-      ip_record = xcalloc(sizeof(pv_ip_record_t));
-      strncpy(ip_record->key_value, key_value, strlen((key_value)));
-      ip_record->data_size = ntohs(iphdr->ip_len);
-      ip_record->packet_count = 1;
-      add_ip(ip_record);
-   }
-
-   /* Create a Fineline event record string */
-   create_event_record(fl_event_string, event_data);
-
-   /* Now write a Fineline event record. */
-   if (options & PV_FILE_OUT)
+   uint32_t keep = event->desc.payload_length;
+
+   if ((flow == NULL) || (worker->payload_packets && (flow->packet_count > worker->payload_packets)))
    {
-      write_event_record(fl_event_string);
+      keep = 0;
    }
-
-   /*
-      Now send event record to the server if the packet captured was not
-      from us to the server, this is to prevent recursive introspection.
-      Server filtering should already be included in the BPF filters,
-      this is a double check to prevent a packet storm in case the BPF
-      filters are not working or have been omitted.
-   */
-   if (options & PV_SERVER_OUT)
+   else if (worker->payload_bytes)
    {
-      if (!((iphdr->ip_p == IPPROTO_TCP) && (iphdr->ip_dst.s_addr == server_ipv4_addr.s_addr) && (tcphdr->dest == server_ipv4_port)))
+      if (flow->payload_bytes >= worker->payload_bytes)
+      {
+         keep = 0;
+      }
+      else if (keep > worker->payload_bytes - flow->payload_bytes)
       {
-         send_event(socket_desc, fl_event_string);
+         keep = worker->payload_bytes - flow->payload_bytes;
       }
+      flow->payload_bytes += keep;
    }
 
-   printf("%s\n", event_data);
-   printf("------------------------------------------------------------\n\n");
+   worker->payload_kept += keep;
+   worker->payload_trimmed += event->desc.payload_length - keep;
+   event->desc.payload_length = keep;
+   if (keep == 0)
+   {
+      event->desc.payload_offset = 0;
+   }
 
    return;
 }
 
+/*
+   Function: interrupt_capture
+   Purpose : Signal handler, tells the capture workers to stop.
+   Input   : Signal number.
+*/
+void interrupt_capture(int signal_number)
+{
+   capture_running = 0;
+}
+
+/*
+   Function: request_reload
+   Purpose : SIGHUP handler, the main thread reloads the blocklist and the
+             filter file, see reload_sensor().
+   Input   : Signal number.
+*/
+void request_reload(int signal_number)
+{
+   reload_requested = 1;
+}
+
+/*
+   Function: reload_sensor
+   Purpose : Called on the main thread after a SIGHUP or a server control
+             message. Reloads the blocklist and the filter file, then sets
+             a filter sent by the server.
+   Input   : None.
+   Output  : None.
+*/
+void reload_sensor()
+{
+   char *expression;
 
+   if (reload_requested)
+   {
+      reload_requested = 0;
+      if (blocklist.table != NULL)
+      {
+         reload_blocklist();
+      }
+      if (bpf_filter.filter_file[0] != 0)
+      {
+         print_log_entry("reload_sensor() <INFO> Reloading the filter file.\n");
+         replace_bpf_filter(NULL);
+      }
+   }
+
+   if (__atomic_load_n(&bpf_filter.pending_set, __ATOMIC_ACQUIRE))
+   {
+      expression = xmalloc(PV_FILTER_MAX_LENGTH);
+      pthread_mutex_lock(&bpf_filter.lock);
+      strcpy(expression, bpf_filter.pending);
+      __atomic_store_n(&bpf_filter.pending_set, 0, __ATOMIC_RELEASE);
+      pthread_mutex_unlock(&bpf_filter.lock);
+      replace_bpf_filter(expression);
+      free(expression);
+   }
+}
+
+/*
+   Function: terminate_capture
+   Purpose : Called when the capture workers have stopped. Closes the
+             capture sockets, merges the worker flow table shards, dumps
+             the statistics and closes the outputs.
+   Input   : Signal number.
+*/
 void terminate_capture(int signal_number)
 {
-   struct pcap_stat stats;
+   capture_running = 0;
 
-   if (pcap_stats(pcap_device, &stats) >= 0)
+   close_workers();
+   if (ngram_models.mode)
+   {
+      close_ngram_models(&ngram_models);
+   }
+   if (url_table.records != NULL)
    {
-      printf("%d packets received\n", stats.ps_recv);
-      printf("%d packets dropped\n\n", stats.ps_drop);
+      delete_all_urls();
+   }
+   if (dns_table.records != NULL)
+   {
+      delete_dns_table();
+   }
+   if (ioc_matcher.states != NULL)
+   {
+      free_ioc_matcher(&ioc_matcher);
+   }
+   if (blocklist.table != NULL)
+   {
+      delete_blocklist();
    }
-   pcap_close(pcap_device);
 
    if (options & PV_FILE_OUT)
    {
-      dump_statistics();
+      if (!(options & PV_HEAVY_ONLY))
+      {
+         dump_statistics();
+      }
       close_fineline_event_file();
    }
 
    if (options & PV_SERVER_OUT)
    {
-      send_event(socket_desc, "<control>disconnect</control>"); /* Tell server we are disconnecting. */
-      close_socket(socket_desc);
+      /* Sends the queued events then tells the server we are disconnecting. */
+      close_spool(&server_spool);
+      print_spool_stats(&server_spool);
    }
+   if (bpf_filter.replaces + bpf_filter.failures > 0)
+   {
+      printf("Capture filter: %lu replaced, %lu failed replacements\n", bpf_filter.replaces, bpf_filter.failures);
+   }
+   delete_bpf_filter();
 
-   print_ip_map();
+   if (!(options & PV_HEAVY_ONLY))
+   {
+      print_ip_map();
+   }
 
    exit(0);
 }
 
+/*
+   Function: send_server_event
+   Purpose : Queues an event for the Pivotal Server, the events are sent
+             by the spool sender thread, see pvspool.c.
+   Input   : Event string.
+   Output  : Returns -1 if the event was dropped, 0 on success.
+*/
+int send_server_event(char *event_string)
+{
+   return(spool_event(&server_spool, event_string, strlen(event_string)));
+}
+
 /*
    Function: start_capture
    Purpose : Opens the pcap socket, sets interrupt signals then calls
              capture_loop() to start packet processing. Also opens the
              event file if logging, opens the tcp socket if sending
              events to the Pivotal Server.
-   Input   : Interface and filter strings, event file name, server ip address.
+             If ring capture is selected the TPACKET_V3 ring backend is used
+             instead of libpcap. Packets are processed by the capture worker
+             threads, this thread writes the statistics reports until a
+             termination signal. In replay mode packets are read from a
+             pcap file on this thread.
+   Input   : Interface and filter strings, event file name, server ip address,
+             mode and capture configuration.
    Output  : Returns -1 on error.
 */
-int start_capture(char *interface, const char *bpf_string, char *event_file, char *server_address, int mode)
+int start_capture(char *interface, const char *bpf_string, char *event_file, char *server_address, int mode, pv_capture_config_t *config)
 {
    char local_ip_address[PV_IP_ADDR_MAX];
-   int packets = 0;
 
    options = mode;
    memset(local_ip_address, 0, PV_IP_ADDR_MAX);
@@ -335,21 +488,66 @@ int start_capture(char *interface, const char *bpf_string, char *event_file, cha
 
    if (options & PV_SERVER_OUT)
    {
-      if ((socket_desc = init_client_socket(server_address)) == -1)
+      /* A closed server connection is reported by the write, not a signal. */
+      signal(SIGPIPE, SIG_IGN);
+      if (init_spool(&server_spool, server_address, config) < 0)
       {
-         print_log_entry("start_capture() <ERROR> Could not init socket.\n");
+         print_log_entry("start_capture() <ERROR> Could not start server output.\n");
          return(-1);
       }
    }
 
-   if ((pcap_device = open_pcap_socket(interface, bpf_string)) != NULL)
+   if (init_stats(&sensor_stats, config) < 0)
+   {
+      print_log_entry("start_capture() <ERROR> Could not open statistics file.\n");
+      return(-1);
+   }
+
+   if ((config->ngram_mode != 0) && (init_ngram_models(&ngram_models, config) < 0))
+   {
+      print_log_entry("start_capture() <ERROR> Could not load the n-gram models.\n");
+      return(-1);
+   }
+
+   if ((config->ioc_file[0] != 0) && (load_ioc_patterns(&ioc_matcher, config->ioc_file) < 0))
    {
-      signal(SIGINT, terminate_capture);
-      signal(SIGTERM, terminate_capture);
-      signal(SIGQUIT, terminate_capture);
-      start_capture_loop(packets, (pcap_handler)process_packet);
-      terminate_capture(0);
+      print_log_entry("start_capture() <ERROR> Could not load the IOC patterns.\n");
+      return(-1);
+   }
+
+   if (((config->blocklist_count > 0) || (config->blocklist_table[0] != 0)) && (init_blocklist(config) < 0))
+   {
+      print_log_entry("start_capture() <ERROR> Could not load the blocklist.\n");
+      return(-1);
    }
 
+   if (config->url_topk > 0)
+   {
+      init_url_map(PV_URL_TABLE_CAPACITY, PV_URL_ARENA_SIZE);
+   }
+   if (config->dns_topk > 0)
+   {
+      init_dns_table(PV_DNS_TABLE_CAPACITY, PV_DNS_ARENA_SIZE);
+   }
+
+   signal(SIGINT, interrupt_capture);
+   signal(SIGTERM, interrupt_capture);
+   signal(SIGQUIT, interrupt_capture);
+   signal(SIGHUP, request_reload);
+
+   if (options & PV_REPLAY_INPUT)
+   {
+      start_replay(bpf_string, config);
+   }
+   else if (start_workers(interface, bpf_string, config) == 0)
+   {
+      monitor_workers(&sensor_stats);
+      wait_for_workers();
+   }
+
+   /* The last report goes to the server before the connection is closed. */
+   close_stats(&sensor_stats);
+   terminate_capture(0);
+
    return(-1);
 }
@@ -0,0 +1,902 @@
+/*  Copyright 2014 Derek Chadwick
+
+    This file is part of the Pivotal Network Security Tools.
+
+    Pivotal is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Pivotal is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Pivotal.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+   pvspool.c
+
+   Title : Pivotal NST Sensor Server Output Spool
+   Author: Derek Chadwick
+   Date  : 17/10/2026
+
+   Purpose: Decouples packet capture from the Pivotal Server connection.
+            The capture workers only copy events into a bounded in memory
+            queue, a sender thread owns the socket and writes the queue to
+            the server with writev(), when the queue reaches the flush
+            threshold or the oldest event reaches the maximum latency
+            (-L option).
+
+            If the queue is full, because the server is slow or unreachable,
+            events are appended to spill segment files in the spool
+            directory (-q option) instead:
+
+            DIR/pivot-sensor-000001.spool
+
+            Once spilling starts every new event goes to the spill files,
+            so the events are always sent in the order they were queued.
+            When the connection is up again the sender replays the segments
+            from the oldest, deleting each one when it has been sent, then
+            goes back to the in memory queue. Segments left at shutdown are
+            replayed by the next run.
+
+            The sender reconnects with an exponential backoff of up to
+            PV_SPOOL_MAX_BACKOFF seconds. Capture never waits for the
+            network, only for the queue lock and a spill file write.
+
+            The sender also reads the control messages the server sends
+            back on the connection, without waiting, each time around its
+            loop. These replace the capture filter, see pvfilter.c.
+
+   Status : EXPERIMENTAL - not for use in production networks.
+
+*/
+
+#include <errno.h>
+#include <glob.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+
+#include "pvcommon.h"
+#include "pivot-sensor.h"
+
+/*
+   Function: get_segment_name
+   Purpose : Builds the file name of a spill segment.
+   Input   : Spool, segment number, output string.
+   Output  : None.
+*/
+void get_segment_name(pv_spool_t *spool, unsigned int seq, char *name)
+{
+   snprintf(name, PV_PATH_MAX_LENGTH, "%s/pivot-sensor-%06u.spool", spool->spool_dir, seq);
+}
+
+/*
+   Function: find_spill_segments
+   Purpose : Looks for spill segments left by a previous run, if there are
+             any the spool starts in spilling mode so they are sent first.
+   Input   : Spool.
+   Output  : Number of segments found.
+*/
+int find_spill_segments(pv_spool_t *spool)
+{
+   char pattern[PV_PATH_MAX_LENGTH];
+   struct stat st;
+   glob_t segments;
+   unsigned int seq;
+   size_t i;
+   char *name;
+
+   snprintf(pattern, PV_PATH_MAX_LENGTH, "%s/pivot-sensor-*.spool", spool->spool_dir);
+   if (glob(pattern, 0, NULL, &segments) != 0)
+   {
+      return(0);
+   }
+
+   /* glob() sorts the names, the zero padded numbers sort in order. */
+   for (i = 0; i < segments.gl_pathc; i++)
+   {
+      name = strrchr(segments.gl_pathv[i], '/') + 1;
+      if ((sscanf(name, "pivot-sensor-%u.spool", &seq) != 1) || (stat(segments.gl_pathv[i], &st) < 0))
+      {
+         continue;
+      }
+      if (!spool->spilling)
+      {
+         spool->read_seq = seq;
+         spool->spilling = 1;
+      }
+      spool->write_seq = seq;
+      spool->segment_bytes = st.st_size;
+      spool->spill_bytes += st.st_size;
+   }
+   i = segments.gl_pathc;
+   globfree(&segments);
+
+   if (spool->spilling)
+   {
+      printf("find_spill_segments() <INFO> Replaying %llu bytes of spilled events from segments %u to %u.\n",
+             (unsigned long long)spool->spill_bytes, spool->read_seq, spool->write_seq);
+   }
+
+   return((int)i);
+}
+
+/*
+   Function: write_spill
+   Purpose : Appends an event to the current spill segment, a new segment
+             is started when the current one is full. The event is dropped
+             if the spill limit has been reached. Called with the lock held.
+   Input   : Spool, event data and length.
+   Output  : Returns -1 if the event was dropped, 0 on success.
+*/
+int write_spill(pv_spool_t *spool, char *data, size_t len)
+{
+   char name[PV_PATH_MAX_LENGTH];
+
+   if (spool->spill_bytes + len > PV_SPOOL_SPILL_LIMIT)
+   {
+      spool->events_dropped++;
+      return(-1);
+   }
+
+   if ((spool->spill_out != NULL) && (spool->segment_bytes >= PV_SPOOL_SEGMENT_SIZE))
+   {
+      fclose(spool->spill_out);
+      spool->spill_out = NULL;
+      spool->write_seq++;
+      spool->segment_bytes = 0;
+   }
+   if (spool->spill_out == NULL)
+   {
+      if (!spool->spilling)
+      {
+         /* Start a new segment after the ones already replayed. */
+         spool->write_seq++;
+         spool->read_seq = spool->write_seq;
+         spool->segment_bytes = 0;
+         print_log_entry("write_spill() <WARNING> Server queue full, spilling events to disk.\n");
+      }
+      get_segment_name(spool, spool->write_seq, name);
+      if ((spool->spill_out = fopen(name, "ab")) == NULL)
+      {
+         sprint_log_entry("write_spill() <ERROR> Could not open spill file", name);
+         spool->events_dropped++;
+         return(-1);
+      }
+   }
+
+   if (fwrite(data, 1, len, spool->spill_out) != len)
+   {
+      print_log_entry("write_spill() <ERROR> Spill file write failed.\n");
+      spool->events_dropped++;
+      return(-1);
+   }
+   spool->spilling = 1;
+   spool->segment_bytes += len;
+   spool->spill_bytes += len;
+   spool->bytes_spilled += len;
+
+   return(0);
+}
+
+/*
+   Function: read_spill
+   Purpose : Reads the next block of spilled events for replay. Replayed
+             segments are deleted, when the last segment has been read the
+             spool goes back to the in memory queue. Called with the lock held.
+   Input   : Spool.
+   Output  : Bytes read into the spool read buffer, 0 if there are none left.
+*/
+size_t read_spill(pv_spool_t *spool)
+{
+   char name[PV_PATH_MAX_LENGTH];
+   size_t n;
+
+   while (spool->spilling)
+   {
+      if ((spool->read_seq == spool->write_seq) && (spool->spill_out != NULL))
+      {
+         fflush(spool->spill_out);
+      }
+      if (spool->spill_in == NULL)
+      {
+         get_segment_name(spool, spool->read_seq, name);
+         spool->spill_in = fopen(name, "rb");
+      }
+      if (spool->spill_in != NULL)
+      {
+         if ((n = fread(spool->read_buffer, 1, PV_SPOOL_READ_SIZE, spool->spill_in)) > 0)
+         {
+            spool->spill_bytes -= (n < spool->spill_bytes) ? n : spool->spill_bytes;
+            return(n);
+         }
+         fclose(spool->spill_in);
+         spool->spill_in = NULL;
+      }
+
+      /* End of the segment, delete it and move to the next one. */
+      get_segment_name(spool, spool->read_seq, name);
+      if (spool->read_seq == spool->write_seq)
+      {
+         if (spool->spill_out != NULL)
+         {
+            fclose(spool->spill_out);
+            spool->spill_out = NULL;
+         }
+         unlink(name);
+         spool->spilling = 0;
+         spool->spill_bytes = 0;
+         print_log_entry("read_spill() <INFO> Spilled events replayed.\n");
+      }
+      else
+      {
+         unlink(name);
+         spool->read_seq++;
+      }
+   }
+
+   return(0);
+}
+
+/*
+   Function: init_spool
+   Purpose : Allocates the server queue and starts the sender thread. The
+             sender makes the server connection, so capture can start when
+             the server is down.
+   Input   : Spool, server IP address, capture configuration.
+   Output  : Returns -1 on error, 0 on success.
+*/
+int init_spool(pv_spool_t *spool, char *server_address, pv_capture_config_t *config)
+{
+   memset(spool, 0, sizeof(pv_spool_t));
+   pthread_mutex_init(&spool->lock, NULL);
+   pthread_cond_init(&spool->ready, NULL);
+   spool->sockfd = -1;
+   strncpy(spool->server_address, server_address, PV_IP_ADDR_MAX - 1);
+   snprintf(spool->spool_dir, PV_PATH_MAX_LENGTH, "%s", config->spool_dir);
+   spool->max_latency = (uint64_t)config->send_latency * 1000000ULL;
+   spool->queue = xmalloc(PV_SPOOL_QUEUE_SIZE);
+   spool->read_buffer = xmalloc(PV_SPOOL_READ_SIZE);
+   spool->control = xmalloc(PV_SPOOL_CONTROL_SIZE);
+
+   find_spill_segments(spool);
+
+   if (pthread_create(&spool->thread, NULL, spool_sender, spool) != 0)
+   {
+      print_log_entry("init_spool() <ERROR> Could not create server sender thread.\n");
+      return(-1);
+   }
+   spool->started = 1;
+
+   return(0);
+}
+
+/*
+   Function: spool_event
+   Purpose : Queues an event for the server. The event is copied into the
+             in memory queue, or appended to the spill files if the queue
+             is full or older events are still waiting on disk. The sender
+             is woken when the queue stops being empty and when it reaches
+             the flush threshold.
+   Input   : Spool, event data and length.
+   Output  : Returns -1 if the event was dropped, 0 on success.
+*/
+int spool_event(pv_spool_t *spool, char *data, size_t len)
+{
+   size_t n;
+   int res = 0;
+
+   pthread_mutex_lock(&spool->lock);
+
+   if (spool->spilling || (PV_SPOOL_QUEUE_SIZE - spool->used < len))
+   {
+      if ((res = write_spill(spool, data, len)) == 0)
+      {
+         spool->events_spilled++;
+      }
+   }
+   else
+   {
+      if (spool->used == 0)
+      {
+         spool->first_queued = get_time_ns();
+         pthread_cond_signal(&spool->ready);
+      }
+      n = PV_SPOOL_QUEUE_SIZE - spool->head;
+      if (n >= len)
+      {
+         memcpy(spool->queue + spool->head, data, len);
+      }
+      else
+      {
+         memcpy(spool->queue + spool->head, data, n);
+         memcpy(spool->queue, data + n, len - n);
+      }
+      spool->head = (spool->head + len) % PV_SPOOL_QUEUE_SIZE;
+      if ((spool->used < PV_SEND_THRESHOLD) && (spool->used + len >= PV_SEND_THRESHOLD))
+      {
+         pthread_cond_signal(&spool->ready);
+      }
+      spool->used += len;
+   }
+   spool->events_queued++;
+
+   pthread_mutex_unlock(&spool->lock);
+
+   return(res);
+}
+
+/*
+   Function: wait_spool
+   Purpose : Waits on the spool condition until the time given or until a
+             producer signals, with the lock held.
+   Input   : Spool, wake up time in ns on the get_time_ns() clock.
+   Output  : None.
+*/
+void wait_spool(pv_spool_t *spool, uint64_t deadline)
+{
+   struct timespec ts;
+   struct timeval tv;
+   uint64_t now = get_time_ns();
+   uint64_t wait = (deadline > now) ? deadline - now : 0;
+
+   /* pthread_cond_timedwait() uses the real time clock. */
+   gettimeofday(&tv, NULL);
+   wait += (uint64_t)tv.tv_usec * 1000ULL;
+   ts.tv_sec = tv.tv_sec + (wait / 1000000000ULL);
+   ts.tv_nsec = wait % 1000000000ULL;
+   pthread_cond_timedwait(&spool->ready, &spool->lock, &ts);
+}
+
+/*
+   Function: connect_spool
+   Purpose : Connects to the server, on failure the next attempt is made
+             after the backoff time, which doubles up to the maximum.
+             Called with the lock held, the lock is released while
+             connecting and waiting.
+   Input   : Spool.
+   Output  : Returns -1 if not connected, 0 on success.
+*/
+int connect_spool(pv_spool_t *spool)
+{
+   struct timeval tv;
+   uint64_t deadline;
+   int sockfd;
+
+   pthread_mutex_unlock(&spool->lock);
+   sockfd = init_client_socket(spool->server_address);
+   pthread_mutex_lock(&spool->lock);
+
+   if (sockfd < 0)
+   {
+      spool->connect_failures++;
+      spool->backoff = (spool->backoff == 0) ? 1 : spool->backoff * 2;
+      if (spool->backoff > PV_SPOOL_MAX_BACKOFF)
+      {
+         spool->backoff = PV_SPOOL_MAX_BACKOFF;
+      }
+      iprint_log_entry("connect_spool() <WARNING> Server connection failed, retry in seconds", spool->backoff);
+      /* Events queued while waiting wake the sender, keep waiting. */
+      deadline = get_time_ns() + (uint64_t)spool->backoff * 1000000000ULL;
+      while (!spool->closing && (get_time_ns() < deadline))
+      {
+         wait_spool(spool, deadline);
+      }
+      return(-1);
+   }
+
+   /* A stalled server is treated as a failed connection. */
+   tv.tv_sec = PV_SPOOL_SEND_TIMEOUT;
+   tv.tv_usec = 0;
+   setsockopt(sockfd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+   spool->sockfd = sockfd;
+   spool->backoff = 0;
+   spool->connects++;
+   print_log_entry("connect_spool() <INFO> Connected to server.\n");
+
+   return(0);
+}
+
+/*
+   Function: send_spool
+   Purpose : Writes data to the server with the lock released. On error
+             the connection is closed and the sender reconnects.
+   Input   : Spool, iovecs, iovec count, bytes sent (output).
+   Output  : Returns -1 on error, 0 on success.
+*/
+int send_spool(pv_spool_t *spool, struct iovec *iov, int count, size_t *sent)
+{
+   int sockfd = spool->sockfd;
+   int writes;
+   uint64_t start = get_time_ns();
+
+   pthread_mutex_unlock(&spool->lock);
+   writes = send_iovec(sockfd, iov, count, sent);
+   pthread_mutex_lock(&spool->lock);
+
+   record_latency(&spool->write_latency, get_time_ns() - start);
+
+   spool->bytes_sent += *sent;
+   if (writes < 0)
+   {
+      spool->send_errors++;
+      close_socket(sockfd);
+      spool->sockfd = -1;
+      return(-1);
+   }
+   spool->writes += writes;
+   spool->short_writes += writes - 1;
+   spool->flushes++;
+   if (*sent > spool->max_flush_bytes)
+   {
+      spool->max_flush_bytes = *sent;
+   }
+
+   return(0);
+}
+
+/*
+   Function: skip_partial_message
+   Purpose : After a write error drops the rest of a message cut off by
+             the error, the server throws away the part it was sent when
+             the connection closes. The queue then starts at the next
+             message start tag, the bytes dropped are counted as lost.
+             Called with the lock held.
+   Input   : Spool.
+   Output  : None.
+*/
+void skip_partial_message(pv_spool_t *spool)
+{
+   static char *start_tags[] = { "<event>", "<flowstats>", "<control>" };
+   size_t skipped, j;
+   int i;
+
+   for (skipped = 0; skipped < spool->used; skipped++)
+   {
+      for (i = 0; i < 3; i++)
+      {
+         for (j = 0; (start_tags[i][j] != 0) && (skipped + j < spool->used); j++)
+         {
+            if (spool->queue[(spool->tail + skipped + j) % PV_SPOOL_QUEUE_SIZE] != start_tags[i][j])
+            {
+               break;
+            }
+         }
+         if (start_tags[i][j] == 0)
+         {
+            break;
+         }
+      }
+      if (i < 3)
+      {
+         break;
+      }
+   }
+
+   spool->tail = (spool->tail + skipped) % PV_SPOOL_QUEUE_SIZE;
+   spool->used -= skipped;
+   spool->bytes_lost += skipped;
+}
+
+/*
+   Function: send_queue
+   Purpose : Sends the in memory queue, the queued bytes are written in
+             place, with two iovecs if they wrap around the end of the
+             ring. Called with the lock held.
+   Input   : Spool.
+   Output  : Returns -1 on error, 0 on success.
+*/
+int send_queue(pv_spool_t *spool)
+{
+   struct iovec iov[2];
+   size_t len = spool->used;
+   size_t sent;
+   int count = 1;
+   int res;
+
+   /* Producers only write after head, so the queued bytes do not change while unlocked. */
+   iov[0].iov_base = spool->queue + spool->tail;
+   iov[0].iov_len = len;
+   if (spool->tail + len > PV_SPOOL_QUEUE_SIZE)
+   {
+      iov[0].iov_len = PV_SPOOL_QUEUE_SIZE - spool->tail;
+      iov[1].iov_base = spool->queue;
+      iov[1].iov_len = len - iov[0].iov_len;
+      count = 2;
+   }
+
+   res = send_spool(spool, iov, count, &sent);
+
+   spool->tail = (spool->tail + sent) % PV_SPOOL_QUEUE_SIZE;
+   spool->used -= sent;
+   spool->first_queued = get_time_ns();
+   /* The following messages stay queued for the next connection. */
+   if ((res < 0) && (sent > 0))
+   {
+      skip_partial_message(spool);
+   }
+
+   return(res);
+}
+
+/*
+   Function: send_spill
+   Purpose : Replays the next block of spilled events. After a write error
+             the unsent part of the block is read again on reconnect.
+             Called with the lock held.
+   Input   : Spool.
+   Output  : Returns -1 on error, 0 on success.
+*/
+int send_spill(pv_spool_t *spool)
+{
+   struct iovec iov;
+   size_t len, sent;
+
+   if ((len = read_spill(spool)) == 0)
+   {
+      return(0);
+   }
+   iov.iov_base = spool->read_buffer;
+   iov.iov_len = len;
+
+   if (send_spool(spool, &iov, 1, &sent) < 0)
+   {
+      /* read_spill() only closes a segment at its end, so the block can be read again. */
+      fseek(spool->spill_in, -(long)(len - sent), SEEK_CUR);
+      spool->spill_bytes += len - sent;
+      spool->bytes_replayed += sent;
+      return(-1);
+   }
+   spool->bytes_replayed += len;
+   spool->replay_flushes++;
+
+   return(0);
+}
+
+/*
+   Function: write_queue
+   Purpose : Writes the in memory queue to a file, in two parts if the
+             queued bytes wrap around the end of the ring.
+   Input   : Spool, file.
+   Output  : None.
+*/
+void write_queue(pv_spool_t *spool, FILE *out)
+{
+   size_t n = PV_SPOOL_QUEUE_SIZE - spool->tail;
+
+   if (n > spool->used)
+   {
+      n = spool->used;
+   }
+   fwrite(spool->queue + spool->tail, 1, n, out);
+   fwrite(spool->queue, 1, spool->used - n, out);
+   spool->bytes_spilled += spool->used;
+   spool->used = 0;
+   spool->tail = spool->head;
+}
+
+/*
+   Function: drain_to_spill
+   Purpose : Saves the unsent events at shutdown when the server cannot be
+             reached, so they are sent by the next run. If spilling is in
+             progress the in memory queue and the unsent part of the
+             segment being replayed are older than the rest of the spill
+             files, so they are written to a new segment in front of them.
+             Called with the lock held.
+   Input   : Spool.
+   Output  : None.
+*/
+void drain_to_spill(pv_spool_t *spool)
+{
+   char name[PV_PATH_MAX_LENGTH];
+   FILE *out;
+   size_t n;
+
+   if (!spool->spilling || (spool->read_seq == 0))
+   {
+      n = PV_SPOOL_QUEUE_SIZE - spool->tail;
+      if (n > spool->used)
+      {
+         n = spool->used;
+      }
+      if (n > 0)
+      {
+         write_spill(spool, spool->queue + spool->tail, n);
+         write_spill(spool, spool->queue, spool->used - n);
+      }
+      spool->used = 0;
+      return;
+   }
+
+   if ((spool->used == 0) && (spool->spill_in == NULL))
+   {
+      return;
+   }
+
+   get_segment_name(spool, spool->read_seq - 1, name);
+   if ((out = fopen(name, "wb")) == NULL)
+   {
+      sprint_log_entry("drain_to_spill() <ERROR> Could not open spill file", name);
+      return;
+   }
+   write_queue(spool, out);
+
+   if (spool->spill_in != NULL)
+   {
+      if ((spool->read_seq == spool->write_seq) && (spool->spill_out != NULL))
+      {
+         fclose(spool->spill_out);
+         spool->spill_out = NULL;
+      }
+      while ((n = fread(spool->read_buffer, 1, PV_SPOOL_READ_SIZE, spool->spill_in)) > 0)
+      {
+         fwrite(spool->read_buffer, 1, n, out);
+      }
+      fclose(spool->spill_in);
+      spool->spill_in = NULL;
+      get_segment_name(spool, spool->read_seq, name);
+      unlink(name);
+   }
+   fclose(out);
+   spool->read_seq--;
+
+   return;
+}
+
+/*
+   Function: read_spool_control
+   Purpose : Reads the control messages sent by the server without
+             waiting, with the lock held. A message may arrive in parts,
+             the part read so far is kept until the end tag arrives. If
+             the server has closed the connection the sender reconnects.
+   Input   : Spool.
+   Output  : None.
+*/
+void read_spool_control(pv_spool_t *spool)
+{
+   ssize_t len;
+   size_t used;
+   char *start, *end;
+
+   len = recv(spool->sockfd, spool->control + spool->control_length, PV_SPOOL_CONTROL_SIZE - 1 - spool->control_length, MSG_DONTWAIT);
+   if ((len == 0) || ((len < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)))
+   {
+      print_log_entry("read_spool_control() <WARNING> Server closed the connection.\n");
+      close_socket(spool->sockfd);
+      spool->sockfd = -1;
+      spool->control_length = 0;
+      return;
+   }
+   if (len < 0)
+   {
+      return;
+   }
+
+   spool->control_length += len;
+   spool->control[spool->control_length] = 0;
+   while ((end = strstr(spool->control, "</control>")) != NULL)
+   {
+      *end = 0;
+      if ((start = strstr(spool->control, "<control>")) != NULL)
+      {
+         run_server_control(start + 9);
+      }
+      used = (end + 10) - spool->control;
+      spool->control_length -= used;
+      memmove(spool->control, end + 10, spool->control_length + 1);
+   }
+
+   if (spool->control_length == PV_SPOOL_CONTROL_SIZE - 1)
+   {
+      print_log_entry("read_spool_control() <WARNING> Server control message is too long, discarded.\n");
+      spool->control_length = 0;
+   }
+}
+
+/*
+   Function: run_server_control
+   Purpose : Acts on a control message from the server. The main thread
+             does the work, so the sender never waits for a reload.
+
+             filter<data>EXPRESSION</data>  replaces the capture filter
+             reload                         the same as SIGHUP
+
+   Input   : Message between the control tags.
+   Output  : None.
+*/
+void run_server_control(char *message)
+{
+   char *data, *data_end;
+
+   if (strncmp(message, "filter", 6) == 0)
+   {
+      if (((data = strstr(message, "<data>")) == NULL) || ((data_end = strstr(data, "</data>")) == NULL))
+      {
+         print_log_entry("run_server_control() <WARNING> Filter message without data.\n");
+         return;
+      }
+      *data_end = 0;
+      sprint_log_entry("run_server_control() <INFO> Server sent a capture filter", data + 6);
+      queue_bpf_filter(data + 6);
+   }
+   else if (strncmp(message, "reload", 6) == 0)
+   {
+      print_log_entry("run_server_control() <INFO> Server requested a reload.\n");
+      reload_requested = 1;
+   }
+   else
+   {
+      sprint_log_entry("run_server_control() <WARNING> Unknown server control message", message);
+   }
+}
+
+/*
+   Function: spool_sender
+   Purpose : Sender thread, connects to the server and sends the queued
+             events until close_spool() is called. The queue is sent when
+             it reaches the flush threshold or the oldest event reaches the
+             maximum latency, spilled events are replayed after the queue.
+   Input   : Spool.
+   Output  : Returns NULL.
+*/
+void *spool_sender(void *arg)
+{
+   pv_spool_t *spool = (pv_spool_t *)arg;
+   uint64_t deadline = 0;
+   sigset_t sigmask;
+
+   /* Termination and reload signals are handled by the main thread. */
+   sigemptyset(&sigmask);
+   sigaddset(&sigmask, SIGINT);
+   sigaddset(&sigmask, SIGTERM);
+   sigaddset(&sigmask, SIGQUIT);
+   sigaddset(&sigmask, SIGHUP);
+   pthread_sigmask(SIG_BLOCK, &sigmask, NULL);
+
+   pthread_mutex_lock(&spool->lock);
+
+   while (1)
+   {
+      if (spool->closing)
+      {
+         if ((spool->used == 0) && !spool->spilling)
+         {
+            break;
+         }
+         if (deadline == 0)
+         {
+            deadline = get_time_ns() + (uint64_t)PV_SPOOL_DRAIN_TIMEOUT * 1000000000ULL;
+         }
+         if ((spool->sockfd < 0) || (get_time_ns() > deadline))
+         {
+            drain_to_spill(spool);
+            break;
+         }
+      }
+
+      if ((spool->sockfd < 0) && (connect_spool(spool) < 0))
+      {
+         continue;
+      }
+      read_spool_control(spool);
+      if (spool->sockfd < 0)
+      {
+         continue;
+      }
+
+      if (spool->used > 0)
+      {
+         if (spool->closing || spool->spilling || (spool->used >= PV_SEND_THRESHOLD))
+         {
+            spool->size_flushes++;
+         }
+         else if (get_time_ns() - spool->first_queued >= spool->max_latency)
+         {
+            spool->latency_flushes++;
+         }
+         else
+         {
+            wait_spool(spool, spool->first_queued + spool->max_latency);
+            continue;
+         }
+         send_queue(spool);
+      }
+      else if (spool->spilling)
+      {
+         send_spill(spool);
+      }
+      else if (!spool->closing)
+      {
+         wait_spool(spool, get_time_ns() + 1000000000ULL);
+      }
+   }
+
+   if (spool->sockfd >= 0)
+   {
+      send_event(spool->sockfd, "<control>disconnect</control>\n"); /* Tell server we are disconnecting. */
+      shutdown_socket(spool->sockfd, PV_SPOOL_SEND_TIMEOUT);
+      spool->sockfd = -1;
+   }
+   if (spool->spill_out != NULL)
+   {
+      fclose(spool->spill_out);
+      spool->spill_out = NULL;
+   }
+   if (spool->spill_in != NULL)
+   {
+      fclose(spool->spill_in);
+      spool->spill_in = NULL;
+   }
+   if (spool->spilling)
+   {
+      print_log_entry("spool_sender() <WARNING> Unsent events left in the spill files for the next run.\n");
+   }
+
+   pthread_mutex_unlock(&spool->lock);
+
+   return(NULL);
+}
+
+/*
+   Function: close_spool
+   Purpose : Stops the sender thread after it has sent the queued events,
+             waiting at most PV_SPOOL_DRAIN_TIMEOUT seconds. Events that
+             could not be sent are left in the spill files.
+   Input   : Spool.
+   Output  : None.
+*/
+void close_spool(pv_spool_t *spool)
+{
+   if (!spool->started)
+   {
+      return;
+   }
+
+   pthread_mutex_lock(&spool->lock);
+   spool->closing = 1;
+   pthread_cond_signal(&spool->ready);
+   pthread_mutex_unlock(&spool->lock);
+
+   pthread_join(spool->thread, NULL);
+   spool->started = 0;
+
+   free(spool->queue);
+   free(spool->read_buffer);
+   free(spool->control);
+   spool->queue = NULL;
+   spool->read_buffer = NULL;
+   spool->control = NULL;
+
+   return;
+}
+
+/*
+   Function: print_spool_stats
+   Purpose : Prints the server output counters.
+   Input   : Spool.
+   Output  : None.
+*/
+void print_spool_stats(pv_spool_t *spool)
+{
+   printf("Server output: %lu events, %llu bytes sent in %lu flushes, %lu writes\n",
+          spool->events_queued, (unsigned long long)spool->bytes_sent, spool->flushes, spool->writes);
+   printf("Server output: %lu size flushes, %lu latency flushes, %lu spill replay flushes\n",
+          spool->size_flushes, spool->latency_flushes, spool->replay_flushes);
+   if (spool->flushes > 0)
+   {
+      printf("Server output: %.1f events/flush, %.0f bytes/flush average, %lu bytes largest flush\n",
+             (double)spool->events_queued / spool->flushes, (double)spool->bytes_sent / spool->flushes,
+             (unsigned long)spool->max_flush_bytes);
+   }
+   printf("Server output: %lu connects, %lu connect failures, %lu short writes, %lu write errors, %llu bytes lost\n",
+          spool->connects, spool->connect_failures, spool->short_writes, spool->send_errors,
+          (unsigned long long)spool->bytes_lost);
+   printf("Server output: %lu events spilled (%llu bytes), %llu bytes replayed, %lu events dropped\n\n",
+          spool->events_spilled, (unsigned long long)spool->bytes_spilled,
+          (unsigned long long)spool->bytes_replayed, spool->events_dropped);
+}
@@ -0,0 +1,759 @@
+/*  Copyright 2014 Derek Chadwick
+
+    This file is part of the Pivotal Network Security Tools.
+
+    Pivotal is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Pivotal is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Pivotal.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+   pvstats.c
+
+   Title : Pivotal NST Sensor Telemetry
+   Author: Derek Chadwick
+   Date  : 17/10/2026
+
+   Purpose: Always on sensor counters and per-stage latency histograms.
+
+            Each packet processing stage (decode, flow update, event format,
+            file write, server send, console and output queue) records its
+            time in a log-linear histogram owned by the thread running the
+            stage, 8 buckets per power of two so every value is within 12.5%.
+            Live capture times one packet in 16 to keep the clock reads off
+            most packets, offline replay times every packet. The spool sender
+            thread records the time of each server write.
+
+            The capture workers sample the kernel packet and drop counters
+            every second. Every -U seconds the main thread adds up the worker
+            histograms and counters, subtracts the totals at the last report
+            and appends the interval report to the statistics file (-u option),
+            for example:
+
+            Statistics: 2026-10-17 12:21:30 Interval: 60 seconds
+            Packets: 123456 (2057 pps) Short: 0 Kernel received: 123460 Kernel dropped: 4 Output dropped: 0
+            Flows: 1234 active
+            Server: 1234 events 0 spilled 0 dropped 123456 bytes 0 write errors
+            Stage          samples      mean       p50       p90       p99     p99.9       max (ns)
+            decode            7716        85        79       103       191      1663      9087
+            ...
+
+            The same report, without the per worker lines, is sent to the
+            Pivotal Server as a <control>stats message. With heavy hitter
+            tracking on (-x option) the top talkers and conversations for the
+            interval follow, see pvheavy.c, and with URL counting on (-y
+            option) the most requested URLs, see pvurlmap.c, and with DNS
+            parsing on (-d option) the DNS summary, see pvdns.c. With IOC
+            matching on (-l option) the patterns with the most hits in the
+            interval are reported, see pvioc.c.
+
+            The histograms and counters are read without locking, on the
+            platforms the sensor supports aligned 64 bit reads are atomic so
+            a report can only be out by the packets in flight.
+
+   Status : EXPERIMENTAL - not for use in production networks.
+
+*/
+
+#include <stdarg.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pvcommon.h"
+#include "pivot-sensor.h"
+
+char *stage_names[PV_STAGE_COUNT] = { "decode", "flow update", "event format", "file write", "server send", "console", "output queue" };
+
+extern pv_worker_t *workers;
+extern int worker_count;
+extern pv_spool_t server_spool;
+extern int options;
+
+/*
+   Function: record_latency
+   Purpose : Adds a time to a histogram. Times below 8 ns have their own
+             bucket, above that each power of two is split into 8 buckets.
+   Input   : Histogram, time in ns.
+   Output  : None.
+*/
+void record_latency(pv_histogram_t *hist, uint64_t ns)
+{
+   int bucket, msb;
+
+   if (ns >= (1ULL << PV_HIST_MAX_BITS))
+   {
+      ns = (1ULL << PV_HIST_MAX_BITS) - 1;
+   }
+
+   if (ns < PV_HIST_SUB_BUCKETS)
+   {
+      bucket = (int)ns;
+   }
+   else
+   {
+      msb = 63 - __builtin_clzll(ns);
+      bucket = ((msb - PV_HIST_SUB_BITS + 1) << PV_HIST_SUB_BITS) + (int)((ns >> (msb - PV_HIST_SUB_BITS)) & (PV_HIST_SUB_BUCKETS - 1));
+   }
+
+   hist->buckets[bucket]++;
+   hist->count++;
+   hist->total_ns += ns;
+   if (ns > hist->max_ns)
+   {
+      hist->max_ns = ns;
+   }
+
+   return;
+}
+
+/*
+   Function: get_bucket_value
+   Purpose : Gets the highest time that is recorded in a histogram bucket.
+   Input   : Bucket number.
+   Output  : Time in ns.
+*/
+uint64_t get_bucket_value(int bucket)
+{
+   int group = bucket >> PV_HIST_SUB_BITS;
+   int sub = bucket & (PV_HIST_SUB_BUCKETS - 1);
+   int shift;
+
+   if (group == 0)
+   {
+      return((uint64_t)bucket);
+   }
+   shift = group - 1;
+
+   return((((uint64_t)(PV_HIST_SUB_BUCKETS + sub + 1)) << shift) - 1);
+}
+
+/*
+   Function: get_percentile
+   Purpose : Finds the time that a fraction of the histogram times are
+             less than or equal to, in tenths of a percent, 999 for p99.9.
+   Input   : Histogram, per mille.
+   Output  : Time in ns, 0 if the histogram is empty.
+*/
+uint64_t get_percentile(pv_histogram_t *hist, unsigned int permille)
+{
+   uint64_t total = 0;
+   uint64_t target, seen = 0;
+   int i;
+
+   for (i = 0; i < PV_HIST_BUCKETS; i++)
+   {
+      total += hist->buckets[i];
+   }
+   if (total == 0)
+   {
+      return(0);
+   }
+
+   target = ((total * permille) + 999) / 1000;
+   for (i = 0; i < PV_HIST_BUCKETS; i++)
+   {
+      seen += hist->buckets[i];
+      if (seen >= target)
+      {
+         break;
+      }
+   }
+
+   return(get_bucket_value(i));
+}
+
+/*
+   Function: add_histogram
+   Purpose : Adds the times in one histogram to another.
+   Input   : Destination and source histograms.
+   Output  : None.
+*/
+void add_histogram(pv_histogram_t *dst, pv_histogram_t *src)
+{
+   int i;
+
+   for (i = 0; i < PV_HIST_BUCKETS; i++)
+   {
+      dst->buckets[i] += src->buckets[i];
+   }
+   dst->count += src->count;
+   dst->total_ns += src->total_ns;
+   if (src->max_ns > dst->max_ns)
+   {
+      dst->max_ns = src->max_ns;
+   }
+
+   return;
+}
+
+/*
+   Function: append_report
+   Purpose : Appends formatted text to a report. The length is clamped at
+             the end of the buffer, so text that does not fit is cut off
+             and the appends after it write nothing.
+   Input   : Report, buffer size, report length, format and arguments.
+   Output  : New report length.
+*/
+int append_report(char *out, int len, int n, char *format, ...)
+{
+   va_list args;
+   int res;
+
+   if (n >= len - 1)
+   {
+      return(len - 1);
+   }
+   va_start(args, format);
+   res = vsnprintf(out + n, len - n, format, args);
+   va_end(args);
+   if (res < 0)
+   {
+      return(n);
+   }
+
+   return((n + res < len) ? n + res : len - 1);
+}
+
+/*
+   Function: format_latency_line
+   Purpose : Appends a histogram to a statistics report as a line with the
+             count, mean, percentiles and the largest bucket with a time.
+   Input   : Report, buffer size, report length, stage name, histogram.
+   Output  : New report length.
+*/
+int format_latency_line(char *out, int len, int n, char *name, pv_histogram_t *hist)
+{
+   uint64_t count = 0;
+   uint64_t max = 0;
+   int i;
+
+   for (i = 0; i < PV_HIST_BUCKETS; i++)
+   {
+      if (hist->buckets[i] > 0)
+      {
+         count += hist->buckets[i];
+         max = get_bucket_value(i);
+      }
+   }
+
+   return(append_report(out, len, n, "%-12s %9lu %9lu %9lu %9lu %9lu %9lu %9lu\n", name, (unsigned long)count,
+                        (unsigned long)((count > 0) ? hist->total_ns / count : 0),
+                        (unsigned long)get_percentile(hist, 500), (unsigned long)get_percentile(hist, 900),
+                        (unsigned long)get_percentile(hist, 990), (unsigned long)get_percentile(hist, 999),
+                        (unsigned long)max));
+}
+
+/*
+   Function: update_capture_stats
+   Purpose : Samples the kernel packet and drop counters for a worker
+             capture socket. Called by the capture worker thread, at most
+             once a second, and when the worker exits.
+   Input   : Worker.
+   Output  : None.
+*/
+void update_capture_stats(pv_worker_t *worker)
+{
+   struct pcap_stat stats;
+
+   if (worker->pcap_device != NULL)
+   {
+      if (pcap_stats(worker->pcap_device, &stats) >= 0)
+      {
+         worker->kernel_packets = stats.ps_recv;
+         worker->kernel_drops = stats.ps_drop;
+      }
+   }
+   else if ((worker->ring.sockfd >= 0) && (update_ring_stats(&worker->ring) == 0))
+   {
+      worker->kernel_packets = worker->ring.kernel_packets;
+      worker->kernel_drops = worker->ring.kernel_drops;
+   }
+   worker->next_kernel_stats = time(NULL) + 1;
+
+   return;
+}
+
+/*
+   Function: init_stats
+   Purpose : Opens the statistics report file, reports are appended so
+             the file keeps the history across sensor restarts.
+   Input   : Statistics, capture configuration.
+   Output  : Returns -1 on error, 0 on success.
+*/
+int init_stats(pv_stats_t *stats, pv_capture_config_t *config)
+{
+   int i;
+
+   memset(stats, 0, sizeof(pv_stats_t));
+   stats->interval = config->stats_interval;
+   stats->last_report = time(NULL);
+   stats->worker_counts = xcalloc(PV_MAX_WORKERS * PV_STATS_COUNTERS * sizeof(unsigned long));
+
+   if (config->heavy_topk > 0)
+   {
+      stats->heavy_topk = config->heavy_topk;
+      for (i = 0; i < PV_HEAVY_TYPES; i++)
+      {
+         init_sketch(&stats->heavy_current[i]);
+         init_sketch(&stats->heavy_previous[i]);
+      }
+   }
+
+   if (config->url_topk > 0)
+   {
+      stats->url_topk = config->url_topk;
+      stats->url_top = xcalloc(stats->url_topk * sizeof(pv_string_top_t));
+   }
+   if (config->dns_topk > 0)
+   {
+      stats->dns_topk = config->dns_topk;
+      stats->dns_top = xcalloc(stats->dns_topk * sizeof(pv_string_top_t));
+   }
+   if (config->ioc_file[0] != 0)
+   {
+      stats->ioc_topk = PV_IOC_REPORT_MAX;
+      stats->ioc_top = xcalloc(stats->ioc_topk * sizeof(pv_ioc_top_t));
+   }
+
+   if (stats->interval == 0)
+   {
+      return(0);
+   }
+   if ((stats->stats_file = fopen(config->stats_file, "a")) == NULL)
+   {
+      sprint_log_entry("init_stats() <ERROR> Could not open statistics file", config->stats_file);
+      return(-1);
+   }
+
+   return(0);
+}
+
+/*
+   Function: write_stats_report
+   Purpose : Writes the counters and latency percentiles for the time since
+             the last report to the statistics file and sends them to the
+             server.
+   Input   : Statistics, report time.
+   Output  : None.
+*/
+void write_stats_report(pv_stats_t *stats, time_t now)
+{
+   char report[PV_STATS_REPORT_MAX];
+   char timestr[32];
+   unsigned long totals[PV_STATS_COUNTERS];
+   unsigned long counts[PV_STATS_COUNTERS];
+   unsigned long *previous;
+   unsigned long spool_events = 0, spool_spilled = 0, spool_dropped = 0, spool_errors = 0;
+   unsigned long active_flows = 0;
+   uint64_t spool_bytes = 0, spool_lost = 0, delta;
+   struct tm loctime;
+   time_t elapsed = now - stats->last_report;
+   int len, i, j, s;
+
+   if (elapsed <= 0)
+   {
+      elapsed = 1;
+   }
+
+   /* Add up the stage times, the current totals become the interval times. */
+   memset(stats->current, 0, sizeof(stats->current));
+   memset(totals, 0, sizeof(totals));
+   for (i = 0; i < worker_count; i++)
+   {
+      for (s = 0; s < PV_STAGE_COUNT; s++)
+      {
+         add_histogram(&stats->current[s], &workers[i].latency[s]);
+         add_histogram(&stats->current[s], &workers[i].output.latency[s]);
+      }
+      active_flows += workers[i].flow_table.count;
+   }
+
+   if (options & PV_SERVER_OUT)
+   {
+      pthread_mutex_lock(&server_spool.lock);
+      add_histogram(&stats->current[PV_STAGE_COUNT], &server_spool.write_latency);
+      spool_events = server_spool.events_queued - stats->spool_events;
+      spool_spilled = server_spool.events_spilled - stats->spool_spilled;
+      spool_dropped = server_spool.events_dropped - stats->spool_dropped;
+      spool_errors = server_spool.send_errors - stats->spool_errors;
+      spool_bytes = server_spool.bytes_sent - stats->spool_bytes;
+      spool_lost = server_spool.bytes_lost - stats->spool_lost;
+      stats->spool_events = server_spool.events_queued;
+      stats->spool_spilled = server_spool.events_spilled;
+      stats->spool_dropped = server_spool.events_dropped;
+      stats->spool_errors = server_spool.send_errors;
+      stats->spool_bytes = server_spool.bytes_sent;
+      stats->spool_lost = server_spool.bytes_lost;
+      pthread_mutex_unlock(&server_spool.lock);
+   }
+
+   for (s = 0; s <= PV_STAGE_COUNT; s++)
+   {
+      for (j = 0; j < PV_HIST_BUCKETS; j++)
+      {
+         delta = stats->current[s].buckets[j] - stats->previous[s].buckets[j];
+         stats->previous[s].buckets[j] = stats->current[s].buckets[j];
+         stats->current[s].buckets[j] = delta;
+      }
+      delta = stats->current[s].total_ns - stats->previous[s].total_ns;
+      stats->previous[s].total_ns = stats->current[s].total_ns;
+      stats->current[s].total_ns = delta;
+   }
+
+   /* Worker counters for the interval. */
+   for (i = 0; i < worker_count; i++)
+   {
+      previous = &stats->worker_counts[i * PV_STATS_COUNTERS];
+      counts[0] = workers[i].packet_count - previous[0];
+      counts[1] = workers[i].short_packets - previous[1];
+      counts[2] = workers[i].kernel_packets - previous[2];
+      counts[3] = workers[i].kernel_drops - previous[3];
+      counts[4] = workers[i].output.ring.dropped - previous[4];
+      previous[0] += counts[0];
+      previous[1] += counts[1];
+      previous[2] += counts[2];
+      previous[3] += counts[3];
+      previous[4] += counts[4];
+      for (j = 0; j < PV_STATS_COUNTERS; j++)
+      {
+         totals[j] += counts[j];
+      }
+   }
+
+   localtime_r(&now, &loctime);
+   strftime(timestr, sizeof(timestr), "%Y-%m-%d %H:%M:%S", &loctime);
+
+   len = append_report(report, PV_STATS_REPORT_MAX, 0, "Statistics: %s Interval: %lu seconds\n", timestr, (unsigned long)elapsed);
+   len = append_report(report, PV_STATS_REPORT_MAX, len, "Packets: %lu (%lu pps) Short: %lu Kernel received: %lu Kernel dropped: %lu Output dropped: %lu\n",
+                       totals[0], totals[0] / (unsigned long)elapsed, totals[1], totals[2], totals[3], totals[4]);
+   len = append_report(report, PV_STATS_REPORT_MAX, len, "Flows: %lu active\n", active_flows);
+   if (options & PV_SERVER_OUT)
+   {
+      len = append_report(report, PV_STATS_REPORT_MAX, len, "Server: %lu events %lu spilled %lu dropped %lu bytes %lu write errors %lu bytes lost\n",
+                          spool_events, spool_spilled, spool_dropped, (unsigned long)spool_bytes, spool_errors, (unsigned long)spool_lost);
+   }
+   len = append_report(report, PV_STATS_REPORT_MAX, len, "%-12s %9s %9s %9s %9s %9s %9s %9s (ns)\n",
+                       "Stage", "samples", "mean", "p50", "p90", "p99", "p99.9", "max");
+   for (s = 0; s < PV_STAGE_COUNT; s++)
+   {
+      len = format_latency_line(report, PV_STATS_REPORT_MAX, len, stage_names[s], &stats->current[s]);
+   }
+   if (options & PV_SERVER_OUT)
+   {
+      format_latency_line(report, PV_STATS_REPORT_MAX, len, "server write", &stats->current[PV_STAGE_COUNT]);
+   }
+
+   if (stats->stats_file != NULL)
+   {
+      fputs(report, stats->stats_file);
+      for (i = 0; i < worker_count; i++)
+      {
+         previous = &stats->worker_counts[i * PV_STATS_COUNTERS];
+         fprintf(stats->stats_file, "Worker %d: %lu packets %lu short %lu kernel received %lu kernel dropped %lu output dropped %u flows\n",
+                 i, previous[0], previous[1], previous[2], previous[3], previous[4], workers[i].flow_table.count);
+      }
+      fputs("\n", stats->stats_file);
+      fflush(stats->stats_file);
+   }
+
+   if (options & PV_SERVER_OUT)
+   {
+      send_control_report("stats", report, now);
+   }
+
+   if (stats->heavy_topk > 0)
+   {
+      write_heavy_report(stats, now);
+   }
+   if (stats->url_topk > 0)
+   {
+      write_url_report(stats, now);
+   }
+   if (stats->dns_topk > 0)
+   {
+      write_dns_report(stats, now);
+   }
+   if (stats->ioc_topk > 0)
+   {
+      write_ioc_report(stats, now);
+   }
+
+   stats->last_report = now;
+   stats->reports++;
+
+   return;
+}
+
+/*
+   Function: write_heavy_report
+   Purpose : Writes the top talkers and conversations for the time since the
+             last report to the statistics file and sends them to the server.
+             The merged worker sketches become the sketches at the last report.
+   Input   : Statistics, report time.
+   Output  : None.
+*/
+void write_heavy_report(pv_stats_t *stats, time_t now)
+{
+   char report[PV_STATS_REPORT_MAX];
+   pv_sketch_t swap;
+   int t;
+
+   for (t = 0; t < PV_HEAVY_TYPES; t++)
+   {
+      merge_heavy_sketches(&stats->heavy_current[t], t);
+   }
+   format_heavy_hitters(stats->heavy_current, stats->heavy_previous, stats->heavy_topk, report, PV_STATS_REPORT_MAX);
+   for (t = 0; t < PV_HEAVY_TYPES; t++)
+   {
+      swap = stats->heavy_previous[t];
+      stats->heavy_previous[t] = stats->heavy_current[t];
+      stats->heavy_current[t] = swap;
+   }
+
+   if (stats->stats_file != NULL)
+   {
+      fputs(report, stats->stats_file);
+      fputs("\n", stats->stats_file);
+      fflush(stats->stats_file);
+   }
+
+   if (options & PV_SERVER_OUT)
+   {
+      send_control_report("topk", report, now);
+   }
+
+   return;
+}
+
+/*
+   Function: write_url_report
+   Purpose : Writes the URLs with the most requests since the last report
+             to the statistics file and sends them to the server.
+   Input   : Statistics, report time.
+   Output  : None.
+*/
+void write_url_report(pv_stats_t *stats, time_t now)
+{
+   int count = select_top_strings(&url_table, stats->url_top, stats->url_topk, 1);
+
+   if (stats->stats_file != NULL)
+   {
+      write_url_map(stats->stats_file, stats->url_top, count);
+      fputs("\n", stats->stats_file);
+      fflush(stats->stats_file);
+   }
+
+   if (options & PV_SERVER_OUT)
+   {
+      send_url_map(stats->url_top, count, now);
+   }
+
+   return;
+}
+
+/*
+   Function: write_dns_report
+   Purpose : Writes the DNS counters and the most queried domains for the
+             time since the last report to the statistics file and sends
+             them to the server.
+   Input   : Statistics, report time.
+   Output  : None.
+*/
+void write_dns_report(pv_stats_t *stats, time_t now)
+{
+   char report[PV_STATS_REPORT_MAX];
+   unsigned long counts[PV_DNS_COUNTERS], total;
+   int count, i;
+
+   sum_dns_counts(counts);
+   for (i = 0; i < PV_DNS_COUNTERS; i++)
+   {
+      total = counts[i];
+      counts[i] -= stats->dns_counts[i];
+      stats->dns_counts[i] = total;
+   }
+   count = select_top_strings(&dns_table, stats->dns_top, stats->dns_topk, 1);
+   format_dns_summary(counts, stats->dns_top, count, report, PV_STATS_REPORT_MAX);
+
+   if (stats->stats_file != NULL)
+   {
+      fputs(report, stats->stats_file);
+      fputs("\n", stats->stats_file);
+      fflush(stats->stats_file);
+   }
+
+   if (options & PV_SERVER_OUT)
+   {
+      send_control_report("dns", report, now);
+   }
+
+   return;
+}
+
+/*
+   Function: write_ioc_report
+   Purpose : Writes the IOC patterns with the most hits since the last
+             report to the statistics file and sends them to the server.
+             Nothing is written for an interval without hits.
+   Input   : Statistics, report time.
+   Output  : None.
+*/
+void write_ioc_report(pv_stats_t *stats, time_t now)
+{
+   char report[PV_STATS_REPORT_MAX];
+   int count = select_top_iocs(stats->ioc_top, stats->ioc_topk, 1);
+
+   if (count == 0)
+   {
+      return;
+   }
+   format_ioc_hits(stats->ioc_top, count, report, PV_STATS_REPORT_MAX);
+
+   if (stats->stats_file != NULL)
+   {
+      fputs(report, stats->stats_file);
+      fputs("\n", stats->stats_file);
+      fflush(stats->stats_file);
+   }
+
+   if (options & PV_SERVER_OUT)
+   {
+      send_control_report("iocs", report, now);
+   }
+
+   return;
+}
+
+/*
+   Function: send_control_report
+   Purpose : Sends a report to the server as a control message of the
+             given type.
+   Input   : Message type, report text, report time.
+   Output  : None.
+*/
+void send_control_report(char *type, char *report, time_t now)
+{
+   char message[PV_MAX_INPUT_STR];
+
+   /* TODO: put an actual sensor id in the id field. */
+   snprintf(message, PV_MAX_INPUT_STR, "<control>%s<id>SENSOR0000</id><time>%lu</time><data>\n%s</data></control>\n",
+            type, (unsigned long)now, report);
+   send_server_event(message);
+}
+
+/*
+   Function: monitor_workers
+   Purpose : Main thread loop while the capture workers are running,
+             writes a statistics report every report interval and
+             handles reload requests. Returns when capture is stopped or
+             all the workers have exited.
+   Input   : Statistics.
+   Output  : None.
+*/
+void monitor_workers(pv_stats_t *stats)
+{
+   time_t now;
+
+   while (capture_running && (count_running_workers() > 0))
+   {
+      sleep(1);
+      if (reload_requested || __atomic_load_n(&bpf_filter.pending_set, __ATOMIC_ACQUIRE))
+      {
+         reload_sensor();
+      }
+      if (blocklist.retired != NULL)
+      {
+         free_retired_blocklist();
+      }
+      now = time(NULL);
+      if ((stats->interval > 0) && (now - stats->last_report >= (time_t)stats->interval))
+      {
+         write_stats_report(stats, now);
+      }
+   }
+
+   return;
+}
+
+/*
+   Function: close_stats
+   Purpose : Writes the report for the time since the last report,
+             prints the heavy hitters, URLs and domains since capture
+             started and closes the statistics file.
+   Input   : Statistics.
+   Output  : None.
+*/
+void close_stats(pv_stats_t *stats)
+{
+   int i;
+
+   if ((stats->interval > 0) && (workers != NULL))
+   {
+      write_stats_report(stats, time(NULL));
+   }
+   if (stats->stats_file != NULL)
+   {
+      fclose(stats->stats_file);
+      stats->stats_file = NULL;
+   }
+   free(stats->worker_counts);
+   stats->worker_counts = NULL;
+
+   if (stats->heavy_topk > 0)
+   {
+      if (workers != NULL)
+      {
+         print_heavy_hitters(stats->heavy_current, stats->heavy_topk);
+      }
+      for (i = 0; i < PV_HEAVY_TYPES; i++)
+      {
+         free_sketch(&stats->heavy_current[i]);
+         free_sketch(&stats->heavy_previous[i]);
+      }
+      stats->heavy_topk = 0;
+   }
+
+   if (stats->url_topk > 0)
+   {
+      if (workers != NULL)
+      {
+         print_url_map(stats->url_topk);
+      }
+      free(stats->url_top);
+      stats->url_top = NULL;
+      stats->url_topk = 0;
+   }
+
+   if (stats->dns_topk > 0)
+   {
+      if (workers != NULL)
+      {
+         print_dns_summary(stats->dns_topk);
+      }
+      free(stats->dns_top);
+      stats->dns_top = NULL;
+      stats->dns_topk = 0;
+   }
+
+   if (stats->ioc_topk > 0)
+   {
+      if (workers != NULL)
+      {
+         print_ioc_hits(stats->ioc_topk);
+      }
+      free(stats->ioc_top);
+      stats->ioc_top = NULL;
+      stats->ioc_topk = 0;
+   }
+
+   return;
+}
@@ -0,0 +1,238 @@
+/*  Copyright 2014 Derek Chadwick
+
+    This file is part of the Pivotal Network Security Tools.
+
+    Pivotal is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Pivotal is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Pivotal.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+   pvstrmap.c
+
+   Title : Pivotal NST Sensor String Count Map
+   Author: Derek Chadwick
+   Date  : 17/10/2026
+
+   Purpose: A table of interned strings with a count for each string,
+            shared by the capture workers. It holds the URLs of the URL
+            map, see pvurlmap.c, and the domains of the DNS dissector, see
+            pvdns.c.
+
+            The strings are interned once in an arena and the records are
+            small fixed size counters, in a preallocated open addressing
+            table. Each record starts with a pv_string_record_t, the user
+            of the map can add its own counters after it. Looking up a
+            string that is already in the table does not take a lock, the
+            table slot is only published once the record and string are
+            complete. New strings are added under the table lock, and when
+            the table or the arena is full new strings are counted as not
+            stored. Records and strings are never removed.
+
+*/
+
+#include "pvcommon.h"
+#include "pivot-sensor.h"
+
+/*
+   Function: init_string_map
+   Purpose : Allocates the table, the records and the string arena.
+   Input   : Map, number of strings, arena size in bytes, record size,
+             rank function for select_top_strings() or NULL to rank by
+             the record count.
+   Output  : Returns 0.
+*/
+int init_string_map(pv_string_map_t *map, uint32_t capacity, uint32_t arena_size, uint32_t record_size, pv_string_rank_t rank)
+{
+   uint32_t slots = 1;
+
+   while (slots < capacity * 2)
+   {
+      slots <<= 1;
+   }
+
+   memset(map, 0, sizeof(pv_string_map_t));
+   map->slots = xcalloc(slots * sizeof(uint32_t));
+   map->mask = slots - 1;
+   map->records = xcalloc(capacity * record_size);
+   map->record_size = record_size;
+   map->capacity = capacity;
+   map->arena = xmalloc(arena_size);
+   map->arena_size = arena_size;
+   map->rank = rank;
+   pthread_mutex_init(&map->lock, NULL);
+
+   return(0);
+}
+
+/*
+   Function: hash_string
+   Purpose : FNV-1a hash of a string.
+   Input   : String, length.
+   Output  : Hash value.
+*/
+uint32_t hash_string(char *string, uint32_t length)
+{
+   uint32_t hash = 2166136261U;
+   uint32_t i;
+
+   for (i = 0; i < length; i++)
+   {
+      hash = (hash ^ (uint8_t)string[i]) * 16777619U;
+   }
+
+   return(hash);
+}
+
+/*
+   Function: probe_string
+   Purpose : Looks a string up in the table without the lock.
+   Input   : Map, string, length, hash, returns the first empty slot index.
+   Output  : Record or NULL if the string is not in the table.
+*/
+pv_string_record_t *probe_string(pv_string_map_t *map, char *string, uint32_t length, uint32_t hash, uint32_t *slot)
+{
+   pv_string_record_t *record;
+   uint32_t index = hash & map->mask;
+   uint32_t n;
+
+   while ((n = __atomic_load_n(&map->slots[index], __ATOMIC_ACQUIRE)) != 0)
+   {
+      record = PV_STRING_RECORD(map, n - 1);
+      if ((record->hash == hash) && (record->length == length) && (memcmp(map->arena + record->offset, string, length) == 0))
+      {
+         return(record);
+      }
+      index = (index + 1) & map->mask;
+   }
+   *slot = index;
+
+   return(NULL);
+}
+
+pv_string_record_t *find_string(pv_string_map_t *map, char *string, uint32_t length)
+{
+   uint32_t slot;
+
+   return(probe_string(map, string, length, hash_string(string, length), &slot));
+}
+
+/*
+   Function: add_string
+   Purpose : Finds a string in the table, adding it if it is new. The
+             caller counts it.
+   Input   : Map, string, length, time in seconds.
+   Output  : Record or NULL if the string is new and the table is full.
+*/
+pv_string_record_t *add_string(pv_string_map_t *map, char *string, uint32_t length, uint32_t now)
+{
+   pv_string_record_t *record;
+   uint32_t hash = hash_string(string, length);
+   uint32_t slot;
+
+   if ((record = probe_string(map, string, length, hash, &slot)) == NULL)
+   {
+      pthread_mutex_lock(&map->lock);
+      /* Another worker may have added it since the probe. */
+      if ((record = probe_string(map, string, length, hash, &slot)) == NULL)
+      {
+         if ((map->count == map->capacity) || (map->arena_used + length + 1 > map->arena_size))
+         {
+            map->not_stored++;
+            pthread_mutex_unlock(&map->lock);
+            return(NULL);
+         }
+         record = PV_STRING_RECORD(map, map->count);
+         memcpy(map->arena + map->arena_used, string, length);
+         map->arena[map->arena_used + length] = 0;
+         record->offset = map->arena_used;
+         record->length = length;
+         record->hash = hash;
+         record->first_seen = now;
+         map->arena_used += length + 1;
+         __atomic_store_n(&map->count, map->count + 1, __ATOMIC_RELEASE);
+         __atomic_store_n(&map->slots[slot], map->count, __ATOMIC_RELEASE);
+      }
+      pthread_mutex_unlock(&map->lock);
+   }
+   record->last_seen = now;
+
+   return(record);
+}
+
+/*
+   Function: get_map_string
+   Purpose : Finds the text of a string record in the arena.
+   Input   : Map, string record.
+   Output  : Returns the NUL terminated string.
+*/
+char *get_map_string(pv_string_map_t *map, pv_string_record_t *record)
+{
+   return(map->arena + record->offset);
+}
+
+/*
+   Function: select_top_strings
+   Purpose : Finds the strings with the highest rank, since capture started
+             or in the interval since the last report. For an interval the
+             rank at this report is kept for the next one.
+   Input   : Map, top list of k entries, k, interval flag.
+   Output  : Number of entries in the list, highest rank first.
+*/
+int select_top_strings(pv_string_map_t *map, pv_string_top_t *top, unsigned int k, int interval)
+{
+   pv_string_record_t *record;
+   uint64_t count, total;
+   uint32_t records = __atomic_load_n(&map->count, __ATOMIC_ACQUIRE);
+   uint32_t i;
+   int n = 0, j;
+
+   for (i = 0; i < records; i++)
+   {
+      record = PV_STRING_RECORD(map, i);
+      total = (map->rank != NULL) ? map->rank(record) : record->count;
+      count = total;
+      if (interval)
+      {
+         count = total - record->exported;
+         record->exported = total;
+      }
+      if ((count == 0) || ((n == (int)k) && (count <= top[n - 1].count)))
+      {
+         continue;
+      }
+      /* Insertion into the short sorted list. */
+      for (j = (n < (int)k) ? n++ : n - 1; (j > 0) && (top[j - 1].count < count); j--)
+      {
+         top[j] = top[j - 1];
+      }
+      top[j].record = record;
+      top[j].count = count;
+   }
+
+   return(n);
+}
+
+/*
+   Function: delete_string_map
+   Purpose : Frees the table, the records and the string arena.
+   Input   : Map.
+   Output  : None.
+*/
+void delete_string_map(pv_string_map_t *map)
+{
+   free(map->slots);
+   free(map->records);
+   free(map->arena);
+   pthread_mutex_destroy(&map->lock);
+   memset(map, 0, sizeof(pv_string_map_t));
+}
@@ -0,0 +1,921 @@
+/*  Copyright 2014 Derek Chadwick
+
+    This file is part of the Pivotal Network Security Tools.
+
+    Pivotal is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Pivotal is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Pivotal.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+   pvtest.c
+
+   Title : Pivotal NST Sensor Unit Tests
+   Author: Derek Chadwick
+   Date  : 17/10/2026
+
+   Purpose: Table driven tests of the sensor parsers and lookup tables:
+            the packet decoder, DNS names, HTTP requests, TLS ClientHello
+            messages, TCP stream reassembly, the IOC pattern matcher and
+            the blocklist prefix table. Each table row is one input, most
+            of them truncated or malformed, and the fields the code under
+            test should produce.
+
+            Built and run with "make test", linked with every sensor
+            object except pivot-sensor.o. Failed checks are printed and
+            the exit status is 1 if any check failed.
+
+   Status : EXPERIMENTAL - not for use in production networks.
+
+*/
+
+#include "pvcommon.h"
+#include "pivot-sensor.h"
+
+#define PV_TEST_MAX_PACKET 256
+#define PV_TEST_MAX_SEGMENTS 6
+#define PV_TEST_STREAM_MAX 64
+#define PV_TEST_IOC_PATTERNS 6
+
+/* Frame parts, hex bytes with optional spaces. */
+#define ETH_ADDRS "000102030405 060708090a0b"
+#define IP4_TCP   "4500 0032 0001 0000 4006 0000 0a000001 0a000002"
+#define TCP_10    "3039 0050 00000001 00000000 5018 2000 0000 0000 30313233343536373839"
+#define TCP_4     "3039 0050 00000001 00000000 5018 2000 0000 0000 61626364"
+
+#define TCP4_FRAME ETH_ADDRS "0800" IP4_TCP TCP_10
+#define UDP4_FRAME ETH_ADDRS "0800" "4500 0020 0001 0000 4011 0000 0a000001 0a000002" "0035 1000 000c 0000 61626364"
+#define VLAN_FRAME ETH_ADDRS "8100 0064 0800" IP4_TCP TCP_10
+#define QINQ_FRAME ETH_ADDRS "88a8 000a 8100 0014 0800" IP4_TCP TCP_10
+#define TCP6_FRAME ETH_ADDRS "86dd" "6000 0000 0020 2c40 20010db8000000000000000000000001 20010db8000000000000000000000002" \
+                   "0600 0000 00000001" TCP_4
+#define GRE_FRAME  ETH_ADDRS "0800" "4500 0036 0001 0000 402f 0000 0a000001 0a000002" "0000 0800" \
+                   "4500 001e 0001 0000 4011 0000 c0a80001 c0a80002" "0035 0035 000a 0000 6869"
+
+#define CLIENT_HELLO "16 0301 005c 01 000058 0303" \
+                     "000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f" \
+                     "00 0004 1301 c02f 01 00 002b" \
+                     "0000 0010 000e 00 000b 6578616d706c652e636f6d" \
+                     "0010 0005 0003 02 6832" \
+                     "000a 0004 0002 001d" \
+                     "000b 0002 0100"
+
+/* A frame, cut to a captured length and with some bytes overwritten, and the decoder output. */
+struct pv_decode_case
+{
+   char *name;
+   char *frame;
+   int caplen;                  /* -1 = the whole frame */
+   int patch_offset;            /* -1 = no patch */
+   char *patch;
+   int result;
+   int flags;
+   int l3_offset;
+   int l4_offset;
+   int payload_length;
+   int protocol;
+   int dst_port;
+   int vlan_count;
+   int vlan_id;                 /* outer tag */
+   int tunnel;
+};
+
+typedef struct pv_decode_case pv_decode_case_t;
+
+struct pv_dns_case
+{
+   char *name;
+   char *message;
+   uint32_t offset;
+   uint32_t result;
+   char *domain;
+};
+
+typedef struct pv_dns_case pv_dns_case_t;
+
+struct pv_http_case
+{
+   char *name;
+   char *payload;
+   uint32_t length;             /* 0 = strlen() */
+   int result;
+   char *method;
+   char *path;                  /* NULL = no path */
+   char *host;                  /* NULL = no host */
+};
+
+typedef struct pv_http_case pv_http_case_t;
+
+struct pv_tls_case
+{
+   char *name;
+   int length;                  /* -1 = the whole ClientHello */
+   int patch_offset;
+   char *patch;
+   int result;
+   int complete;
+   char *sni;
+   char *alpn;
+};
+
+typedef struct pv_tls_case pv_tls_case_t;
+
+/* A segment, the sequence number is from the initial sequence number. */
+struct pv_test_segment
+{
+   uint32_t seq;
+   uint8_t flags;
+   char *data;                  /* NULL ends the list */
+};
+
+typedef struct pv_test_segment pv_test_segment_t;
+
+struct pv_reasm_case
+{
+   char *name;
+   uint32_t isn;
+   pv_test_segment_t segments[PV_TEST_MAX_SEGMENTS];
+   char *stream;
+   unsigned long out_of_order;
+   unsigned long duplicates;
+   unsigned long gaps;
+   int done;
+};
+
+typedef struct pv_reasm_case pv_reasm_case_t;
+
+struct pv_ioc_parse_case
+{
+   char *text;
+   int length;
+   char *pattern;               /* hex */
+};
+
+typedef struct pv_ioc_parse_case pv_ioc_parse_case_t;
+
+/* A payload scanned in two parts, the second from the state the first ended in. */
+struct pv_ioc_case
+{
+   char *name;
+   char *first;
+   uint32_t first_length;       /* 0 = strlen() */
+   char *second;
+   uint64_t hits[PV_TEST_IOC_PATTERNS];
+};
+
+typedef struct pv_ioc_case pv_ioc_case_t;
+
+struct pv_prefix_case
+{
+   char *text;
+   int result;
+   int length;
+   char *addr;
+};
+
+typedef struct pv_prefix_case pv_prefix_case_t;
+
+struct pv_lookup_case
+{
+   char *addr;
+   int length;                  /* -1 = no match */
+   int list;
+};
+
+typedef struct pv_lookup_case pv_lookup_case_t;
+
+pv_decode_case_t decode_cases[] = {
+   { "TCP", TCP4_FRAME, -1, -1, NULL, PV_DECODE_OK, 0, 14, 34, 10, IPPROTO_TCP, 80, 0, 0, PV_TUNNEL_NONE },
+   { "Ethernet header cut", TCP4_FRAME, 13, -1, NULL, PV_DECODE_SHORT, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+   { "No IP header", TCP4_FRAME, 14, -1, NULL, PV_DECODE_SHORT, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+   { "IP header cut", TCP4_FRAME, 33, -1, NULL, PV_DECODE_SHORT, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+   { "IP header only", TCP4_FRAME, 34, -1, NULL, PV_DECODE_OK, 0, 14, 0, 0, IPPROTO_TCP, 0, 0, 0, PV_TUNNEL_NONE },
+   { "TCP header cut", TCP4_FRAME, 53, -1, NULL, PV_DECODE_OK, 0, 14, 0, 0, IPPROTO_TCP, 0, 0, 0, PV_TUNNEL_NONE },
+   { "TCP header only", TCP4_FRAME, 54, -1, NULL, PV_DECODE_OK, 0, 14, 34, 0, IPPROTO_TCP, 80, 0, 0, PV_TUNNEL_NONE },
+   { "TCP payload cut", TCP4_FRAME, 59, -1, NULL, PV_DECODE_OK, 0, 14, 34, 5, IPPROTO_TCP, 80, 0, 0, PV_TUNNEL_NONE },
+   { "IHL below 5", TCP4_FRAME, -1, 14, "44", PV_DECODE_SHORT, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+   { "IP version not 4", TCP4_FRAME, -1, 14, "65", PV_DECODE_SHORT, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+   { "IP options cut", TCP4_FRAME, -1, 14, "4f", PV_DECODE_OK, 0, 14, 0, 0, IPPROTO_TCP, 0, 0, 0, PV_TUNNEL_NONE },
+   { "Not IP", TCP4_FRAME, -1, 12, "0806", PV_DECODE_UNSUPPORTED, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+   { "IPv4 later fragment", TCP4_FRAME, -1, 20, "0010", PV_DECODE_OK, PV_DECODE_FRAGMENT, 14, 0, 0, IPPROTO_TCP, 0, 0, 0, PV_TUNNEL_NONE },
+   { "IP length zero", TCP4_FRAME, -1, 16, "0000", PV_DECODE_OK, 0, 14, 34, 10, IPPROTO_TCP, 80, 0, 0, PV_TUNNEL_NONE },
+   { "IP length before the frame end", TCP4_FRAME, -1, 16, "002c", PV_DECODE_OK, 0, 14, 34, 4, IPPROTO_TCP, 80, 0, 0, PV_TUNNEL_NONE },
+   { "IP length past the capture", TCP4_FRAME, -1, 16, "05dc", PV_DECODE_OK, 0, 14, 34, 10, IPPROTO_TCP, 80, 0, 0, PV_TUNNEL_NONE },
+   { "TCP data offset past the end", TCP4_FRAME, -1, 46, "f0", PV_DECODE_OK, 0, 14, 34, 0, IPPROTO_TCP, 80, 0, 0, PV_TUNNEL_NONE },
+   { "UDP", UDP4_FRAME, -1, -1, NULL, PV_DECODE_OK, 0, 14, 34, 4, IPPROTO_UDP, 4096, 0, 0, PV_TUNNEL_NONE },
+   { "UDP header cut", UDP4_FRAME, 41, -1, NULL, PV_DECODE_OK, 0, 14, 0, 0, IPPROTO_UDP, 0, 0, 0, PV_TUNNEL_NONE },
+   { "VLAN", VLAN_FRAME, -1, -1, NULL, PV_DECODE_OK, 0, 18, 38, 10, IPPROTO_TCP, 80, 1, 100, PV_TUNNEL_NONE },
+   { "VLAN tag cut", VLAN_FRAME, 17, -1, NULL, PV_DECODE_SHORT, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+   { "VLAN IP header cut", VLAN_FRAME, 37, -1, NULL, PV_DECODE_SHORT, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+   { "QinQ", QINQ_FRAME, -1, -1, NULL, PV_DECODE_OK, 0, 22, 42, 10, IPPROTO_TCP, 80, 2, 10, PV_TUNNEL_NONE },
+   { "IPv6 fragment header", TCP6_FRAME, -1, -1, NULL, PV_DECODE_OK, 0, 14, 62, 4, IPPROTO_TCP, 80, 0, 0, PV_TUNNEL_NONE },
+   { "IPv6 header cut", TCP6_FRAME, 53, -1, NULL, PV_DECODE_SHORT, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+   { "IPv6 version not 6", TCP6_FRAME, -1, 14, "40", PV_DECODE_SHORT, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+   { "IPv6 extension header cut", TCP6_FRAME, 60, -1, NULL, PV_DECODE_OK, 0, 14, 0, 0, IPPROTO_FRAGMENT, 0, 0, 0, PV_TUNNEL_NONE },
+   { "IPv6 later fragment", TCP6_FRAME, -1, 56, "0008", PV_DECODE_OK, PV_DECODE_FRAGMENT, 14, 0, 0, IPPROTO_TCP, 0, 0, 0, PV_TUNNEL_NONE },
+   { "GRE", GRE_FRAME, -1, -1, NULL, PV_DECODE_OK, 0, 38, 58, 2, IPPROTO_UDP, 53, 0, 0, PV_TUNNEL_GRE },
+   { "GRE header cut", GRE_FRAME, 36, -1, NULL, PV_DECODE_OK, 0, 14, 0, 0, IPPROTO_GRE, 0, 0, 0, PV_TUNNEL_NONE },
+   { "GRE inner packet cut", GRE_FRAME, 50, -1, NULL, PV_DECODE_OK, 0, 14, 0, 0, IPPROTO_GRE, 0, 0, 0, PV_TUNNEL_NONE },
+   { "GRE version 1", GRE_FRAME, -1, 35, "01", PV_DECODE_OK, 0, 14, 0, 0, IPPROTO_GRE, 0, 0, 0, PV_TUNNEL_NONE },
+   { "GRE key flag without a key", GRE_FRAME, -1, 34, "2000", PV_DECODE_OK, 0, 14, 0, 0, IPPROTO_GRE, 0, 0, 0, PV_TUNNEL_NONE },
+   { NULL, NULL, 0, 0, NULL, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 }
+};
+
+pv_dns_case_t dns_cases[] = {
+   { "Name", "03 777777 07 6578616d706c65 03 636f6d 00", 0, 17, "www.example.com" },
+   { "Root", "00", 0, 1, "." },
+   { "Upper case", "03 575757 00", 0, 5, "www" },
+   { "Pointer back", "03 777777 00 03 667470 c000", 5, 11, "ftp.www" },
+   { "Pointer chain", "03 777777 00 c000 03 667470 c005", 7, 13, "ftp.www" },
+   { "Markup", "05 3c623e2f2e 00", 0, 7, "?b???" },
+   { "Control and space bytes", "03 61207f 00", 0, 5, "a??" },
+   { "Label cut", "07 657861 00", 0, 0, NULL },
+   { "No end", "03 777777", 0, 0, NULL },
+   { "Empty message", "", 0, 0, NULL },
+   { "Offset past the end", "00", 1, 0, NULL },
+   { "Pointer cut", "03 777777 c0", 0, 0, NULL },
+   { "Pointer forward", "c002 03 777777 00", 0, 0, NULL },
+   { "Pointer to itself", "c000", 0, 0, NULL },
+   { "Pointer loop", "01 61 c000", 0, 0, NULL },
+   { "Reserved label type", "41 61 00", 0, 0, NULL },
+   { NULL, NULL, 0, 0, NULL }
+};
+
+pv_http_case_t http_cases[] = {
+   { "GET", "GET /index.html HTTP/1.1\r\nHost: example.com\r\n\r\n", 0, 1, "GET", "/index.html", "example.com" },
+   { "Query", "POST /upload?x=1 HTTP/1.1\r\nContent-Length: 0\r\nHost: up.test\r\n\r\n", 0, 1, "POST", "/upload", "up.test" },
+   { "Host white space", "GET / HTTP/1.1\r\nhost:\t  a.b \r\n\r\n", 0, 1, "GET", "/", "a.b" },
+   { "Empty host", "GET / HTTP/1.1\r\nHost:\r\n\r\n", 0, 1, "GET", "/", "" },
+   { "Absolute URL", "GET http://proxy.test/p HTTP/1.1\r\n\r\n", 0, 1, "GET", "/p", "proxy.test" },
+   { "Absolute URL without a path", "GET http://proxy.test HTTP/1.1\r\n\r\n", 0, 1, "GET", "", "proxy.test" },
+   { "CONNECT", "CONNECT example.com:443 HTTP/1.1\r\n\r\n", 0, 1, "CONNECT", NULL, "example.com:443" },
+   { "No Host header", "GET / HTTP/1.0\r\n\r\nHost: x\r\n", 0, 1, "GET", "/", NULL },
+   { "Path cut", "GET /long/pa", 0, 1, "GET", "/long/pa", NULL },
+   { "Version cut", "GET / HTT", 0, 1, "GET", "/", NULL },
+   { "Host cut", "GET / HTTP/1.1\r\nHost: exa", 0, 1, "GET", "/", "exa" },
+   { "Too short", "GET /", 0, 0, NULL, NULL, NULL },
+   { "Unknown method", "FOO / HTTP/1.1\r\n\r\n", 0, 0, NULL, NULL, NULL },
+   { "Method prefix", "GETX / HTTP/1.1\r\n\r\n", 0, 0, NULL, NULL, NULL },
+   { "Lower case method", "get / HTTP/1.1\r\n\r\n", 0, 0, NULL, NULL, NULL },
+   { "Not HTTP", "GET / SMTP/1.0\r\n\r\n", 0, 0, NULL, NULL, NULL },
+   { "No version", "GET /\r\nHost: x\r\n\r\n", 0, 0, NULL, NULL, NULL },
+   { "Empty target", "GET  HTTP/1.1\r\n\r\n", 0, 0, NULL, NULL, NULL },
+   { "Relative target", "GET index.html HTTP/1.1\r\n\r\n", 0, 0, NULL, NULL, NULL },
+   { "Asterisk target", "OPTIONS * HTTP/1.1\r\n\r\n", 0, 0, NULL, NULL, NULL },
+   { "Absolute URL without a host", "GET http:// HTTP/1.1\r\n\r\n", 0, 0, NULL, NULL, NULL },
+   { "Binary", "\x16\x03\x01\x00\x05\x01\x00", 7, 0, NULL, NULL, NULL },
+   { NULL, NULL, 0, 0, NULL, NULL, NULL }
+};
+
+pv_tls_case_t tls_cases[] = {
+   { "ClientHello", -1, -1, NULL, 1, 1, "example.com", "h2" },
+   { "Shorter than the headers", 42, -1, NULL, 0, 0, NULL, NULL },
+   { "Cut after the random", 43, -1, NULL, 1, 0, "", "" },
+   { "Cut in the cipher suites", 48, -1, NULL, 1, 0, "", "" },
+   { "Cut in the server name", 70, -1, NULL, 1, 0, "", "" },
+   { "Cut in the ALPN", 80, -1, NULL, 1, 0, "example.com", "" },
+   { "Cut in the last extension", 96, -1, NULL, 1, 0, "example.com", "h2" },
+   { "Not a handshake record", -1, 0, "17", 0, 0, NULL, NULL },
+   { "Not TLS", -1, 1, "02", 0, 0, NULL, NULL },
+   { "Not a ClientHello", -1, 5, "02", 0, 0, NULL, NULL },
+   { "Handshake shorter than the ClientHello", -1, 6, "000010", 1, 0, "", "" },
+   { "Cipher suites past the end", -1, 44, "ffff", 1, 0, "", "" },
+   { "Extension past the end", -1, 56, "00ff", 1, 0, "", "" },
+   { "Server name past the extension", -1, 61, "00ff", 1, 1, "", "h2" },
+   { "Upper case server name", -1, 63, "45", 1, 1, "example.com", "h2" },
+   { "Markup in the server name", -1, 63, "3c", 1, 1, "?xample.com", "h2" },
+   { "Markup in the ALPN", -1, 81, "3c", 1, 1, "example.com", "?2" },
+   { NULL, 0, 0, NULL, 0, 0, NULL, NULL }
+};
+
+pv_reasm_case_t reasm_cases[] = {
+   { "In order", 1000, { { 0, TH_SYN, "" }, { 1, TH_ACK, "abc" }, { 4, TH_ACK, "def" }, { 0, 0, NULL } }, "abcdef", 0, 0, 0, 0 },
+   { "Out of order", 1000, { { 0, TH_SYN, "" }, { 4, TH_ACK, "def" }, { 1, TH_ACK, "abc" }, { 0, 0, NULL } }, "abcdef", 1, 0, 0, 0 },
+   { "Duplicate", 1000, { { 0, TH_SYN, "" }, { 1, TH_ACK, "abc" }, { 1, TH_ACK, "abc" }, { 4, TH_ACK, "def" }, { 0, 0, NULL } }, "abcdef", 0, 1, 0, 0 },
+   { "Duplicate held", 1000, { { 0, TH_SYN, "" }, { 4, TH_ACK, "def" }, { 4, TH_ACK, "def" }, { 1, TH_ACK, "abc" }, { 0, 0, NULL } }, "abcdef", 2, 0, 0, 0 },
+   { "Overlap", 1000, { { 0, TH_SYN, "" }, { 1, TH_ACK, "abcd" }, { 3, TH_ACK, "cdef" }, { 0, 0, NULL } }, "abcdef", 0, 0, 0, 0 },
+   { "Overlap held", 1000, { { 0, TH_SYN, "" }, { 5, TH_ACK, "ef" }, { 4, TH_ACK, "def" }, { 1, TH_ACK, "abc" }, { 0, 0, NULL } }, "abcdef", 2, 0, 0, 0 },
+   { "Gap at FIN", 1000, { { 0, TH_SYN, "" }, { 1, TH_ACK, "abc" }, { 7, TH_ACK | TH_FIN, "ghi" }, { 0, 0, NULL } }, "abcghi", 1, 0, 1, 1 },
+   { "Gap at RST", 1000, { { 0, TH_SYN, "" }, { 1, TH_ACK, "abc" }, { 7, TH_ACK, "ghi" }, { 10, TH_RST, "" }, { 0, 0, NULL } }, "abcghi", 1, 0, 1, 1 },
+   { "No SYN", 5000, { { 0, TH_ACK, "" }, { 0, TH_ACK, "xyz" }, { 3, TH_ACK, "uvw" }, { 0, 0, NULL } }, "xyzuvw", 0, 0, 0, 0 },
+   { "Sequence wrap", 0xfffffffe, { { 0, TH_SYN, "" }, { 1, TH_ACK, "abc" }, { 4, TH_ACK, "def" }, { 0, 0, NULL } }, "abcdef", 0, 0, 0, 0 },
+   { "Out of order sequence wrap", 0xfffffffe, { { 0, TH_SYN, "" }, { 4, TH_ACK, "def" }, { 1, TH_ACK, "abc" }, { 0, 0, NULL } }, "abcdef", 1, 0, 0, 0 },
+   { "Depth", 1000, { { 0, TH_SYN, "" }, { 1, TH_ACK, "abcdef" }, { 7, TH_ACK, "ghijkl" }, { 0, 0, NULL } }, "abcdefgh", 0, 0, 0, 1 },
+   { NULL, 0, { { 0, 0, NULL } }, NULL, 0, 0, 0, 0 }
+};
+
+/* Pattern file, the patterns are numbered in order without the duplicate and the invalid line. */
+char *ioc_file_text = "# test patterns\n"
+                      "he\n"
+                      "she\n"
+                      "his\n"
+                      "hers\n"
+                      "|00 ff|bin\n"
+                      "/gate.php?id=\n"
+                      "he\n"
+                      "|4d 5|\n"
+                      "\n";
+
+pv_ioc_parse_case_t ioc_parse_cases[] = {
+   { "abc", 3, "616263" },
+   { "a b", 3, "612062" },
+   { "|4d 5a|", 2, "4d5a" },
+   { "|4D5a|x", 3, "4d5a78" },
+   { "a|20|b", 3, "612062" },
+   { "|4d 5|", -1, NULL },
+   { "|zz|", -1, NULL },
+   { "|4d", -1, NULL },
+   { "||", -1, NULL },
+   { "", -1, NULL },
+   { NULL, 0, NULL }
+};
+
+pv_ioc_case_t ioc_cases[] = {
+   { "Overlapping", "ushers", 0, "", { 1, 1, 0, 1, 0, 0 } },
+   { "Overlapping and nested", "hishers", 0, "", { 1, 1, 1, 1, 0, 0 } },
+   { "Repeated", "hehehe", 0, "", { 3, 0, 0, 0, 0, 0 } },
+   { "Fail link", "shis", 0, "", { 0, 0, 1, 0, 0, 0 } },
+   { "Restart", "hhers", 0, "", { 1, 0, 0, 1, 0, 0 } },
+   { "No match", "xyz", 0, "", { 0, 0, 0, 0, 0, 0 } },
+   { "Empty", "", 0, "", { 0, 0, 0, 0, 0, 0 } },
+   { "Split", "us", 0, "hers", { 1, 1, 0, 1, 0, 0 } },
+   { "Split URI", "GET /gate.p", 0, "hp?id=1", { 0, 0, 0, 0, 0, 1 } },
+   { "Binary", "x\0\377bin", 6, "", { 0, 0, 0, 0, 1, 0 } },
+   { "Split binary", "\0", 1, "\377bin", { 0, 0, 0, 0, 1, 0 } },
+   { NULL, NULL, 0, NULL, { 0 } }
+};
+
+pv_prefix_case_t prefix_cases[] = {
+   { "10.1.2.3/24", 0, 24, "10.1.2.0" },
+   { "10.1.2.255/25", 0, 25, "10.1.2.128" },
+   { "10.1.2.3", 0, 32, "10.1.2.3" },
+   { "10.1.2.3/0", 0, 0, "0.0.0.0" },
+   { "2001:db8::1/128", 0, 128, "2001:db8::1" },
+   { "2001:ffff::/17", 0, 17, "2001:8000::" },
+   { "2001:db8::1", 0, 128, "2001:db8::1" },
+   { "::/0", 0, 0, "::" },
+   { "10.0.0.0/33", -1, 0, NULL },
+   { "10.0.0.0/", -1, 0, NULL },
+   { "10.0.0.0/8x", -1, 0, NULL },
+   { "10.0.0.0/-1", -1, 0, NULL },
+   { "10.0.0", -1, 0, NULL },
+   { "2001:db8::/129", -1, 0, NULL },
+   { "example.com", -1, 0, NULL },
+   { NULL, 0, 0, NULL }
+};
+
+/* Blocklists, the second list adds the default route and repeats a first list prefix. */
+char *lpm_file_text[2] = {
+   "# list a\n"
+   "10.0.0.0/8\n"
+   "10.1.2.0/24\n"
+   "10.1.2.128/25\n"
+   "10.1.2.200/32\n"
+   "192.168.1.1\n"
+   "10.9.9.10\n10.9.9.20\n10.9.9.30\n10.9.9.40\n10.9.9.50\n10.9.9.60\n10.9.9.70\n"
+   "10.9.9.80\n10.9.9.90\n10.9.9.100\n10.9.9.110\n10.9.9.120\n10.9.9.130\n10.9.9.200\n"
+   "2001::/16\n"
+   "2001:8000::/17\n"
+   "2001:db8::/32\n"
+   "2001:db8::1/128\n"
+   "10.0.0.0/33\n"
+   "bogus\n",
+   "0.0.0.0/0\n"
+   "10.1.2.0/24 ; also in list a\n"
+};
+
+pv_lookup_case_t lookup_cases[] = {
+   { "10.1.2.3", 24, 0 },
+   { "10.1.2.0", 24, 0 },
+   { "10.1.2.127", 24, 0 },
+   { "10.1.2.128", 25, 0 },
+   { "10.1.2.199", 25, 0 },
+   { "10.1.2.200", 32, 0 },
+   { "10.1.2.201", 25, 0 },
+   { "10.1.2.255", 25, 0 },
+   { "10.1.1.255", 8, 0 },
+   { "10.1.3.0", 8, 0 },
+   { "10.0.0.0", 8, 0 },
+   { "10.255.255.255", 8, 0 },
+   { "10.9.9.10", 32, 0 },
+   { "10.9.9.11", 8, 0 },
+   { "10.9.9.130", 32, 0 },
+   { "10.9.9.200", 32, 0 },
+   { "10.9.9.255", 8, 0 },
+   { "192.168.1.1", 32, 0 },
+   { "192.168.1.0", 0, 1 },
+   { "192.168.1.2", 0, 1 },
+   { "9.255.255.255", 0, 1 },
+   { "11.0.0.0", 0, 1 },
+   { "0.0.0.0", 0, 1 },
+   { "255.255.255.255", 0, 1 },
+   { "2001:db8::1", 128, 0 },
+   { "2001:db8::", 32, 0 },
+   { "2001:db8::2", 32, 0 },
+   { "2001:db8:ffff:ffff:ffff:ffff:ffff:ffff", 32, 0 },
+   { "2001:db9::", 16, 0 },
+   { "2001:7fff:ffff:ffff:ffff:ffff:ffff:ffff", 16, 0 },
+   { "2001:8000::", 17, 0 },
+   { "2001:ffff:ffff:ffff:ffff:ffff:ffff:ffff", 17, 0 },
+   { "2000:ffff:ffff:ffff:ffff:ffff:ffff:ffff", -1, 0 },
+   { "2002::", -1, 0 },
+   { "::1", -1, 0 },
+   { NULL, 0, 0 }
+};
+
+int test_checks;
+int test_failures;
+
+char test_stream[PV_TEST_STREAM_MAX];
+uint32_t test_stream_length;
+
+/*
+   Function: check_int
+   Purpose : Compares a number with the expected value.
+   Input   : Test group, case name, field name, expected and actual value.
+   Output  : Returns 0, or -1 if the values differ.
+*/
+int check_int(char *group, char *name, char *field, long expected, long actual)
+{
+   test_checks++;
+   if (expected != actual)
+   {
+      printf("FAIL %s: %s: %s is %ld, expected %ld\n", group, name, field, actual, expected);
+      test_failures++;
+      return(-1);
+   }
+
+   return(0);
+}
+
+/*
+   Function: check_string
+   Purpose : Compares a string, or a string that is not NUL terminated,
+             with the expected value. NULL expects a NULL pointer.
+   Input   : Test group, case name, field name, expected string, actual
+             string, actual length or -1 if it is NUL terminated.
+   Output  : Returns 0, or -1 if the strings differ.
+*/
+int check_string(char *group, char *name, char *field, char *expected, const char *actual, int length)
+{
+   char text[PV_MAX_INPUT_STR];
+
+   test_checks++;
+   if ((expected == NULL) || (actual == NULL))
+   {
+      if (expected == actual)
+      {
+         return(0);
+      }
+      printf("FAIL %s: %s: %s is %s, expected %s\n", group, name, field, (actual == NULL) ? "NULL" : "set", (expected == NULL) ? "NULL" : expected);
+      test_failures++;
+      return(-1);
+   }
+   if (length < 0)
+   {
+      length = strlen(actual);
+   }
+   if (length >= PV_MAX_INPUT_STR)
+   {
+      length = PV_MAX_INPUT_STR - 1;
+   }
+   memcpy(text, actual, length);
+   text[length] = 0;
+   if (strcmp(expected, text) != 0)
+   {
+      printf("FAIL %s: %s: %s is \"%s\", expected \"%s\"\n", group, name, field, text, expected);
+      test_failures++;
+      return(-1);
+   }
+
+   return(0);
+}
+
+/*
+   Function: parse_hex
+   Purpose : Converts hex digits to bytes, spaces are skipped.
+   Input   : Hex text, byte buffer, buffer size.
+   Output  : Number of bytes.
+*/
+uint32_t parse_hex(char *hex, uint8_t *out, uint32_t size)
+{
+   uint32_t n = 0;
+   unsigned int value;
+
+   while ((*hex != 0) && (n < size))
+   {
+      if (*hex == ' ')
+      {
+         hex++;
+         continue;
+      }
+      sscanf(hex, "%2x", &value);
+      out[n++] = (uint8_t)value;
+      hex += 2;
+   }
+
+   return(n);
+}
+
+/*
+   Function: test_decoder
+   Purpose : Decodes each frame of the decoder table.
+   Input   : None.
+   Output  : None.
+*/
+void test_decoder()
+{
+   pv_decode_case_t *c;
+   pv_packet_event_t event;
+   uint8_t packet[PV_TEST_MAX_PACKET];
+   uint32_t length;
+   int res;
+
+   for (c = decode_cases; c->name != NULL; c++)
+   {
+      length = parse_hex(c->frame, packet, PV_TEST_MAX_PACKET);
+      if (c->patch_offset >= 0)
+      {
+         parse_hex(c->patch, packet + c->patch_offset, PV_TEST_MAX_PACKET - c->patch_offset);
+      }
+      if (c->caplen >= 0)
+      {
+         length = c->caplen;
+      }
+      memset(&event, 0, sizeof(pv_packet_event_t));
+      res = decode_ethernet(&event, packet, length);
+      if ((check_int("decoder", c->name, "result", c->result, res) < 0) || (res != PV_DECODE_OK))
+      {
+         continue;
+      }
+      check_int("decoder", c->name, "flags", c->flags, event.desc.flags);
+      check_int("decoder", c->name, "l3_offset", c->l3_offset, event.desc.l3_offset);
+      check_int("decoder", c->name, "l4_offset", c->l4_offset, event.desc.l4_offset);
+      check_int("decoder", c->name, "payload_length", c->payload_length, event.desc.payload_length);
+      check_int("decoder", c->name, "payload_offset", (c->payload_length > 0) ? c->l4_offset + ((c->protocol == IPPROTO_TCP) ? 20 : 8) : 0, event.desc.payload_offset);
+      check_int("decoder", c->name, "protocol", c->protocol, event.key.protocol);
+      check_int("decoder", c->name, "dst_port", c->dst_port, ntohs(event.key.dst_port));
+      check_int("decoder", c->name, "vlan_count", c->vlan_count, event.desc.vlan_count);
+      if (c->vlan_count > 0)
+      {
+         check_int("decoder", c->name, "vlan_id", c->vlan_id, event.desc.vlan_id[0]);
+      }
+      check_int("decoder", c->name, "tunnel", c->tunnel, event.desc.tunnel);
+   }
+}
+
+/*
+   Function: test_dns_names
+   Purpose : Reads the name in each message of the DNS table.
+   Input   : None.
+   Output  : None.
+*/
+void test_dns_names()
+{
+   pv_dns_case_t *c;
+   uint8_t msg[PV_TEST_MAX_PACKET];
+   char name[PV_DNS_NAME_MAX];
+   uint32_t len, name_length, res;
+
+   for (c = dns_cases; c->name != NULL; c++)
+   {
+      len = parse_hex(c->message, msg, PV_TEST_MAX_PACKET);
+      res = read_dns_name(msg, len, c->offset, name, &name_length);
+      if ((check_int("dns", c->name, "result", c->result, res) < 0) || (res == 0))
+      {
+         continue;
+      }
+      check_string("dns", c->name, "name", c->domain, name, -1);
+      check_int("dns", c->name, "name_length", strlen(c->domain), name_length);
+      /* Skipping the name ends at the same offset. */
+      check_int("dns", c->name, "skipped", c->result, read_dns_name(msg, len, c->offset, NULL, NULL));
+   }
+}
+
+/*
+   Function: test_http_requests
+   Purpose : Parses each payload of the HTTP table.
+   Input   : None.
+   Output  : None.
+*/
+void test_http_requests()
+{
+   pv_http_case_t *c;
+   pv_http_request_t request;
+   uint8_t *payload;
+   uint32_t len;
+   int res;
+
+   for (c = http_cases; c->name != NULL; c++)
+   {
+      /* A copy the size of the payload, so reading past it shows up under a memory checker. */
+      len = (c->length > 0) ? c->length : strlen(c->payload);
+      payload = xmalloc(len + 1);
+      memcpy(payload, c->payload, len);
+      res = parse_http_request(payload, len, &request);
+      if ((check_int("http", c->name, "result", c->result, res) == 0) && (res == 1))
+      {
+         check_string("http", c->name, "method", c->method, (char *)request.method, request.method_length);
+         check_string("http", c->name, "path", c->path, (char *)request.path, request.path_length);
+         check_string("http", c->name, "host", c->host, (char *)request.host, request.host_length);
+      }
+      free(payload);
+   }
+}
+
+/*
+   Function: test_client_hellos
+   Purpose : Parses each ClientHello of the TLS table.
+   Input   : None.
+   Output  : None.
+*/
+void test_client_hellos()
+{
+   pv_tls_case_t *c;
+   pv_tls_info_t tls;
+   uint8_t hello[PV_TEST_MAX_PACKET];
+   uint8_t *payload;
+   uint32_t len;
+   int res, i, ja3;
+
+   for (c = tls_cases; c->name != NULL; c++)
+   {
+      len = parse_hex(CLIENT_HELLO, hello, PV_TEST_MAX_PACKET);
+      if (c->patch_offset >= 0)
+      {
+         parse_hex(c->patch, hello + c->patch_offset, PV_TEST_MAX_PACKET - c->patch_offset);
+      }
+      if (c->length >= 0)
+      {
+         len = c->length;
+      }
+      payload = xmalloc(len + 1);
+      memcpy(payload, hello, len);
+      res = parse_client_hello(payload, len, &tls);
+      if ((check_int("tls", c->name, "result", c->result, res) == 0) && (res == 1))
+      {
+         check_int("tls", c->name, "version", 0x0303, tls.version);
+         check_int("tls", c->name, "complete", c->complete, tls.complete);
+         check_string("tls", c->name, "sni", c->sni, tls.sni, -1);
+         check_string("tls", c->name, "alpn", c->alpn, tls.alpn, -1);
+         for (i = 0, ja3 = 0; i < 16; i++)
+         {
+            ja3 |= tls.ja3[i];
+         }
+         check_int("tls", c->name, "ja3 set", c->complete, ja3 != 0);
+      }
+      free(payload);
+   }
+}
+
+/*
+   Function: collect_stream
+   Purpose : Stream consumer that appends the reassembled data to the test
+             stream buffer.
+   Input   : Worker, flow record, packet event, data, length.
+   Output  : None.
+*/
+void collect_stream(pv_worker_t *worker, pv_flow_record_t *flow, pv_packet_event_t *event, uint8_t *data, uint32_t len)
+{
+   if (test_stream_length + len > PV_TEST_STREAM_MAX - 1)
+   {
+      len = PV_TEST_STREAM_MAX - 1 - test_stream_length;
+   }
+   memcpy(test_stream + test_stream_length, data, len);
+   test_stream_length += len;
+   test_stream[test_stream_length] = 0;
+}
+
+/*
+   Function: test_reassembly
+   Purpose : Passes the segments of each reassembly table row to a stream
+             of its own, with an 8 byte depth, and checks the stream data
+             and counters.
+   Input   : None.
+   Output  : None.
+*/
+void test_reassembly()
+{
+   pv_reasm_case_t *c;
+   pv_test_segment_t *s;
+   pv_worker_t *worker;
+   pv_flow_record_t *records;
+   pv_reasm_t reasm;
+   pv_packet_event_t event;
+   uint32_t count;
+
+   for (count = 0; reasm_cases[count].name != NULL; count++)
+      ;
+   worker = xcalloc(sizeof(pv_worker_t));
+   records = xcalloc(count * sizeof(pv_flow_record_t));
+   worker->flow_table.records = records;
+   worker->reasm = &reasm;
+   init_reasm(&reasm, count, 0, 8);
+   add_stream_consumer(&reasm, collect_stream, 1);
+
+   for (c = reasm_cases; c->name != NULL; c++)
+   {
+      test_stream_length = 0;
+      test_stream[0] = 0;
+      reasm.out_of_order = 0;
+      reasm.duplicates = 0;
+      reasm.gaps = 0;
+      for (s = c->segments; s->data != NULL; s++)
+      {
+         memset(&event, 0, sizeof(pv_packet_event_t));
+         event.key.protocol = IPPROTO_TCP;
+         event.tcp_seq = c->isn + s->seq;
+         event.tcp_flags = s->flags;
+         event.desc.payload_length = strlen(s->data);
+         reassemble_tcp(worker, &records[c - reasm_cases], &event, (uint8_t *)s->data);
+      }
+      check_string("reassembly", c->name, "stream", c->stream, test_stream, -1);
+      check_int("reassembly", c->name, "out_of_order", c->out_of_order, reasm.out_of_order);
+      check_int("reassembly", c->name, "duplicates", c->duplicates, reasm.duplicates);
+      check_int("reassembly", c->name, "gaps", c->gaps, reasm.gaps);
+      check_int("reassembly", c->name, "done", c->done, (records[c - reasm_cases].flags & PV_FLOW_REASM_DONE) != 0);
+   }
+   /* Every held block went back to the pool. */
+   check_int("reassembly", "pool", "free blocks", reasm.block_count, reasm.free_count);
+
+   free_reasm(&reasm);
+   free(records);
+   free(worker);
+}
+
+/*
+   Function: test_ioc_matcher
+   Purpose : Checks the pattern file syntax, then scans each payload of the
+             IOC table and counts the hits of each pattern.
+   Input   : Temporary file name template.
+   Output  : None.
+*/
+void test_ioc_matcher(char *file_template)
+{
+   pv_ioc_parse_case_t *p;
+   pv_ioc_case_t *c;
+   pv_worker_t *worker;
+   pv_packet_event_t event;
+   uint8_t pattern[PV_IOC_MAX_PATTERN];
+   uint8_t expected[PV_IOC_MAX_PATTERN];
+   char text[PV_MAX_INPUT_STR];
+   char file_name[PV_PATH_MAX_LENGTH];
+   uint32_t s, i;
+   int fd, length;
+
+   for (p = ioc_parse_cases; p->text != NULL; p++)
+   {
+      strncpy(text, p->text, PV_MAX_INPUT_STR - 1);
+      length = parse_ioc_pattern(text, pattern);
+      if ((check_int("ioc pattern", p->text, "length", p->length, length) == 0) && (length > 0))
+      {
+         parse_hex(p->pattern, expected, PV_IOC_MAX_PATTERN);
+         check_int("ioc pattern", p->text, "bytes", 0, memcmp(pattern, expected, length) != 0);
+      }
+   }
+
+   strncpy(file_name, file_template, PV_PATH_MAX_LENGTH - 1);
+   if (((fd = mkstemp(file_name)) < 0) || (write(fd, ioc_file_text, strlen(ioc_file_text)) < 0))
+   {
+      printf("FAIL ioc: could not write the pattern file %s\n", file_name);
+      test_failures++;
+      return;
+   }
+   close(fd);
+   length = load_ioc_patterns(&ioc_matcher, file_name);
+   unlink(file_name);
+   if ((check_int("ioc", "pattern file", "result", 0, length) < 0)
+       || (check_int("ioc", "pattern file", "patterns", PV_TEST_IOC_PATTERNS, ioc_matcher.pattern_count) < 0))
+   {
+      return;
+   }
+
+   worker = xcalloc(sizeof(pv_worker_t));
+   memset(&event, 0, sizeof(pv_packet_event_t));
+   for (c = ioc_cases; c->name != NULL; c++)
+   {
+      for (i = 0; i < PV_TEST_IOC_PATTERNS; i++)
+      {
+         ioc_matcher.patterns[i].hits = 0;
+      }
+      s = scan_iocs(worker, NULL, &event, 0, (uint8_t *)c->first, (c->first_length > 0) ? c->first_length : strlen(c->first));
+      scan_iocs(worker, NULL, &event, s, (uint8_t *)c->second, strlen(c->second));
+      for (i = 0; i < PV_TEST_IOC_PATTERNS; i++)
+      {
+         sprintf(text, "hits of pattern %u", i);
+         check_int("ioc", c->name, text, c->hits[i], ioc_matcher.patterns[i].hits);
+      }
+   }
+
+   free(worker);
+   free_ioc_matcher(&ioc_matcher);
+}
+
+/*
+   Function: test_blocklist
+   Purpose : Checks the prefix syntax, then builds a table from two
+             blocklist files and looks up the addresses either side of
+             the prefix boundaries.
+   Input   : Temporary file name template.
+   Output  : None.
+*/
+void test_blocklist(char *file_template)
+{
+   pv_prefix_case_t *p;
+   pv_lookup_case_t *c;
+   pv_lpm_rule_t rule;
+   pv_lpm_rule_t *match;
+   pv_lpm_table_t *table;
+   char files[2][PV_PATH_MAX_LENGTH];
+   char text[PV_MAX_INPUT_STR];
+   uint8_t addr[16];
+   uint8_t family;
+   int fd, i, res;
+
+   for (p = prefix_cases; p->text != NULL; p++)
+   {
+      strncpy(text, p->text, PV_MAX_INPUT_STR - 1);
+      res = parse_prefix(text, &rule);
+      if ((check_int("prefix", p->text, "result", p->result, res) < 0) || (res < 0))
+      {
+         continue;
+      }
+      family = (strchr(p->addr, ':') != NULL) ? PV_FLOW_IPV6 : PV_FLOW_IPV4;
+      memset(addr, 0, 16);
+      inet_pton((family == PV_FLOW_IPV6) ? AF_INET6 : AF_INET, p->addr, addr);
+      check_int("prefix", p->text, "family", family, rule.family);
+      check_int("prefix", p->text, "length", p->length, rule.length);
+      check_int("prefix", p->text, "address", 0, memcmp(addr, rule.addr, 16) != 0);
+   }
+
+   strcpy(files[0], "/nonexistent/pvtest.txt");
+   check_int("blocklist", "missing file", "table", 0, build_lpm_table(files, 1) != NULL);
+
+   for (i = 0; i < 2; i++)
+   {
+      strncpy(files[i], file_template, PV_PATH_MAX_LENGTH - 1);
+      if (((fd = mkstemp(files[i])) < 0) || (write(fd, lpm_file_text[i], strlen(lpm_file_text[i])) < 0))
+      {
+         printf("FAIL blocklist: could not write the blocklist file %s\n", files[i]);
+         test_failures++;
+         return;
+      }
+      close(fd);
+   }
+   table = build_lpm_table(files, 2);
+   unlink(files[0]);
+   unlink(files[1]);
+   if (table == NULL)
+   {
+      printf("FAIL blocklist: could not build the table\n");
+      test_failures++;
+      return;
+   }
+   check_int("blocklist", "table", "rules", 24, table->header->rule_count);
+   check_int("blocklist", "table", "check", 0, check_lpm_table(table));
+
+   for (c = lookup_cases; c->addr != NULL; c++)
+   {
+      family = (strchr(c->addr, ':') != NULL) ? PV_FLOW_IPV6 : PV_FLOW_IPV4;
+      memset(addr, 0, 16);
+      inet_pton((family == PV_FLOW_IPV6) ? AF_INET6 : AF_INET, c->addr, addr);
+      match = lookup_prefix(table, family, addr);
+      if ((check_int("blocklist", c->addr, "length", c->length, (match != NULL) ? match->length : -1) == 0) && (match != NULL))
+      {
+         check_int("blocklist", c->addr, "list", c->list, match->list);
+         check_int("blocklist", c->addr, "family", family, match->family);
+      }
+   }
+
+   free_lpm_table(table);
+}
+
+int main(int argc, char *argv[])
+{
+   if (open_log_file(argv[0]) < 0)
+   {
+      return(1);
+   }
+
+   test_decoder();
+   test_dns_names();
+   test_http_requests();
+   test_client_hellos();
+   test_reassembly();
+   test_ioc_matcher("/tmp/pvtest-iocXXXXXX");
+   test_blocklist("/tmp/pvtest-listXXXXXX");
+
+   printf("pvtest: %d checks, %d failed.\n", test_checks, test_failures);
+   close_log_file();
+
+   return((test_failures > 0) ? 1 : 0);
+}
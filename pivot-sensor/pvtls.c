@@ -0,0 +1,398 @@
+/*  Copyright 2014 Derek Chadwick
+
+    This file is part of the Pivotal Network Security Tools.
+
+    Pivotal is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Pivotal is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Pivotal.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+   pvtls.c
+
+   Title : Pivotal NST Sensor TLS ClientHello Inspection
+   Author: Derek Chadwick
+   Date  : 17/10/2026
+
+   Purpose: Extracts the server name (SNI), the first ALPN protocol and a
+            JA3 fingerprint from TLS ClientHello messages (-e option).
+
+            Only the first TCP payload packet of a flow is inspected, the
+            flow record is marked so established flows cost one flag test.
+            The results are kept in a per worker array indexed like the
+            flow record pool, so the flow records stay two cache lines, and
+            are added to the flow record output when the flow is exported:
+
+            ... Reason:idle TLS:0x0303 SNI:www.example.com ALPN:h2 JA3:cd08e31494f9531f560d64c695473da9
+
+            The JA3 fingerprint is the MD5 of "version,ciphers,extensions,
+            groups,point formats" with GREASE values left out. The fields
+            are fed to the hash as they are parsed, nothing but the SNI and
+            ALPN strings is copied, each bounded to its field. A ClientHello
+            cut off by the segment or the snaplen still gives the SNI and
+            ALPN if they were in the captured part, but no fingerprint.
+
+   Status : EXPERIMENTAL - not for use in production networks.
+
+*/
+
+#include "pvcommon.h"
+#include "pivot-sensor.h"
+
+static const uint32_t md5_sines[64] = {
+   0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+   0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+   0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+   0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+   0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+   0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+   0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+   0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391 };
+
+static const uint8_t md5_shifts[16] = { 7, 12, 17, 22, 5, 9, 14, 20, 4, 11, 16, 23, 6, 10, 15, 21 };
+
+/*
+   Function: md5_transform
+   Purpose : MD5 compression of one 64 byte block, RFC 1321.
+   Input   : Hash state, block.
+   Output  : None.
+*/
+void md5_transform(uint32_t *state, const uint8_t *block)
+{
+   uint32_t m[16];
+   uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+   uint32_t f, t;
+   int i, g;
+
+   for (i = 0; i < 16; i++)
+   {
+      m[i] = block[i * 4] | (block[i * 4 + 1] << 8) | (block[i * 4 + 2] << 16) | ((uint32_t)block[i * 4 + 3] << 24);
+   }
+   for (i = 0; i < 64; i++)
+   {
+      switch (i >> 4)
+      {
+      case 0:  f = (b & c) | (~b & d); g = i; break;
+      case 1:  f = (d & b) | (~d & c); g = (5 * i + 1) & 15; break;
+      case 2:  f = b ^ c ^ d;          g = (3 * i + 5) & 15; break;
+      default: f = c ^ (b | ~d);       g = (7 * i) & 15; break;
+      }
+      t = a + f + md5_sines[i] + m[g];
+      a = d;
+      d = c;
+      c = b;
+      b += (t << md5_shifts[((i >> 4) << 2) | (i & 3)]) | (t >> (32 - md5_shifts[((i >> 4) << 2) | (i & 3)]));
+   }
+   state[0] += a;
+   state[1] += b;
+   state[2] += c;
+   state[3] += d;
+}
+
+/*
+   Function: md5_init
+   Purpose : Starts an MD5 hash.
+   Input   : Hash.
+   Output  : None.
+*/
+void md5_init(pv_md5_t *md5)
+{
+   md5->state[0] = 0x67452301;
+   md5->state[1] = 0xefcdab89;
+   md5->state[2] = 0x98badcfe;
+   md5->state[3] = 0x10325476;
+   md5->length = 0;
+}
+
+/*
+   Function: md5_update
+   Purpose : Adds data to an MD5 hash.
+   Input   : Hash, data and length.
+   Output  : None.
+*/
+void md5_update(pv_md5_t *md5, const uint8_t *data, uint32_t len)
+{
+   uint32_t used = md5->length & 63;
+   uint32_t n;
+
+   md5->length += len;
+   while (len > 0)
+   {
+      n = (len < 64 - used) ? len : 64 - used;
+      memcpy(md5->block + used, data, n);
+      used += n;
+      data += n;
+      len -= n;
+      if (used == 64)
+      {
+         md5_transform(md5->state, md5->block);
+         used = 0;
+      }
+   }
+}
+
+/*
+   Function: md5_final
+   Purpose : Pads an MD5 hash and writes the digest.
+   Input   : Hash, 16 byte digest (output).
+   Output  : None.
+*/
+void md5_final(pv_md5_t *md5, uint8_t *digest)
+{
+   uint64_t bits = md5->length * 8;
+   uint8_t pad[72];
+   uint32_t n = 64 - ((md5->length + 8) & 63);
+   int i;
+
+   memset(pad, 0, sizeof(pad));
+   pad[0] = 0x80;
+   for (i = 0; i < 8; i++)
+   {
+      pad[n + i] = (uint8_t)(bits >> (8 * i));
+   }
+   md5_update(md5, pad, n + 8);
+   for (i = 0; i < 16; i++)
+   {
+      digest[i] = (uint8_t)(md5->state[i >> 2] >> (8 * (i & 3)));
+   }
+}
+
+/*
+   Function: hash_ja3_list
+   Purpose : Adds a JA3 field to the fingerprint, the decimal values
+             separated by dashes. GREASE values are left out.
+   Input   : Hash state, big endian values, number of values, value width
+             in bytes (1 or 2).
+   Output  : None.
+*/
+void hash_ja3_list(pv_md5_t *md5, const uint8_t *list, uint32_t count, int width)
+{
+   char number[8];
+   uint32_t i, value;
+   int n, first = 1;
+
+   for (i = 0; i < count; i++)
+   {
+      value = (width == 2) ? ((list[i * 2] << 8) | list[i * 2 + 1]) : list[i];
+      if ((width == 2) && PV_TLS_GREASE(value))
+      {
+         continue;
+      }
+      n = sprintf(number, first ? "%u" : "-%u", value);
+      md5_update(md5, (uint8_t *)number, n);
+      first = 0;
+   }
+}
+
+/*
+   Function: copy_tls_string
+   Purpose : Copies a name out of the ClientHello, lower cased and cut to
+             the field size. The names go into the flow records sent to
+             the server, so for a host name the bytes outside the host name
+             characters become '?', and for a protocol name markup
+             characters and bytes that are not printable become '?'.
+   Input   : Field, field size, name, name length, host name flag.
+   Output  : None.
+*/
+void copy_tls_string(char *out, uint32_t size, const uint8_t *name, uint32_t len, int host)
+{
+   uint32_t i;
+   uint8_t c;
+
+   for (i = 0; (i < len) && (i < size - 1); i++)
+   {
+      c = ((name[i] >= 'A') && (name[i] <= 'Z')) ? (name[i] | 0x20) : name[i];
+      if (host)
+      {
+         out[i] = (((c >= 'a') && (c <= 'z')) || ((c >= '0') && (c <= '9')) || (c == '-') || (c == '.') || (c == '_')) ? c : '?';
+      }
+      else
+      {
+         out[i] = PV_TEXT_CHAR(c) ? c : '?';
+      }
+   }
+   out[i] = 0;
+}
+
+/*
+   Function: parse_client_hello
+   Purpose : Parses a TLS ClientHello at the start of a payload.
+   Input   : Payload, payload length, TLS information to fill in.
+   Output  : Returns 1 if the payload starts with a ClientHello, otherwise 0.
+             The fingerprint is only set, and complete is 1, when the whole
+             ClientHello was in the payload.
+*/
+int parse_client_hello(const uint8_t *data, uint32_t len, pv_tls_info_t *tls)
+{
+   const uint8_t *end, *p, *ciphers, *extensions, *ext, *groups = NULL, *formats = NULL;
+   uint32_t cipher_length, extensions_length, type, length, group_count = 0, format_count = 0;
+   pv_md5_t md5;
+   char number[8];
+   int first = 1;
+
+   /* Record header and handshake header. */
+   if ((len < PV_TLS_MIN_HELLO) || (data[0] != PV_TLS_HANDSHAKE) || (data[1] != 3) || (data[5] != PV_TLS_CLIENT_HELLO))
+   {
+      return(0);
+   }
+   memset(tls, 0, sizeof(pv_tls_info_t));
+   tls->version = (data[9] << 8) | data[10];
+   end = data + len;
+   if (((data[6] << 16) | (data[7] << 8) | data[8]) + 9 <= len)
+   {
+      end = data + ((data[6] << 16) | (data[7] << 8) | data[8]) + 9;
+   }
+
+   /* Random, session ID, cipher suites and compression methods. */
+   p = data + 11 + 32;
+   if ((p >= end) || (p + 1 + *p + 2 > end))
+   {
+      return(1);
+   }
+   p += 1 + *p;
+   cipher_length = (p[0] << 8) | p[1];
+   ciphers = p + 2;
+   p = ciphers + cipher_length;
+   if ((p >= end) || (p + 1 + *p + 2 > end))
+   {
+      return(1);
+   }
+   p += 1 + *p;
+   extensions_length = (p[0] << 8) | p[1];
+   extensions = p + 2;
+   if (extensions + extensions_length <= end)
+   {
+      end = extensions + extensions_length;
+      tls->complete = 1;
+   }
+
+   md5_init(&md5);
+   md5_update(&md5, (uint8_t *)number, sprintf(number, "%u,", tls->version));
+   hash_ja3_list(&md5, ciphers, cipher_length / 2, 2);
+   md5_update(&md5, (uint8_t *)",", 1);
+
+   for (ext = extensions; ext + 4 <= end; ext += 4 + length)
+   {
+      type = (ext[0] << 8) | ext[1];
+      length = (ext[2] << 8) | ext[3];
+      if (ext + 4 + length > end)
+      {
+         tls->complete = 0;
+         break;
+      }
+      if (!PV_TLS_GREASE(type))
+      {
+         md5_update(&md5, (uint8_t *)number, sprintf(number, first ? "%u" : "-%u", type));
+         first = 0;
+      }
+      p = ext + 4;
+      switch (type)
+      {
+      case PV_TLS_EXT_SNI:
+         /* Server name list, the first entry is a host name. */
+         if ((length >= 5) && (p[2] == 0) && (5 + ((p[3] << 8) | p[4]) <= length))
+         {
+            copy_tls_string(tls->sni, PV_TLS_SNI_MAX, p + 5, (p[3] << 8) | p[4], 1);
+         }
+         break;
+      case PV_TLS_EXT_ALPN:
+         if ((length >= 3) && (3 + p[2] <= length))
+         {
+            copy_tls_string(tls->alpn, PV_TLS_ALPN_MAX, p + 3, p[2], 0);
+         }
+         break;
+      case PV_TLS_EXT_GROUPS:
+         if ((length >= 2) && (2 + ((p[0] << 8) | p[1]) <= length))
+         {
+            groups = p + 2;
+            group_count = ((p[0] << 8) | p[1]) / 2;
+         }
+         break;
+      case PV_TLS_EXT_POINT_FORMATS:
+         if ((length >= 1) && (1 + p[0] <= length))
+         {
+            formats = p + 1;
+            format_count = p[0];
+         }
+         break;
+      }
+   }
+
+   if (tls->complete)
+   {
+      md5_update(&md5, (uint8_t *)",", 1);
+      hash_ja3_list(&md5, groups, group_count, 2);
+      md5_update(&md5, (uint8_t *)",", 1);
+      hash_ja3_list(&md5, formats, format_count, 1);
+      md5_final(&md5, tls->ja3);
+   }
+
+   return(1);
+}
+
+/*
+   Function: inspect_tls
+   Purpose : Inspects the first payload packet of a TCP flow for a
+             ClientHello. The flow is marked so it is not inspected again.
+   Input   : Worker, flow record, payload, payload length.
+   Output  : None.
+*/
+void inspect_tls(pv_worker_t *worker, pv_flow_record_t *flow, uint8_t *payload, uint32_t len)
+{
+   pv_tls_info_t *tls = &worker->tls[flow - worker->flow_table.records];
+
+   flow->flags |= PV_FLOW_TLS_INSPECTED;
+   if (parse_client_hello(payload, len, tls))
+   {
+      flow->flags |= PV_FLOW_TLS;
+      worker->tls_hellos++;
+      if (!tls->complete)
+      {
+         worker->tls_truncated++;
+      }
+   }
+}
+
+/*
+   Function: format_tls_info
+   Purpose : Renders the TLS information of a flow for the flow record.
+   Input   : TLS information, output string and length.
+   Output  : Number of characters written.
+*/
+int format_tls_info(pv_tls_info_t *tls, char *out, int len)
+{
+   int n, i;
+
+   n = snprintf(out, len, " TLS:0x%04x SNI:%s ALPN:%s JA3:", tls->version, (tls->sni[0] != 0) ? tls->sni : "-",
+                (tls->alpn[0] != 0) ? tls->alpn : "-");
+   if (!tls->complete)
+   {
+      return(n + snprintf(out + n, len - n, "-"));
+   }
+   for (i = 0; (i < 16) && (n < len); i++)
+   {
+      n += snprintf(out + n, len - n, "%02x", tls->ja3[i]);
+   }
+
+   return(n);
+}
+
+/*
+   Function: print_tls_stats
+   Purpose : Prints the TLS counters of a worker.
+   Input   : Worker ID, worker.
+   Output  : None.
+*/
+void print_tls_stats(int worker_id, pv_worker_t *worker)
+{
+   printf("Worker %d TLS: %lu ClientHellos, %lu without a fingerprint\n", worker_id, worker->tls_hellos, worker->tls_truncated);
+}
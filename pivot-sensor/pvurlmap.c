@@ -1,4 +1,3 @@
-
 /*  Copyright 2014 Derek Chadwick
 
     This file is part of the Pivotal Network Security Tools.
@@ -24,92 +23,107 @@
    Author: Derek Chadwick
    Date  : 06/07/2014
 
-   Purpose: A hashmap wrapper for uthash, used to store URLs extracted from
-            packet captures and various statistics for each URL.
+   Purpose: Stores the URLs extracted from packet captures, see pvhttp.c,
+            and a request count for each URL.
+
+            The URLs are interned in a string map shared by the capture
+            workers, see pvstrmap.c, and the string count of each URL is
+            its requests. When the map is full new URLs are counted as not
+            stored.
+
+            Every statistics report (-U option) the URLs with the most
+            requests in the interval are written to the statistics file and
+            sent to the server as a <control>urls message.
 
 */
 
 #include "pvcommon.h"
 #include "pivot-sensor.h"
 
-pv_url_record_t *url_map = NULL; /* the hash map head record */
+pv_string_map_t url_table;
 
-void add_url(pv_url_record_t *flurl)
+/*
+   Function: init_url_map
+   Purpose : Allocates the URL string map.
+   Input   : Number of URLs, arena size in bytes.
+   Output  : Returns 0.
+*/
+int init_url_map(uint32_t capacity, uint32_t arena_size)
 {
-    pv_url_record_t *s;
-
-    HASH_FIND_STR(url_map, flurl->url_record_string , s);  /* id already in the hash? */
-    if (s == NULL)
-    {
-      HASH_ADD_STR(url_map, url_record_string, flurl);  /* id: name of key field */
-    }
-
+   return(init_string_map(&url_table, capacity, arena_size, sizeof(pv_string_record_t), NULL));
 }
 
-pv_url_record_t *find_url(char *lookup_string)
+/*
+   Function: add_url
+   Purpose : Counts a request for a URL, adding the URL to the map if it
+             is new.
+   Input   : URL, length, request time in seconds.
+   Output  : Record or NULL if the URL is new and the map is full.
+*/
+pv_string_record_t *add_url(char *url, uint32_t length, uint32_t now)
 {
-    pv_url_record_t *s;
+   pv_string_record_t *record;
 
-    HASH_FIND_STR(url_map, lookup_string, s);  /* s: output pointer */
-    return s;
-}
+   if ((record = add_string(&url_table, url, length, now)) != NULL)
+   {
+      __atomic_fetch_add(&record->count, 1, __ATOMIC_RELAXED);
+   }
 
-pv_url_record_t *get_first_url_record()
-{
-   return(url_map);
+   return(record);
 }
 
-pv_url_record_t *get_last_url_record()
+/*
+   Function: format_url_map
+   Purpose : Renders a top URL list, URLs too long for a line are cut.
+   Input   : Top list, entries, output string and length.
+   Output  : Number of characters written.
+*/
+int format_url_map(pv_string_top_t *top, int count, char *out, int len)
 {
-   pv_url_record_t *s = get_first_url_record();
-   if (s != NULL)
-      return((pv_url_record_t *)s->hh.prev);
-   return(NULL);
-}
+   int n, i;
 
-void delete_url(pv_url_record_t *url_record)
-{
-    HASH_DEL(url_map, url_record);  /* event: pointer to deletee */
-    free(url_record);
+   n = snprintf(out, len, "Top URLs: %u stored %u bytes %lu not stored\n%12s %12s  %s\n",
+                url_table.count, url_table.arena_used, url_table.not_stored, "requests", "total", "URL");
+   for (i = 0; (i < count) && (len - n > PV_URL_LINE_MAX + 32); i++)
+   {
+      n += snprintf(out + n, len - n, "%12lu %12lu  %.*s\n", (unsigned long)top[i].count, (unsigned long)top[i].record->count,
+                    PV_URL_LINE_MAX, get_map_string(&url_table, top[i].record));
+   }
+
+   return(n);
 }
 
-void delete_all_urls()
+void write_url_map(FILE *outfile, pv_string_top_t *top, int count)
 {
-  pv_url_record_t *current_url, *tmp;
+   char report[PV_STATS_REPORT_MAX];
 
-  HASH_ITER(hh, url_map, current_url, tmp)
-  {
-    HASH_DEL(url_map,current_url);  /* delete it (url_map advances to next) */
-    free(current_url);              /* free it */
-  }
+   format_url_map(top, count, report, PV_STATS_REPORT_MAX);
+   fputs(report, outfile);
 }
 
-void write_url_map(FILE *outfile)
+void send_url_map(pv_string_top_t *top, int count, time_t now)
 {
-    pv_url_record_t *s;
+   char report[PV_STATS_REPORT_MAX];
 
-    for(s=url_map; s != NULL; s=(pv_url_record_t *)(s->hh.next))
-    {
-        fputs(s->url_record_string, outfile);
-    }
+   format_url_map(top, count, report, PV_STATS_REPORT_MAX);
+   send_control_report("urls", report, now);
 }
 
-void send_url_map(int sock_desc)
+/*
+   Function: print_url_map
+   Purpose : Prints the URLs with the most requests since capture started.
+   Input   : Number of URLs to print.
+   Output  : None.
+*/
+void print_url_map(unsigned int k)
 {
-    pv_url_record_t *s;
+   pv_string_top_t *top = xmalloc(k * sizeof(pv_string_top_t));
 
-    for(s=url_map; s != NULL; s=(pv_url_record_t *)(s->hh.next))    {
-        send_event(sock_desc, s->url_record_string);
-    }
+   write_url_map(stdout, top, select_top_strings(&url_table, top, k, 0));
+   free(top);
 }
 
-void print_url_map()
+void delete_all_urls()
 {
-    pv_url_record_t *s;
-
-    for(s=url_map; s != NULL; s=(pv_url_record_t *)(s->hh.next))
-    {
-        printf("URL: %s\n", s->url_record_string);
-    }
+   delete_string_map(&url_table);
 }
-
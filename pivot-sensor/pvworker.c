@@ -0,0 +1,506 @@
+/*  Copyright 2014 Derek Chadwick
+
+    This file is part of the Pivotal Network Security Tools.
+
+    Pivotal is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Pivotal is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Pivotal.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+   pvworker.c
+
+   Title : Pivotal NST Sensor Capture Workers
+   Author: Derek Chadwick
+   Date  : 17/10/2026
+
+   Purpose: Runs packet capture on N worker threads (-W option). Each worker
+            opens its own capture socket, libpcap or TPACKET_V3 ring, and
+            when there is more than one worker the sockets are joined to a
+            PACKET_FANOUT hash group so the kernel spreads flows across the
+            workers, with both directions of a flow going to the same worker.
+
+            Each worker owns a private flow table shard and a private event
+            file output buffer, so the packet processing path does not share
+            any writable state between threads. The shards are merged into
+            the global IP map by terminate_capture().
+
+   Status : EXPERIMENTAL - not for use in production networks.
+
+*/
+
+#include <pthread.h>
+#include <time.h>
+
+#include "pvcommon.h"
+#include "pivot-sensor.h"
+
+pv_worker_t *workers = NULL;
+int worker_count = 0;
+
+extern int options;
+
+/*
+   Function: open_worker_socket
+   Purpose : Opens the worker capture socket and joins the fanout group.
+   Input   : Worker, interface, filter string, capture configuration, fanout id.
+   Output  : Returns -1 on error, 0 on success.
+*/
+int open_worker_socket(pv_worker_t *worker, char *interface, const char *bpf_string, pv_capture_config_t *config, int fanout_id)
+{
+   int sockfd;
+
+   if (options & PV_RING_CAPTURE)
+   {
+      if (open_ring_socket(&worker->ring, interface, bpf_string, config) < 0)
+      {
+         return(-1);
+      }
+      worker->link_type = worker->ring.link_type;
+      sockfd = worker->ring.sockfd;
+   }
+   else
+   {
+      if ((worker->pcap_device = open_pcap_socket(interface, bpf_string, config)) == NULL)
+      {
+         return(-1);
+      }
+      worker->link_type = pcap_datalink(worker->pcap_device);
+      sockfd = pcap_fileno(worker->pcap_device);
+   }
+   bpf_filter.link_type = worker->link_type;
+
+   if (worker_count > 1)
+   {
+      return(join_fanout_group(sockfd, fanout_id));
+   }
+
+   return(0);
+}
+
+/*
+   Function: capture_worker
+   Purpose : Worker thread main loop, reads batches of packets from the
+             worker socket until capture is stopped. When the output stage
+             runs inline buffered events are flushed after each second of
+             quiet time, otherwise the output thread does this. The kernel
+             packet counters are sampled every second for the statistics
+             reports. A replaced capture filter is set, and a blocklist
+             reload acknowledged, between reads.
+   Input   : Worker.
+   Output  : Returns NULL.
+*/
+void *capture_worker(void *arg)
+{
+   pv_worker_t *worker = (pv_worker_t *)arg;
+   unsigned int generation;
+   int res;
+
+   while (capture_running)
+   {
+      if (options & PV_RING_CAPTURE)
+      {
+         res = ring_dispatch(&worker->ring, (pcap_handler)process_packet, (u_char *)worker);
+      }
+      else
+      {
+         res = pcap_dispatch(worker->pcap_device, -1, (pcap_handler)process_packet, (u_char *)worker);
+      }
+
+      if (res < 0)
+      {
+         if (res != PCAP_ERROR_BREAK)
+         {
+            iprint_log_entry("capture_worker() <ERROR> Capture failed on worker", worker->worker_id);
+         }
+         break;
+      }
+
+      if (worker->filter_generation != __atomic_load_n(&bpf_filter.generation, __ATOMIC_ACQUIRE))
+      {
+         set_worker_filter(worker);
+      }
+      /* No blocklist lookup is in progress between reads, the tables a reload replaced can be freed. */
+      generation = __atomic_load_n(&blocklist.generation, __ATOMIC_ACQUIRE);
+      if (worker->blocklist_generation != generation)
+      {
+         __atomic_store_n(&worker->blocklist_generation, generation, __ATOMIC_RELEASE);
+      }
+
+      /* Flows still time out when no packets are arriving. */
+      update_flow_timers(worker, (uint32_t)time(NULL));
+      update_flow_exports(worker, (uint32_t)time(NULL));
+
+      if (time(NULL) >= worker->next_kernel_stats)
+      {
+         update_capture_stats(worker);
+      }
+
+      if (!worker->output.running && (worker->output.out_length > 0) && (time(NULL) - worker->output.last_flush >= PV_WORKER_FLUSH_INTERVAL))
+      {
+         flush_output(&worker->output);
+      }
+   }
+
+   stop_output(&worker->output);
+   update_capture_stats(worker);
+   worker->finished = 1;
+
+   return(NULL);
+}
+
+/*
+   Function: init_worker_state
+   Purpose : Sets up the flow table shard, timer wheel and the state of
+             each enabled analysis for a capture or replay worker. Alert
+             thresholds and the reassembly memory are shared out between
+             the workers, each worker sees only its share of the flows.
+   Input   : Worker, capture configuration, number of workers.
+   Output  : None.
+*/
+void init_worker_state(pv_worker_t *worker, pv_capture_config_t *config, int count)
+{
+   worker->ring.sockfd = -1;
+   worker->payload_packets = config->payload_packets;
+   worker->payload_bytes = config->payload_bytes;
+   init_flow_table(&worker->flow_table, config->flow_capacity);
+   init_timer_wheel(&worker->wheel, config->idle_timeout, config->active_timeout);
+   init_flow_stats(worker, config);
+   if (config->heavy_topk > 0)
+   {
+      worker->heavy = xmalloc(sizeof(pv_heavy_t));
+      init_heavy_hitters(worker->heavy, config->heavy_topk);
+   }
+   if (config->fanout_threshold > 0)
+   {
+      worker->fanout = xmalloc(PV_FANOUT_TYPES * sizeof(pv_fanout_t));
+      init_fanout(&worker->fanout[PV_FANOUT_OUT], config->fanout_hosts, (config->fanout_threshold + count - 1) / count, config->fanout_window);
+      init_fanout(&worker->fanout[PV_FANOUT_IN], config->fanout_hosts, (config->fanout_threshold + count - 1) / count, config->fanout_window);
+   }
+   if ((config->scan_ports > 0) || (config->scan_syns > 0))
+   {
+      worker->scan = xmalloc(sizeof(pv_scan_t));
+      init_scan(worker->scan, config->fanout_hosts, (config->scan_ports + count - 1) / count,
+                (config->scan_syns + count - 1) / count, config->fanout_window);
+   }
+   if (config->tls_inspect)
+   {
+      worker->tls = xmalloc(config->flow_capacity * sizeof(pv_tls_info_t));
+   }
+   if (config->reasm_memory > 0)
+   {
+      worker->reasm = xmalloc(sizeof(pv_reasm_t));
+      init_reasm(worker->reasm, config->flow_capacity, ((uint64_t)config->reasm_memory << 20) / count, config->reasm_depth << 10);
+      init_stream_consumers(worker->reasm);
+   }
+   if (ioc_matcher.states != NULL)
+   {
+      worker->ioc = xmalloc(config->flow_capacity * sizeof(pv_ioc_flow_t));
+   }
+}
+
+/*
+   Function: start_workers
+   Purpose : Opens a capture socket for each worker then starts the worker
+             threads. Termination signals are blocked in the worker threads
+             so they are always delivered to the main thread. If a worker
+             cannot be started the pool is stopped and freed.
+   Input   : Interface, filter string, capture configuration.
+   Output  : Returns -1 on error, 0 on success.
+*/
+int start_workers(char *interface, const char *bpf_string, pv_capture_config_t *config)
+{
+   sigset_t sigmask, oldmask;
+   int fanout_id = getpid() & 0xffff;
+   int i;
+
+   worker_count = config->worker_count;
+   workers = xmemalign(PV_CACHE_LINE_SIZE, worker_count * sizeof(pv_worker_t));
+   memset(workers, 0, worker_count * sizeof(pv_worker_t));
+
+   for (i = 0; i < worker_count; i++)
+   {
+      workers[i].worker_id = i;
+      workers[i].sample_mask = PV_STATS_SAMPLE_MASK;
+      init_output(&workers[i].output, (config->output_slots < 0) ? PV_DEFAULT_OUTPUT_SLOTS : config->output_slots, PV_STATS_SAMPLE_MASK);
+      init_worker_state(&workers[i], config, worker_count);
+   }
+
+   for (i = 0; i < worker_count; i++)
+   {
+      if (open_worker_socket(&workers[i], interface, bpf_string, config, fanout_id) < 0)
+      {
+         iprint_log_entry("start_workers() <ERROR> Could not open capture socket for worker", i);
+         delete_workers();
+         return(-1);
+      }
+      if ((workers[i].link_decoder = get_link_decoder(workers[i].link_type)) == NULL)
+      {
+         delete_workers();
+         return(-1);
+      }
+   }
+
+   sigemptyset(&sigmask);
+   sigaddset(&sigmask, SIGINT);
+   sigaddset(&sigmask, SIGTERM);
+   sigaddset(&sigmask, SIGQUIT);
+   sigaddset(&sigmask, SIGHUP);
+   pthread_sigmask(SIG_BLOCK, &sigmask, &oldmask);
+
+   for (i = 0; i < worker_count; i++)
+   {
+      if (start_output(&workers[i].output) < 0)
+      {
+         break;
+      }
+      if (pthread_create(&workers[i].thread, NULL, capture_worker, &workers[i]) != 0)
+      {
+         iprint_log_entry("start_workers() <ERROR> Could not create thread for worker", i);
+         break;
+      }
+      workers[i].running = 1;
+   }
+
+   pthread_sigmask(SIG_SETMASK, &oldmask, NULL);
+
+   if (i < worker_count)
+   {
+      delete_workers();
+      return(-1);
+   }
+
+   printf("start_workers() <INFO> Started %d capture workers.\n", worker_count);
+
+   return(0);
+}
+
+/*
+   Function: wait_for_workers
+   Purpose : Waits for all of the worker threads to exit.
+   Input   : None.
+   Output  : None.
+*/
+void wait_for_workers()
+{
+   int i;
+
+   for (i = 0; i < worker_count; i++)
+   {
+      if (workers[i].running)
+      {
+         pthread_join(workers[i].thread, NULL);
+         workers[i].running = 0;
+      }
+   }
+
+   return;
+}
+
+/*
+   Function: delete_workers
+   Purpose : Stops the workers after a failed start. The workers already
+             running are joined, then the sockets are closed and the shards
+             freed without being merged, close_workers() then has nothing
+             left to close.
+   Input   : None.
+   Output  : None.
+*/
+void delete_workers()
+{
+   int i;
+
+   capture_running = 0;
+   wait_for_workers();
+
+   for (i = 0; i < worker_count; i++)
+   {
+      stop_output(&workers[i].output);
+      if (workers[i].pcap_device != NULL)
+      {
+         pcap_close(workers[i].pcap_device);
+         workers[i].pcap_device = NULL;
+      }
+      else if (workers[i].ring.sockfd >= 0)
+      {
+         close_ring_socket(&workers[i].ring);
+      }
+      free_worker_state(&workers[i]);
+   }
+   free(workers);
+   workers = NULL;
+   worker_count = 0;
+
+   return;
+}
+
+/*
+   Function: count_running_workers
+   Purpose : Counts the worker threads that have not exited.
+   Input   : None.
+   Output  : Number of running workers.
+*/
+int count_running_workers()
+{
+   int count = 0;
+   int i;
+
+   for (i = 0; i < worker_count; i++)
+   {
+      if (workers[i].running && !workers[i].finished)
+      {
+         count++;
+      }
+   }
+
+   return(count);
+}
+
+/*
+   Function: close_workers
+   Purpose : Prints the capture statistics for each worker socket, closes the
+             sockets and merges the worker flow table shards into the global
+             IP map, unless heavy hitters replace the map (-X option).
+   Input   : None.
+   Output  : None.
+*/
+void close_workers()
+{
+   struct pcap_stat stats;
+   uint32_t total_flows = 0;
+   int i;
+
+   if (!(options & PV_HEAVY_ONLY))
+   {
+      for (i = 0; i < worker_count; i++)
+      {
+         total_flows += workers[i].flow_table.count;
+      }
+      init_ip_map(total_flows);
+   }
+
+   for (i = 0; i < worker_count; i++)
+   {
+      printf("Worker %d: %lu packets processed, %lu too short, %lu not IP, %u flows, %lu flow table full\n", i, workers[i].packet_count,
+             workers[i].short_packets, workers[i].unsupported_packets, workers[i].flow_table.count, workers[i].flow_table.insert_failures);
+      printf("Worker %d: %lu flows exported, %lu idle, %lu active, %lu closed\n", i, workers[i].flows_exported,
+             workers[i].wheel.expired_idle, workers[i].wheel.expired_active, workers[i].wheel.expired_closed);
+      if (workers[i].payload_packets | workers[i].payload_bytes)
+      {
+         printf("Worker %d: %llu payload bytes sampled, %llu trimmed\n", i, workers[i].payload_kept, workers[i].payload_trimmed);
+      }
+      stop_output(&workers[i].output);  /* in case the capture thread did not start */
+      print_output_stats(i, &workers[i].output);
+
+      /* Send the last flow statistics deltas before the server connection is closed. */
+      if (options & PV_SERVER_OUT)
+      {
+         export_flow_deltas(&workers[i]);
+         printf("Worker %d: %lu flow statistics batches sent\n", i, workers[i].stats_batches);
+      }
+
+      if (workers[i].pcap_device != NULL)
+      {
+         if (pcap_stats(workers[i].pcap_device, &stats) >= 0)
+         {
+            printf("%d packets received\n", stats.ps_recv);
+            printf("%d packets dropped\n\n", stats.ps_drop);
+         }
+         pcap_close(workers[i].pcap_device);
+         workers[i].pcap_device = NULL;
+      }
+      else if (workers[i].ring.sockfd >= 0)
+      {
+         print_ring_stats(&workers[i].ring);
+         close_ring_socket(&workers[i].ring);
+      }
+
+      if (!(options & PV_HEAVY_ONLY))
+      {
+         merge_ip_map(&workers[i].flow_table);
+      }
+      if (workers[i].fanout != NULL)
+      {
+         print_fanout_stats(i, workers[i].fanout);
+      }
+      if (workers[i].scan != NULL)
+      {
+         print_scan_stats(i, workers[i].scan);
+      }
+      if (ngram_models.mode)
+      {
+         print_ngram_stats(i, &workers[i]);
+      }
+      if (workers[i].tls != NULL)
+      {
+         print_tls_stats(i, &workers[i]);
+      }
+      if (workers[i].reasm != NULL)
+      {
+         print_reasm_stats(i, workers[i].reasm);
+      }
+      if (workers[i].ioc != NULL)
+      {
+         print_ioc_stats(i, &workers[i]);
+      }
+      if (blocklist.table != NULL)
+      {
+         print_blocklist_stats(i, &workers[i]);
+      }
+      free_worker_state(&workers[i]);
+   }
+
+   return;
+}
+
+/*
+   Function: free_worker_state
+   Purpose : Frees what init_worker_state() and init_output() set up for
+             a worker.
+   Input   : Worker.
+   Output  : None.
+*/
+void free_worker_state(pv_worker_t *worker)
+{
+   free_flow_table(&worker->flow_table);
+   if (worker->heavy != NULL)
+   {
+      free_heavy_hitters(worker->heavy);
+      free(worker->heavy);
+      worker->heavy = NULL;
+   }
+   if (worker->fanout != NULL)
+   {
+      free_fanout(&worker->fanout[PV_FANOUT_OUT]);
+      free_fanout(&worker->fanout[PV_FANOUT_IN]);
+      free(worker->fanout);
+      worker->fanout = NULL;
+   }
+   if (worker->scan != NULL)
+   {
+      free_scan(worker->scan);
+      free(worker->scan);
+      worker->scan = NULL;
+   }
+   free(worker->tls);
+   worker->tls = NULL;
+   if (worker->reasm != NULL)
+   {
+      free_reasm(worker->reasm);
+      free(worker->reasm);
+      worker->reasm = NULL;
+   }
+   free(worker->ioc);
+   worker->ioc = NULL;
+   free_flow_stats(worker);
+   free_output(&worker->output);
+}
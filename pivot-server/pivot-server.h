@@ -53,6 +53,8 @@
 #include <pcap.h>
 
 
+#define PV_RECV_BUFFER_SIZE 65536 /* sensor messages are coalesced into writes of up to 64KB */
+
 /* pivot-server.c */
 
 int parse_command_line_args(int argc, char *argv[], char *event_filename);
@@ -60,7 +62,10 @@ int show_server_help();
 
 /* pvconnection.c */
 
+int get_next_message(char *buffer, int *offset, int length, char *message, int size);
+FILE *open_sensor_log(char *sensor_message);
 void *sensor_connection_handler(void *socket_desc);
+int update_connection_stats(pv_ip_record_t **connection_map, char *sensor_message);
 void get_sensor_id(char *msg, char *sid);
 
 #endif
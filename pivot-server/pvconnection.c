@@ -40,103 +40,276 @@
 
 char pvconnection_source_file[20] = "pvconnection.c";
 
+/*
+   Function: get_next_message
+   Purpose : Extracts the next complete message from the receive buffer.
+             The sensor coalesces messages into large writes, so one recv
+             can return several messages and a message can be split over
+             two reads. Messages are framed by their <event>, <flowstats>
+             or <control> start and end tags. Data that is not a message
+             is skipped up to the next '<'.
+   Input   : Receive buffer, read offset, buffer length, message buffer and size.
+   Return  : Message length, 0 if more data is needed or -1 if a message
+             is too large and was skipped.
+*/
+int get_next_message(char *buffer, int *offset, int length, char *message, int size)
+{
+   static char *start_tags[] = { "<event>", "<flowstats>", "<control>" };
+   static char *end_tags[] = { "</event>", "</flowstats>", "</control>" };
+   char *ptr, *end;
+   int remaining, tag_len, msg_len;
+   int i;
+
+   while (*offset < length)
+   {
+      ptr = buffer + *offset;
+      remaining = length - *offset;
+
+      if ((*ptr == '\n') || (*ptr == '\r') || (*ptr == ' ') || (*ptr == '\t') || (*ptr == 0))
+      {
+         (*offset)++;
+         continue;
+      }
+
+      for (i = 0; i < 3; i++)
+      {
+         tag_len = strlen(start_tags[i]);
+         if (strncmp(ptr, start_tags[i], (remaining < tag_len) ? remaining : tag_len) == 0)
+         {
+            break;
+         }
+      }
+
+      if (i == 3) /* Not a message, resynchronise on the next tag. */
+      {
+         print_log_entry("get_next_message() <WARNING> Skipping unknown sensor data.\n");
+         if ((end = memchr(ptr + 1, '<', remaining - 1)) == NULL)
+         {
+            *offset = length;
+            return(0);
+         }
+         *offset = end - buffer;
+         continue;
+      }
+
+      if (remaining < tag_len) /* Partial start tag. */
+      {
+         return(0);
+      }
+
+      buffer[length] = 0;
+      if ((end = strstr(ptr, end_tags[i])) == NULL)
+      {
+         return(0);
+      }
+      end += strlen(end_tags[i]);
+      if (*end == '\n')
+      {
+         end++;
+      }
+      msg_len = end - ptr;
+      *offset += msg_len;
+
+      if (msg_len >= size)
+      {
+         print_log_entry("get_next_message() <ERROR> Sensor message too large.\n");
+         return(-1);
+      }
+      memcpy(message, ptr, msg_len);
+      message[msg_len] = 0;
+
+      return(msg_len);
+   }
+
+   return(0);
+}
+
+/*
+   Function: open_sensor_log
+   Purpose : Opens the log file for the sensor that sent the message.
+   Input   : First sensor message.
+   Return  : Log file or NULL on error.
+*/
+FILE *open_sensor_log(char *sensor_message)
+{
+   char timestr[100];
+   char sensor_id[100];
+   char event_filename[PV_MAX_INPUT_STR];
+   FILE *sensor_log;
+   int tlen;
+
+   /* !!!CLEAR THE BUFFERS!!! */
+   memset(event_filename, 0, PV_MAX_INPUT_STR);
+   memset(sensor_id, 0, 100);
+   memset(timestr, 0, 100);
+
+   get_sensor_id(sensor_message, sensor_id);
+   strncpy(event_filename, sensor_id, strlen(sensor_id));
+   tlen = get_time_string(timestr, 100);
+
+   if (tlen > 0) /* Build the default event log filename, SENSOR0000-YYYYMMDD-HHMMSS.fle */
+   {
+      strncat(event_filename, timestr, tlen);
+   }
+   else
+   {
+      strncat(event_filename, "-YYYYMMDD-HHMMSS", 16);
+      print_log_entry("open_sensor_log() <WARNING> Invalid time string.\n");
+   }
+   strncat(event_filename, EVENT_FILE_EXT, 4);
+
+   sensor_log = open_sensor_log_file(event_filename);
+   if (sensor_log == NULL)
+   {
+      print_log_entry("open_sensor_log() <ERROR> Could not open sensor log file.\n");
+      return(NULL);
+   }
+   write_project_header(sensor_log, "Pivotal Sensor Log");
+
+   return(sensor_log);
+}
+
 /*
    Function: sensor_connection_handler
    Purpose : Called by the posix thread, opens sensor log file then
              loops on the socket recv command, logs messages received
              from the sensor and updates the IP statistics hash map.
+             Each recv may return any number of whole or partial messages,
+             complete messages are taken from the receive buffer with
+             get_next_message() and the remainder is kept for the next read.
    Input   : Socket descriptor.
    Return  : returns NULL.
 */
 void *sensor_connection_handler(void *socket_desc)
 {
    int sock = *(int*)socket_desc;
-   int read_size, tlen;
-   char timestr[100];
-   char sensor_id[100];
+   int read_size, msg_len;
+   int length = 0;
+   int offset;
+   int connected = 1;
+   char *recv_buffer;
    char sensor_message[PV_MAX_INPUT_STR];
-   char event_filename[PV_MAX_INPUT_STR];
-   FILE *sensor_log;
-   /* TODO: pv_ip_record_t *connection_map = NULL;  the hash map head record */
+   FILE *sensor_log = NULL;
+   pv_ip_record_t *connection_map = NULL; /* the hash map head record */
 
    print_log_entry("sensor_connection_handler() <INFO> Connection handler starting.\n");
 
-   /* !!!CLEAR THE BUFFERS!!! */
-   memset(sensor_message, 0, PV_MAX_INPUT_STR);
-   memset(event_filename, 0, PV_MAX_INPUT_STR);
-   memset(sensor_id, 0, 100);
-   memset(timestr, 0, 100);
+   recv_buffer = xmalloc(PV_RECV_BUFFER_SIZE + 1);
 
    /*
-      Read the first message from the sensor, extract the sensor ID from the message
-      and open the log file. A separate log file is maintained for each sensor.
+      The first message from the sensor gives the sensor ID used to open the
+      log file. A separate log file is maintained for each sensor.
       The file format is plain text Fineline Event format ->
 
       https://code.google.com/p/fineline-computer-forensics-timeline-tools/
 
       The log file name format is: SID0000-YYYYMMDD-HHMMSS.fle
 
+      Start the receive loop, only exit receive on error or sensor disconnect.
    */
 
-   if ((read_size = recv(sock, sensor_message, PV_MAX_INPUT_STR, 0)) > 0)
+   while (connected && ((read_size = recv(sock, recv_buffer + length, PV_RECV_BUFFER_SIZE - length, 0)) > 0))
    {
+      length += read_size;
+      offset = 0;
 
-      get_sensor_id(sensor_message, sensor_id);
-      strncpy(event_filename, sensor_id, strlen(sensor_id));
-      tlen = get_time_string(timestr, 100);
+      while (connected && ((msg_len = get_next_message(recv_buffer, &offset, length, sensor_message, PV_MAX_INPUT_STR)) != 0))
+      {
+         if (msg_len < 0)
+         {
+            continue;
+         }
+         if ((sensor_log == NULL) && ((sensor_log = open_sensor_log(sensor_message)) == NULL))
+         {
+            connected = 0;
+         }
+         else if (strncmp(sensor_message, "<event>", 7) == 0)
+         {
+            write_sensor_log_record(sensor_log, sensor_message);
+         }
+         else if (strncmp(sensor_message, "<flowstats>", 11) == 0)
+         {
+            update_connection_stats(&connection_map, sensor_message);
+         }
+         else if (strncmp(sensor_message, "<control>disconnect", 19) == 0)
+         {
+            connected = 0;
+         }
+         else /* We have a control message from the sensor. */
+         {
+            /* TODO: check for alarm or error message. */
+            write_sensor_log_record(sensor_log, sensor_message);
+         }
+      }
 
-      if (tlen > 0) /* Build the default event log filename, SENSOR0000-YYYYMMDD-HHMMSS.fle */
+      /* Keep the partial message at the end of the buffer for the next read. */
+      length -= offset;
+      memmove(recv_buffer, recv_buffer + offset, length);
+      if (length == PV_RECV_BUFFER_SIZE)
       {
-         strncat(event_filename, timestr, tlen);
-      }
-      else
-      {
-         strncat(event_filename, "-YYYYMMDD-HHMMSS", 16);
-         print_log_entry("sensor_connection_handler() <WARNING> Invalid time string.\n");
+         print_log_entry("sensor_connection_handler() <ERROR> Sensor message too large, receive buffer dropped.\n");
+         length = 0;
       }
-      strncat(event_filename, EVENT_FILE_EXT, 4);
+   }
 
-      sensor_log = open_sensor_log_file(event_filename);
-      if (sensor_log == NULL)
-      {
-         print_log_entry("sensor_connection_handler() <ERROR> Could not open sensor log file.\n");
-         return(NULL);
-      }
-      /* TODO: update statistics hashmap */
-      write_project_header(sensor_log, "Pivotal Sensor Log");
-      write_sensor_log_record(sensor_log, sensor_message);
+   if (sensor_log == NULL)
+   {
+      print_log_entry("sensor_connection_handler() <ERROR> Sensor receive failed.\n");
    }
    else
    {
-      print_log_entry("sensor_connection_handler() <ERROR> Sensor receive failed.\n");
-      return(NULL);
+      print_log_entry("sensor_connection_handler() <INFO> Sensor disconnected.\n");
+
+      /* Write the traffic totals reported by the sensor to the end of the log. */
+      write_connection_map(connection_map, sensor_log);
+      close_sensor_log_file(sensor_log);
    }
+   delete_all_connections(&connection_map);
 
-   /*
-      Start the receive loop, only exit receive on error or sensor disconnect.
-   */
+   free(recv_buffer);
+   close_socket(sock);
+   free(socket_desc);
+
+   return(NULL);
+}
 
-   while((read_size = recv(sock, sensor_message, PV_MAX_INPUT_STR, 0)) > 0 )
+/*
+   Function: update_connection_stats
+   Purpose : Parses a flow statistics message from the sensor and adds the
+             packet count and data size deltas for each flow to the
+             connection statistics map. Each line of the message data is:
+             PROTO SRCIP SRCPORT DSTIP DSTPORT PACKETS BYTES
+   Input   : Connection map head, sensor message.
+   Return  : Number of flows updated or -1 if the message is malformed.
+*/
+int update_connection_stats(pv_ip_record_t **connection_map, char *sensor_message)
+{
+   char key_value[512];
+   char srcip[64], dstip[64];
+   unsigned int protocol, src_port, dst_port;
+   unsigned long packets, data_size;
+   char *line, *end;
+   int count = 0;
+
+   if (((line = strstr(sensor_message, "<data>")) == NULL) || ((end = strstr(line, "</data>")) == NULL))
    {
-      if (strncmp(sensor_message, "<event>", 7) == 0)
-      {
-         /* TODO: update connections statistics map */
-         write_sensor_log_record(sensor_log, sensor_message);
-         memset(sensor_message, 0, PV_MAX_INPUT_STR);
-      }
-      else /* We have a control message from the sensor. */
+      print_log_entry("update_connection_stats() <ERROR> Malformed flow statistics message.\n");
+      return(-1);
+   }
+   *end = 0;
+
+   while ((line = strchr(line, '\n')) != NULL)
+   {
+      line++;
+      if (sscanf(line, "%u %63s %u %63s %u %lu %lu", &protocol, srcip, &src_port, dstip, &dst_port, &packets, &data_size) == 7)
       {
-         /* TODO: check for disconnect, alarm or error message. */
-         break;
+         sprintf(key_value, "Proto:%u %s:%u -> %s:%u", protocol, srcip, src_port, dstip, dst_port);
+         update_connection_ip(connection_map, key_value, packets, data_size);
+         count++;
       }
    }
 
-   print_log_entry("sensor_connection_handler() <INFO> Sensor disconnected.\n");
-
-   close_sensor_log_file(sensor_log);
-   free(socket_desc);
-
-   return(NULL);
+   return(count);
 }
 
 void get_sensor_id(char *msg, char *sid)